@@ -0,0 +1,86 @@
+package gradlebuild;
+
+import org.gradle.api.JavaVersion;
+import org.gradle.api.Plugin;
+import org.gradle.api.Project;
+import org.gradle.api.artifacts.dsl.DependencyHandler;
+import org.gradle.api.file.Directory;
+import org.gradle.api.plugins.JavaPluginConvention;
+import org.gradle.api.provider.Provider;
+import org.gradle.api.tasks.JavaExec;
+import org.gradle.api.tasks.SourceSet;
+import org.gradle.api.tasks.SourceSetContainer;
+import org.gradle.api.tasks.compile.JavaCompile;
+import org.gradle.nativeplatform.platform.internal.DefaultNativePlatform;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Adds a {@code jmh} source set with JMH benchmarks for the project and a {@code jmh} task to run them.
+ *
+ * Results are written as JSON to {@code build/reports/jmh}, named after the platform they were measured on,
+ * so results from different machines can be compared side by side.
+ * Use {@code -PjmhInclude=<regexp>} to only run some of the benchmarks,
+ * and {@code -PjmhArgs=<args>} to pass further options to JMH.
+ */
+public class JmhPlugin implements Plugin<Project> {
+    private static final String JMH_VERSION = "1.26";
+    private static final String BENCHMARK_DIRECTORY_SYSTEM_PROPERTY = "benchmark.directory";
+
+    @Override
+    public void apply(Project project) {
+        SourceSetContainer sourceSets = project.getConvention().getPlugin(JavaPluginConvention.class).getSourceSets();
+        SourceSet main = sourceSets.getByName(SourceSet.MAIN_SOURCE_SET_NAME);
+        SourceSet jmh = sourceSets.create("jmh", sourceSet -> {
+            sourceSet.setCompileClasspath(sourceSet.getCompileClasspath().plus(main.getOutput()));
+            sourceSet.setRuntimeClasspath(sourceSet.getRuntimeClasspath().plus(main.getOutput()));
+        });
+        project.getConfigurations().getByName(jmh.getImplementationConfigurationName())
+            .extendsFrom(project.getConfigurations().getByName(main.getImplementationConfigurationName()));
+        project.getConfigurations().getByName(jmh.getCompileOnlyConfigurationName())
+            .extendsFrom(project.getConfigurations().getByName(main.getCompileOnlyConfigurationName()));
+        project.getConfigurations().getByName(jmh.getRuntimeOnlyConfigurationName())
+            .extendsFrom(project.getConfigurations().getByName(main.getRuntimeOnlyConfigurationName()));
+
+        DependencyHandler dependencies = project.getDependencies();
+        dependencies.add(jmh.getImplementationConfigurationName(), "org.openjdk.jmh:jmh-core:" + JMH_VERSION);
+        dependencies.add(jmh.getAnnotationProcessorConfigurationName(), "org.openjdk.jmh:jmh-generator-annprocess:" + JMH_VERSION);
+
+        // The code generated by JMH needs a newer language level than the main sources
+        project.getTasks().named(jmh.getCompileJavaTaskName(), JavaCompile.class, task -> {
+            task.setSourceCompatibility(JavaVersion.VERSION_1_8.toString());
+            task.setTargetCompatibility(JavaVersion.VERSION_1_8.toString());
+        });
+
+        DefaultNativePlatform currentPlatform = new DefaultNativePlatform("current");
+        String platformName = currentPlatform.getOperatingSystem().toFamilyName() + "-" + currentPlatform.getArchitecture().getName();
+        Provider<Directory> reportsDir = project.getLayout().getBuildDirectory().dir("reports/jmh");
+        project.getTasks().register("jmh", JavaExec.class, task -> {
+            task.setDescription("Runs the JMH benchmarks.");
+            task.setGroup("verification");
+            task.setClasspath(jmh.getRuntimeClasspath());
+            task.setMain("org.openjdk.jmh.Main");
+            task.getOutputs().upToDateWhen(spec -> false);
+            task.systemProperty(BENCHMARK_DIRECTORY_SYSTEM_PROPERTY, project.getLayout().getBuildDirectory().dir("benchmark files").get().getAsFile().getAbsolutePath());
+            task.doFirst(ignored -> reportsDir.get().getAsFile().mkdirs());
+
+            List<String> args = new ArrayList<>();
+            args.add("-rf");
+            args.add("json");
+            args.add("-rff");
+            args.add(reportsDir.get().file("results-" + platformName + ".json").getAsFile().getAbsolutePath());
+            Provider<String> jmhArgs = project.getProviders().gradleProperty("jmhArgs").forUseAtConfigurationTime();
+            if (jmhArgs.isPresent()) {
+                for (String arg : jmhArgs.get().trim().split("\\s+")) {
+                    args.add(arg);
+                }
+            }
+            Provider<String> include = project.getProviders().gradleProperty("jmhInclude").forUseAtConfigurationTime();
+            if (include.isPresent()) {
+                args.add(include.get());
+            }
+            task.setArgs(args);
+        });
+    }
+}
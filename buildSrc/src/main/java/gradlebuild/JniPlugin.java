@@ -17,6 +17,7 @@ import org.gradle.api.plugins.JavaPluginConvention;
 import org.gradle.api.provider.ProviderFactory;
 import org.gradle.api.publish.PublishingExtension;
 import org.gradle.api.publish.maven.MavenPublication;
+import org.gradle.api.tasks.JavaExec;
 import org.gradle.api.tasks.SourceSet;
 import org.gradle.api.tasks.TaskContainer;
 import org.gradle.api.tasks.TaskProvider;
@@ -36,6 +37,7 @@ import org.gradle.model.Mutate;
 import org.gradle.model.RuleSource;
 import org.gradle.model.internal.registry.ModelRegistry;
 import org.gradle.nativeplatform.NativeBinarySpec;
+import org.gradle.nativeplatform.NativeLibrarySpec;
 import org.gradle.nativeplatform.PreprocessingTool;
 import org.gradle.nativeplatform.SharedLibraryBinarySpec;
 import org.gradle.nativeplatform.Tool;
@@ -181,6 +183,7 @@ public abstract class JniPlugin implements Plugin<Project> {
                             if (!testVersionFromLocalRepository) {
                                 project.getTasks().withType(Test.class).configureEach(it -> ((ConfigurableFileCollection) it.getClasspath()).from(nativeJar));
                             }
+                            project.getTasks().withType(JavaExec.class).matching(it -> it.getName().equals("jmh")).configureEach(it -> it.classpath(nativeJar));
                         }
                     }));
         });
@@ -277,7 +280,8 @@ public abstract class JniPlugin implements Plugin<Project> {
 
         @Mutate
         void addComponentSourcesSetsToProjectSourceSet(ModelMap<Task> tasks, ModelMap<SourceComponentSpec> sourceContainer) {
-            sourceContainer.forEach(sources -> sources.getSources().withType(CppSourceSet.class).forEach(sourceSet ->
+            // Only the libraries loaded by the Java side need to match the version of the Java classes
+            sourceContainer.withType(NativeLibrarySpec.class).forEach(sources -> sources.getSources().withType(CppSourceSet.class).forEach(sourceSet ->
                 tasks.withType(WriteNativeVersionSources.class, task -> {
                     task.getNativeSources().from(sourceSet.getSource().getSourceDirectories());
                     task.getNativeSources().from(sourceSet.getExportedHeaders().getSourceDirectories());
@@ -0,0 +1,516 @@
+/*
+ * Measures the operating system APIs the file watchers are built on, without any JNI involved:
+ * listing and querying directory entries, how fast change notifications arrive, and from which
+ * burst size the notifications overflow for a given event buffer size.
+ *
+ * Comparing these numbers with the JMH benchmarks of the same operations shows the overhead added by
+ * the native libraries and the JVM. The output uses the same units as the JMH benchmarks.
+ *
+ * Change notifications are measured with inotify on Linux and ReadDirectoryChangesW() on Windows.
+ * FSEvents on macOS coalesces instead of dropping events, so it is only covered by the JMH benchmarks.
+ *
+ * Usage: native-platform-file-events-benchmark <directory> [file count] [rounds]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#endif
+
+using namespace std;
+
+// Same as the initial and maximum event buffer sizes of the Linux watcher
+#define LINUX_EVENT_BUFFER_SIZE (16 * 1024)
+#define LINUX_MAX_EVENT_BUFFER_SIZE (1024 * 1024)
+
+// Time without new events after which all events of a burst are considered delivered
+#define QUIET_PERIOD_IN_MILLIS 1000
+
+#ifdef _WIN32
+typedef wstring Path;
+#else
+typedef string Path;
+#endif
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void report(const char* benchmark, const string& params, double score, const char* unit) {
+    printf("%-28s %-32s %16.1f  %s\n", benchmark, params.c_str(), score, unit);
+    fflush(stdout);
+}
+
+static void fail(const string& message) {
+    throw runtime_error(message);
+}
+
+//
+// Platform specific file system operations
+//
+
+#ifdef _WIN32
+
+static Path toPath(const string& path) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+    vector<wchar_t> buffer(length);
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, buffer.data(), length);
+    return Path(buffer.data());
+}
+
+static Path childPath(const Path& dir, const string& name) {
+    return dir + L"\\" + Path(name.begin(), name.end());
+}
+
+static void createDirectory(const Path& path) {
+    if (!CreateDirectoryW(path.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        fail("Could not create directory, error " + to_string(GetLastError()));
+    }
+}
+
+static void createFile(const Path& path) {
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        fail("Could not create file, error " + to_string(GetLastError()));
+    }
+    CloseHandle(handle);
+}
+
+static void appendToFile(const Path& path) {
+    HANDLE handle = CreateFileW(path.c_str(), FILE_APPEND_DATA, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        fail("Could not open file, error " + to_string(GetLastError()));
+    }
+    DWORD written;
+    WriteFile(handle, "x", 1, &written, NULL);
+    CloseHandle(handle);
+}
+
+static void removeFile(const Path& path) {
+    DeleteFileW(path.c_str());
+}
+
+static void removeDirectory(const Path& path) {
+    RemoveDirectoryW(path.c_str());
+}
+
+static size_t listDirectory(const Path& dir) {
+    WIN32_FIND_DATAW entry;
+    HANDLE handle = FindFirstFileExW((dir + L"\\*").c_str(), FindExInfoBasic, &entry, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (handle == INVALID_HANDLE_VALUE) {
+        fail("Could not list directory, error " + to_string(GetLastError()));
+    }
+    size_t count = 0;
+    do {
+        if (wcscmp(entry.cFileName, L".") != 0 && wcscmp(entry.cFileName, L"..") != 0) {
+            count++;
+        }
+    } while (FindNextFileW(handle, &entry));
+    FindClose(handle);
+    return count;
+}
+
+static uint64_t statFile(const Path& path) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes)) {
+        fail("Could not query file, error " + to_string(GetLastError()));
+    }
+    return attributes.nFileSizeLow;
+}
+
+#else
+
+static Path toPath(const string& path) {
+    return path;
+}
+
+static Path childPath(const Path& dir, const string& name) {
+    return dir + "/" + name;
+}
+
+static void createDirectory(const Path& path) {
+    if (mkdir(path.c_str(), 0777) == -1 && errno != EEXIST) {
+        fail("Could not create directory " + path + ": " + strerror(errno));
+    }
+}
+
+static void createFile(const Path& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        fail("Could not create file " + path + ": " + strerror(errno));
+    }
+    close(fd);
+}
+
+static void appendToFile(const Path& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd == -1) {
+        fail("Could not open file " + path + ": " + strerror(errno));
+    }
+    if (write(fd, "x", 1) != 1) {
+        close(fd);
+        fail("Could not write to file " + path + ": " + strerror(errno));
+    }
+    close(fd);
+}
+
+static void removeFile(const Path& path) {
+    unlink(path.c_str());
+}
+
+static void removeDirectory(const Path& path) {
+    rmdir(path.c_str());
+}
+
+static size_t listDirectory(const Path& dir) {
+    DIR* stream = opendir(dir.c_str());
+    if (stream == NULL) {
+        fail("Could not list directory " + dir + ": " + strerror(errno));
+    }
+    size_t count = 0;
+    while (struct dirent* entry = readdir(stream)) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            count++;
+        }
+    }
+    closedir(stream);
+    return count;
+}
+
+static uint64_t statFile(const Path& path) {
+    struct stat fileInfo;
+    if (lstat(path.c_str(), &fileInfo) == -1) {
+        fail("Could not stat file " + path + ": " + strerror(errno));
+    }
+    return (uint64_t) fileInfo.st_size;
+}
+
+#endif
+
+//
+// Change notifications, read on a background thread like the watchers do
+//
+
+#if defined(__linux__) || defined(_WIN32)
+#define HAVE_EVENT_READER
+
+class EventReader {
+public:
+    EventReader(const Path& dir, size_t bufferSize);
+    ~EventReader();
+
+    /**
+     * Waits until the given number of events has arrived, events are lost,
+     * or no events have arrived for QUIET_PERIOD_IN_MILLIS.
+     */
+    void await(long expectedEvents) const {
+        long lastCount = -1;
+        Clock::time_point lastChange = Clock::now();
+        while (events < expectedEvents && !overflowed) {
+            long count = events;
+            if (count != lastCount) {
+                lastCount = count;
+                lastChange = Clock::now();
+            } else if (secondsSince(lastChange) * 1000 > QUIET_PERIOD_IN_MILLIS) {
+                return;
+            }
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+    atomic<long> events { 0 };
+    atomic<bool> overflowed { false };
+
+private:
+    void run();
+
+    atomic<bool> stopped { false };
+    vector<uint8_t> buffer;
+#ifdef _WIN32
+    HANDLE directoryHandle;
+    OVERLAPPED overlapped;
+#else
+    int fd;
+#endif
+    thread reader;
+};
+
+#ifdef __linux__
+
+EventReader::EventReader(const Path& dir, size_t bufferSize)
+    : buffer(bufferSize) {
+    fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd == -1) {
+        fail(string("Could not initialize inotify: ") + strerror(errno));
+    }
+    if (inotify_add_watch(fd, dir.c_str(), IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR) == -1) {
+        close(fd);
+        fail("Could not watch " + dir + ": " + strerror(errno));
+    }
+    reader = thread(&EventReader::run, this);
+}
+
+EventReader::~EventReader() {
+    stopped = true;
+    reader.join();
+    close(fd);
+}
+
+void EventReader::run() {
+    struct pollfd pollFd = {};
+    pollFd.fd = fd;
+    pollFd.events = POLLIN;
+    while (!stopped) {
+        if (poll(&pollFd, 1, 10) <= 0) {
+            continue;
+        }
+        // Grow the buffer like the watcher does when more events are queued
+        unsigned int available = 0;
+        if (ioctl(fd, FIONREAD, &available) == 0 && available > buffer.size()) {
+            buffer.resize(min(static_cast<size_t>(available), static_cast<size_t>(LINUX_MAX_EVENT_BUFFER_SIZE)));
+        }
+        ssize_t bytesRead = read(fd, buffer.data(), buffer.size());
+        if (bytesRead <= 0) {
+            continue;
+        }
+        for (ssize_t index = 0; index < bytesRead;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(&buffer[index]);
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflowed = true;
+            } else {
+                events++;
+            }
+            index += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+#else
+
+EventReader::EventReader(const Path& dir, size_t bufferSize)
+    : buffer(bufferSize) {
+    directoryHandle = CreateFileW(dir.c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (directoryHandle == INVALID_HANDLE_VALUE) {
+        fail("Could not open directory, error " + to_string(GetLastError()));
+    }
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    reader = thread(&EventReader::run, this);
+}
+
+EventReader::~EventReader() {
+    stopped = true;
+    reader.join();
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(directoryHandle);
+}
+
+void EventReader::run() {
+    while (!stopped) {
+        ResetEvent(overlapped.hEvent);
+        if (!ReadDirectoryChangesW(directoryHandle, buffer.data(), (DWORD) buffer.size(), FALSE,
+                FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                NULL, &overlapped, NULL)) {
+            overflowed = true;
+            return;
+        }
+        while (WaitForSingleObject(overlapped.hEvent, 10) == WAIT_TIMEOUT) {
+            if (stopped) {
+                CancelIo(directoryHandle);
+                break;
+            }
+        }
+        DWORD bytesTransferred;
+        if (!GetOverlappedResult(directoryHandle, &overlapped, &bytesTransferred, TRUE)) {
+            // Cancelled, or the buffer could not hold the events (ERROR_NOTIFY_ENUM_DIR)
+            if (GetLastError() != ERROR_OPERATION_ABORTED) {
+                overflowed = true;
+            }
+            continue;
+        }
+        if (bytesTransferred == 0) {
+            overflowed = true;
+            continue;
+        }
+        for (DWORD index = 0;;) {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(&buffer[index]);
+            events++;
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            index += info->NextEntryOffset;
+        }
+    }
+}
+
+#endif
+
+#endif
+
+//
+// Benchmarks
+//
+
+static void benchmarkFileSystem(const Path& dir, int fileCount, int rounds) {
+    vector<Path> files;
+    for (int i = 0; i < fileCount; i++) {
+        files.push_back(childPath(dir, "file-" + to_string(i) + ".txt"));
+        createFile(files.back());
+    }
+    string params = "files=" + to_string(fileCount);
+
+    Clock::time_point start = Clock::now();
+    size_t listed = 0;
+    for (int round = 0; round < rounds; round++) {
+        listed += listDirectory(dir);
+    }
+    report("listDir", params, listed / secondsSince(start), "entries/s");
+
+    start = Clock::now();
+    uint64_t checksum = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (auto& file : files) {
+            checksum += statFile(file);
+        }
+    }
+    report("stat", params, ((double) rounds * fileCount) / secondsSince(start), "ops/s");
+    if (checksum != 0) {
+        fail("Unexpected file size");
+    }
+
+    for (auto& file : files) {
+        removeFile(file);
+    }
+}
+
+#ifdef HAVE_EVENT_READER
+
+static void benchmarkEventThroughput(const Path& dir, int fileCount, int rounds) {
+    vector<Path> files;
+    for (int i = 0; i < fileCount; i++) {
+        files.push_back(childPath(dir, "file-" + to_string(i) + ".txt"));
+        createFile(files.back());
+    }
+
+    size_t bufferSize = 1024 * 1024;
+    double totalSeconds = 0;
+    long totalEvents = 0;
+    for (int round = 0; round < rounds; round++) {
+        EventReader reader(dir, bufferSize);
+        Clock::time_point start = Clock::now();
+        for (auto& file : files) {
+            appendToFile(file);
+        }
+        reader.await(fileCount);
+        totalSeconds += secondsSince(start);
+        totalEvents += min(reader.events.load(), (long) fileCount);
+        if (reader.overflowed) {
+            fail("Events overflowed while measuring throughput");
+        }
+    }
+    report("modifyFiles", "files=" + to_string(fileCount), totalEvents / totalSeconds, "ops/s");
+
+    for (auto& file : files) {
+        removeFile(file);
+    }
+}
+
+static void benchmarkOverflow(const Path& root, int rounds) {
+#ifdef _WIN32
+    const size_t bufferSizes[] = { 16384, 65536, 1048576 };
+#else
+    const size_t bufferSizes[] = { LINUX_EVENT_BUFFER_SIZE };
+#endif
+    const int burstSizes[] = { 1000, 10000, 50000 };
+    for (size_t bufferSize : bufferSizes) {
+        for (int burstSize : burstSizes) {
+            double overflows = 0;
+            long creations = 0;
+            for (int round = 0; round < rounds; round++) {
+                Path dir = childPath(root, "burst-" + to_string(round));
+                createDirectory(dir);
+                vector<Path> files;
+                {
+                    EventReader reader(dir, bufferSize);
+                    for (int i = 0; i < burstSize; i++) {
+                        files.push_back(childPath(dir, "file-" + to_string(i)));
+                        createFile(files.back());
+                    }
+                    reader.await(burstSize);
+                    if (reader.overflowed) {
+                        overflows++;
+                    }
+                    creations += reader.events;
+                }
+                for (auto& file : files) {
+                    removeFile(file);
+                }
+                removeDirectory(dir);
+            }
+            string params = "burstSize=" + to_string(burstSize) + " bufferSize=" + to_string(bufferSize);
+            report("createBurst:overflows", params, overflows / rounds, "#");
+            report("createBurst:creations", params, (double) creations / rounds, "#");
+        }
+    }
+}
+
+#endif
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [file count] [rounds]\n", argv[0]);
+        return 2;
+    }
+    int fileCount = argc > 2 ? atoi(argv[2]) : 1000;
+    int rounds = argc > 3 ? atoi(argv[3]) : 10;
+    if (fileCount <= 0 || rounds <= 0) {
+        fprintf(stderr, "File count and rounds must be positive\n");
+        return 2;
+    }
+
+    try {
+        Path root = toPath(argv[1]);
+        createDirectory(root);
+        Path dir = childPath(root, "file-events-benchmark");
+        createDirectory(dir);
+
+        printf("%-28s %-32s %16s  %s\n", "Benchmark", "Parameters", "Score", "Units");
+        benchmarkFileSystem(dir, fileCount, rounds);
+#ifdef HAVE_EVENT_READER
+        benchmarkEventThroughput(dir, fileCount, rounds);
+        benchmarkOverflow(dir, rounds);
+#endif
+        removeDirectory(dir);
+        return 0;
+    } catch (const exception& e) {
+        fprintf(stderr, "Benchmark failed: %s\n", e.what());
+        return 1;
+    }
+}
@@ -2,18 +2,74 @@
 
 #include "apple_fsnotifier.h"
 
+#include <algorithm>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace std;
 
-WatchPoint::WatchPoint(Server* server, CFRunLoopRef runLoop, const u16string& path, long latencyInMillis) {
-    CFStringRef cfPath = CFStringCreateWithCharacters(NULL, (UniChar*) path.c_str(), path.length());
-    if (cfPath == nullptr) {
-        throw FileWatcherException("Could not allocate CFString for path", path);
+static string toLowerCase(string path) {
+    // Good enough for case-insensitive matching, we only need to match the paths FSEvents reports
+    transform(path.begin(), path.end(), path.begin(), [](char c) {
+        return (char) tolower((unsigned char) c);
+    });
+    return path;
+}
+
+string getDeviceUuid(const string& path) {
+    struct stat fileInfo;
+    if (stat(path.c_str(), &fileInfo) != 0) {
+        return string();
+    }
+    CFUUIDRef uuid = FSEventsCopyUUIDForDevice(fileInfo.st_dev);
+    if (uuid == NULL) {
+        return string();
     }
-    CFMutableArrayRef pathArray = CFArrayCreateMutable(NULL, 1, NULL);
+    CFStringRef uuidString = CFUUIDCreateString(NULL, uuid);
+    CFRelease(uuid);
+    if (uuidString == NULL) {
+        return string();
+    }
+    char buffer[64];
+    bool converted = CFStringGetCString(uuidString, buffer, sizeof(buffer), kCFStringEncodingUTF8);
+    CFRelease(uuidString);
+    return converted ? string(buffer) : string();
+}
+
+WatchPoint::WatchPoint(const u16string& path, FSEventStreamEventId registrationEventId)
+    : registrationEventId(registrationEventId) {
+    string utf8Path = utf16ToUtf8String(path);
+    routes.push_back(toLowerCase(utf8Path));
+    int fd = open(utf8Path.c_str(), O_RDONLY | O_EVTONLY);
+    if (fd != -1) {
+        char realPath[MAXPATHLEN];
+        if (fcntl(fd, F_GETPATH, realPath) != -1) {
+            string realRoute = toLowerCase(realPath);
+            if (realRoute != routes[0]) {
+                routes.push_back(move(realRoute));
+            }
+        }
+        close(fd);
+    }
+}
+
+EventStream::EventStream(Server* server, CFRunLoopRef runLoop, dispatch_queue_t dispatchQueue, const vector<u16string>& paths, FSEventStreamEventId sinceWhen, long latencyInMillis) {
+    CFMutableArrayRef pathArray = CFArrayCreateMutable(NULL, paths.size(), &kCFTypeArrayCallBacks);
     if (pathArray == NULL) {
-        throw FileWatcherException("Could not allocate array to store root to watch", path);
+        throw FileWatcherException("Could not allocate array to store roots to watch");
+    }
+    for (auto& path : paths) {
+        CFStringRef cfPath = CFStringCreateWithCharacters(NULL, (UniChar*) path.c_str(), path.length());
+        if (cfPath == nullptr) {
+            CFRelease(pathArray);
+            throw FileWatcherException("Could not allocate CFString for path", path);
+        }
+        CFArrayAppendValue(pathArray, cfPath);
+        CFRelease(cfPath);
     }
-    CFArrayAppendValue(pathArray, cfPath);
 
     FSEventStreamContext context = {
         0,                 // version, must be 0
@@ -22,25 +78,32 @@ WatchPoint::WatchPoint(Server* server, CFRunLoopRef runLoop, const u16string& pa
         NULL,              // release
         NULL               // copyDescription
     };
-    FSEventStreamRef watcherStream = FSEventStreamCreate(
+    FSEventStreamRef stream = FSEventStreamCreate(
         NULL,
         &handleEventsCallback,
         &context,
         pathArray,
-        kFSEventStreamEventIdSinceNow,
+        sinceWhen,
         latencyInMillis / 1000.0,
         kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagWatchRoot);
     CFRelease(pathArray);
-    CFRelease(cfPath);
-    if (watcherStream == NULL) {
-        throw FileWatcherException("Couldn't add watch", path);
+    if (stream == NULL) {
+        throw FileWatcherException("Couldn't create event stream");
+    }
+    if (dispatchQueue != NULL) {
+        FSEventStreamSetDispatchQueue(stream, dispatchQueue);
+    } else {
+        FSEventStreamScheduleWithRunLoop(stream, runLoop, kCFRunLoopDefaultMode);
+    }
+    if (!FSEventStreamStart(stream)) {
+        FSEventStreamInvalidate(stream);
+        FSEventStreamRelease(stream);
+        throw FileWatcherException("Couldn't start event stream");
     }
-    FSEventStreamScheduleWithRunLoop(watcherStream, runLoop, kCFRunLoopDefaultMode);
-    FSEventStreamStart(watcherStream);
-    this->watcherStream = watcherStream;
+    this->stream = stream;
 }
 
-WatchPoint::~WatchPoint() {
+EventStream::~EventStream() {
     // Reading the Apple docs it seems we should call FSEventStreamFlushSync() here.
     // But doing so produces this log:
     //
@@ -50,10 +113,10 @@ WatchPoint::~WatchPoint() {
     // https://github.com/nodejs/node/issues/854#issuecomment-294892950
     // As the comment mentions, even Watchman doesn't flush:
     // https://github.com/facebook/watchman/blob/b397e00cf566f361282a456122eef4e909f26182/watcher/fsevents.cpp#L276-L285
-    // FSEventStreamFlushSync(watcherStream);
-    FSEventStreamStop(watcherStream);
-    FSEventStreamInvalidate(watcherStream);
-    FSEventStreamRelease(watcherStream);
+    // FSEventStreamFlushSync(stream);
+    FSEventStreamStop(stream);
+    FSEventStreamInvalidate(stream);
+    FSEventStreamRelease(stream);
 }
 
 //
@@ -65,9 +128,37 @@ void acceptTrigger(void*) {
     // run loop alive when there are no watch points registered
 }
 
-Server::Server(JNIEnv* env, jobject watcherCallback, long latencyInMillis)
+/**
+ * Key marking the dispatch queue of a server, so that mutations submitted while
+ * already running on the queue, like from an event callback, can run inline.
+ */
+static char dispatchQueueServerKey;
+
+static pthread_key_t dispatchThreadDetachKey;
+static pthread_once_t dispatchThreadDetachKeyOnce = PTHREAD_ONCE_INIT;
+
+static void detachDispatchThread(void* jvm) {
+    ((JavaVM*) jvm)->DetachCurrentThread();
+}
+
+static void createDispatchThreadDetachKey() {
+    pthread_key_create(&dispatchThreadDetachKey, detachDispatchThread);
+}
+
+Server::Server(JNIEnv* env, jobject watcherCallback, long latencyInMillis, FSEventStreamEventId historyEventId, const string& historyDeviceUuid, bool useDispatchQueue)
     : AbstractServer(env, watcherCallback)
-    , latencyInMillis(latencyInMillis) {
+    , latencyInMillis(latencyInMillis)
+    , eventRoutes(make_shared<EventRoutes>())
+    , historyEventId(historyEventId)
+    , historyDeviceUuid(historyDeviceUuid) {
+    if (useDispatchQueue) {
+        // Each watcher has its own serial queue, so that a watcher blocked in a callback,
+        // or mutating another watcher from a callback, doesn't hold up the other watchers.
+        // The queues target the default global queue, which shares its threads between them.
+        dispatchQueue = dispatch_queue_create("net.rubygrapefruit.platform.file-events", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(dispatchQueue, &dispatchQueueServerKey, this, NULL);
+        return;
+    }
     CFRunLoopSourceContext context = {
         0,               // version;
         (void*) this,    // info;
@@ -87,21 +178,107 @@ Server::Server(JNIEnv* env, jobject watcherCallback, long latencyInMillis)
     );
 }
 
+Server::~Server() {
+    if (dispatchQueue != NULL) {
+        dispatch_release(dispatchQueue);
+    }
+}
+
 void Server::initializeRunLoop() {
+    if (dispatchQueue != NULL) {
+        return;
+    }
     threadLoop = CFRunLoopGetCurrent();
     CFRunLoopAddSource(threadLoop, messageSource, kCFRunLoopDefaultMode);
 }
 
 void Server::runLoop() {
-    CFRunLoopRun();
+    if (dispatchQueue != NULL) {
+        unique_lock<mutex> lock(shutdownMutex);
+        shutdownVariable.wait(lock, [this]() {
+            return shutdownRequested;
+        });
+    } else {
+        CFRunLoopRun();
+    }
 
-    unique_lock<recursive_mutex> lock(mutationMutex);
-    watchPoints.clear();
-    CFRelease(messageSource);
+    executeMutation([this]() {
+        eventStream.reset();
+        watchPoints.clear();
+        watchPointCount = 0;
+    });
+    if (messageSource != NULL) {
+        CFRelease(messageSource);
+    }
 }
 
 void Server::shutdownRunLoop() {
-    CFRunLoopStop(threadLoop);
+    if (dispatchQueue != NULL) {
+        unique_lock<mutex> lock(shutdownMutex);
+        shutdownRequested = true;
+        shutdownVariable.notify_all();
+    } else {
+        CFRunLoopStop(threadLoop);
+    }
+}
+
+struct DispatchedMutation {
+    function<void()>* mutation;
+    exception_ptr failure;
+};
+
+void Server::executeMutation(function<void()> mutation) {
+    // Events are handled without locking, the mutex only guards against reading the watched paths concurrently
+    function<void()> lockedMutation = [this, &mutation]() {
+        if (dispatchQueue != NULL) {
+            // The block might run on a thread of the queue, make sure we can log from there
+            getDispatchThreadEnv();
+        }
+        unique_lock<recursive_mutex> lock(mutationMutex);
+        mutation();
+    };
+    if (dispatchQueue == NULL || dispatch_get_specific(&dispatchQueueServerKey) == this) {
+        // Already on our queue, dispatching synchronously would deadlock
+        lockedMutation();
+        return;
+    }
+    DispatchedMutation dispatched = { &lockedMutation, nullptr };
+    dispatch_sync_f(dispatchQueue, &dispatched, [](void* context) {
+        DispatchedMutation* dispatched = (DispatchedMutation*) context;
+        try {
+            (*dispatched->mutation)();
+        } catch (const exception&) {
+            dispatched->failure = current_exception();
+        }
+    });
+    if (dispatched.failure) {
+        rethrow_exception(dispatched.failure);
+    }
+}
+
+/**
+ * Returns the JNI environment for the current thread, attaching it to the JVM if needed.
+ *
+ * Dispatch queues run on threads we don't control, so we attach them as daemons,
+ * and detach them when the thread exits.
+ */
+JNIEnv* Server::getDispatchThreadEnv() {
+    JNIEnv* env;
+    if (jvm->GetEnv((void**) &env, JNI_VERSION_1_6) == JNI_OK) {
+        return env;
+    }
+    pthread_once(&dispatchThreadDetachKeyOnce, createDispatchThreadDetachKey);
+    JavaVMAttachArgs args = {
+        JNI_VERSION_1_6,                              // version
+        (char*) "File watcher dispatch queue",        // name
+        NULL                                          // group
+    };
+    jint ret = jvm->AttachCurrentThreadAsDaemon((void**) &env, &args);
+    if (ret != JNI_OK) {
+        throw runtime_error(string("Failed to attach dispatch queue thread to JVM: ") + to_string(ret));
+    }
+    pthread_setspecific(dispatchThreadDetachKey, jvm);
+    return env;
 }
 
 static void handleEventsCallback(
@@ -120,15 +297,40 @@ void Server::handleEvents(
     char** eventPaths,
     const FSEventStreamEventFlags eventFlags[],
     const FSEventStreamEventId eventIds[]) {
-    JNIEnv* env = getThreadEnv();
+    JNIEnv* env = dispatchQueue != NULL
+        ? getDispatchThreadEnv()
+        : getThreadEnv();
+    // FSEvents doesn't tell us how much data it has transferred
+    recordEventsReceived(numEvents, 0);
+    shared_ptr<const EventRoutes> routes = atomic_load(&eventRoutes);
 
     try {
         for (size_t i = 0; i < numEvents; i++) {
-            handleEvent(env, eventPaths[i], eventFlags[i], eventIds[i]);
+            if (IS_SET(eventFlags[i], kFSEventStreamEventFlagHistoryDone)) {
+                logToJava(LogLevel::FINE, "Finished replaying history", NULL);
+                reportPathsWithoutHistory(env);
+                continue;
+            }
+            handleEvent(env, *routes, eventPaths[i], eventFlags[i], eventIds[i]);
+            if (eventIds[i] > lastEventId) {
+                lastEventId = eventIds[i];
+            }
         }
     } catch (const exception& ex) {
         reportFailure(env, ex);
     }
+    flushChangeEventsReportingFailures(env);
+}
+
+void Server::reportPathsWithoutHistory(JNIEnv* env) {
+    vector<u16string> paths;
+    {
+        unique_lock<mutex> lock(historyMutex);
+        paths.swap(pathsWithoutHistory);
+    }
+    for (auto& path : paths) {
+        reportOverflow(env, path);
+    }
 }
 
 /**
@@ -161,16 +363,48 @@ static const FSEventStreamEventFlags IGNORED_FLAGS = kFSEventStreamCreateFlagNon
     | kFSEventStreamEventFlagItemIsLastHardlink
     | kFSEventStreamEventFlagItemCloned;
 
-void Server::handleEvent(JNIEnv* env, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId) {
-    logToJava(LogLevel::FINE, "Event flags: 0x%x (ID %d) for '%s'", flags, eventId, path);
+bool Server::isRouted(const EventRoutes& routes, const char* path, FSEventStreamEventId eventId) {
+    if (routes.empty()) {
+        return false;
+    }
+    // Look for the closest watched ancestor of the path
+    string prefix = toLowerCase(path);
+    bool foundRoute = false;
+    for (;;) {
+        auto it = routes.find(prefix);
+        if (it != routes.end()) {
+            // Root changed and mount events have no ID
+            if (eventId == 0 || eventId > it->second) {
+                return true;
+            }
+            foundRoute = true;
+        }
+        size_t separator = prefix.find_last_of('/');
+        if (separator == string::npos || prefix.length() == 1) {
+            break;
+        }
+        // Keep the slash when we reach the file system root
+        prefix.resize(separator == 0 ? 1 : separator);
+    }
+    // Don't drop events we can't route, we'd rather report too much than too little
+    return !foundRoute;
+}
 
-    u16string pathStr = utf8ToUtf16String(path);
+void Server::handleEvent(JNIEnv* env, const EventRoutes& routes, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId) {
+    logToJava(LogLevel::FINE, "Event flags: 0x%x (ID %d) for '%s'", flags, eventId, path);
 
     if ((flags & ~IGNORED_FLAGS) == kFSEventStreamCreateFlagNone) {
         logToJava(LogLevel::FINE, "Ignoring event 0x%x (ID %d) for '%s'", flags, eventId, path);
         return;
     }
 
+    if (!isRouted(routes, path, eventId)) {
+        logToJava(LogLevel::FINE, "Ignoring event 0x%x (ID %d) for '%s' as it happened outside of the watched paths or before they were watched", flags, eventId, path);
+        return;
+    }
+
+    u16string pathStr = utf8ToUtf16String(path);
+
     if (IS_SET(flags, kFSEventStreamEventFlagMustScanSubDirs)) {
         reportOverflow(env, pathStr);
         return;
@@ -209,33 +443,182 @@ void Server::handleEvent(JNIEnv* env, char* path, FSEventStreamEventFlags flags,
     reportChangeEvent(env, type, pathStr);
 }
 
-void Server::registerPaths(const vector<u16string>& paths) {
-    unique_lock<recursive_mutex> lock(mutationMutex);
-    for (auto& path : paths) {
-        if (watchPoints.find(path) != watchPoints.end()) {
-            throw FileWatcherException("Already watching path", path);
+void Server::registerPath(const u16string& path) {
+    if (watchPoints.find(path) != watchPoints.end()) {
+        throw FileWatcherException("Already watching path", path);
+    }
+    FSEventStreamEventId registrationEventId = FSEventsGetCurrentEventId();
+    if (historyEventId != 0) {
+        if (getDeviceUuid(utf16ToUtf8String(path)) == historyDeviceUuid) {
+            registrationEventId = historyEventId;
+        } else {
+            logToJava(LogLevel::INFO, "History is not available for %s", utf16ToUtf8String(path).c_str());
+            unique_lock<mutex> lock(historyMutex);
+            pathsWithoutHistory.push_back(path);
+        }
+    }
+    watchPoints.emplace(piecewise_construct,
+        forward_as_tuple(path),
+        forward_as_tuple(path, registrationEventId));
+    watchPointCount = watchPoints.size();
+}
+
+bool Server::unregisterPath(const u16string& path) {
+    if (watchPoints.erase(path) == 0) {
+        logToJava(LogLevel::INFO, "Path is not watched: %s", utf16ToUtf8String(path).c_str());
+        return false;
+    }
+    watchPointCount = watchPoints.size();
+    return true;
+}
+
+/**
+ * Replaces the event stream with one covering the current watch points.
+ *
+ * The new stream replays the events since the last one received from the previous stream,
+ * so that no events are lost while switching streams.
+ */
+void Server::updateEventStream() {
+    auto routes = make_shared<EventRoutes>();
+    vector<u16string> paths;
+    paths.reserve(watchPoints.size());
+    for (auto& it : watchPoints) {
+        paths.push_back(it.first);
+        for (auto& route : it.second.routes) {
+            auto existing = routes->find(route);
+            if (existing == routes->end() || existing->second > it.second.registrationEventId) {
+                (*routes)[route] = it.second.registrationEventId;
+            }
         }
-        watchPoints.emplace(piecewise_construct,
-            forward_as_tuple(path),
-            forward_as_tuple(this, threadLoop, path, latencyInMillis));
     }
+
+    bool replacing = eventStream != nullptr;
+    // Stop the previous stream first, so that we don't receive events twice
+    eventStream.reset();
+    atomic_store(&eventRoutes, shared_ptr<const EventRoutes>(routes));
+    if (paths.empty()) {
+        return;
+    }
+    FSEventStreamEventId sinceWhen;
+    if (replacing || lastEventId != 0) {
+        sinceWhen = lastEventId;
+    } else if (historyEventId != 0) {
+        // Replay history for the paths registered with the first stream
+        sinceWhen = historyEventId;
+        lastEventId = historyEventId;
+        historyEventId = 0;
+    } else {
+        sinceWhen = kFSEventStreamEventIdSinceNow;
+        lastEventId = FSEventsGetCurrentEventId();
+    }
+    eventStream.reset(new EventStream(this, threadLoop, dispatchQueue, paths, sinceWhen, latencyInMillis));
+}
+
+void Server::registerPaths(const vector<u16string>& paths) {
+    executeMutation([this, &paths]() {
+        try {
+            for (auto& path : paths) {
+                registerPath(path);
+            }
+        } catch (const exception&) {
+            // Keep watching the paths registered before the failure
+            updateEventStream();
+            throw;
+        }
+        updateEventStream();
+    });
+}
+
+vector<string> Server::tryRegisterPaths(const vector<u16string>& paths) {
+    // Rebuild the event stream only once for all paths
+    vector<string> failures;
+    executeMutation([this, &paths, &failures]() {
+        failures.reserve(paths.size());
+        for (auto& path : paths) {
+            try {
+                registerPath(path);
+                failures.emplace_back();
+            } catch (const exception& ex) {
+                failures.emplace_back(ex.what());
+            }
+        }
+        updateEventStream();
+    });
+    return failures;
 }
 
 bool Server::unregisterPaths(const vector<u16string>& paths) {
-    unique_lock<recursive_mutex> lock(mutationMutex);
     bool success = true;
-    for (auto& path : paths) {
-        if (watchPoints.erase(path) == 0) {
-            logToJava(LogLevel::INFO, "Path is not watched: %s", utf16ToUtf8String(path).c_str());
-            success = false;
+    executeMutation([this, &paths, &success]() {
+        for (auto& path : paths) {
+            success &= unregisterPath(path);
         }
-    }
+        updateEventStream();
+    });
     return success;
 }
 
+void Server::setWatchedPaths(const vector<u16string>& paths) {
+    // The watched paths cannot change between diffing and applying the difference
+    executeMutation([this, &paths]() {
+        vector<u16string> pathsToRegister;
+        vector<u16string> pathsToUnregister;
+        diffWatchedPaths(getWatchedPaths(), paths, pathsToRegister, pathsToUnregister);
+        try {
+            for (auto& path : pathsToUnregister) {
+                unregisterPath(path);
+            }
+            for (auto& path : pathsToRegister) {
+                registerPath(path);
+            }
+        } catch (const exception&) {
+            updateEventStream();
+            throw;
+        }
+        updateEventStream();
+    });
+}
+
+vector<u16string> Server::getWatchedPaths() {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    vector<u16string> paths;
+    paths.reserve(watchPoints.size());
+    for (auto& it : watchPoints) {
+        paths.push_back(it.first);
+    }
+    return paths;
+}
+
+size_t Server::getWatchedPathCount() {
+    return watchPointCount;
+}
+
 JNIEXPORT jobject JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_OsxFileEventFunctions_startWatcher0(JNIEnv* env, jclass, long latencyInMillis, jobject javaCallback) {
-    return wrapServer(env, new Server(env, javaCallback, latencyInMillis));
+Java_net_rubygrapefruit_platform_internal_jni_OsxFileEventFunctions_startWatcher0(JNIEnv* env, jclass, long latencyInMillis, jlong historyEventId, jstring javaHistoryDeviceUuid, jboolean useDispatchQueue, jobject javaCallback) {
+    string historyDeviceUuid = javaHistoryDeviceUuid == NULL
+        ? string()
+        : javaToUtf8String(env, javaHistoryDeviceUuid);
+    return wrapServer(env, new Server(env, javaCallback, latencyInMillis, (FSEventStreamEventId) historyEventId, historyDeviceUuid, useDispatchQueue));
+}
+
+JNIEXPORT jstring JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_OsxFileEventFunctions_getDeviceUuid0(JNIEnv* env, jclass, jstring javaPath) {
+    string uuid = getDeviceUuid(javaToUtf8String(env, javaPath));
+    if (uuid.empty()) {
+        return NULL;
+    }
+    return env->NewStringUTF(uuid.c_str());
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_OsxFileEventFunctions_00024OsxFileWatcher_getLastEventId0(JNIEnv* env, jobject, jobject javaServer) {
+    try {
+        Server* server = (Server*) getServer(env, javaServer);
+        return (jlong) server->getLastEventId();
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return 0;
+    }
 }
 
 #endif
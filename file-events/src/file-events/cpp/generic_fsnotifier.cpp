@@ -1,60 +1,414 @@
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 #include "generic_fsnotifier.h"
 
+#ifdef _WIN32
+#define PATH_SEPARATOR u'\\'
+#else
+#define PATH_SEPARATOR u'/'
+#endif
+
+// Marks a pending change event that has been superseded by a later event for the same path
+#define SUPERSEDED_CHANGE_TYPE (-1)
+
 InsufficientResourcesFileWatcherException::InsufficientResourcesFileWatcherException(const string& message)
     : FileWatcherException(message) {
 }
 
+void rethrowWhenNotAllocated(JNIEnv* env, jobject object, jobject localRefToDelete) {
+    if (object == nullptr) {
+        if (localRefToDelete != nullptr) {
+            env->DeleteLocalRef(localRefToDelete);
+        }
+        JniSupport::rethrowJavaException(env);
+        throw runtime_error("Couldn't allocate Java object");
+    }
+}
+
 AbstractServer::AbstractServer(JNIEnv* env, jobject watcherCallback)
     : JniSupport(env)
     , watcherCallback(env, watcherCallback) {
-    jclass callbackClass = env->GetObjectClass(watcherCallback);
-    this->watcherReportChangeEventMethod = env->GetMethodID(callbackClass, "reportChangeEvent", "(ILjava/lang/String;)V");
-    this->watcherReportUnknownEventMethod = env->GetMethodID(callbackClass, "reportUnknownEvent", "(Ljava/lang/String;)V");
-    this->watcherReportOverflowMethod = env->GetMethodID(callbackClass, "reportOverflow", "(Ljava/lang/String;)V");
-    this->watcherReportFailureMethod = env->GetMethodID(callbackClass, "reportFailure", "(Ljava/lang/Throwable;)V");
-    this->watcherReportTerminationMethod = env->GetMethodID(callbackClass, "reportTermination", "()V");
+    for (auto& statistic : statistics) {
+        statistic.store(0, memory_order_relaxed);
+    }
+    pendingChangeTypes.reserve(CHANGE_EVENT_BATCH_SIZE);
+    pendingChangePaths.reserve(CHANGE_EVENT_BATCH_SIZE);
+    this->coalesceChangeEvents = env->CallBooleanMethod(watcherCallback, nativePlatformJniConstants->watcherIsCoalescingChangeEventsMethod);
+    getJavaExceptionAndPrintStacktrace(env);
+
+    jobject javaSharedEventBuffer = env->CallObjectMethod(watcherCallback, nativePlatformJniConstants->watcherGetSharedEventBufferMethod);
+    getJavaExceptionAndPrintStacktrace(env);
+    this->sharedEventBuffer = nullptr;
+    this->sharedEventBufferCapacity = 0;
+    if (javaSharedEventBuffer != nullptr) {
+        this->sharedEventBuffer = (uint8_t*) env->GetDirectBufferAddress(javaSharedEventBuffer);
+        if (sharedEventBuffer == nullptr) {
+            logToJava(LogLevel::WARNING, "Shared event buffer is not a direct buffer, reporting events via arrays", nullptr);
+        } else {
+            this->sharedEventBufferCapacity = (size_t) env->GetDirectBufferCapacity(javaSharedEventBuffer);
+        }
+        env->DeleteLocalRef(javaSharedEventBuffer);
+    }
 }
 
 AbstractServer::~AbstractServer() {
 }
 
+vector<uint64_t> AbstractServer::getStatistics() {
+    vector<uint64_t> snapshot;
+    snapshot.reserve(static_cast<size_t>(Statistic::COUNT));
+    for (auto& statistic : statistics) {
+        snapshot.push_back(statistic.load(memory_order_relaxed));
+    }
+    snapshot[static_cast<size_t>(Statistic::WATCHED_PATHS)] = getWatchedPathCount();
+    return snapshot;
+}
+
+void AbstractServer::incrementStatistic(Statistic statistic, uint64_t delta) {
+    statistics[static_cast<size_t>(statistic)].fetch_add(delta, memory_order_relaxed);
+}
+
+void AbstractServer::recordEventsReceived(size_t eventCount, size_t byteCount) {
+    incrementStatistic(Statistic::EVENTS_RECEIVED, eventCount);
+    incrementStatistic(Statistic::BYTES_RECEIVED, byteCount);
+    incrementStatistic(Statistic::EVENT_BATCHES_RECEIVED);
+}
+
+void AbstractServer::recordCallbackDuration(chrono::steady_clock::time_point start) {
+    uint64_t nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    incrementStatistic(Statistic::CALLBACKS);
+    incrementStatistic(Statistic::CALLBACK_NANOS, nanos);
+    int bucket = static_cast<int>(Statistic::CALLBACKS_UNDER_10_MICROS);
+    for (uint64_t limit = 10 * 1000; nanos >= limit && bucket < static_cast<int>(Statistic::CALLBACKS_OVER_100_MILLIS); limit *= 10) {
+        bucket++;
+    }
+    incrementStatistic(static_cast<Statistic>(bucket));
+}
+
+void AbstractServer::recordCommandDuration(chrono::steady_clock::time_point start) {
+    uint64_t nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    incrementStatistic(Statistic::COMMANDS);
+    incrementStatistic(Statistic::COMMAND_NANOS, nanos);
+    auto& maxNanos = statistics[static_cast<size_t>(Statistic::COMMAND_MAX_NANOS)];
+    uint64_t currentMax = maxNanos.load(memory_order_relaxed);
+    while (nanos > currentMax && !maxNanos.compare_exchange_weak(currentMax, nanos, memory_order_relaxed)) {
+    }
+}
+
+vector<string> AbstractServer::tryRegisterPaths(const vector<u16string>& paths) {
+    vector<string> failures;
+    failures.reserve(paths.size());
+    for (auto& path : paths) {
+        try {
+            registerPaths(vector<u16string> { path });
+            failures.emplace_back();
+        } catch (const exception& ex) {
+            failures.emplace_back(ex.what());
+        }
+    }
+    return failures;
+}
+
+void AbstractServer::setWatchedPaths(const vector<u16string>& paths) {
+    vector<u16string> pathsToRegister;
+    vector<u16string> pathsToUnregister;
+    diffWatchedPaths(getWatchedPaths(), paths, pathsToRegister, pathsToUnregister);
+    if (!pathsToUnregister.empty()) {
+        unregisterPaths(pathsToUnregister);
+    }
+    if (!pathsToRegister.empty()) {
+        registerPaths(pathsToRegister);
+    }
+}
+
+void AbstractServer::diffWatchedPaths(const vector<u16string>& watchedPaths, const vector<u16string>& desiredPaths,
+    vector<u16string>& pathsToRegister, vector<u16string>& pathsToUnregister) {
+    unordered_set<u16string> remainingDesiredPaths(desiredPaths.begin(), desiredPaths.end());
+    for (auto& watchedPath : watchedPaths) {
+        if (remainingDesiredPaths.erase(watchedPath) == 0) {
+            pathsToUnregister.push_back(watchedPath);
+        }
+    }
+    // Keep the order of the desired paths, and ignore duplicates
+    for (auto& desiredPath : desiredPaths) {
+        if (remainingDesiredPaths.erase(desiredPath) != 0) {
+            pathsToRegister.push_back(desiredPath);
+        }
+    }
+}
+
 void AbstractServer::reportChangeEvent(JNIEnv* env, ChangeType type, const u16string& path) {
-    jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
-    env->CallVoidMethod(watcherCallback.get(), watcherReportChangeEventMethod, type, javaPath);
-    env->DeleteLocalRef(javaPath);
+    if (coalesceChangeEvents && coalesceChangeEvent(type, path)) {
+        return;
+    }
+    pendingChangeTypes.push_back(static_cast<jint>(type));
+    pendingChangePaths.push_back(path);
+    if (pendingChangePaths.size() >= CHANGE_EVENT_BATCH_SIZE) {
+        flushChangeEvents(env);
+    }
+}
+
+/**
+ * Merges the event with the latest pending event for the same path, if possible.
+ *
+ * Repeated events of the same kind are dropped, and so are modifications right after creation.
+ * Removal after creation or modification supersedes the earlier event, and is reported in the
+ * position of the removal. Creation after removal is not merged, as we cannot tell whether the
+ * type of the item changed in between. Removal is never dropped either: the creation might have
+ * replaced an existing item, so the net change is still a removal. An earlier removal superseded
+ * events are merged into, like in removed-created-removed, is reported only once, in the position
+ * of the last removal.
+ *
+ * Returns true if the event has been merged and needs no further reporting.
+ */
+bool AbstractServer::coalesceChangeEvent(ChangeType type, const u16string& path) {
+    size_t index = pendingChangePaths.size();
+    size_t removalIndex = type == ChangeType::REMOVED ? index : SIZE_MAX;
+    auto it = pendingChangeIndices.find(path);
+    if (it == pendingChangeIndices.end()) {
+        pendingChangeIndices.emplace(path, PendingChangeIndices { index, removalIndex });
+        return false;
+    }
+    PendingChangeIndices& indices = it->second;
+    ChangeType latestType = static_cast<ChangeType>(pendingChangeTypes[indices.latest]);
+    if (type == ChangeType::INVALIDATED || latestType == ChangeType::INVALIDATED) {
+        // Always report these, and don't merge across them
+    } else if (type == latestType) {
+        return true;
+    } else if (latestType == ChangeType::CREATED && type == ChangeType::MODIFIED) {
+        return true;
+    } else if (type == ChangeType::REMOVED) {
+        supersedePendingChangeEvent(indices.latest);
+        if (indices.removal != SIZE_MAX) {
+            // Only changes that we just superseded happened since the earlier removal
+            supersedePendingChangeEvent(indices.removal);
+        }
+    } else {
+        // Keep tracking the earlier removal, a later one supersedes it
+        removalIndex = indices.removal;
+    }
+    indices.latest = index;
+    indices.removal = removalIndex;
+    return false;
+}
+
+void AbstractServer::supersedePendingChangeEvent(size_t index) {
+    pendingChangeTypes[index] = SUPERSEDED_CHANGE_TYPE;
+    supersededPendingChangeCount++;
+}
+
+void AbstractServer::removeCoalescedChangeEvents() {
+    size_t target = 0;
+    for (size_t i = 0; i < pendingChangePaths.size(); i++) {
+        if (pendingChangeTypes[i] == SUPERSEDED_CHANGE_TYPE) {
+            continue;
+        }
+        if (target != i) {
+            pendingChangeTypes[target] = pendingChangeTypes[i];
+            pendingChangePaths[target] = move(pendingChangePaths[i]);
+        }
+        target++;
+    }
+    logToJava(LogLevel::FINER, "Coalesced %d superseded change events", (int) supersededPendingChangeCount);
+    pendingChangeTypes.resize(target);
+    pendingChangePaths.resize(target);
+    supersededPendingChangeCount = 0;
+}
+
+void AbstractServer::flushChangeEvents(JNIEnv* env) {
+    pendingChangeIndices.clear();
+    if (supersededPendingChangeCount > 0) {
+        removeCoalescedChangeEvents();
+    }
+    if (pendingChangePaths.empty()) {
+        return;
+    }
+    for (jint type : pendingChangeTypes) {
+        incrementStatistic(static_cast<Statistic>(static_cast<int>(Statistic::CREATED_EVENTS_REPORTED) + type));
+    }
+    if (sharedEventBuffer != nullptr) {
+        reportChangeEventsInSharedBuffer(env);
+    } else {
+        reportChangeEventsAsArrays(env, 0, pendingChangePaths.size());
+    }
+    pendingChangeTypes.clear();
+    pendingChangePaths.clear();
+}
+
+void AbstractServer::reportChangeEventsAsArrays(JNIEnv* env, size_t from, size_t to) {
+    jsize count = (jsize) (to - from);
+    jintArray javaTypes = env->NewIntArray(count);
+    rethrowWhenNotAllocated(env, javaTypes);
+    jobjectArray javaPaths = env->NewObjectArray(count, baseJniConstants->stringClass.get(), nullptr);
+    rethrowWhenNotAllocated(env, javaPaths, javaTypes);
+    env->SetIntArrayRegion(javaTypes, 0, count, &pendingChangeTypes[from]);
+    for (jsize i = 0; i < count; i++) {
+        const u16string& path = pendingChangePaths[from + i];
+        jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
+        if (javaPath == nullptr) {
+            env->DeleteLocalRef(javaTypes);
+        }
+        rethrowWhenNotAllocated(env, javaPath, javaPaths);
+        env->SetObjectArrayElement(javaPaths, i, javaPath);
+        env->DeleteLocalRef(javaPath);
+    }
+    auto callbackStart = chrono::steady_clock::now();
+    env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportChangeEventsMethod, javaTypes, javaPaths);
+    recordCallbackDuration(callbackStart);
+    env->DeleteLocalRef(javaTypes);
+    env->DeleteLocalRef(javaPaths);
     getJavaExceptionAndPrintStacktrace(env);
 }
 
+/**
+ * Encodes the pending events as a sequence of records in the shared buffer:
+ *
+ *     jint type, jint length, jchar path[length]
+ *
+ * using native byte order. Whenever the buffer fills up, the records written so far are
+ * handed to Java, which decodes them before returning, then the buffer is reused.
+ */
+void AbstractServer::reportChangeEventsInSharedBuffer(JNIEnv* env) {
+    size_t position = 0;
+    for (size_t i = 0; i < pendingChangePaths.size(); i++) {
+        const u16string& path = pendingChangePaths[i];
+        size_t recordSize = 2 * sizeof(jint) + path.length() * sizeof(jchar);
+        if (position + recordSize > sharedEventBufferCapacity && position > 0) {
+            auto callbackStart = chrono::steady_clock::now();
+            env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportEncodedChangeEventsMethod, (jint) position);
+            recordCallbackDuration(callbackStart);
+            getJavaExceptionAndPrintStacktrace(env);
+            position = 0;
+        }
+        if (recordSize > sharedEventBufferCapacity) {
+            // Doesn't fit in the buffer at all, report it the slow way
+            reportChangeEventsAsArrays(env, i, i + 1);
+            continue;
+        }
+        jint header[2] = { pendingChangeTypes[i], (jint) path.length() };
+        memcpy(sharedEventBuffer + position, header, sizeof(header));
+        memcpy(sharedEventBuffer + position + sizeof(header), path.c_str(), path.length() * sizeof(jchar));
+        position += recordSize;
+    }
+    if (position > 0) {
+        auto callbackStart = chrono::steady_clock::now();
+        env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportEncodedChangeEventsMethod, (jint) position);
+        recordCallbackDuration(callbackStart);
+        getJavaExceptionAndPrintStacktrace(env);
+    }
+}
+
+void AbstractServer::flushChangeEventsReportingFailures(JNIEnv* env) {
+    try {
+        flushChangeEvents(env);
+    } catch (const exception& ex) {
+        logToJava(LogLevel::SEVERE, "Couldn't report change events: %s", ex.what());
+    }
+}
+
 void AbstractServer::reportUnknownEvent(JNIEnv* env, const u16string& path) {
+    flushChangeEvents(env);
+    incrementStatistic(Statistic::UNKNOWN_EVENTS_REPORTED);
     jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
-    env->CallVoidMethod(watcherCallback.get(), watcherReportUnknownEventMethod, javaPath);
+    rethrowWhenNotAllocated(env, javaPath);
+    auto callbackStart = chrono::steady_clock::now();
+    env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportUnknownEventMethod, javaPath);
+    recordCallbackDuration(callbackStart);
     env->DeleteLocalRef(javaPath);
     getJavaExceptionAndPrintStacktrace(env);
 }
 
 void AbstractServer::reportOverflow(JNIEnv* env, const u16string& path) {
+    flushChangeEvents(env);
+    incrementStatistic(Statistic::OVERFLOWS_REPORTED);
     logToJava(LogLevel::INFO, "Detected overflow for %s", utf16ToUtf8String(path).c_str());
     jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
-    env->CallVoidMethod(watcherCallback.get(), watcherReportOverflowMethod, javaPath);
+    rethrowWhenNotAllocated(env, javaPath);
+    auto callbackStart = chrono::steady_clock::now();
+    env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportOverflowMethod, javaPath);
+    recordCallbackDuration(callbackStart);
     env->DeleteLocalRef(javaPath);
     getJavaExceptionAndPrintStacktrace(env);
 }
 
+void AbstractServer::reportOverflow(JNIEnv* env, const vector<u16string>& paths) {
+    flushChangeEvents(env);
+    incrementStatistic(Statistic::OVERFLOWS_REPORTED);
+    logToJava(LogLevel::INFO, "Detected overflow for %d paths", (int) paths.size());
+    jobjectArray javaPaths = env->NewObjectArray((jsize) paths.size(), baseJniConstants->stringClass.get(), nullptr);
+    rethrowWhenNotAllocated(env, javaPaths);
+    for (size_t i = 0; i < paths.size(); i++) {
+        jstring javaPath = env->NewString((jchar*) paths[i].c_str(), (jsize) paths[i].length());
+        rethrowWhenNotAllocated(env, javaPath, javaPaths);
+        env->SetObjectArrayElement(javaPaths, (jsize) i, javaPath);
+        env->DeleteLocalRef(javaPath);
+    }
+    auto callbackStart = chrono::steady_clock::now();
+    env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportOverflowsMethod, javaPaths);
+    recordCallbackDuration(callbackStart);
+    env->DeleteLocalRef(javaPaths);
+    getJavaExceptionAndPrintStacktrace(env);
+}
+
+vector<u16string> AbstractServer::findRootPaths(const vector<u16string>& paths) {
+    // Shorter paths first, so that ancestors are seen before their descendants
+    vector<const u16string*> sortedPaths;
+    sortedPaths.reserve(paths.size());
+    for (auto& path : paths) {
+        sortedPaths.push_back(&path);
+    }
+    sort(sortedPaths.begin(), sortedPaths.end(), [](const u16string* a, const u16string* b) {
+        return a->length() < b->length();
+    });
+    unordered_set<u16string> roots;
+    vector<u16string> result;
+    for (auto path : sortedPaths) {
+        bool descendant = false;
+        for (size_t separator = path->find(PATH_SEPARATOR); separator != u16string::npos && separator + 1 < path->length(); separator = path->find(PATH_SEPARATOR, separator + 1)) {
+            // Roots like / or C:\ end with a separator themselves
+            if (roots.find(path->substr(0, separator)) != roots.end() || roots.find(path->substr(0, separator + 1)) != roots.end()) {
+                descendant = true;
+                break;
+            }
+        }
+        if (!descendant && roots.insert(*path).second) {
+            result.push_back(*path);
+        }
+    }
+    return result;
+}
+
 void AbstractServer::reportFailure(JNIEnv* env, const exception& exception) {
+    // Failures are reported from catch blocks and OS callbacks, so this must not throw
+    flushChangeEventsReportingFailures(env);
+    incrementStatistic(Statistic::FAILURES_REPORTED);
     u16string message = utf8ToUtf16String(exception.what());
     jstring javaMessage = env->NewString((jchar*) message.c_str(), (jsize) message.length());
-    jmethodID constructor = env->GetMethodID(nativePlatformJniConstants->nativeExceptionClass.get(), "<init>", "(Ljava/lang/String;)V");
-    jobject javaException = env->NewObject(nativePlatformJniConstants->nativeExceptionClass.get(), constructor, javaMessage);
-    env->CallVoidMethod(watcherCallback.get(), watcherReportFailureMethod, javaException);
+    if (javaMessage == nullptr) {
+        getJavaExceptionAndPrintStacktrace(env);
+        return;
+    }
+    jobject javaException = env->NewObject(nativePlatformJniConstants->nativeExceptionClass.get(), nativePlatformJniConstants->nativeExceptionConstructor, javaMessage);
+    if (javaException == nullptr) {
+        env->DeleteLocalRef(javaMessage);
+        getJavaExceptionAndPrintStacktrace(env);
+        return;
+    }
+    auto callbackStart = chrono::steady_clock::now();
+    env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportFailureMethod, javaException);
+    recordCallbackDuration(callbackStart);
     env->DeleteLocalRef(javaMessage);
     env->DeleteLocalRef(javaException);
     getJavaExceptionAndPrintStacktrace(env);
 }
 
 void AbstractServer::reportTermination(JNIEnv* env) {
-    env->CallVoidMethod(watcherCallback.get(), watcherReportTerminationMethod);
+    flushChangeEventsReportingFailures(env);
+    auto callbackStart = chrono::steady_clock::now();
+    env->CallVoidMethod(watcherCallback.get(), nativePlatformJniConstants->watcherReportTerminationMethod);
+    recordCallbackDuration(callbackStart);
     getJavaExceptionAndPrintStacktrace(env);
 }
 
@@ -131,7 +485,56 @@ Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024Na
         AbstractServer* server = getServer(env, javaServer);
         vector<u16string> paths;
         javaToUtf16StringArray(env, javaPaths, paths);
+        auto start = chrono::steady_clock::now();
         server->registerPaths(paths);
+        server->recordCommandDuration(start);
+    } catch (const JavaExceptionThrownException&) {
+        // Ignore, the Java exception has already been thrown.
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+    }
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_tryStartWatching0(JNIEnv* env, jobject, jobject javaServer, jobjectArray javaPaths) {
+    try {
+        AbstractServer* server = getServer(env, javaServer);
+        vector<u16string> paths;
+        javaToUtf16StringArray(env, javaPaths, paths);
+        auto start = chrono::steady_clock::now();
+        vector<string> failures = server->tryRegisterPaths(paths);
+        server->recordCommandDuration(start);
+
+        jobjectArray javaFailures = env->NewObjectArray((jsize) failures.size(), baseJniConstants->stringClass.get(), nullptr);
+        rethrowWhenNotAllocated(env, javaFailures);
+        for (size_t i = 0; i < failures.size(); i++) {
+            if (failures[i].empty()) {
+                continue;
+            }
+            jstring javaFailure = env->NewStringUTF(failures[i].c_str());
+            rethrowWhenNotAllocated(env, javaFailure, javaFailures);
+            env->SetObjectArrayElement(javaFailures, (jsize) i, javaFailure);
+            env->DeleteLocalRef(javaFailure);
+        }
+        return javaFailures;
+    } catch (const JavaExceptionThrownException&) {
+        // Ignore, the Java exception has already been thrown.
+        return nullptr;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return nullptr;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_setWatchedPaths0(JNIEnv* env, jobject, jobject javaServer, jobjectArray javaPaths) {
+    try {
+        AbstractServer* server = getServer(env, javaServer);
+        vector<u16string> paths;
+        javaToUtf16StringArray(env, javaPaths, paths);
+        auto start = chrono::steady_clock::now();
+        server->setWatchedPaths(paths);
+        server->recordCommandDuration(start);
     } catch (const JavaExceptionThrownException&) {
         // Ignore, the Java exception has already been thrown.
     } catch (const exception& e) {
@@ -145,13 +548,34 @@ Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024Na
         AbstractServer* server = getServer(env, javaServer);
         vector<u16string> paths;
         javaToUtf16StringArray(env, javaPaths, paths);
-        return server->unregisterPaths(paths);
+        auto start = chrono::steady_clock::now();
+        bool success = server->unregisterPaths(paths);
+        server->recordCommandDuration(start);
+        return success;
     } catch (const exception& e) {
         rethrowAsJavaException(env, e);
         return false;
     }
 }
 
+JNIEXPORT jlongArray JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_getStatistics0(JNIEnv* env, jobject, jobject javaServer) {
+    try {
+        AbstractServer* server = getServer(env, javaServer);
+        vector<uint64_t> statistics = server->getStatistics();
+        jlongArray javaStatistics = env->NewLongArray((jsize) statistics.size());
+        if (javaStatistics == nullptr) {
+            return nullptr;
+        }
+        vector<jlong> values(statistics.begin(), statistics.end());
+        env->SetLongArrayRegion(javaStatistics, 0, (jsize) values.size(), values.data());
+        return javaStatistics;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return nullptr;
+    }
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_shutdown0(JNIEnv* env, jobject, jobject javaServer) {
     try {
@@ -186,7 +610,36 @@ Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_invalid
     }
 }
 
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_setAsynchronousLogging0(JNIEnv* env, jclass, jboolean asynchronous) {
+    try {
+        logging->setAsynchronous(env, asynchronous);
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_drainLogMessages0(JNIEnv* env, jclass) {
+    try {
+        logging->drain(env);
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+    }
+}
+
 NativePlatformJniConstants::NativePlatformJniConstants(JavaVM* jvm)
     : JniSupport(jvm)
-    , nativeExceptionClass(getThreadEnv(), "net/rubygrapefruit/platform/NativeException") {
+    , nativeExceptionClass(getThreadEnv(), "net/rubygrapefruit/platform/NativeException")
+    , nativeFileWatcherCallbackClass(getThreadEnv(), "net/rubygrapefruit/platform/internal/jni/AbstractFileEventFunctions$NativeFileWatcherCallback")
+    , nativeExceptionConstructor(getThreadEnv()->GetMethodID(nativeExceptionClass.get(), "<init>", "(Ljava/lang/String;)V"))
+    , watcherReportChangeEventsMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "reportChangeEvents", "([I[Ljava/lang/String;)V"))
+    , watcherReportEncodedChangeEventsMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "reportEncodedChangeEvents", "(I)V"))
+    , watcherReportUnknownEventMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "reportUnknownEvent", "(Ljava/lang/String;)V"))
+    , watcherReportOverflowMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "reportOverflow", "(Ljava/lang/String;)V"))
+    , watcherReportOverflowsMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "reportOverflows", "([Ljava/lang/String;)V"))
+    , watcherReportFailureMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "reportFailure", "(Ljava/lang/Throwable;)V"))
+    , watcherReportTerminationMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "reportTermination", "()V"))
+    , watcherIsCoalescingChangeEventsMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "isCoalescingChangeEvents", "()Z"))
+    , watcherGetSharedEventBufferMethod(getThreadEnv()->GetMethodID(nativeFileWatcherCallbackClass.get(), "getSharedEventBuffer", "()Ljava/nio/ByteBuffer;")) {
 }
@@ -1,6 +1,6 @@
-#include <codecvt>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <locale>
 #include <string>
 
 #include "jni_support.h"
@@ -28,12 +28,22 @@ JniSupport::JniSupport(JNIEnv* env)
     : jvm(getJavaVm(env)) {
 }
 
+// The threads calling into native code are Java threads, which stay attached to the JVM
+// for as long as they live, so their env can be cached instead of being looked up on every call.
+static thread_local JavaVM* threadJvm = nullptr;
+static thread_local JNIEnv* threadEnv = nullptr;
+
 JNIEnv* JniSupport::getThreadEnv() {
+    if (threadJvm == jvm) {
+        return threadEnv;
+    }
     JNIEnv* env;
     jint ret = jvm->GetEnv((void**) &env, JNI_VERSION_1_6);
     if (ret != JNI_OK) {
         throw runtime_error(string("Failed to get JNI env for current thread: ") + to_string(ret));
     }
+    threadJvm = jvm;
+    threadEnv = env;
     return env;
 }
 
@@ -53,8 +63,7 @@ void JniSupport::rethrowJavaException(JNIEnv* env) {
         env->ExceptionClear();
 
         jclass exceptionClass = env->GetObjectClass(exception);
-        jmethodID getClassName = env->GetMethodID(baseJniConstants->classClass.get(), "getName", "()Ljava/lang/String;");
-        jstring javaExceptionType = (jstring) env->CallObjectMethod(exceptionClass, getClassName);
+        jstring javaExceptionType = (jstring) env->CallObjectMethod(exceptionClass, baseJniConstants->classGetNameMethod);
         if (env->ExceptionCheck()) {
             env->ExceptionDescribe();
             throw runtime_error("Couldn't get exception type");
@@ -62,8 +71,7 @@ void JniSupport::rethrowJavaException(JNIEnv* env) {
         string exceptionType = javaToUtf8String(env, javaExceptionType);
         env->DeleteLocalRef(javaExceptionType);
 
-        jmethodID getMessage = env->GetMethodID(exceptionClass, "getMessage", "()Ljava/lang/String;");
-        jstring javaMessage = (jstring) env->CallObjectMethod(exception, getMessage);
+        jstring javaMessage = (jstring) env->CallObjectMethod(exception, baseJniConstants->throwableGetMessageMethod);
         if (env->ExceptionCheck()) {
             env->ExceptionDescribe();
             throw runtime_error("Couldn't get exception message");
@@ -92,11 +100,31 @@ void JniSupport::throwNativeExceptionWhenJavaExceptionOccurred(JNIEnv* env) {
 
 BaseJniConstants::BaseJniConstants(JavaVM* jvm)
     : JniSupport(jvm)
-    , classClass(getThreadEnv(), "java/lang/Class") {
+    , classClass(getThreadEnv(), "java/lang/Class")
+    , stringClass(getThreadEnv(), "java/lang/String")
+    , throwableClass(getThreadEnv(), "java/lang/Throwable")
+    , listClass(getThreadEnv(), "java/util/List")
+    , classGetNameMethod(getThreadEnv()->GetMethodID(classClass.get(), "getName", "()Ljava/lang/String;"))
+    , throwableGetMessageMethod(getThreadEnv()->GetMethodID(throwableClass.get(), "getMessage", "()Ljava/lang/String;"))
+    , listAddMethod(getThreadEnv()->GetMethodID(listClass.get(), "add", "(Ljava/lang/Object;)Z")) {
 }
 
 string javaToUtf8String(JNIEnv* env, jstring javaString) {
-    return utf16ToUtf8String(javaToUtf16String(env, javaString));
+    jsize length = env->GetStringLength(javaString);
+    const jchar* javaChars = env->GetStringCritical(javaString, nullptr);
+    if (javaChars == NULL) {
+        throw runtime_error("Could not get Java string character");
+    }
+    string result;
+    try {
+        // Encode straight from the Java chars, without an intermediate UTF-16 copy
+        appendUtf16ToUtf8String(result, (const char16_t*) javaChars, length);
+    } catch (...) {
+        env->ReleaseStringCritical(javaString, javaChars);
+        throw;
+    }
+    env->ReleaseStringCritical(javaString, javaChars);
+    return result;
 }
 
 u16string javaToUtf16String(JNIEnv* env, jstring javaString) {
@@ -121,12 +149,129 @@ void javaToUtf16StringArray(JNIEnv* env, jobjectArray javaStrings, vector<u16str
     }
 }
 
+// Number of leading ASCII chars handled a word at a time before falling back to decoding char by char
+static size_t countAsciiPrefix(const char* string, size_t length) {
+    size_t index = 0;
+    for (; index + sizeof(uint64_t) <= length; index += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, string + index, sizeof(word));
+        if (word & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+    while (index < length && static_cast<unsigned char>(string[index]) < 0x80) {
+        index++;
+    }
+    return index;
+}
+
+static size_t countAsciiPrefix(const char16_t* string, size_t length) {
+    size_t index = 0;
+    for (; index + sizeof(uint64_t) / sizeof(char16_t) <= length; index += sizeof(uint64_t) / sizeof(char16_t)) {
+        uint64_t word;
+        memcpy(&word, string + index, sizeof(word));
+        if (word & 0xFF80FF80FF80FF80ULL) {
+            break;
+        }
+    }
+    while (index < length && string[index] < 0x80) {
+        index++;
+    }
+    return index;
+}
+
+void appendUtf8ToUtf16String(u16string& target, const char* string, size_t length) {
+    target.reserve(target.length() + length);
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(string);
+    const unsigned char* end = in + length;
+    while (in < end) {
+        size_t ascii = countAsciiPrefix(reinterpret_cast<const char*>(in), end - in);
+        target.append(in, in + ascii);
+        in += ascii;
+        if (in == end) {
+            break;
+        }
+
+        char32_t ch = *in++;
+        int continuations;
+        char32_t min;
+        if ((ch & 0xE0) == 0xC0) {
+            continuations = 1;
+            min = 0x80;
+            ch &= 0x1F;
+        } else if ((ch & 0xF0) == 0xE0) {
+            continuations = 2;
+            min = 0x800;
+            ch &= 0x0F;
+        } else if ((ch & 0xF8) == 0xF0) {
+            continuations = 3;
+            min = 0x10000;
+            ch &= 0x07;
+        } else {
+            throw range_error("Invalid UTF-8 string");
+        }
+        for (int i = 0; i < continuations; i++) {
+            if (in == end || (*in & 0xC0) != 0x80) {
+                throw range_error("Invalid UTF-8 string");
+            }
+            ch = (ch << 6) | (*in++ & 0x3F);
+        }
+        if (ch < min || ch > 0x10FFFF || (ch >= 0xD800 && ch < 0xE000)) {
+            throw range_error("Invalid UTF-8 string");
+        }
+        if (ch >= 0x10000) {
+            ch -= 0x10000;
+            target.push_back(static_cast<char16_t>(0xD800 + (ch >> 10)));
+            target.push_back(static_cast<char16_t>(0xDC00 + (ch & 0x3FF)));
+        } else {
+            target.push_back(static_cast<char16_t>(ch));
+        }
+    }
+}
+
+void appendUtf16ToUtf8String(string& target, const char16_t* string, size_t length) {
+    target.reserve(target.length() + length);
+    const char16_t* in = string;
+    const char16_t* end = in + length;
+    while (in < end) {
+        size_t ascii = countAsciiPrefix(in, end - in);
+        target.append(in, in + ascii);
+        in += ascii;
+        if (in == end) {
+            break;
+        }
+
+        char32_t ch = *in++;
+        if (ch < 0x800) {
+            target.push_back(static_cast<char>(0xC0 | (ch >> 6)));
+            target.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+            continue;
+        }
+        if (ch >= 0xD800 && ch < 0xE000) {
+            if (ch >= 0xDC00 || in == end || *in < 0xDC00 || *in >= 0xE000) {
+                throw range_error("Invalid UTF-16 string");
+            }
+            ch = 0x10000 + ((ch - 0xD800) << 10) + (*in++ - 0xDC00);
+            target.push_back(static_cast<char>(0xF0 | (ch >> 18)));
+            target.push_back(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+            target.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+            target.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+            continue;
+        }
+        target.push_back(static_cast<char>(0xE0 | (ch >> 12)));
+        target.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        target.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    }
+}
+
 u16string utf8ToUtf16String(const char* string) {
-    wstring_convert<deletable_facet<codecvt<char16_t, char, mbstate_t>>, char16_t> conv16;
-    return conv16.from_bytes(string);
+    u16string result;
+    appendUtf8ToUtf16String(result, string, strlen(string));
+    return result;
 }
 
 string utf16ToUtf8String(const u16string& string) {
-    wstring_convert<deletable_facet<codecvt<char16_t, char, mbstate_t>>, char16_t> conv16;
-    return conv16.to_bytes(string);
+    std::string result;
+    appendUtf16ToUtf8String(result, string.data(), string.length());
+    return result;
 }
@@ -0,0 +1,629 @@
+#ifdef __linux__
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#include "linux_fanotify.h"
+
+FanotifyUnavailableException::FanotifyUnavailableException(const string& message, int errorCode)
+    : FileWatcherException(message, errorCode) {
+}
+
+#ifdef FANOTIFY_SUPPORTED
+
+// Initial size of the event buffer, it grows when more events are queued
+#define FANOTIFY_BUFFER_SIZE (64 * 1024)
+
+#define FANOTIFY_EVENT_MASK (FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR)
+
+// Maximum number of resolved directories to remember, unrelated activity on a busy filesystem shouldn't grow it forever
+#define FANOTIFY_DIRECTORY_CACHE_SIZE 16384
+
+// Suffix the kernel appends to the path of a directory that has been removed
+#define DELETED_SUFFIX " (deleted)"
+
+static uint64_t toFsid(const int* val) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(val[0])) << 32) | static_cast<uint32_t>(val[1]);
+}
+
+Fanotify::Fanotify()
+    : fd(fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_CLOEXEC | O_LARGEFILE)) {
+    if (fd == -1) {
+        // EINVAL: kernel older than 5.9, EPERM: not privileged, ENOSYS: fanotify not compiled in
+        throw FanotifyUnavailableException("Couldn't initialize fanotify", errno);
+    }
+    // Whether we can place filesystem marks is only known once we try with the first registered path
+}
+
+Fanotify::~Fanotify() {
+    close(fd);
+}
+
+FanotifyFilesystem::FanotifyFilesystem(int mountFd)
+    : mountFd(mountFd) {
+}
+
+FanotifyFilesystem::~FanotifyFilesystem() {
+    close(mountFd);
+}
+
+FanotifyWatchPoint::FanotifyWatchPoint(const u16string& path, const string& canonicalPath, uint64_t fsid, ino_t inode)
+    : path(path)
+    , canonicalPath(canonicalPath)
+    , fsid(fsid)
+    , inode(inode) {
+}
+
+static string parentPath(const string& path) {
+    size_t separator = path.rfind('/');
+    return separator == 0 || separator == string::npos
+        ? "/"
+        : path.substr(0, separator);
+}
+
+static void appendChild(u16string& path, const char* name, size_t length) {
+    if (path.empty() || path.back() != u'/') {
+        path.push_back(u'/');
+    }
+    appendUtf8ToUtf16String(path, name, length);
+}
+
+/**
+ * Maps a canonical directory below a canonical watch root to the path it has below the registered watch root.
+ */
+static u16string toWatchedPath(const u16string& registeredRoot, const string& canonicalRoot, const string& canonicalDirectory) {
+    u16string path = registeredRoot;
+    if (!path.empty() && path.back() == u'/') {
+        path.pop_back();
+    }
+    size_t suffixStart = canonicalRoot == "/" ? 0 : canonicalRoot.length();
+    if (suffixStart < canonicalDirectory.length() && canonicalDirectory != "/") {
+        appendUtf8ToUtf16String(path, canonicalDirectory.data() + suffixStart, canonicalDirectory.length() - suffixStart);
+    }
+    if (path.empty()) {
+        path.push_back(u'/');
+    }
+    return path;
+}
+
+static void addDistinct(vector<u16string>& paths, const u16string& path) {
+    if (find(paths.begin(), paths.end(), path) == paths.end()) {
+        paths.push_back(path);
+    }
+}
+
+FanotifyServer::FanotifyServer(JNIEnv* env, jobject watcherCallback, bool reconcileOverflows)
+    : AbstractServer(env, watcherCallback)
+    , reconcileOverflows(reconcileOverflows)
+    , callback(env, watcherCallback) {
+    buffer.resize(FANOTIFY_BUFFER_SIZE);
+    epoll.add(shutdownEvent.fd);
+    epoll.add(fanotify.fd);
+}
+
+void FanotifyServer::initializeRunLoop() {
+}
+
+void FanotifyServer::shutdownRunLoop() {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    shutdownRequested = true;
+    if (inotifyServer) {
+        inotifyServer->shutdownRunLoop();
+    }
+    shutdownEvent.trigger();
+}
+
+void FanotifyServer::runLoop() {
+    int forever = numeric_limits<int>::max();
+
+    while (!shouldTerminate) {
+        processQueues(forever);
+    }
+
+    // No need to clean up marks, they are removed when the fanotify descriptor is closed
+
+    Server* fallback;
+    {
+        unique_lock<recursive_mutex> lock(mutationMutex);
+        fallback = shutdownRequested ? nullptr : inotifyServer.get();
+    }
+    if (fallback != nullptr) {
+        // Keep running the inotify server on this thread until we are shut down
+        fallback->initializeRunLoop();
+        fallback->runLoop();
+    }
+}
+
+bool FanotifyServer::isUsingInotify() {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    return inotifyServer != nullptr;
+}
+
+vector<uint64_t> FanotifyServer::getStatistics() {
+    vector<uint64_t> statistics = AbstractServer::getStatistics();
+    Server* fallback;
+    {
+        unique_lock<recursive_mutex> lock(mutationMutex);
+        fallback = inotifyServer.get();
+    }
+    if (fallback != nullptr) {
+        // Commands are recorded by this server, events by the inotify server
+        vector<uint64_t> fallbackStatistics = fallback->getStatistics();
+        for (size_t i = 0; i < statistics.size(); i++) {
+            statistics[i] = i == static_cast<size_t>(Statistic::COMMAND_MAX_NANOS)
+                ? max(statistics[i], fallbackStatistics[i])
+                : statistics[i] + fallbackStatistics[i];
+        }
+    }
+    return statistics;
+}
+
+void FanotifyServer::processQueues(int timeout) {
+    struct epoll_event events[2];
+    int count = epoll.wait(events, 2, timeout);
+
+    bool fanotifyReady = false;
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == shutdownEvent.fd) {
+            shutdownEvent.consume();
+            // Ignore counter, we only care about the notification itself
+            shouldTerminate = true;
+            return;
+        }
+        fanotifyReady = true;
+    }
+
+    if (fanotifyReady) {
+        try {
+            handleEvents();
+        } catch (const exception& ex) {
+            reportFailure(getThreadEnv(), ex);
+        }
+    }
+}
+
+void FanotifyServer::handleEvents() {
+    bool moreAvailable = true;
+    while (moreAvailable) {
+        ssize_t bytesRead = readAvailableEvents(fanotify.fd, buffer, "fanotify", moreAvailable);
+        if (bytesRead == 0) {
+            return;
+        }
+
+        unique_lock<recursive_mutex> lock(mutationMutex);
+        JNIEnv* env = getThreadEnv();
+        logToJava(LogLevel::FINE, "Processing %d bytes worth of events", bytesRead);
+        int count = 0;
+        const struct fanotify_event_metadata* event = (const struct fanotify_event_metadata*) &buffer[0];
+        while (FAN_EVENT_OK(event, bytesRead)) {
+            if (event->vers != FANOTIFY_METADATA_VERSION) {
+                throw FileWatcherException("Unsupported fanotify metadata version", event->vers);
+            }
+            handleEvent(env, event);
+            event = FAN_EVENT_NEXT(event, bytesRead);
+            count++;
+        }
+        flushChangeEvents(env);
+        recordEventsReceived(count, bytesRead);
+        logToJava(LogLevel::FINE, "Processed %d events", count);
+    }
+}
+
+void FanotifyServer::handleEvent(JNIEnv* env, const fanotify_event_metadata* event) {
+    uint64_t mask = event->mask;
+    if (event->fd >= 0) {
+        // We don't get file descriptors when reporting file handles, but be safe
+        close(event->fd);
+    }
+
+    // Overflow received, handle gracefully
+    if (IS_SET(mask, FAN_Q_OVERFLOW)) {
+        // We might have missed directories being moved
+        resolvedDirectories.clear();
+        vector<u16string> paths;
+        paths.reserve(watchPoints.size());
+        for (auto& it : watchPoints) {
+            paths.push_back(it.first);
+        }
+        reportOverflow(env, findRootPaths(paths));
+        return;
+    }
+
+    if (shouldTerminate) {
+        logToJava(LogLevel::FINE, "Ignoring incoming events because server is terminating", NULL);
+        return;
+    }
+
+    const struct fanotify_event_info_fid* fid = nullptr;
+    const char* name = nullptr;
+    const uint8_t* infoStart = reinterpret_cast<const uint8_t*>(event) + event->metadata_len;
+    const uint8_t* infoEnd = reinterpret_cast<const uint8_t*>(event) + event->event_len;
+    while (infoStart < infoEnd) {
+        auto info = reinterpret_cast<const struct fanotify_event_info_fid*>(infoStart);
+        if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+            auto handle = reinterpret_cast<const struct file_handle*>(info->handle);
+            fid = info;
+            name = reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes);
+            break;
+        } else if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID) {
+            fid = info;
+        }
+        if (info->hdr.len == 0) {
+            break;
+        }
+        infoStart += info->hdr.len;
+    }
+    if (fid == nullptr) {
+        logToJava(LogLevel::INFO, "Received event without directory information (mask = 0x%llx)", (unsigned long long) mask);
+        return;
+    }
+
+    const FanotifyDirectory& directory = resolveDirectory(fid);
+    if (directory.watchedPaths.empty() && !directory.containsWatchPoints) {
+        // Most events on a filesystem are for unrelated directories, keep ignoring them cheap
+        return;
+    }
+    bool hasName = name != nullptr && name[0] != '\0' && strcmp(name, ".") != 0;
+    size_t nameLength = hasName ? strlen(name) : 0;
+    vector<u16string> paths;
+    paths.reserve(directory.watchedPaths.size());
+    for (auto& watchedDirectory : directory.watchedPaths) {
+        u16string path = watchedDirectory;
+        if (hasName) {
+            appendChild(path, name, nameLength);
+        }
+        addDistinct(paths, path);
+    }
+    if (hasName && directory.containsWatchPoints) {
+        // The event is about a watch point itself
+        string canonicalPath = directory.canonicalPath;
+        if (canonicalPath.back() != '/') {
+            canonicalPath.push_back('/');
+        }
+        canonicalPath.append(name, nameLength);
+        auto iRoot = watchRoots.find(canonicalPath);
+        if (iRoot != watchRoots.end()) {
+            for (auto& root : iRoot->second) {
+                addDistinct(paths, root);
+            }
+        }
+    }
+    if (IS_SET(mask, FAN_ONDIR) && IS_SET(mask, FAN_MOVED_FROM | FAN_MOVED_TO)) {
+        // The paths of the directories we have resolved below the moved one have changed
+        resolvedDirectories.clear();
+    }
+
+    for (auto& path : paths) {
+        reportEvent(env, mask, path);
+    }
+}
+
+void FanotifyServer::reportEvent(JNIEnv* env, uint64_t mask, const u16string& path) {
+    logToJava(LogLevel::FINE, "Event mask: 0x%llx for %s", (unsigned long long) mask, utf16ToUtf8String(path).c_str());
+
+    ChangeType type;
+    if (IS_SET(mask, FAN_CREATE | FAN_MOVED_TO) && IS_SET(mask, FAN_DELETE | FAN_MOVED_FROM)) {
+        // fanotify merged events for the same entry, we cannot tell the order
+        type = ChangeType::INVALIDATED;
+    } else if (IS_SET(mask, FAN_CREATE | FAN_MOVED_TO)) {
+        type = ChangeType::CREATED;
+    } else if (IS_SET(mask, FAN_DELETE | FAN_MOVED_FROM)) {
+        type = ChangeType::REMOVED;
+    } else if (IS_SET(mask, FAN_MODIFY)) {
+        type = ChangeType::MODIFIED;
+    } else {
+        logToJava(LogLevel::WARNING, "Unknown event 0x%llx for %s", (unsigned long long) mask, utf16ToUtf8String(path).c_str());
+        reportUnknownEvent(env, path);
+        return;
+    }
+
+    reportChangeEvent(env, type, path);
+}
+
+const FanotifyDirectory& FanotifyServer::resolveDirectory(const fanotify_event_info_fid* fid) {
+    auto handle = reinterpret_cast<const struct file_handle*>(fid->handle);
+    string key(reinterpret_cast<const char*>(handle), sizeof(struct file_handle) + handle->handle_bytes);
+    key.append(reinterpret_cast<const char*>(&fid->fsid), sizeof(fid->fsid));
+    auto cached = resolvedDirectories.find(key);
+    if (cached != resolvedDirectories.end()) {
+        return cached->second;
+    }
+    if (resolvedDirectories.size() >= FANOTIFY_DIRECTORY_CACHE_SIZE) {
+        resolvedDirectories.clear();
+    }
+    FanotifyDirectory& directory = resolvedDirectories[key];
+
+    auto iFilesystem = filesystems.find(toFsid(fid->fsid.val));
+    if (iFilesystem == filesystems.end()) {
+        // Event for a filesystem we have recently stopped watching
+        return directory;
+    }
+    int fd = open_by_handle_at(iFilesystem->second.mountFd, const_cast<struct file_handle*>(handle), O_PATH | O_CLOEXEC);
+    if (fd == -1) {
+        // ESTALE means the directory has been removed since
+        logToJava(LogLevel::FINE, "Couldn't resolve directory handle (errno = %d)", errno);
+        return directory;
+    }
+    char procPath[64];
+    snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", fd);
+    char resolved[PATH_MAX];
+    ssize_t length = readlink(procPath, resolved, sizeof(resolved) - 1);
+    if (length == -1) {
+        logToJava(LogLevel::FINE, "Couldn't resolve directory path (errno = %d)", errno);
+        close(fd);
+        return directory;
+    }
+    directory.canonicalPath.assign(resolved, length);
+
+    // A removed directory still resolves while we hold a handle to it, but with a suffix
+    size_t suffixLength = strlen(DELETED_SUFFIX);
+    struct stat st;
+    if (directory.canonicalPath.length() > suffixLength
+        && directory.canonicalPath.compare(directory.canonicalPath.length() - suffixLength, suffixLength, DELETED_SUFFIX) == 0
+        && fstat(fd, &st) == 0
+        && st.st_nlink == 0) {
+        directory.canonicalPath.resize(directory.canonicalPath.length() - suffixLength);
+    }
+    close(fd);
+
+    findWatchedPaths(directory);
+    return directory;
+}
+
+void FanotifyServer::findWatchedPaths(FanotifyDirectory& directory) {
+    const string& canonicalPath = directory.canonicalPath;
+    directory.containsWatchPoints = watchRootParents.find(canonicalPath) != watchRootParents.end();
+    // Look up each ancestor instead of matching every watch point
+    string ancestor = canonicalPath;
+    while (true) {
+        auto iRoot = watchRoots.find(ancestor);
+        if (iRoot != watchRoots.end()) {
+            for (auto& root : iRoot->second) {
+                addDistinct(directory.watchedPaths, toWatchedPath(root, ancestor, canonicalPath));
+            }
+        }
+        if (ancestor == "/") {
+            break;
+        }
+        ancestor = parentPath(ancestor);
+    }
+}
+
+void FanotifyServer::registerPaths(const vector<u16string>& paths) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (inotifyServer) {
+            inotifyServer->registerPaths(vector<u16string>(paths.begin() + i, paths.end()));
+            return;
+        }
+        registerPath(paths[i]);
+    }
+}
+
+vector<string> FanotifyServer::tryRegisterPaths(const vector<u16string>& paths) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    if (inotifyServer) {
+        return inotifyServer->tryRegisterPaths(paths);
+    }
+    return AbstractServer::tryRegisterPaths(paths);
+}
+
+bool FanotifyServer::unregisterPaths(const vector<u16string>& paths) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    if (inotifyServer) {
+        return inotifyServer->unregisterPaths(paths);
+    }
+    bool success = true;
+    for (auto& path : paths) {
+        success &= unregisterPath(path);
+    }
+    return success;
+}
+
+void FanotifyServer::setWatchedPaths(const vector<u16string>& paths) {
+    // Hold the lock so that the watched paths cannot change between diffing and applying the difference
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    if (inotifyServer) {
+        inotifyServer->setWatchedPaths(paths);
+        return;
+    }
+    AbstractServer::setWatchedPaths(paths);
+}
+
+vector<u16string> FanotifyServer::getWatchedPaths() {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    if (inotifyServer) {
+        return inotifyServer->getWatchedPaths();
+    }
+    vector<u16string> paths;
+    paths.reserve(watchPoints.size());
+    for (auto& it : watchPoints) {
+        paths.push_back(it.first);
+    }
+    return paths;
+}
+
+size_t FanotifyServer::getWatchedPathCount() {
+    Server* fallback = publishedInotifyServer;
+    if (fallback != nullptr) {
+        return fallback->getWatchedPathCount();
+    }
+    return watchPointCount;
+}
+
+void FanotifyServer::registerPath(const u16string& path) {
+    auto it = watchPoints.find(path);
+    if (it != watchPoints.end()) {
+        throw FileWatcherException("Already watching path", path);
+    }
+    string pathNarrow = utf16ToUtf8String(path);
+    struct stat st;
+    if (lstat(pathNarrow.c_str(), &st) != 0) {
+        throw FileWatcherException("Couldn't add watch, stat failed", path, errno);
+    }
+    struct statfs stfs;
+    if (statfs(pathNarrow.c_str(), &stfs) != 0) {
+        throw FileWatcherException("Couldn't add watch, statfs failed", path, errno);
+    }
+    uint64_t fsid = toFsid(stfs.f_fsid.__val);
+    char canonicalPath[PATH_MAX];
+    if (realpath(pathNarrow.c_str(), canonicalPath) == nullptr) {
+        throw FileWatcherException("Couldn't add watch, realpath failed", path, errno);
+    }
+
+    auto iFilesystem = filesystems.find(fsid);
+    if (iFilesystem == filesystems.end()) {
+        int mountFd = open(pathNarrow.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mountFd == -1) {
+            throw FileWatcherException("Couldn't add watch, open failed", path, errno);
+        }
+        if (fanotify_mark(fanotify.fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FANOTIFY_EVENT_MASK, AT_FDCWD, pathNarrow.c_str()) != 0) {
+            int errorCode = errno;
+            close(mountFd);
+            // EPERM: not privileged, EINVAL: filesystem marks not supported,
+            // EXDEV, EOPNOTSUPP and ENODEV: the filesystem (e.g. overlayfs) cannot report file handles
+            bool unsupported = errorCode == EPERM || errorCode == EINVAL
+                || errorCode == EXDEV || errorCode == EOPNOTSUPP || errorCode == ENODEV;
+            if (!fanotifyUsable && unsupported) {
+                fallBackToInotify(path, errorCode);
+                inotifyServer->registerPaths(vector<u16string> { path });
+                return;
+            }
+            throw FileWatcherException("Couldn't add watch, fanotify_mark failed", path, errorCode);
+        }
+        fanotifyUsable = true;
+        iFilesystem = filesystems.emplace(piecewise_construct,
+                                     forward_as_tuple(fsid),
+                                     forward_as_tuple(mountFd))
+                          .first;
+    }
+    iFilesystem->second.watchPointCount++;
+
+    watchPoints.emplace(piecewise_construct,
+        forward_as_tuple(path),
+        forward_as_tuple(path, canonicalPath, fsid, st.st_ino));
+    watchPointCount = watchPoints.size();
+    watchRoots[canonicalPath].push_back(path);
+    watchRootParents[parentPath(canonicalPath)]++;
+    resolvedDirectories.clear();
+}
+
+bool FanotifyServer::unregisterPath(const u16string& path) {
+    auto it = watchPoints.find(path);
+    if (it == watchPoints.end()) {
+        logToJava(LogLevel::INFO, "Path is not watched: %s", utf16ToUtf8String(path).c_str());
+        return false;
+    }
+    uint64_t fsid = it->second.fsid;
+    const string& canonicalPath = it->second.canonicalPath;
+    auto iRoot = watchRoots.find(canonicalPath);
+    auto& roots = iRoot->second;
+    roots.erase(find(roots.begin(), roots.end(), path));
+    if (roots.empty()) {
+        watchRoots.erase(iRoot);
+    }
+    auto iParent = watchRootParents.find(parentPath(canonicalPath));
+    if (--iParent->second == 0) {
+        watchRootParents.erase(iParent);
+    }
+    watchPoints.erase(it);
+    watchPointCount = watchPoints.size();
+    resolvedDirectories.clear();
+
+    auto iFilesystem = filesystems.find(fsid);
+    if (--iFilesystem->second.watchPointCount > 0) {
+        return true;
+    }
+    // Remove the mark via our descriptor, the watched path itself might not exist anymore
+    bool success = true;
+    if (fanotify_mark(fanotify.fd, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, FANOTIFY_EVENT_MASK, iFilesystem->second.mountFd, NULL) != 0) {
+        logToJava(LogLevel::INFO, "Couldn't remove fanotify mark for %s (errno = %d)", utf16ToUtf8String(path).c_str(), errno);
+        success = false;
+    }
+    filesystems.erase(iFilesystem);
+    return success;
+}
+
+void FanotifyServer::fallBackToInotify(const u16string& path, int errorCode) {
+    logToJava(LogLevel::INFO, "Falling back to inotify, couldn't place fanotify filesystem mark for %s (errno = %d)", utf16ToUtf8String(path).c_str(), errorCode);
+    inotifyServer.reset(new Server(getThreadEnv(), callback.get(), reconcileOverflows));
+    publishedInotifyServer = inotifyServer.get();
+    // Wake up the run loop, so that it hands over to the inotify server
+    shutdownEvent.trigger();
+}
+
+void FanotifyServer::stopWatchingMovedPaths(jobjectArray absolutePathsToCheck, jobject droppedPaths) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    if (inotifyServer) {
+        inotifyServer->stopWatchingMovedPaths(absolutePathsToCheck, droppedPaths);
+        return;
+    }
+    JNIEnv* env = getThreadEnv();
+    int count = env->GetArrayLength(absolutePathsToCheck);
+    for (int i = 0; i < count; i++) {
+        jstring jPathToCheck = reinterpret_cast<jstring>(env->GetObjectArrayElement(absolutePathsToCheck, i));
+        auto pathToCheck = javaToUtf16String(env, jPathToCheck);
+
+        auto it = watchPoints.find(pathToCheck);
+        bool dropped = true;
+        if (it != watchPoints.end()) {
+            string pathNarrow = utf16ToUtf8String(pathToCheck);
+            struct stat st;
+            if (lstat(pathNarrow.c_str(), &st) == 0 && st.st_ino == it->second.inode) {
+                dropped = false;
+            } else {
+                unregisterPath(pathToCheck);
+            }
+        }
+        if (dropped) {
+            env->CallBooleanMethod(droppedPaths, baseJniConstants->listAddMethod, jPathToCheck);
+            env->DeleteLocalRef(jPathToCheck);
+            throwNativeExceptionWhenJavaExceptionOccurred(env);
+        } else {
+            env->DeleteLocalRef(jPathToCheck);
+        }
+    }
+}
+
+#endif
+
+JNIEXPORT jobject JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_startFanotifyWatcher0(JNIEnv* env, jclass, jobject javaCallback, jboolean reconcileOverflows) {
+#ifdef FANOTIFY_SUPPORTED
+    try {
+        return wrapServer(env, new FanotifyServer(env, javaCallback, reconcileOverflows));
+    } catch (const FanotifyUnavailableException& e) {
+        logToJava(LogLevel::INFO, "Falling back to inotify: %s", e.what());
+        return NULL;
+    }
+#else
+    (void) env;
+    (void) javaCallback;
+    (void) reconcileOverflows;
+    logToJava(LogLevel::INFO, "Falling back to inotify: fanotify is not supported by this build", NULL);
+    return NULL;
+#endif
+}
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_00024LinuxFileWatcher_isWatchingRecursively0(JNIEnv* env, jobject, jobject javaServer) {
+#ifdef FANOTIFY_SUPPORTED
+    try {
+        auto fanotifyServer = dynamic_cast<FanotifyServer*>(getServer(env, javaServer));
+        return fanotifyServer != nullptr && !fanotifyServer->isUsingInotify();
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return false;
+    }
+#else
+    (void) env;
+    (void) javaServer;
+    return false;
+#endif
+}
+
+#endif
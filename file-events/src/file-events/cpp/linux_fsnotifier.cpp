@@ -1,16 +1,29 @@
 #ifdef __linux__
 
-#include <codecvt>
+#include <cstring>
+#include <dirent.h>
 #include <dlfcn.h>
-#include <locale>
+#include <fcntl.h>
 #include <string>
 #include <sys/ioctl.h>
+#include <system_error>
 #include <unistd.h>
 
+#include "linux_fanotify.h"
 #include "linux_fsnotifier.h"
 
+// Initial size of the event buffer, it grows when more events are queued
 #define EVENT_BUFFER_SIZE (16 * 1024)
 
+// Upper limit for the event buffer; more queued events are read in multiple rounds
+#define MAX_EVENT_BUFFER_SIZE (1024 * 1024)
+
+// Number of paths from which tryRegisterPaths() spreads the system calls across worker threads
+#define PARALLEL_REGISTRATION_THRESHOLD 1024
+
+// Upper limit for the number of worker threads used by tryRegisterPaths()
+#define MAX_REGISTRATION_WORKERS 8
+
 #define EVENT_MASK (IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_EXCL_UNLINK | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
 
 InotifyInstanceLimitTooLowException::InotifyInstanceLimitTooLowException()
@@ -29,6 +42,45 @@ WatchPoint::WatchPoint(const u16string& path, shared_ptr<Inotify> inotify, int w
     , inode(inode) {
 }
 
+static EntrySnapshot toEntrySnapshot(const struct stat& st) {
+    return EntrySnapshot { st.st_ino, ((int64_t) st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec, st.st_size };
+}
+
+bool snapshotDirectory(const string& path, DirectorySnapshot& snapshot) {
+    int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1) {
+        return false;
+    }
+    DIR* dir = fdopendir(dirFd);
+    if (dir == nullptr) {
+        int errorCode = errno;
+        close(dirFd);
+        errno = errorCode;
+        return false;
+    }
+    snapshot.clear();
+    while (true) {
+        errno = 0;
+        struct dirent* entry = readdir(dir);
+        if (entry == nullptr) {
+            break;
+        }
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirFd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            // Removed since it has been listed
+            continue;
+        }
+        snapshot.emplace(entry->d_name, toEntrySnapshot(st));
+    }
+    int errorCode = errno;
+    closedir(dir);
+    errno = errorCode;
+    return errorCode == 0;
+}
+
 CancelResult WatchPoint::cancel() {
     if (status == WatchPointStatus::CANCELLED) {
         return CancelResult::ALREADY_CANCELLED;
@@ -84,12 +136,67 @@ void ShutdownEvent::consume() const {
     }
 }
 
-Server::Server(JNIEnv* env, jobject watcherCallback)
+Epoll::Epoll()
+    : fd(epoll_create1(EPOLL_CLOEXEC)) {
+    if (fd == -1) {
+        throw FileWatcherException("Couldn't create epoll instance", errno);
+    }
+}
+
+Epoll::~Epoll() {
+    close(fd);
+}
+
+void Epoll::add(int watchedFd) const {
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = watchedFd;
+    if (epoll_ctl(fd, EPOLL_CTL_ADD, watchedFd, &event) == -1) {
+        throw FileWatcherException("Couldn't register event source with epoll", errno);
+    }
+}
+
+int Epoll::wait(epoll_event* events, int maxEvents, int timeout) const {
+    int ret = epoll_wait(fd, events, maxEvents, timeout);
+    if (ret == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        throw FileWatcherException("Couldn't wait for events", errno);
+    }
+    return ret;
+}
+
+ssize_t readAvailableEvents(int fd, vector<uint8_t>& buffer, const char* source, bool& moreAvailable) {
+    unsigned int available = 0;
+    if (ioctl(fd, FIONREAD, &available) == 0 && available > buffer.size()) {
+        buffer.resize(min(static_cast<size_t>(available), static_cast<size_t>(MAX_EVENT_BUFFER_SIZE)));
+    }
+    moreAvailable = available > buffer.size();
+
+    ssize_t bytesRead = read(fd, &buffer[0], buffer.size());
+    switch (bytesRead) {
+        case -1:
+            if (errno == EAGAIN) {
+                // For a non-blocking read, we receive EAGAIN here if there is nothing to read.
+                // This may happen when the descriptor is already closed.
+                return 0;
+            }
+            throw FileWatcherException(string("Couldn't read from ") + source, errno);
+        case 0:
+            throw FileWatcherException(string("EOF reading from ") + source, errno);
+        default:
+            return bytesRead;
+    }
+}
+
+Server::Server(JNIEnv* env, jobject watcherCallback, bool reconcileOverflows)
     : AbstractServer(env, watcherCallback)
+    , reconcileOverflows(reconcileOverflows)
     , inotify(new Inotify()) {
-    buffer.reserve(EVENT_BUFFER_SIZE);
-    jclass listClass = env->FindClass("java/util/List");
-    this->listAddMethod = env->GetMethodID(listClass, "add", "(Ljava/lang/Object;)Z");
+    buffer.resize(EVENT_BUFFER_SIZE);
+    epoll.add(shutdownEvent.fd);
+    epoll.add(inotify->fd);
 }
 
 void Server::initializeRunLoop() {
@@ -111,25 +218,21 @@ void Server::runLoop() {
 }
 
 void Server::processQueues(int timeout) {
-    struct pollfd fds[2];
-    fds[0].fd = shutdownEvent.fd;
-    fds[1].fd = inotify->fd;
-    fds[0].events = POLLIN;
-    fds[1].events = POLLIN;
-
-    int ret = poll(fds, 2, timeout);
-    if (ret == -1) {
-        throw FileWatcherException("Couldn't poll for events", errno);
-    }
+    struct epoll_event events[2];
+    int count = epoll.wait(events, 2, timeout);
 
-    if (IS_SET(fds[0].revents, POLLIN)) {
-        shutdownEvent.consume();
-        // Ignore counter, we only care about the notification itself
-        shouldTerminate = true;
-        return;
+    bool inotifyReady = false;
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == shutdownEvent.fd) {
+            shutdownEvent.consume();
+            // Ignore counter, we only care about the notification itself
+            shouldTerminate = true;
+            return;
+        }
+        inotifyReady = true;
     }
 
-    if (IS_SET(fds[1].revents, POLLIN)) {
+    if (inotifyReady) {
         try {
             handleEvents();
         } catch (const exception& ex) {
@@ -139,42 +242,28 @@ void Server::processQueues(int timeout) {
 }
 
 void Server::handleEvents() {
-    unsigned int available;
-    ioctl(inotify->fd, FIONREAD, &available);
-
-    while (available > 0) {
-        ssize_t bytesRead = read(inotify->fd, &buffer[0], buffer.capacity());
-
-        switch (bytesRead) {
-            case -1:
-                if (errno == EAGAIN) {
-                    // For a non-blocking read, we receive EAGAIN here if there is nothing to read.
-                    // This may happen when the inotify is already closed.
-                    return;
-                } else {
-                    throw FileWatcherException("Couldn't read from inotify", errno);
-                }
-                break;
-            case 0:
-                throw FileWatcherException("EOF reading from inotify", errno);
-                break;
-            default:
-                // Handle events
-                unique_lock<recursive_mutex> lock(mutationMutex);
-                JNIEnv* env = getThreadEnv();
-                logToJava(LogLevel::FINE, "Processing %d bytes worth of events", bytesRead);
-                int index = 0;
-                int count = 0;
-                while (index < bytesRead) {
-                    const struct inotify_event* event = (struct inotify_event*) &buffer[index];
-                    handleEvent(env, event);
-                    index += sizeof(struct inotify_event) + event->len;
-                    count++;
-                }
-                logToJava(LogLevel::FINE, "Processed %d events", count);
-                break;
+    bool moreAvailable = true;
+    while (moreAvailable) {
+        ssize_t bytesRead = readAvailableEvents(inotify->fd, buffer, "inotify", moreAvailable);
+        if (bytesRead == 0) {
+            return;
+        }
+
+        // Handle events
+        unique_lock<recursive_mutex> lock(mutationMutex);
+        JNIEnv* env = getThreadEnv();
+        logToJava(LogLevel::FINE, "Processing %d bytes worth of events", bytesRead);
+        int index = 0;
+        int count = 0;
+        while (index < bytesRead) {
+            const struct inotify_event* event = (struct inotify_event*) &buffer[index];
+            handleEvent(env, event);
+            index += sizeof(struct inotify_event) + event->len;
+            count++;
         }
-        available -= bytesRead;
+        flushChangeEvents(env);
+        recordEventsReceived(count, bytesRead);
+        logToJava(LogLevel::FINE, "Processed %d events", count);
     }
 }
 
@@ -190,10 +279,7 @@ void Server::handleEvent(JNIEnv* env, const inotify_event* event) {
 
     // Overflow received, handle gracefully
     if (IS_SET(mask, IN_Q_OVERFLOW)) {
-        for (auto it : watchPoints) {
-            auto path = it.first;
-            reportOverflow(env, path);
-        }
+        handleOverflow(env);
         return;
     }
 
@@ -217,15 +303,18 @@ void Server::handleEvent(JNIEnv* env, const inotify_event* event) {
         return;
     }
 
-    auto path = iWatchRoot->second;
-    auto& watchPoint = watchPoints.at(path);
+    auto& watchPoint = *iWatchRoot->second;
+    const u16string& path = watchPoint.path;
 
     if (IS_SET(mask, IN_IGNORED)) {
         // Finished with watch point
         logToJava(LogLevel::FINE, "Finished watching still registered '%s' (wd = %d)",
             utf16ToUtf8String(path).c_str(), event->wd);
-        watchRoots.erase(event->wd);
-        watchPoints.erase(path);
+        // Copy the key as erasing destroys the watch point that holds the path
+        const u16string removedPath = path;
+        watchRoots.erase(iWatchRoot);
+        watchPoints.erase(removedPath);
+        watchPointCount = watchPoints.size();
         return;
     }
 
@@ -242,11 +331,11 @@ void Server::handleEvent(JNIEnv* env, const inotify_event* event) {
     }
 
     ChangeType type;
-    const u16string name = utf8ToUtf16String(eventName);
-
-    if (!name.empty()) {
-        path.append(u"/");
-        path.append(name);
+    // Reuse the same buffer for building event paths to avoid allocations
+    eventPath.assign(path);
+    if (eventName[0] != '\0') {
+        eventPath.push_back(u'/');
+        appendUtf8ToUtf16String(eventPath, eventName, strlen(eventName));
     }
 
     if (IS_SET(mask, IN_CREATE | IN_MOVED_TO)) {
@@ -256,21 +345,204 @@ void Server::handleEvent(JNIEnv* env, const inotify_event* event) {
     } else if (IS_SET(mask, IN_MODIFY)) {
         type = ChangeType::MODIFIED;
     } else {
-        logToJava(LogLevel::WARNING, "Unknown event 0x%x for %s", mask, utf16ToUtf8String(path).c_str());
-        reportUnknownEvent(env, path);
+        logToJava(LogLevel::WARNING, "Unknown event 0x%x for %s", mask, utf16ToUtf8String(eventPath).c_str());
+        reportUnknownEvent(env, eventPath);
+        return;
+    }
+
+    if (reconcileOverflows && eventName[0] != '\0') {
+        updateSnapshot(watchPoint, eventName);
+    }
+    reportChangeEvent(env, type, eventPath);
+}
+
+void Server::handleOverflow(JNIEnv* env) {
+    // The queue is shared by all watch points, so any of them could have lost events
+    if (!reconcileOverflows) {
+        vector<u16string> paths;
+        paths.reserve(watchPoints.size());
+        for (auto& it : watchPoints) {
+            paths.push_back(it.first);
+        }
+        reportOverflow(env, findRootPaths(paths));
         return;
     }
 
-    reportChangeEvent(env, type, path);
+    logToJava(LogLevel::INFO, "Reconciling %d watched directories after overflow", (int) watchPoints.size());
+    vector<u16string> failedPaths;
+    for (auto& it : watchPoints) {
+        if (it.second.status == WatchPointStatus::LISTENING && !reconcile(env, it.second)) {
+            failedPaths.push_back(it.first);
+        }
+    }
+    if (failedPaths.empty()) {
+        flushChangeEvents(env);
+    } else {
+        reportOverflow(env, findRootPaths(failedPaths));
+    }
+}
+
+bool Server::reconcile(JNIEnv* env, WatchPoint& watchPoint) {
+    DirectorySnapshot current;
+    if (!snapshotDirectory(utf16ToUtf8String(watchPoint.path), current)) {
+        logToJava(LogLevel::INFO, "Couldn't rescan %s after overflow (errno = %d)", utf16ToUtf8String(watchPoint.path).c_str(), errno);
+        return false;
+    }
+    auto report = [this, env, &watchPoint](ChangeType type, const string& name) {
+        eventPath.assign(watchPoint.path);
+        eventPath.push_back(u'/');
+        appendUtf8ToUtf16String(eventPath, name.c_str(), name.length());
+        reportChangeEvent(env, type, eventPath);
+    };
+    for (auto& it : current) {
+        auto previous = watchPoint.snapshot.find(it.first);
+        if (previous == watchPoint.snapshot.end()) {
+            report(ChangeType::CREATED, it.first);
+        } else if (previous->second.inode != it.second.inode) {
+            // Replaced by a different file
+            report(ChangeType::REMOVED, it.first);
+            report(ChangeType::CREATED, it.first);
+        } else if (previous->second.modifiedNanos != it.second.modifiedNanos || previous->second.size != it.second.size) {
+            report(ChangeType::MODIFIED, it.first);
+        }
+    }
+    for (auto& it : watchPoint.snapshot) {
+        if (current.find(it.first) == current.end()) {
+            report(ChangeType::REMOVED, it.first);
+        }
+    }
+    watchPoint.snapshot = move(current);
+    return true;
+}
+
+void Server::updateSnapshot(WatchPoint& watchPoint, const char* name) {
+    string childPath = utf16ToUtf8String(watchPoint.path);
+    childPath.push_back('/');
+    childPath.append(name);
+    struct stat st;
+    if (lstat(childPath.c_str(), &st) == 0) {
+        watchPoint.snapshot[name] = toEntrySnapshot(st);
+    } else {
+        watchPoint.snapshot.erase(name);
+    }
 }
 
 void Server::registerPaths(const vector<u16string>& paths) {
     unique_lock<recursive_mutex> lock(mutationMutex);
+    watchPoints.reserve(watchPoints.size() + paths.size());
+    watchRoots.reserve(watchRoots.size() + paths.size());
     for (auto& path : paths) {
         registerPath(path);
     }
 }
 
+/**
+ * Outcome of the system calls made for registering a single path.
+ */
+struct PreparedWatch {
+    int watchDescriptor = -1;
+    ino_t inode = 0;
+    int errorCode = 0;
+    const char* failure = nullptr;
+    DirectorySnapshot snapshot;
+};
+
+vector<string> Server::tryRegisterPaths(const vector<u16string>& paths) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    size_t count = paths.size();
+    vector<string> failures(count);
+    vector<PreparedWatch> prepared(count);
+
+    // Adding a watch for an already watched path would only return its existing watch descriptor
+    for (size_t i = 0; i < count; i++) {
+        if (watchPoints.find(paths[i]) != watchPoints.end()) {
+            failures[i] = FileWatcherException("Already watching path", paths[i]).what();
+        }
+    }
+
+    // The conversions and system calls don't touch any shared state, so they can run in parallel.
+    // Any failure is reported for the path it happened with, exceptions must not escape the worker threads
+    auto prepare = [this, &paths, &failures, &prepared](size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+            if (!failures[i].empty()) {
+                continue;
+            }
+            try {
+                auto& watch = prepared[i];
+                string pathNarrow = utf16ToUtf8String(paths[i]);
+                struct stat st;
+                if (lstat(pathNarrow.c_str(), &st) != 0) {
+                    watch.errorCode = errno;
+                    watch.failure = "Couldn't add watch, stat failed";
+                    continue;
+                }
+                watch.inode = st.st_ino;
+                watch.watchDescriptor = inotify_add_watch(inotify->fd, pathNarrow.c_str(), EVENT_MASK);
+                if (watch.watchDescriptor == -1) {
+                    watch.errorCode = errno;
+                    watch.failure = "Couldn't add watch, inotify_add_watch failed";
+                    continue;
+                }
+                if (reconcileOverflows) {
+                    // Taken after adding the watch, so that changes happening meanwhile update the snapshot via events.
+                    // An incomplete snapshot only causes spurious events when reconciling
+                    snapshotDirectory(pathNarrow, watch.snapshot);
+                }
+            } catch (const exception& e) {
+                failures[i] = e.what();
+            }
+        }
+    };
+    size_t workerCount = count < PARALLEL_REGISTRATION_THRESHOLD
+        ? 1
+        : min(static_cast<size_t>(thread::hardware_concurrency()), static_cast<size_t>(MAX_REGISTRATION_WORKERS));
+    if (workerCount <= 1) {
+        prepare(0, count);
+    } else {
+        vector<thread> workers;
+        size_t chunkSize = (count + workerCount - 1) / workerCount;
+        size_t from = 0;
+        try {
+            for (; from < count; from += chunkSize) {
+                workers.emplace_back(prepare, from, min(from + chunkSize, count));
+            }
+        } catch (const system_error&) {
+            // Couldn't start another worker, prepare the remaining paths on this thread instead
+            prepare(from, count);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    watchPoints.reserve(watchPoints.size() + count);
+    watchRoots.reserve(watchRoots.size() + count);
+    for (size_t i = 0; i < count; i++) {
+        if (!failures[i].empty()) {
+            continue;
+        }
+        auto& path = paths[i];
+        auto& watch = prepared[i];
+        if (watch.failure != nullptr) {
+            failures[i] = watch.errorCode == ENOSPC
+                ? InotifyWatchesLimitTooLowException().what()
+                : FileWatcherException(watch.failure, path, watch.errorCode).what();
+            continue;
+        }
+        if (watchRoots.find(watch.watchDescriptor) != watchRoots.end()) {
+            failures[i] = FileWatcherException("Already watching path", path).what();
+            continue;
+        }
+        auto inserted = watchPoints.emplace(piecewise_construct,
+            forward_as_tuple(path),
+            forward_as_tuple(path, inotify, watch.watchDescriptor, watch.inode));
+        inserted.first->second.snapshot = move(watch.snapshot);
+        watchRoots[watch.watchDescriptor] = &inserted.first->second;
+    }
+    watchPointCount = watchPoints.size();
+    return failures;
+}
+
 bool Server::unregisterPaths(const vector<u16string>& paths) {
     unique_lock<recursive_mutex> lock(mutationMutex);
     bool success = true;
@@ -280,6 +552,26 @@ bool Server::unregisterPaths(const vector<u16string>& paths) {
     return success;
 }
 
+void Server::setWatchedPaths(const vector<u16string>& paths) {
+    // Hold the lock so that the watched paths cannot change between diffing and applying the difference
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    AbstractServer::setWatchedPaths(paths);
+}
+
+vector<u16string> Server::getWatchedPaths() {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    vector<u16string> paths;
+    paths.reserve(watchPoints.size());
+    for (auto& it : watchPoints) {
+        paths.push_back(it.first);
+    }
+    return paths;
+}
+
+size_t Server::getWatchedPathCount() {
+    return watchPointCount;
+}
+
 void Server::registerPath(const u16string& path) {
     auto it = watchPoints.find(path);
     if (it != watchPoints.end()) {
@@ -303,10 +595,14 @@ void Server::registerPath(const u16string& path) {
         throw FileWatcherException("Already watching path", path);
     }
 
-    watchPoints.emplace(piecewise_construct,
+    auto inserted = watchPoints.emplace(piecewise_construct,
         forward_as_tuple(path),
         forward_as_tuple(path, inotify, watchDescriptor, st.st_ino));
-    watchRoots[watchDescriptor] = path;
+    if (reconcileOverflows) {
+        snapshotDirectory(pathNarrow, inserted.first->second.snapshot);
+    }
+    watchRoots[watchDescriptor] = &inserted.first->second;
+    watchPointCount = watchPoints.size();
 }
 
 bool Server::unregisterPath(const u16string& path) {
@@ -327,6 +623,7 @@ bool Server::unregisterPath(const u16string& path) {
     // when inside a Docker container a host-mapped directory is watched. There is no good theory as
     // of this writing why the problem occurs, but not using the iterator here fixes it.
     watchPoints.erase(path);
+    watchPointCount = watchPoints.size();
     return ret == CancelResult::CANCELLED;
 }
 
@@ -365,14 +662,14 @@ void Server::stopWatchingMovedPaths(jobjectArray absolutePathsToCheck, jobject d
 }
 
 void Server::addToList(JNIEnv* env, jobject jList, jstring jString) {
-        env->CallBooleanMethod(jList, listAddMethod, jString);
+        env->CallBooleanMethod(jList, baseJniConstants->listAddMethod, jString);
         throwNativeExceptionWhenJavaExceptionOccurred(env);
 }
 
 JNIEXPORT jobject JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_startWatcher0(JNIEnv* env, jclass, jobject javaCallback) {
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_startWatcher0(JNIEnv* env, jclass, jobject javaCallback, jboolean reconcileOverflows) {
     try {
-        return wrapServer(env, new Server(env, javaCallback));
+        return wrapServer(env, new Server(env, javaCallback, reconcileOverflows));
     } catch (const InotifyInstanceLimitTooLowException& e) {
         rethrowAsJavaException(env, e, linuxJniConstants->inotifyInstanceLimitTooLowExceptionClass.get());
         return NULL;
@@ -394,8 +691,15 @@ Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_isGlibc0(J
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_00024LinuxFileWatcher_stopWatchingMovedPaths0(JNIEnv* env, jobject, jobject javaServer, jobjectArray jAbsolutePathsToCheck, jobject jDroppedPaths) {
     try {
-        Server* server = (Server*) getServer(env, javaServer);
-        server->stopWatchingMovedPaths(jAbsolutePathsToCheck, jDroppedPaths);
+        AbstractServer* server = getServer(env, javaServer);
+#ifdef FANOTIFY_SUPPORTED
+        FanotifyServer* fanotifyServer = dynamic_cast<FanotifyServer*>(server);
+        if (fanotifyServer != nullptr) {
+            fanotifyServer->stopWatchingMovedPaths(jAbsolutePathsToCheck, jDroppedPaths);
+            return;
+        }
+#endif
+        ((Server*) server)->stopWatchingMovedPaths(jAbsolutePathsToCheck, jDroppedPaths);
     } catch (const JavaExceptionThrownException&) {
         // Ignore, the Java exception has already been thrown.
     } catch (const exception& e) {
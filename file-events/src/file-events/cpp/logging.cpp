@@ -1,9 +1,64 @@
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <thread>
 
 #include "logging.h"
 
+LogQueue::LogQueue()
+    : cells(new Cell[LOG_QUEUE_CAPACITY])
+    , enqueuePosition(0)
+    , dequeuePosition(0) {
+    for (size_t i = 0; i < LOG_QUEUE_CAPACITY; i++) {
+        cells[i].sequence.store(i, memory_order_relaxed);
+    }
+}
+
+bool LogQueue::offer(LogLevel level, const char* fmt, va_list args) {
+    size_t position = enqueuePosition.load(memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[position & (LOG_QUEUE_CAPACITY - 1)];
+        size_t sequence = cell->sequence.load(memory_order_acquire);
+        intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The queue is full
+            return false;
+        } else {
+            position = enqueuePosition.load(memory_order_relaxed);
+        }
+    }
+    cell->level = level;
+    vsnprintf(cell->message, sizeof(cell->message), fmt, args);
+    cell->sequence.store(position + 1, memory_order_release);
+    return true;
+}
+
+bool LogQueue::poll(LogLevel& level, char* message) {
+    size_t position = dequeuePosition.load(memory_order_relaxed);
+    Cell* cell = &cells[position & (LOG_QUEUE_CAPACITY - 1)];
+    size_t sequence = cell->sequence.load(memory_order_acquire);
+    if ((intptr_t) sequence - (intptr_t) (position + 1) < 0) {
+        // The queue is empty, or the next record is still being written
+        return false;
+    }
+    dequeuePosition.store(position + 1, memory_order_relaxed);
+    level = cell->level;
+    memcpy(message, cell->message, sizeof(cell->message));
+    cell->sequence.store(position + LOG_QUEUE_CAPACITY, memory_order_release);
+    return true;
+}
+
 Logging::Logging(JavaVM* jvm)
     : JniSupport(jvm)
+    , minimumLogLevel(static_cast<int>(LogLevel::ALL))
+    , asynchronous(false)
+    , queueingSenders(0)
+    , droppedMessages(0)
     , clsLogger(getThreadEnv(), "net/rubygrapefruit/platform/internal/jni/NativeLogger")
     , logMethod(getThreadEnv()->GetStaticMethodID(clsLogger.get(), "log", "(ILjava/lang/String;)V"))
     , getLevelMethod(getThreadEnv()->GetStaticMethodID(clsLogger.get(), "getLogLevel", "()I")) {
@@ -11,34 +66,91 @@ Logging::Logging(JavaVM* jvm)
 
 void Logging::invalidateLogLevelCache() {
     lastLevelCheck = chrono::steady_clock::time_point();
+    if (asynchronous.load(memory_order_relaxed)) {
+        // Called from Java, so we can refresh right away instead of waiting for the next drain
+        refreshLogLevel(getThreadEnv());
+    }
 }
 
 bool Logging::enabled(LogLevel level) {
-    auto current = chrono::steady_clock::now();
-    auto elapsed = chrono::duration_cast<chrono::milliseconds>(current - lastLevelCheck).count();
-    if (elapsed > LOG_LEVEL_CHECK_INTERVAL_IN_MS) {
-        JNIEnv* env = getThreadEnv();
-        minimumLogLevel = env->CallStaticIntMethod(clsLogger.get(), getLevelMethod);
-        rethrowJavaException(env);
-        lastLevelCheck = current;
+    if (!asynchronous.load(memory_order_relaxed)) {
+        auto current = chrono::steady_clock::now();
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(current - lastLevelCheck).count();
+        if (elapsed > LOG_LEVEL_CHECK_INTERVAL_IN_MS) {
+            refreshLogLevel(getThreadEnv());
+            lastLevelCheck = current;
+        }
     }
-    return minimumLogLevel <= static_cast<int>(level);
+    return minimumLogLevel.load(memory_order_relaxed) <= static_cast<int>(level);
+}
+
+void Logging::refreshLogLevel(JNIEnv* env) {
+    int level = env->CallStaticIntMethod(clsLogger.get(), getLevelMethod);
+    rethrowJavaException(env);
+    minimumLogLevel.store(level, memory_order_relaxed);
 }
 
 void Logging::send(LogLevel level, const char* fmt, ...) {
-    char buffer[1024];
     va_list args;
     va_start(args, fmt);
+    // Announce ourselves before checking the mode, so that switching back to synchronous mode
+    // waits for us to finish queueing before draining the queue for the last time
+    queueingSenders.fetch_add(1);
+    if (asynchronous.load()) {
+        if (!queue->offer(level, fmt, args)) {
+            droppedMessages.fetch_add(1, memory_order_relaxed);
+        }
+        queueingSenders.fetch_sub(1);
+        va_end(args);
+        return;
+    }
+    queueingSenders.fetch_sub(1);
+    char buffer[LOG_MESSAGE_MAX_LENGTH];
     vsnprintf(buffer, sizeof(buffer), fmt, args);
     va_end(args);
 
-    JNIEnv* env = getThreadEnv();
+    sendToJava(getThreadEnv(), level, buffer);
+}
+
+void Logging::sendToJava(JNIEnv* env, LogLevel level, const char* message) {
     if (env == NULL) {
-        cerr << buffer << endl;
+        cerr << message << endl;
     } else {
-        jstring logString = env->NewStringUTF(buffer);
+        jstring logString = env->NewStringUTF(message);
         env->CallStaticVoidMethod(clsLogger.get(), logMethod, level, logString);
         env->DeleteLocalRef(logString);
         rethrowJavaException(env);
     }
 }
+
+void Logging::setAsynchronous(JNIEnv* env, bool asynchronous) {
+    if (asynchronous) {
+        if (queue == nullptr) {
+            queue.reset(new LogQueue());
+        }
+        refreshLogLevel(env);
+        this->asynchronous.store(true);
+    } else {
+        this->asynchronous.store(false);
+        // Threads that saw asynchronous mode may still be queueing, offering never blocks so this is short
+        while (queueingSenders.load() > 0) {
+            this_thread::yield();
+        }
+        // Send whatever has been queued before switching back
+        drain(env);
+    }
+}
+
+void Logging::drain(JNIEnv* env) {
+    refreshLogLevel(env);
+    LogLevel level;
+    char message[LOG_MESSAGE_MAX_LENGTH];
+    while (queue != nullptr && queue->poll(level, message)) {
+        sendToJava(env, level, message);
+    }
+    uint64_t dropped = droppedMessages.exchange(0, memory_order_relaxed);
+    if (dropped > 0) {
+        snprintf(message, sizeof(message), "Dropped %llu log messages because the queue was full", (unsigned long long) dropped);
+        sendToJava(env, LogLevel::WARNING, message);
+    }
+}
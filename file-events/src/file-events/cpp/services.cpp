@@ -1,29 +1,71 @@
+#include <memory>
+#include <mutex>
+
 #include "logging.h"
 #include "generic_fsnotifier.h"
 #include "linux_fsnotifier.h"
+#include "win_usn_journal.h"
 
 BaseJniConstants* baseJniConstants;
 NativePlatformJniConstants* nativePlatformJniConstants;
 #ifdef __linux__
 LinuxJniConstants* linuxJniConstants;
 #endif
+#ifdef _WIN32
+WindowsJniConstants* windowsJniConstants;
+#endif
 Logging* logging;
 
+static JavaVM* javaVm;
+static once_flag initialized;
+
 JNIEXPORT jint JNICALL
 JNI_OnLoad(JavaVM* jvm, void*) {
-    baseJniConstants = new BaseJniConstants(jvm);
-    nativePlatformJniConstants = new NativePlatformJniConstants(jvm);
-    logging = new Logging(jvm);
+    // The JNI constants are only set up when the integration is first used, see initialize0()
+    javaVm = jvm;
+    return JNI_VERSION_1_6;
+}
+
+static void initializeConstants() {
+    // Only publish the constants once all of them have been set up, so that a failure can be retried
+    unique_ptr<BaseJniConstants> base(new BaseJniConstants(javaVm));
+    unique_ptr<NativePlatformJniConstants> nativePlatform(new NativePlatformJniConstants(javaVm));
+    unique_ptr<Logging> logger(new Logging(javaVm));
 #ifdef __linux__
-    linuxJniConstants = new LinuxJniConstants(jvm);
+    unique_ptr<LinuxJniConstants> linuxConstants(new LinuxJniConstants(javaVm));
+    linuxJniConstants = linuxConstants.release();
 #endif
-    return JNI_VERSION_1_6;
+#ifdef _WIN32
+    unique_ptr<WindowsJniConstants> windowsConstants(new WindowsJniConstants(javaVm));
+    windowsJniConstants = windowsConstants.release();
+#endif
+    baseJniConstants = base.release();
+    nativePlatformJniConstants = nativePlatform.release();
+    logging = logger.release();
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_initialize0(JNIEnv* env, jclass) {
+    try {
+        call_once(initialized, initializeConstants);
+    } catch (const exception& e) {
+        // Keep the exception thrown by the failing JNI call, if any
+        if (!env->ExceptionCheck()) {
+            jclass exceptionClass = env->FindClass("net/rubygrapefruit/platform/NativeException");
+            if (exceptionClass != nullptr) {
+                env->ThrowNew(exceptionClass, e.what());
+            }
+        }
+    }
 }
 
 JNIEXPORT void JNICALL
 JNI_OnUnload(JavaVM*, void*) {
 #ifdef __linux__
     delete linuxJniConstants;
+#endif
+#ifdef _WIN32
+    delete windowsJniConstants;
 #endif
     delete logging;
     delete nativePlatformJniConstants;
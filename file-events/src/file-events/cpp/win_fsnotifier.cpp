@@ -3,14 +3,15 @@
 #include "win_fsnotifier.h"
 #include "command.h"
 
-#include <codecvt>
-#include <locale>
+#include <exception>
 
 using namespace std;
 
 string wideToUtf8String(const wstring& string) {
-    wstring_convert<deletable_facet<codecvt<wchar_t, char, mbstate_t>>, wchar_t> conv;
-    return conv.to_bytes(string);
+    // wchar_t holds UTF-16 on Windows
+    std::string result;
+    appendUtf16ToUtf8String(result, (const char16_t*) string.data(), string.length());
+    return result;
 }
 
 #define wideToUtf16String(string) (u16string((string).begin(), (string).end()))
@@ -66,24 +67,60 @@ void convertToLongPathIfNeeded(wstring& path) {
     }
 }
 
-// Allocate maximum path length
-#define PATH_BUFFER_SIZE 32768
+// Most paths fit on the stack, only longer ones need to be allocated
+#define PATH_BUFFER_SIZE MAX_PATH
 
 bool resolveFinalPath(HANDLE handle, wstring& path) {
-    vector<wchar_t> buffer;
-    buffer.reserve(PATH_BUFFER_SIZE);
+    wchar_t buffer[PATH_BUFFER_SIZE];
     DWORD pathLength = GetFinalPathNameByHandleW(
         handle,
-        &buffer[0],
+        buffer,
         PATH_BUFFER_SIZE,
         FILE_NAME_OPENED);
-    if (pathLength == 0 || pathLength > PATH_BUFFER_SIZE) {
-        logToJava(LogLevel::WARNING, "Couldn't get final path for handle 0x%x, error code: %d", handle, GetLastError());
+    if (pathLength != 0 && pathLength < PATH_BUFFER_SIZE) {
+        path.assign(buffer, pathLength);
+        return true;
+    }
+    if (pathLength != 0) {
+        // The buffer was too small, the result is the required size including the terminating null
+        vector<wchar_t> longBuffer(pathLength);
+        pathLength = GetFinalPathNameByHandleW(
+            handle,
+            longBuffer.data(),
+            (DWORD) longBuffer.size(),
+            FILE_NAME_OPENED);
+        if (pathLength != 0 && pathLength < longBuffer.size()) {
+            path.assign(longBuffer.data(), pathLength);
+            return true;
+        }
+    }
+    logToJava(LogLevel::WARNING, "Couldn't get final path for handle 0x%x, error code: %d", handle, GetLastError());
+    return false;
+}
+
+/**
+ * Checks whether the handle still resolves to the given final path, i.e. that it has not been moved.
+ *
+ * The file ID of an open handle doesn't change when the directory is moved, so this needs to resolve
+ * the path; but unlike resolveFinalPath() it avoids allocating for the common case.
+ */
+bool hasFinalPath(HANDLE handle, const wstring& expectedPath) {
+    wchar_t buffer[PATH_BUFFER_SIZE];
+    DWORD pathLength = GetFinalPathNameByHandleW(
+        handle,
+        buffer,
+        PATH_BUFFER_SIZE,
+        FILE_NAME_OPENED);
+    if (pathLength != 0 && pathLength < PATH_BUFFER_SIZE) {
+        return expectedPath.compare(0, wstring::npos, buffer, pathLength) == 0;
+    }
+    if (pathLength != 0 && pathLength - 1 != expectedPath.length()) {
+        // The path didn't fit the buffer, but its length already tells that it has changed
         return false;
     }
-    path.clear();
-    path.insert(0, &buffer[0], pathLength);
-    return true;
+    wstring currentFinalPath;
+    return resolveFinalPath(handle, currentFinalPath)
+        && currentFinalPath == expectedPath;
 }
 
 //
@@ -114,14 +151,29 @@ WatchPoint::WatchPoint(Server* server, size_t eventBufferSize, const wstring& pa
         throw FileWatcherException("Couldn't resolve final path of", wideToUtf16String(path), GetLastError());
     }
     this->eventBuffer.reserve(eventBufferSize);
+    this->spareEventBuffer.reserve(eventBufferSize);
     ZeroMemory(&this->overlapped, sizeof(OVERLAPPED));
-    this->overlapped.hEvent = this;
+    if (server->useCompletionPort) {
+        ULONG_PTR key = server->nextCompletionKey++;
+        if (CreateIoCompletionPort(directoryHandle, server->completionPort, key, 0) == NULL) {
+            DWORD associateError = GetLastError();
+            close();
+            throw FileWatcherException("Couldn't associate watch with completion port", wideToUtf16String(path), associateError);
+        }
+        this->completionKey = key;
+    } else {
+        this->overlapped.hEvent = this;
+    }
     switch (listen()) {
         case ListenResult::SUCCESS:
             break;
         case ListenResult::DELETED:
             throw FileWatcherException("Couldn't add watch, path is not a directory", wideToUtf16String(path));
     }
+    if (completionKey != 0) {
+        // Completions are only dequeued on the run loop thread, so no event can arrive before this
+        server->watchPointsByCompletionKey.emplace(completionKey, this);
+    }
 }
 
 bool WatchPoint::cancel() {
@@ -148,11 +200,21 @@ bool WatchPoint::cancel() {
 WatchPoint::~WatchPoint() {
     try {
         cancel();
-        SleepEx(0, true);
+        if (completionKey == 0) {
+            SleepEx(0, true);
+        } else if (status == WatchPointStatus::CANCELLED) {
+            // Wait for the cancelled read to finish, so the system doesn't write to the buffer after we're gone.
+            // The completion packet is ignored once the key is unregistered below.
+            DWORD bytesTransferred;
+            GetOverlappedResult(directoryHandle, &overlapped, &bytesTransferred, TRUE);
+        }
         close();
     } catch (const exception& ex) {
         logToJava(LogLevel::WARNING, "Couldn't cancel watch point %s: %s", wideToUtf8String(registeredPath).c_str(), ex.what());
     }
+    if (completionKey != 0) {
+        server->watchPointsByCompletionKey.erase(completionKey);
+    }
 }
 
 static void CALLBACK handleEventCallback(DWORD errorCode, DWORD bytesTransferred, LPOVERLAPPED overlapped) {
@@ -176,7 +238,9 @@ ListenResult WatchPoint::listen() {
         EVENT_MASK,                        // filter conditions
         NULL,                              // bytes returned
         &overlapped,                       // overlapped buffer
-        &handleEventCallback,              // completion routine
+        completionKey == 0                 // completion routine, or none when using a completion port
+            ? &handleEventCallback
+            : NULL,
         ReadDirectoryNotifyExtendedInformation);
     if (success) {
         status = WatchPointStatus::LISTENING;
@@ -221,14 +285,14 @@ void WatchPoint::handleEventsInBuffer(DWORD errorCode, DWORD bytesTransferred) {
         return;
     }
     status = WatchPointStatus::NOT_LISTENING;
-    server->handleEvents(this, errorCode, eventBuffer, bytesTransferred);
+    server->handleEvents(this, errorCode, bytesTransferred);
 }
 
 //
 // Server
 //
 
-void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<BYTE>& eventBuffer, DWORD bytesTransferred) {
+void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, DWORD bytesTransferred) {
     JNIEnv* env = getThreadEnv();
 
     try {
@@ -241,9 +305,7 @@ void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<
             }
         }
 
-        wstring currentFinalPath;
-        bool watchedHandleIsAccessible = resolveFinalPath(watchPoint->directoryHandle, currentFinalPath);
-        if (!watchedHandleIsAccessible || currentFinalPath != watchPoint->registeredFinalPath) {
+        if (!hasFinalPath(watchPoint->directoryHandle, watchPoint->registeredFinalPath)) {
             // The handle has become invalid or missing, or the directory has been relocated, consider this as if the the watch point was deleted
             reportWatchPointDeleted(watchPoint);
             return;
@@ -256,6 +318,19 @@ void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<
             return;
         }
 
+        // Listen again with the spare buffer before processing the events, so that changes
+        // happening while we call back to Java don't pile up in the kernel and overflow
+        watchPoint->eventBuffer.swap(watchPoint->spareEventBuffer);
+        const vector<BYTE>& eventBuffer = watchPoint->spareEventBuffer;
+        ListenResult listenResult = ListenResult::SUCCESS;
+        exception_ptr listenFailure;
+        try {
+            listenResult = watchPoint->listen();
+        } catch (const exception&) {
+            // Report the failure after the events that have already been received
+            listenFailure = current_exception();
+        }
+
         if (bytesTransferred == 0) {
             // This is what the documentation has to say about a zero-length dataset:
             //
@@ -267,20 +342,27 @@ void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<
             // (See https://docs.microsoft.com/en-us/windows/win32/api/winbase/nf-winbase-readdirectorychangesw)
             //
             // We'll handle this as a simple overflow and report it as such.
+            recordEventsReceived(0, 0);
             reportOverflow(env, wideToUtf16String(path));
         } else {
             int index = 0;
+            size_t count = 0;
             for (;;) {
                 FILE_NOTIFY_EXTENDED_INFORMATION* current = (FILE_NOTIFY_EXTENDED_INFORMATION*) &eventBuffer[index];
                 handleEvent(env, path, current);
+                count++;
                 if (current->NextEntryOffset == 0) {
                     break;
                 }
                 index += current->NextEntryOffset;
             }
+            recordEventsReceived(count, bytesTransferred);
         }
 
-        switch (watchPoint->listen()) {
+        if (listenFailure) {
+            rethrow_exception(listenFailure);
+        }
+        switch (listenResult) {
             case ListenResult::SUCCESS:
                 break;
             case ListenResult::DELETED:
@@ -291,6 +373,7 @@ void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<
     } catch (const exception& ex) {
         reportFailure(env, ex);
     }
+    flushChangeEventsReportingFailures(env);
 }
 
 void Server::handleEvent(JNIEnv* env, const wstring& watchedPathW, FILE_NOTIFY_EXTENDED_INFORMATION* info) {
@@ -328,15 +411,22 @@ void Server::reportWatchPointDeleted(WatchPoint* watchPoint) {
     watchPoint->close();
 }
 
-Server::Server(JNIEnv* env, size_t eventBufferSize, long commandTimeoutInMillis, jobject watcherCallback)
+Server::Server(JNIEnv* env, size_t eventBufferSize, long commandTimeoutInMillis, bool useCompletionPort, jobject watcherCallback)
     : AbstractServer(env, watcherCallback)
     , eventBufferSize(eventBufferSize)
-    , commandTimeoutInMillis(commandTimeoutInMillis) {
-    jclass listClass = env->FindClass("java/util/List");
-    this->listAddMethod = env->GetMethodID(listClass, "add", "(Ljava/lang/Object;)Z");
+    , commandTimeoutInMillis(commandTimeoutInMillis)
+    , useCompletionPort(useCompletionPort) {
 }
 
 void Server::initializeRunLoop() {
+    if (useCompletionPort) {
+        completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+        if (completionPort == NULL) {
+            throw FileWatcherException("Couldn't create completion port", GetLastError());
+        }
+        return;
+    }
+
     // For some reason GetCurrentThread() returns a thread that doesn't accept APCs
     // so we need to use OpenThread() instead.
     threadHandle = OpenThread(
@@ -358,7 +448,11 @@ void Server::shutdownRunLoop() {
 
 void Server::runLoop() {
     while (!shouldTerminate) {
-        SleepEx(INFINITE, true);
+        if (useCompletionPort) {
+            processCompletions(INFINITE);
+        } else {
+            SleepEx(INFINITE, true);
+        }
     }
 
     // We have received termination, cancel all watchers
@@ -375,7 +469,12 @@ void Server::runLoop() {
     }
 
     logToJava(LogLevel::FINE, "Waiting for any pending watch points to abort completely", NULL);
-    SleepEx(0, true);
+    if (useCompletionPort) {
+        while (processCompletions(0)) {
+        }
+    } else {
+        SleepEx(0, true);
+    }
 
     // Warn about  any unfinished watchpoints
     for (auto& it : watchPoints) {
@@ -391,7 +490,51 @@ void Server::runLoop() {
         }
     }
 
-    CloseHandle(threadHandle);
+    CloseHandle(useCompletionPort ? completionPort : threadHandle);
+}
+
+/**
+ * Dequeues a batch of completions and handles them, returns whether anything was dequeued before the timeout.
+ */
+bool Server::processCompletions(DWORD timeoutInMillis) {
+    OVERLAPPED_ENTRY entries[COMPLETION_BATCH_SIZE];
+    ULONG count;
+    if (!GetQueuedCompletionStatusEx(completionPort, entries, COMPLETION_BATCH_SIZE, &count, timeoutInMillis, FALSE)) {
+        DWORD waitError = GetLastError();
+        if (waitError == WAIT_TIMEOUT) {
+            return false;
+        }
+        throw FileWatcherException("Couldn't dequeue completions", waitError);
+    }
+    for (ULONG index = 0; index < count; index++) {
+        handleCompletion(entries[index]);
+    }
+    return count > 0;
+}
+
+void Server::handleCompletion(const OVERLAPPED_ENTRY& entry) {
+    if (entry.lpCompletionKey == COMMAND_COMPLETION_KEY) {
+        Command* command = (Command*) entry.lpOverlapped;
+        command->executeInsideRunLoop();
+        return;
+    }
+
+    auto it = watchPointsByCompletionKey.find(entry.lpCompletionKey);
+    if (it == watchPointsByCompletionKey.end()) {
+        logToJava(LogLevel::FINE, "Ignoring completion for removed watch point (%d bytes)", entry.dwNumberOfBytesTransferred);
+        return;
+    }
+    WatchPoint* watchPoint = it->second;
+    if (watchPoint->status == WatchPointStatus::FINISHED) {
+        logToJava(LogLevel::FINE, "Ignoring completion for finished watch point %s", wideToUtf8String(watchPoint->registeredPath).c_str());
+        return;
+    }
+    // Translate the status of the completed read to the error code a completion routine would receive
+    DWORD bytesTransferred;
+    DWORD errorCode = GetOverlappedResult(watchPoint->directoryHandle, entry.lpOverlapped, &bytesTransferred, FALSE)
+        ? ERROR_SUCCESS
+        : GetLastError();
+    watchPoint->handleEventsInBuffer(errorCode, entry.dwNumberOfBytesTransferred);
 }
 
 static void CALLBACK executeOnRunLoopCallback(_In_ ULONG_PTR info) {
@@ -402,6 +545,12 @@ static void CALLBACK executeOnRunLoopCallback(_In_ ULONG_PTR info) {
 bool Server::executeOnRunLoop(function<bool()> function) {
     Command command(function);
     return command.execute(commandTimeoutInMillis, [this](Command* command) {
+        if (useCompletionPort) {
+            if (!PostQueuedCompletionStatus(completionPort, 0, COMMAND_COMPLETION_KEY, (LPOVERLAPPED) command)) {
+                throw FileWatcherException("Received error while posting command", GetLastError());
+            }
+            return;
+        }
         DWORD ret = QueueUserAPC(executeOnRunLoopCallback, threadHandle, (ULONG_PTR) command);
         if (ret == 0) {
             throw FileWatcherException("Received error while queuing APC", GetLastError());
@@ -418,6 +567,24 @@ void Server::registerPaths(const vector<u16string>& paths) {
     });
 }
 
+vector<string> Server::tryRegisterPaths(const vector<u16string>& paths) {
+    // Register all paths with a single APC round trip
+    auto failures = make_shared<vector<string>>();
+    executeOnRunLoop([this, paths, failures]() {
+        failures->reserve(paths.size());
+        for (auto& path : paths) {
+            try {
+                registerPath(path);
+                failures->emplace_back();
+            } catch (const exception& ex) {
+                failures->emplace_back(ex.what());
+            }
+        }
+        return true;
+    });
+    return *failures;
+}
+
 bool Server::unregisterPaths(const vector<u16string>& paths) {
     return executeOnRunLoop([this, paths]() {
         bool success = true;
@@ -428,12 +595,47 @@ bool Server::unregisterPaths(const vector<u16string>& paths) {
     });
 }
 
+void Server::setWatchedPaths(const vector<u16string>& paths) {
+    // Diff and apply the difference with a single APC round trip
+    executeOnRunLoop([this, paths]() {
+        vector<u16string> pathsToRegister;
+        vector<u16string> pathsToUnregister;
+        diffWatchedPaths(getWatchedPaths(), paths, pathsToRegister, pathsToUnregister);
+        for (auto& path : pathsToUnregister) {
+            unregisterPath(path);
+        }
+        for (auto& path : pathsToRegister) {
+            registerPath(path);
+        }
+        return true;
+    });
+}
+
+vector<u16string> Server::getWatchedPaths() {
+    vector<u16string> paths;
+    paths.reserve(watchPoints.size());
+    for (auto& it : watchPoints) {
+        if (it.second.status == WatchPointStatus::FINISHED) {
+            // Finished watch points get replaced when registering the path again
+            continue;
+        }
+        auto& path = it.first;
+        paths.emplace_back(path.begin(), path.end());
+    }
+    return paths;
+}
+
+size_t Server::getWatchedPathCount() {
+    return watchPointCount;
+}
+
 void Server::registerPath(const u16string& path) {
     wstring registeredPath(path.begin(), path.end());
     auto it = watchPoints.find(registeredPath);
     if (it != watchPoints.end()) {
         if (it->second.status == WatchPointStatus::FINISHED) {
             watchPoints.erase(it);
+            watchPointCount = watchPoints.size();
         } else {
             throw FileWatcherException("Already watching path", path);
         }
@@ -441,6 +643,7 @@ void Server::registerPath(const u16string& path) {
     watchPoints.emplace(piecewise_construct,
         forward_as_tuple(registeredPath),
         forward_as_tuple(this, eventBufferSize, registeredPath));
+    watchPointCount = watchPoints.size();
 }
 
 bool Server::unregisterPath(const u16string& path) {
@@ -449,6 +652,7 @@ bool Server::unregisterPath(const u16string& path) {
         logToJava(LogLevel::INFO, "Path is not watched: %s", wideToUtf8String(registeredPath).c_str());
         return false;
     }
+    watchPointCount = watchPoints.size();
     return true;
 }
 
@@ -459,11 +663,9 @@ void Server::stopWatchingMovedPaths(jobject droppedPaths) {
         if (watchPoint.status == WatchPointStatus::FINISHED) {
             continue;
         }
-        wstring currentFinalPath;
-        bool watchedHandleIsAccessible = resolveFinalPath(watchPoint.directoryHandle, currentFinalPath);
-        if (!watchedHandleIsAccessible || watchPoint.registeredFinalPath != currentFinalPath) {
+        if (!hasFinalPath(watchPoint.directoryHandle, watchPoint.registeredFinalPath)) {
             jstring javaPath = env->NewString((jchar*) wideToUtf16String(watchPoint.registeredPath).c_str(), (jsize) watchPoint.registeredPath.length());
-            env->CallBooleanMethod(droppedPaths, listAddMethod, javaPath);
+            env->CallBooleanMethod(droppedPaths, baseJniConstants->listAddMethod, javaPath);
             env->DeleteLocalRef(javaPath);
             getJavaExceptionAndPrintStacktrace(env);
 
@@ -477,8 +679,8 @@ void Server::stopWatchingMovedPaths(jobject droppedPaths) {
 //
 
 JNIEXPORT jobject JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_WindowsFileEventFunctions_startWatcher0(JNIEnv* env, jclass target, jint eventBufferSize, jlong commandTimeoutInMillis, jobject javaCallback) {
-    return wrapServer(env, new Server(env, eventBufferSize, (long) commandTimeoutInMillis, javaCallback));
+Java_net_rubygrapefruit_platform_internal_jni_WindowsFileEventFunctions_startWatcher0(JNIEnv* env, jclass target, jint eventBufferSize, jlong commandTimeoutInMillis, jboolean useCompletionPort, jobject javaCallback) {
+    return wrapServer(env, new Server(env, eventBufferSize, (long) commandTimeoutInMillis, useCompletionPort, javaCallback));
 }
 
 JNIEXPORT void JNICALL
@@ -0,0 +1,385 @@
+#ifdef _WIN32
+
+#include "win_usn_journal.h"
+
+using namespace std;
+
+#define wideToUtf16String(string) (u16string((string).begin(), (string).end()))
+
+// Final paths resolved via GetFinalPathNameByHandleW() start with \\?\ that registered paths don't have
+static void stripLongPathPrefix(wstring& path) {
+    if (path.compare(0, 4, L"\\\\?\\") == 0) {
+        path.erase(0, 4);
+    }
+}
+
+static void appendName(wstring& path, const wchar_t* name, size_t length) {
+    if (path.empty() || path.back() != L'\\') {
+        // The root directory of the volume already ends with a backslash
+        path.append(1, L'\\');
+    }
+    path.append(name, length);
+}
+
+static bool isDescendantOrSelf(const wstring& path, const wstring& root) {
+    if (path.compare(0, root.length(), root) != 0) {
+        return false;
+    }
+    return path.length() == root.length()
+        || path[root.length()] == L'\\'
+        || (!root.empty() && root.back() == L'\\');
+}
+
+ChangeJournal::ChangeJournal(const wstring& path) {
+    wstring longPath = path;
+    convertToLongPathIfNeeded(longPath);
+    wchar_t buffer[MAX_PATH];
+    if (!GetVolumePathNameW(longPath.c_str(), buffer, MAX_PATH)) {
+        throw FileWatcherException("Couldn't find volume", wideToUtf16String(path), GetLastError());
+    }
+    volumePath = buffer;
+
+    // Use the volume GUID path, so volumes mounted in a folder work, too
+    if (!GetVolumeNameForVolumeMountPointW(volumePath.c_str(), buffer, MAX_PATH)) {
+        throw FileWatcherException("Couldn't find volume name", wideToUtf16String(volumePath), GetLastError());
+    }
+    wstring volumeName = buffer;
+    if (!volumeName.empty() && volumeName.back() == L'\\') {
+        // Without the trailing backslash we open the volume instead of its root directory
+        volumeName.pop_back();
+    }
+    volumeHandle = CreateFileW(
+        volumeName.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL,
+        OPEN_EXISTING,
+        0,
+        NULL);
+    if (volumeHandle == INVALID_HANDLE_VALUE) {
+        throw FileWatcherException("Couldn't open volume", wideToUtf16String(volumePath), GetLastError());
+    }
+}
+
+ChangeJournal::~ChangeJournal() {
+    CloseHandle(volumeHandle);
+}
+
+USN_JOURNAL_DATA_V0 ChangeJournal::query() {
+    USN_JOURNAL_DATA_V0 journal;
+    DWORD bytesReturned;
+    if (!DeviceIoControl(volumeHandle, FSCTL_QUERY_USN_JOURNAL, NULL, 0, &journal, sizeof(journal), &bytesReturned, NULL)) {
+        throw FileWatcherException("Couldn't query change journal", wideToUtf16String(volumePath), GetLastError());
+    }
+    return journal;
+}
+
+bool ChangeJournal::readChangesSince(DWORDLONG journalId, USN startUsn, const vector<wstring>& roots, vector<wstring>& changedPaths, USN& nextUsn) {
+    USN_JOURNAL_DATA_V0 journal = query();
+    if (journal.UsnJournalID != journalId || startUsn < journal.LowestValidUsn || startUsn > journal.NextUsn) {
+        logToJava(LogLevel::INFO, "Changes since USN %lld are not available in change journal of %s anymore",
+            startUsn, wideToUtf8String(volumePath).c_str());
+        return false;
+    }
+
+    unordered_set<wstring> reportedPaths;
+    vector<wstring> finalRoots;
+    finalRoots.reserve(roots.size());
+    for (auto& root : roots) {
+        wstring finalRoot;
+        if (!resolveRoot(root, finalRoot)) {
+            // The root itself is gone, that's a change as well
+            if (reportedPaths.insert(root).second) {
+                changedPaths.push_back(root);
+            }
+        }
+        finalRoots.push_back(move(finalRoot));
+    }
+
+    // First collect where directories have been before they were renamed or deleted,
+    // so that the parents of all records can be resolved in the second pass
+    function<bool(const USN_RECORD_V2*)> collectPreviousLocation = [this](const USN_RECORD_V2* record) {
+        recordPreviousLocation(record);
+        return true;
+    };
+    previousLocations.clear();
+    renamedDirectories.clear();
+    USN scannedUsn;
+    if (!readRecords(journalId, startUsn, journal.NextUsn, collectPreviousLocation, scannedUsn)) {
+        return false;
+    }
+
+    function<bool(const USN_RECORD_V2*)> reportChange = [&](const USN_RECORD_V2* record) {
+        return handleRecord(record, roots, finalRoots, changedPaths, reportedPaths);
+    };
+    return readRecords(journalId, startUsn, journal.NextUsn, reportChange, nextUsn);
+}
+
+bool ChangeJournal::readRecords(DWORDLONG journalId, USN startUsn, USN endUsn, const function<bool(const USN_RECORD_V2*)>& handler, USN& nextUsn) {
+    READ_USN_JOURNAL_DATA_V0 request;
+    request.StartUsn = startUsn;
+    request.ReasonMask = 0xFFFFFFFF;
+    request.ReturnOnlyOnClose = FALSE;
+    request.Timeout = 0;
+    request.BytesToWaitFor = 0;
+    request.UsnJournalID = journalId;
+
+    vector<BYTE> buffer(CHANGE_JOURNAL_BUFFER_SIZE);
+    // Only read up to the position we have queried, so that busy volumes don't keep us here indefinitely
+    while (request.StartUsn < endUsn) {
+        DWORD bytesReturned;
+        if (!DeviceIoControl(volumeHandle, FSCTL_READ_USN_JOURNAL, &request, sizeof(request), buffer.data(), (DWORD) buffer.size(), &bytesReturned, NULL)) {
+            DWORD readError = GetLastError();
+            if (readError == ERROR_JOURNAL_ENTRY_DELETED || readError == ERROR_JOURNAL_DELETE_IN_PROGRESS) {
+                return false;
+            }
+            throw FileWatcherException("Couldn't read change journal", wideToUtf16String(volumePath), readError);
+        }
+        if (bytesReturned < sizeof(USN)) {
+            break;
+        }
+
+        // The buffer starts with the USN to continue reading from, followed by the records
+        USN continueUsn = *(USN*) buffer.data();
+        DWORD offset = sizeof(USN);
+        while (offset < bytesReturned) {
+            const USN_RECORD_V2* record = (const USN_RECORD_V2*) &buffer[offset];
+            if (record->RecordLength == 0) {
+                break;
+            }
+            if (record->MajorVersion == 2 && !handler(record)) {
+                return false;
+            }
+            offset += record->RecordLength;
+        }
+
+        if (continueUsn <= request.StartUsn) {
+            break;
+        }
+        request.StartUsn = continueUsn;
+    }
+    nextUsn = request.StartUsn;
+    return true;
+}
+
+void ChangeJournal::recordPreviousLocation(const USN_RECORD_V2* record) {
+    if (!(record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        || !(record->Reason & (USN_REASON_FILE_DELETE | USN_REASON_RENAME_OLD_NAME))) {
+        return;
+    }
+    const wchar_t* name = (const wchar_t*) ((const BYTE*) record + record->FileNameOffset);
+    // Keep the earliest location, that's where the directory has been for the records preceding its first move
+    PreviousDirectoryLocation location { record->ParentFileReferenceNumber, wstring(name, record->FileNameLength / sizeof(wchar_t)) };
+    previousLocations.emplace(record->FileReferenceNumber, move(location));
+}
+
+bool ChangeJournal::handleRecord(const USN_RECORD_V2* record, const vector<wstring>& roots, const vector<wstring>& finalRoots,
+    vector<wstring>& changedPaths, unordered_set<wstring>& reportedPaths) {
+    wstring changedPath;
+    switch (resolveDirectory(record->ParentFileReferenceNumber, changedPath)) {
+        case DirectoryResolution::RESOLVED:
+            break;
+        case DirectoryResolution::INACCESSIBLE:
+            // Records in directories we can't open, like the metadata directories of the volume, are routine
+            // on a whole volume journal. Even below a root the caller couldn't look into them, so skip them.
+            return true;
+        case DirectoryResolution::UNKNOWN:
+            // We can't tell where the change happened, it might have been below one of the roots
+            logToJava(LogLevel::FINE, "Couldn't resolve parent of change journal record at USN %lld", record->Usn);
+            return false;
+    }
+    const wchar_t* name = (const wchar_t*) ((const BYTE*) record + record->FileNameOffset);
+    appendName(changedPath, name, record->FileNameLength / sizeof(wchar_t));
+
+    if (record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        if (record->Reason & USN_REASON_FILE_DELETE) {
+            directories.erase(record->FileReferenceNumber);
+            renamedDirectories.erase(record->FileReferenceNumber);
+        } else if (record->Reason & USN_REASON_RENAME_OLD_NAME) {
+            renamedDirectories[record->FileReferenceNumber] = changedPath;
+        } else {
+            auto iRenamed = renamedDirectories.find(record->FileReferenceNumber);
+            if (iRenamed != renamedDirectories.end()) {
+                moveCachedDescendants(iRenamed->second, changedPath);
+                renamedDirectories.erase(iRenamed);
+            }
+            directories[record->FileReferenceNumber] = changedPath;
+        }
+    }
+
+    for (size_t index = 0; index < roots.size(); index++) {
+        auto& finalRoot = finalRoots[index];
+        if (finalRoot.empty() || !isDescendantOrSelf(changedPath, finalRoot)) {
+            continue;
+        }
+        // Report the change relative to the root as it has been passed to us
+        wstring reportedPath = roots[index];
+        reportedPath.append(changedPath, finalRoot.length(), wstring::npos);
+        if (reportedPaths.insert(reportedPath).second) {
+            changedPaths.push_back(move(reportedPath));
+        }
+    }
+    return true;
+}
+
+/**
+ * Updates the cached paths of the directories below a renamed directory, so that the records
+ * following the rename are reported at the new location.
+ */
+void ChangeJournal::moveCachedDescendants(const wstring& oldPath, const wstring& newPath) {
+    if (oldPath == newPath) {
+        return;
+    }
+    for (auto& entry : directories) {
+        wstring& path = entry.second;
+        if (path.length() > oldPath.length() && isDescendantOrSelf(path, oldPath)) {
+            path.replace(0, oldPath.length(), newPath);
+        }
+    }
+}
+
+DirectoryResolution ChangeJournal::resolveDirectory(DWORDLONG fileReference, wstring& path) {
+    // Follow the previous locations of moved and deleted directories up to a directory we know or can open
+    vector<const wstring*> names;
+    DWORDLONG current = fileReference;
+    while (true) {
+        auto it = directories.find(current);
+        if (it != directories.end()) {
+            path = it->second;
+            break;
+        }
+        auto iPrevious = previousLocations.find(current);
+        if (iPrevious == previousLocations.end()) {
+            DirectoryResolution resolution = openDirectory(current, path);
+            if (resolution != DirectoryResolution::RESOLVED) {
+                return resolution;
+            }
+            break;
+        }
+        if (names.size() >= previousLocations.size()) {
+            // The chain loops, the records can't be placed consistently
+            return DirectoryResolution::UNKNOWN;
+        }
+        names.push_back(&iPrevious->second.name);
+        current = iPrevious->second.parentFileReference;
+    }
+    for (auto iName = names.rbegin(); iName != names.rend(); ++iName) {
+        appendName(path, (*iName)->c_str(), (*iName)->length());
+    }
+    if (!names.empty()) {
+        directories.emplace(fileReference, path);
+    }
+    return DirectoryResolution::RESOLVED;
+}
+
+DirectoryResolution ChangeJournal::openDirectory(DWORDLONG fileReference, wstring& path) {
+    FILE_ID_DESCRIPTOR descriptor;
+    descriptor.dwSize = sizeof(descriptor);
+    descriptor.Type = FileIdType;
+    descriptor.FileId.QuadPart = (LONGLONG) fileReference;
+    HANDLE handle = OpenFileById(volumeHandle, &descriptor, 0, CREATE_SHARE, NULL, FILE_FLAG_BACKUP_SEMANTICS);
+    if (handle == INVALID_HANDLE_VALUE) {
+        DWORD openError = GetLastError();
+        return openError == ERROR_ACCESS_DENIED || openError == ERROR_CANT_ACCESS_FILE
+            ? DirectoryResolution::INACCESSIBLE
+            : DirectoryResolution::UNKNOWN;
+    }
+    bool resolved = resolveFinalPath(handle, path);
+    CloseHandle(handle);
+    if (!resolved) {
+        return DirectoryResolution::UNKNOWN;
+    }
+    stripLongPathPrefix(path);
+    directories.emplace(fileReference, path);
+    return DirectoryResolution::RESOLVED;
+}
+
+bool ChangeJournal::resolveRoot(const wstring& root, wstring& finalRoot) {
+    wstring longPath = root;
+    convertToLongPathIfNeeded(longPath);
+    HANDLE handle = CreateFileW(longPath.c_str(), 0, CREATE_SHARE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    bool resolved = GetFileInformationByHandle(handle, &info)
+        && resolveFinalPath(handle, finalRoot);
+    CloseHandle(handle);
+    if (!resolved) {
+        finalRoot.clear();
+        return false;
+    }
+    stripLongPathPrefix(finalRoot);
+    // Seed the cache, so that changes directly inside the root are resolved without opening it again
+    DWORDLONG fileReference = (((DWORDLONG) info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    directories.emplace(fileReference, finalRoot);
+    return true;
+}
+
+//
+// JNI calls
+//
+
+JNIEXPORT jobject JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_WindowsFileEventFunctions_getChangeJournalPosition0(JNIEnv* env, jclass, jstring javaPath) {
+    try {
+        u16string path = javaToUtf16String(env, javaPath);
+        ChangeJournal journal(wstring(path.begin(), path.end()));
+        USN_JOURNAL_DATA_V0 data = journal.query();
+
+        const wstring& volumePath = journal.getVolumePath();
+        jstring javaVolumePath = env->NewString((jchar*) wideToUtf16String(volumePath).c_str(), (jsize) volumePath.length());
+        rethrowWhenNotAllocated(env, javaVolumePath);
+        jobject position = env->NewObject(
+            windowsJniConstants->changeJournalPositionClass.get(),
+            windowsJniConstants->changeJournalPositionConstructor,
+            javaVolumePath, (jlong) data.UsnJournalID, (jlong) data.NextUsn);
+        env->DeleteLocalRef(javaVolumePath);
+        rethrowWhenNotAllocated(env, position);
+        return position;
+    } catch (const exception& e) {
+        return rethrowAsJavaException(env, e);
+    }
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_WindowsFileEventFunctions_readChangeJournal0(JNIEnv* env, jclass, jstring javaVolumePath, jlong journalId, jlong startUsn, jobjectArray javaRoots, jobject javaChangedPaths) {
+    try {
+        u16string volumePath = javaToUtf16String(env, javaVolumePath);
+        vector<u16string> rootPaths;
+        javaToUtf16StringArray(env, javaRoots, rootPaths);
+        vector<wstring> roots;
+        roots.reserve(rootPaths.size());
+        for (auto& root : rootPaths) {
+            roots.emplace_back(root.begin(), root.end());
+        }
+
+        ChangeJournal journal(wstring(volumePath.begin(), volumePath.end()));
+        vector<wstring> changedPaths;
+        USN nextUsn;
+        if (!journal.readChangesSince((DWORDLONG) journalId, (USN) startUsn, roots, changedPaths, nextUsn)) {
+            return -1;
+        }
+
+        // The caller only advances its position past the changes when all of them have been received
+        for (auto& changedPath : changedPaths) {
+            jstring javaPath = env->NewString((jchar*) wideToUtf16String(changedPath).c_str(), (jsize) changedPath.length());
+            rethrowWhenNotAllocated(env, javaPath);
+            env->CallBooleanMethod(javaChangedPaths, baseJniConstants->listAddMethod, javaPath);
+            env->DeleteLocalRef(javaPath);
+            JniSupport::rethrowJavaException(env);
+        }
+        return (jlong) nextUsn;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return -1;
+    }
+}
+
+WindowsJniConstants::WindowsJniConstants(JavaVM* jvm)
+    : JniSupport(jvm)
+    , changeJournalPositionClass(getThreadEnv(), "net/rubygrapefruit/platform/internal/jni/WindowsFileEventFunctions$ChangeJournalPosition")
+    , changeJournalPositionConstructor(getThreadEnv()->GetMethodID(changeJournalPositionClass.get(), "<init>", "(Ljava/lang/String;JJ)V")) {
+}
+
+#endif
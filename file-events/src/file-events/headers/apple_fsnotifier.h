@@ -3,10 +3,15 @@
 #if defined(__APPLE__)
 
 #include <CoreServices/CoreServices.h>
+#include <condition_variable>
+#include <dispatch/dispatch.h>
+#include <functional>
+#include <memory>
 #include <unordered_map>
 
 #include "generic_fsnotifier.h"
 #include "net_rubygrapefruit_platform_internal_jni_OsxFileEventFunctions.h"
+#include "net_rubygrapefruit_platform_internal_jni_OsxFileEventFunctions_OsxFileWatcher.h"
 
 using namespace std;
 
@@ -20,30 +25,94 @@ static void handleEventsCallback(
     const FSEventStreamEventFlags eventFlags[],
     const FSEventStreamEventId*);
 
+/**
+ * Watch points by the lower case prefixes of the event paths that belong to them, mapped to the
+ * event ID at the time of registration.
+ */
+typedef unordered_map<string, FSEventStreamEventId> EventRoutes;
+
+/**
+ * Returns the UUID of the FSEvents database for the device the path is on, or an empty string if there's none.
+ */
+string getDeviceUuid(const string& path);
+
 class WatchPoint {
 public:
-    WatchPoint(Server* server, CFRunLoopRef runLoop, const u16string& path, long latencyInMillis);
-    ~WatchPoint();
+    WatchPoint(const u16string& path, FSEventStreamEventId registrationEventId);
+
+private:
+    /**
+     * Events with IDs up to this one happened before the path has been registered.
+     *
+     * When the event stream is rebuilt it replays events since the last one received,
+     * so we need to drop the events that the watch point shouldn't see.
+     */
+    const FSEventStreamEventId registrationEventId;
+
+    /**
+     * Paths events belonging to this watch point can be reported under, in lower case.
+     *
+     * FSEvents reports the real path of the changed files, which can differ in case and symlinks
+     * from the registered path.
+     */
+    vector<string> routes;
+
+    friend class Server;
+};
+
+/**
+ * A single FSEvents stream covering all watched paths.
+ */
+class EventStream {
+public:
+    /**
+     * Schedules the stream on the given dispatch queue, or on the given run loop when the queue is NULL.
+     */
+    EventStream(Server* server, CFRunLoopRef runLoop, dispatch_queue_t dispatchQueue, const vector<u16string>& paths, FSEventStreamEventId sinceWhen, long latencyInMillis);
+    ~EventStream();
 
 private:
-    FSEventStreamRef watcherStream;
+    FSEventStreamRef stream;
 };
 
 class Server : public AbstractServer {
 public:
-    Server(JNIEnv* env, jobject watcherCallback, long latencyInMillis);
+    Server(JNIEnv* env, jobject watcherCallback, long latencyInMillis, FSEventStreamEventId historyEventId, const string& historyDeviceUuid, bool useDispatchQueue);
+    ~Server() override;
+
+    FSEventStreamEventId getLastEventId() {
+        return lastEventId;
+    }
 
     virtual void registerPaths(const vector<u16string>& paths) override;
+    virtual vector<string> tryRegisterPaths(const vector<u16string>& paths) override;
     virtual bool unregisterPaths(const vector<u16string>& paths) override;
+    virtual void setWatchedPaths(const vector<u16string>& paths) override;
 
 protected:
     void initializeRunLoop() override;
     void runLoop() override;
 
     void shutdownRunLoop() override;
+    vector<u16string> getWatchedPaths() override;
+    size_t getWatchedPathCount() override;
 
 private:
-    void handleEvent(JNIEnv* env, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId);
+    void registerPath(const u16string& path);
+    bool unregisterPath(const u16string& path);
+    void updateEventStream();
+    void reportPathsWithoutHistory(JNIEnv* env);
+
+    /**
+     * Executes a mutation of the watched paths, on the dispatch queue if we use one,
+     * otherwise while holding the mutation mutex. Mutations requested while already on
+     * the dispatch queue are executed inline.
+     */
+    void executeMutation(function<void()> mutation);
+    JNIEnv* getDispatchThreadEnv();
+    static bool isRouted(const EventRoutes& routes, const char* path, FSEventStreamEventId eventId);
+
+    void handleEvent(JNIEnv* env, const EventRoutes& routes, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId);
     void handleEvents(
         size_t numEvents,
         char** eventPaths,
@@ -62,8 +131,57 @@ private:
     recursive_mutex mutationMutex;
     unordered_map<u16string, WatchPoint> watchPoints;
 
-    CFRunLoopRef threadLoop;
-    CFRunLoopSourceRef messageSource;
+    /**
+     * Size of watchPoints, so that statistics can be read without taking the mutation lock.
+     */
+    atomic<size_t> watchPointCount { 0 };
+
+    unique_ptr<EventStream> eventStream;
+
+    /**
+     * Snapshot of the routes of the current watch points, replaced when the event stream is rebuilt.
+     * Accessed via atomic_load() and atomic_store() so that handling events doesn't need to lock.
+     */
+    shared_ptr<const EventRoutes> eventRoutes;
+
+    /**
+     * The ID of the last event received, or the current event ID when the first stream has been created.
+     */
+    atomic<FSEventStreamEventId> lastEventId { 0 };
+
+    /**
+     * The event ID to replay history from for the paths registered with the first stream, or 0 to start from now.
+     */
+    FSEventStreamEventId historyEventId;
+
+    /**
+     * The UUID of the FSEvents database the history event ID belongs to.
+     * Event IDs are only meaningful for paths on devices with the same UUID.
+     */
+    const string historyDeviceUuid;
+
+    /**
+     * Paths registered for replaying history that don't have the history available,
+     * reported as overflown when the history is done so that they get rescanned.
+     */
+    mutex historyMutex;
+    vector<u16string> pathsWithoutHistory;
+
+    CFRunLoopRef threadLoop = NULL;
+    CFRunLoopSourceRef messageSource = NULL;
+
+    /**
+     * Serial queue events are handled and mutations are executed on instead of the run loop, or NULL.
+     * Each watcher has its own queue.
+     */
+    dispatch_queue_t dispatchQueue = NULL;
+
+    /**
+     * When using a dispatch queue the run loop thread only waits for the server to be shut down.
+     */
+    mutex shutdownMutex;
+    condition_variable shutdownVariable;
+    bool shutdownRequested = false;
 };
 
 #endif
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <exception>
 #include <iostream>
 #include <memory>
@@ -9,6 +11,8 @@
 #include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "exception.h"
@@ -27,13 +31,60 @@ enum class ChangeType {
     INVALIDATED
 };
 
+// Corresponds to the indexes used by FileWatcherStatistics
+enum class Statistic {
+    EVENTS_RECEIVED,
+    BYTES_RECEIVED,
+    EVENT_BATCHES_RECEIVED,
+    // Change events reported in the order of ChangeType
+    CREATED_EVENTS_REPORTED,
+    REMOVED_EVENTS_REPORTED,
+    MODIFIED_EVENTS_REPORTED,
+    INVALIDATED_EVENTS_REPORTED,
+    UNKNOWN_EVENTS_REPORTED,
+    OVERFLOWS_REPORTED,
+    FAILURES_REPORTED,
+    CALLBACKS,
+    CALLBACK_NANOS,
+    // Histogram of callback durations, each bucket is ten times as wide as the previous one
+    CALLBACKS_UNDER_10_MICROS,
+    CALLBACKS_UNDER_100_MICROS,
+    CALLBACKS_UNDER_1_MILLI,
+    CALLBACKS_UNDER_10_MILLIS,
+    CALLBACKS_UNDER_100_MILLIS,
+    CALLBACKS_OVER_100_MILLIS,
+    COMMANDS,
+    COMMAND_NANOS,
+    COMMAND_MAX_NANOS,
+    WATCHED_PATHS,
+    COUNT
+};
+
 #define IS_SET(flags, mask) (((flags) & (mask)) != 0)
 
+// Maximum number of change events to buffer before handing them over to Java
+#define CHANGE_EVENT_BATCH_SIZE 1024
+
 struct InsufficientResourcesFileWatcherException : public FileWatcherException {
 public:
     InsufficientResourcesFileWatcherException(const string& message);
 };
 
+/**
+ * Indexes of the pending change events of a path, used when coalescing.
+ */
+struct PendingChangeIndices {
+    /**
+     * The latest pending event.
+     */
+    size_t latest;
+
+    /**
+     * The pending removal still reported, or SIZE_MAX if there's none.
+     */
+    size_t removal;
+};
+
 class AbstractServer;
 
 AbstractServer* getServer(JNIEnv* env, jobject javaServer);
@@ -51,11 +102,24 @@ public:
      */
     virtual void registerPaths(const vector<u16string>& paths) = 0;
 
+    /**
+     * Registers new watch points with the server for the given paths, carrying on when some of them fail.
+     * Returns the failure message for each path in order, or an empty string if the path has been registered.
+     * The default implementation registers the paths one by one.
+     */
+    virtual vector<string> tryRegisterPaths(const vector<u16string>& paths);
+
     /**
      * Unregisters watch points with the server for the given paths.
      */
     virtual bool unregisterPaths(const vector<u16string>& paths) = 0;
 
+    /**
+     * Updates the server to watch exactly the given paths, only registering and unregistering
+     * the difference to the currently watched paths.
+     */
+    virtual void setWatchedPaths(const vector<u16string>& paths);
+
     /**
      * Shuts the server down.
      */
@@ -66,12 +130,72 @@ public:
      */
     bool awaitTermination(long timeoutInMillis);
 
+    /**
+     * Returns a snapshot of the statistics collected by the server, indexed by Statistic.
+     */
+    virtual vector<uint64_t> getStatistics();
+
+    /**
+     * Records the time it took to execute a command (registering or unregistering paths) that started at the given time.
+     */
+    void recordCommandDuration(chrono::steady_clock::time_point start);
+
 protected:
     virtual void runLoop() = 0;
 
+    /**
+     * Returns the paths currently registered with the server.
+     */
+    virtual vector<u16string> getWatchedPaths() = 0;
+
+    /**
+     * Returns the number of paths currently registered with the server.
+     * Must be safe to call from any thread.
+     */
+    virtual size_t getWatchedPathCount() = 0;
+
+    /**
+     * Records events received from the operating system in a single read, completion or callback.
+     */
+    void recordEventsReceived(size_t eventCount, size_t byteCount);
+
+    /**
+     * Computes which paths need to be registered and which need to be unregistered to go from
+     * watching the watched paths to watching the desired paths.
+     */
+    static void diffWatchedPaths(const vector<u16string>& watchedPaths, const vector<u16string>& desiredPaths,
+        vector<u16string>& pathsToRegister, vector<u16string>& pathsToUnregister);
+
+    /**
+     * Returns the paths that are not descendants of any other of the given paths.
+     */
+    static vector<u16string> findRootPaths(const vector<u16string>& paths);
+
+    /**
+     * Buffers a change event to be reported to Java with the next call to flushChangeEvents().
+     */
     void reportChangeEvent(JNIEnv* env, ChangeType type, const u16string& path);
+
+    /**
+     * Reports all buffered change events to Java in a single call.
+     * Other kinds of events report the buffered changes first to preserve their ordering.
+     */
+    void flushChangeEvents(JNIEnv* env);
+
+    /**
+     * Like flushChangeEvents(), but logs failures instead of throwing them.
+     * For reporting from OS callbacks, which exceptions must not escape.
+     */
+    void flushChangeEventsReportingFailures(JNIEnv* env);
+
     void reportUnknownEvent(JNIEnv* env, const u16string& path);
     void reportOverflow(JNIEnv* env, const u16string& path);
+
+    /**
+     * Reports a single overflow affecting the given paths, or all watched paths when empty,
+     * instead of one overflow per path.
+     */
+    void reportOverflow(JNIEnv* env, const vector<u16string>& paths);
     void reportFailure(JNIEnv* env, const exception& ex);
     void reportTermination(JNIEnv* env);
 
@@ -80,12 +204,47 @@ private:
     condition_variable terminationVariable;
     bool terminated = false;
 
+    void incrementStatistic(Statistic statistic, uint64_t delta = 1);
+    void recordCallbackDuration(chrono::steady_clock::time_point start);
+
+    /**
+     * Counters updated from the run loop and read from any thread, indexed by Statistic.
+     */
+    atomic<uint64_t> statistics[static_cast<size_t>(Statistic::COUNT)];
+
+    bool coalesceChangeEvent(ChangeType type, const u16string& path);
+    void supersedePendingChangeEvent(size_t index);
+    void removeCoalescedChangeEvents();
+    void reportChangeEventsAsArrays(JNIEnv* env, size_t from, size_t to);
+    void reportChangeEventsInSharedBuffer(JNIEnv* env);
+
+    vector<jint> pendingChangeTypes;
+    vector<u16string> pendingChangePaths;
+
+    /**
+     * Whether to coalesce repeated change events for the same path within a batch.
+     */
+    bool coalesceChangeEvents;
+
+    /**
+     * Indexes of the pending change events for each path, used when coalescing.
+     */
+    unordered_map<u16string, PendingChangeIndices> pendingChangeIndices;
+
+    /**
+     * Number of pending change events that have been superseded by a later event.
+     */
+    size_t supersededPendingChangeCount = 0;
+
     JniGlobalRef<jobject> watcherCallback;
-    jmethodID watcherReportChangeEventMethod;
-    jmethodID watcherReportUnknownEventMethod;
-    jmethodID watcherReportOverflowMethod;
-    jmethodID watcherReportFailureMethod;
-    jmethodID watcherReportTerminationMethod;
+
+    /**
+     * Direct buffer shared with NativeFileWatcherCallback to pass encoded change events
+     * without creating Java strings on the native side, or nullptr if not enabled.
+     * The buffer is kept alive by the callback object.
+     */
+    uint8_t* sharedEventBuffer;
+    size_t sharedEventBufferCapacity;
 };
 
 class NativePlatformJniConstants : public JniSupport {
@@ -93,6 +252,18 @@ public:
     NativePlatformJniConstants(JavaVM* jvm);
 
     const JClass nativeExceptionClass;
+    const JClass nativeFileWatcherCallbackClass;
+
+    const jmethodID nativeExceptionConstructor;
+    const jmethodID watcherReportChangeEventsMethod;
+    const jmethodID watcherReportEncodedChangeEventsMethod;
+    const jmethodID watcherReportUnknownEventMethod;
+    const jmethodID watcherReportOverflowMethod;
+    const jmethodID watcherReportOverflowsMethod;
+    const jmethodID watcherReportFailureMethod;
+    const jmethodID watcherReportTerminationMethod;
+    const jmethodID watcherIsCoalescingChangeEventsMethod;
+    const jmethodID watcherGetSharedEventBufferMethod;
 };
 
 extern NativePlatformJniConstants* nativePlatformJniConstants;
@@ -101,3 +272,9 @@ jobject wrapServer(JNIEnv* env, AbstractServer* server);
 
 jobject rethrowAsJavaException(JNIEnv* env, const exception& e);
 jobject rethrowAsJavaException(JNIEnv* env, const exception& e, jclass exceptionClass);
+
+/**
+ * Bails out with the pending Java exception, usually an OutOfMemoryError, when JNI couldn't allocate an object.
+ * Deletes the given local reference first, if any.
+ */
+void rethrowWhenNotAllocated(JNIEnv* env, jobject object, jobject localRefToDelete = nullptr);
@@ -7,19 +7,6 @@
 
 using namespace std;
 
-// Utility wrapper to adapt locale-bound facets for wstring convert
-// Exposes the protected destructor as public
-// See https://en.cppreference.com/w/cpp/locale/codecvt
-template <class Facet>
-struct deletable_facet : Facet {
-    template <class... Args>
-    deletable_facet(Args&&... args)
-        : Facet(forward<Args>(args)...) {
-    }
-    ~deletable_facet() {
-    }
-};
-
 template <typename T>
 class JniGlobalRef;
 
@@ -96,6 +83,13 @@ public:
     BaseJniConstants(JavaVM* jvm);
 
     const JClass classClass;
+    const JClass stringClass;
+    const JClass throwableClass;
+    const JClass listClass;
+
+    const jmethodID classGetNameMethod;
+    const jmethodID throwableGetMessageMethod;
+    const jmethodID listAddMethod;
 };
 
 extern BaseJniConstants* baseJniConstants;
@@ -106,6 +100,11 @@ extern u16string javaToUtf16String(JNIEnv* env, jstring javaString);
 
 extern void javaToUtf16StringArray(JNIEnv* env, jobjectArray javaStrings, vector<u16string>& strings);
 
+// Conversions throw range_error on malformed input, ASCII runs are copied without decoding each char
 extern u16string utf8ToUtf16String(const char* string);
 
+extern void appendUtf8ToUtf16String(u16string& target, const char* string, size_t length);
+
 extern string utf16ToUtf8String(const u16string& string);
+
+extern void appendUtf16ToUtf8String(string& target, const char16_t* string, size_t length);
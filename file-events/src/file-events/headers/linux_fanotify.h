@@ -0,0 +1,192 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <sys/fanotify.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <memory>
+#include <unordered_map>
+
+#include "generic_fsnotifier.h"
+#include "linux_fsnotifier.h"
+
+using namespace std;
+
+// FAN_REPORT_DFID_NAME has been introduced in Linux 5.9
+#ifdef FAN_REPORT_DFID_NAME
+#define FANOTIFY_SUPPORTED
+#endif
+
+/**
+ * Thrown when fanotify cannot be used on this system, e.g. because the kernel is too old
+ * or because the process isn't privileged enough to place filesystem marks.
+ */
+struct FanotifyUnavailableException : public FileWatcherException {
+public:
+    FanotifyUnavailableException(const string& message, int errorCode);
+};
+
+#ifdef FANOTIFY_SUPPORTED
+
+struct Fanotify {
+    Fanotify();
+    ~Fanotify();
+
+    const int fd;
+};
+
+/**
+ * A filesystem we have placed a mark on, shared by all watch points on that filesystem.
+ */
+struct FanotifyFilesystem {
+    FanotifyFilesystem(int mountFd);
+    ~FanotifyFilesystem();
+
+    /**
+     * Descriptor of a directory on the filesystem, used to resolve file handles.
+     */
+    const int mountFd;
+    int watchPointCount = 0;
+};
+
+class FanotifyWatchPoint {
+public:
+    FanotifyWatchPoint(const u16string& path, const string& canonicalPath, uint64_t fsid, ino_t inode);
+
+private:
+    const u16string path;
+
+    /**
+     * The path with all symlinks resolved, which is what directories of events resolve to.
+     */
+    const string canonicalPath;
+    const uint64_t fsid;
+    const ino_t inode;
+
+    friend class FanotifyServer;
+};
+
+/**
+ * A directory we received events for, resolved from its file handle.
+ */
+struct FanotifyDirectory {
+    /**
+     * The canonical path of the directory, empty if it couldn't be resolved.
+     */
+    string canonicalPath;
+
+    /**
+     * The directory as seen from each of the watch points it is in, empty if it isn't watched.
+     */
+    vector<u16string> watchedPaths;
+
+    /**
+     * Whether any of the watch points is an entry of the directory.
+     */
+    bool containsWatchPoints = false;
+};
+
+/**
+ * Watches whole hierarchies with a single fanotify filesystem mark per filesystem.
+ *
+ * Events are reported with the file handle of the parent directory and the name of the entry,
+ * which we resolve to a canonical path and match against the canonical paths of the registered watch points.
+ * The changes are reported relative to the paths as they have been registered.
+ * Unlike the inotify-based server, changes to all descendants of the watched paths are reported.
+ *
+ * Whether fanotify can be used is determined with the filesystem of the first registered path.
+ * If it cannot place a filesystem mark there, the server hands over to an inotify-based one for good.
+ */
+class FanotifyServer : public AbstractServer {
+public:
+    FanotifyServer(JNIEnv* env, jobject watcherCallback, bool reconcileOverflows);
+
+    // List<String> absolutePathsToCheck, List<String> droppedPaths
+    void stopWatchingMovedPaths(jobjectArray absolutePathsToCheck, jobject droppedPaths);
+
+    virtual void registerPaths(const vector<u16string>& paths) override;
+    virtual vector<string> tryRegisterPaths(const vector<u16string>& paths) override;
+    virtual bool unregisterPaths(const vector<u16string>& paths) override;
+    virtual void setWatchedPaths(const vector<u16string>& paths) override;
+    virtual vector<uint64_t> getStatistics() override;
+
+    /**
+     * Whether the server has fallen back to inotify, and thus only reports changes to the immediate children of the watched paths.
+     */
+    bool isUsingInotify();
+
+protected:
+    void initializeRunLoop() override;
+    void runLoop() override;
+    void shutdownRunLoop() override;
+    vector<u16string> getWatchedPaths() override;
+    size_t getWatchedPathCount() override;
+
+private:
+    void processQueues(int timeout);
+    void handleEvents();
+    void handleEvent(JNIEnv* env, const fanotify_event_metadata* event);
+    const FanotifyDirectory& resolveDirectory(const fanotify_event_info_fid* fid);
+    void findWatchedPaths(FanotifyDirectory& directory);
+    void reportEvent(JNIEnv* env, uint64_t mask, const u16string& path);
+
+    void registerPath(const u16string& path);
+    bool unregisterPath(const u16string& path);
+    void fallBackToInotify(const u16string& path, int errorCode);
+
+    recursive_mutex mutationMutex;
+    unordered_map<u16string, FanotifyWatchPoint> watchPoints;
+
+    /**
+     * Size of watchPoints, so that statistics can be read without taking the mutation lock.
+     */
+    atomic<size_t> watchPointCount { 0 };
+
+    unordered_map<uint64_t, FanotifyFilesystem> filesystems;
+
+    /**
+     * Registered paths by their canonical path.
+     */
+    unordered_map<string, vector<u16string>> watchRoots;
+
+    /**
+     * Number of watch points in each directory, by the canonical path of the directory.
+     */
+    unordered_map<string, size_t> watchRootParents;
+
+    /**
+     * Directories resolved from events, keyed by file handle, so that events for unrelated directories
+     * only need to be resolved once. Cleared when directories get moved, and when the watch points change.
+     */
+    unordered_map<string, FanotifyDirectory> resolvedDirectories;
+    const Fanotify fanotify;
+
+    /**
+     * Whether a filesystem mark has been placed, which proves that fanotify is usable.
+     */
+    bool fanotifyUsable = false;
+    const bool reconcileOverflows;
+    JniGlobalRef<jobject> callback;
+
+    /**
+     * The server handling all watch points after falling back to inotify.
+     */
+    unique_ptr<Server> inotifyServer;
+
+    /**
+     * Published copy of inotifyServer, so that statistics can be read without taking the mutation lock.
+     */
+    atomic<Server*> publishedInotifyServer { nullptr };
+
+    bool shutdownRequested = false;
+    const ShutdownEvent shutdownEvent;
+    const Epoll epoll;
+    bool shouldTerminate = false;
+    vector<uint8_t> buffer;
+};
+
+#endif
+
+#endif
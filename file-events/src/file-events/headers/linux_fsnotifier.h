@@ -2,7 +2,7 @@
 
 #ifdef __linux__
 
-#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <sys/inotify.h>
 #include <sys/stat.h>
@@ -43,6 +43,31 @@ struct ShutdownEvent {
     const int fd;
 };
 
+/**
+ * Multiplexes the notification and shutdown descriptors serviced by a single run loop thread.
+ */
+struct Epoll {
+    Epoll();
+    ~Epoll();
+
+    void add(int fd) const;
+
+    /**
+     * Waits for any of the added descriptors to become readable, and returns the number of ready events.
+     */
+    int wait(epoll_event* events, int maxEvents, int timeout) const;
+
+    const int fd;
+};
+
+/**
+ * Reads queued events from a notification descriptor in a single call, growing the buffer to fit the amount
+ * of data the kernel reports as available via FIONREAD, up to a limit.
+ * Returns the number of bytes read, or 0 if nothing was available; moreAvailable is set if
+ * the buffer could not take all queued events.
+ */
+ssize_t readAvailableEvents(int fd, vector<uint8_t>& buffer, const char* source, bool& moreAvailable);
+
 enum class WatchPointStatus {
     /**
      * The watch point is listening, expect events to arrive.
@@ -72,6 +97,25 @@ enum class CancelResult {
     ALREADY_CANCELLED
 };
 
+/**
+ * State of a directory entry, recorded to find the changes lost by an overflow.
+ */
+struct EntrySnapshot {
+    ino_t inode;
+    int64_t modifiedNanos;
+    off_t size;
+};
+
+/**
+ * Entries of a watched directory by name.
+ */
+typedef unordered_map<string, EntrySnapshot> DirectorySnapshot;
+
+/**
+ * Records the entries of the given directory. Returns false and sets errno on failure.
+ */
+bool snapshotDirectory(const string& path, DirectorySnapshot& snapshot);
+
 class WatchPoint {
 public:
     WatchPoint(const u16string& path, const shared_ptr<Inotify> inotify, int watchDescriptor, ino_t inode);
@@ -85,28 +129,45 @@ private:
     const u16string path;
     const ino_t inode;
 
+    /**
+     * The entries of the directory, only maintained when reconciling overflows.
+     */
+    DirectorySnapshot snapshot;
+
     friend class Server;
 };
 
 class Server : public AbstractServer {
 public:
-    Server(JNIEnv* env, jobject watcherCallback);
+    Server(JNIEnv* env, jobject watcherCallback, bool reconcileOverflows);
 
     // List<String> absolutePathsToCheck, List<String> droppedPaths
     void stopWatchingMovedPaths(jobjectArray absolutePathsToCheck, jobject droppedPaths);
 
     virtual void registerPaths(const vector<u16string>& paths) override;
+    virtual vector<string> tryRegisterPaths(const vector<u16string>& paths) override;
     virtual bool unregisterPaths(const vector<u16string>& paths) override;
+    virtual void setWatchedPaths(const vector<u16string>& paths) override;
 
 protected:
     void initializeRunLoop() override;
     void runLoop() override;
     void shutdownRunLoop() override;
+    vector<u16string> getWatchedPaths() override;
+    size_t getWatchedPathCount() override;
 
 private:
     void processQueues(int timeout);
     void handleEvents();
     void handleEvent(JNIEnv* env, const inotify_event* event);
+    void handleOverflow(JNIEnv* env);
+
+    /**
+     * Rescans the directory of the watch point, and reports the differences to its snapshot as change events.
+     * Returns false if the directory couldn't be scanned.
+     */
+    bool reconcile(JNIEnv* env, WatchPoint& watchPoint);
+    void updateSnapshot(WatchPoint& watchPoint, const char* name);
 
     void registerPath(const u16string& path);
     bool unregisterPath(const u16string& path);
@@ -115,13 +176,33 @@ private:
 
     recursive_mutex mutationMutex;
     unordered_map<u16string, WatchPoint> watchPoints;
-    unordered_map<int, u16string> watchRoots;
+
+    /**
+     * Size of watchPoints, so that statistics can be read without taking the mutation lock.
+     */
+    atomic<size_t> watchPointCount { 0 };
+
+    /**
+     * When set, watch points keep a snapshot of their entries, and overflows are recovered from
+     * by rescanning the watched directories instead of being reported to Java.
+     */
+    const bool reconcileOverflows;
+
+    /**
+     * Watch points by watch descriptor, pointing into watchPoints so that handling an event
+     * does not need to hash the path. Elements of unordered_map are never relocated.
+     */
+    unordered_map<int, WatchPoint*> watchRoots;
     unordered_map<int, u16string> recentlyUnregisteredWatchRoots;
     const shared_ptr<Inotify> inotify;
     const ShutdownEvent shutdownEvent;
+    const Epoll epoll;
     bool shouldTerminate = false;
     vector<uint8_t> buffer;
-    jmethodID listAddMethod;
+    u16string eventPath;
+
+    // Runs this server when fanotify is not usable
+    friend class FanotifyServer;
 };
 
 class LinuxJniConstants : public JniSupport {
@@ -1,12 +1,20 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdarg>
 #include <jni.h>
+#include <memory>
 
 #include "jni_support.h"
 
 #define LOG_LEVEL_CHECK_INTERVAL_IN_MS 1000
 
+// Number of records the asynchronous log queue can hold, must be a power of two
+#define LOG_QUEUE_CAPACITY 1024
+
+#define LOG_MESSAGE_MAX_LENGTH 1024
+
 enum class LogLevel : int {
     ALL,
     FINEST,
@@ -19,6 +27,37 @@ enum class LogLevel : int {
     OFF
 };
 
+/**
+ * Bounded queue of formatted log records, based on Dmitry Vyukov's bounded MPMC queue.
+ * Any number of threads can offer records without ever blocking; a single thread polls them.
+ */
+class LogQueue {
+public:
+    LogQueue();
+
+    /**
+     * Formats and enqueues the record, returns false if the queue is full.
+     */
+    bool offer(LogLevel level, const char* fmt, va_list args);
+
+    /**
+     * Dequeues the oldest record into message (of at least LOG_MESSAGE_MAX_LENGTH bytes),
+     * returns false if the queue is empty.
+     */
+    bool poll(LogLevel& level, char* message);
+
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        LogLevel level;
+        char message[LOG_MESSAGE_MAX_LENGTH];
+    };
+
+    unique_ptr<Cell[]> cells;
+    atomic<size_t> enqueuePosition;
+    atomic<size_t> dequeuePosition;
+};
+
 class Logging : public JniSupport {
 public:
     Logging(JavaVM* jvm);
@@ -27,8 +66,31 @@ public:
     bool enabled(LogLevel level);
     void send(LogLevel level, const char* fmt, ...);
 
+    /**
+     * In asynchronous mode messages are queued, and sent to Java by a Java thread regularly calling drain().
+     * The minimum log level is then also refreshed by drain(), so that checking it never calls into Java.
+     * The queue is only allocated when asynchronous mode is first enabled.
+     *
+     * When switching back, waits for threads still queueing a message and then drains the queue, so no message is left behind.
+     */
+    void setAsynchronous(JNIEnv* env, bool asynchronous);
+
+    /**
+     * Sends all queued messages to Java and refreshes the minimum log level.
+     */
+    void drain(JNIEnv* env);
+
 private:
-    int minimumLogLevel;
+    void refreshLogLevel(JNIEnv* env);
+    void sendToJava(JNIEnv* env, LogLevel level, const char* message);
+
+    atomic<int> minimumLogLevel;
+    atomic<bool> asynchronous;
+    // Number of threads currently in send() that may be offering a message to the queue
+    atomic<int> queueingSenders;
+    atomic<uint64_t> droppedMessages;
+    // Only replaced by setAsynchronous() while asynchronous mode is off, and kept once allocated
+    unique_ptr<LogQueue> queue;
     const JClass clsLogger;
     const jmethodID logMethod;
     const jmethodID getLevelMethod;
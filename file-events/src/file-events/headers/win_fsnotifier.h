@@ -22,6 +22,16 @@ using namespace std;
 
 #define EVENT_MASK (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE)
 
+// Completion key used to post commands to the completion port, watch points use keys above it
+#define COMMAND_COMPLETION_KEY ((ULONG_PTR) 1)
+
+// Maximum number of completions dequeued with a single GetQueuedCompletionStatusEx() call
+#define COMPLETION_BATCH_SIZE 64
+
+string wideToUtf8String(const wstring& string);
+void convertToLongPathIfNeeded(wstring& path);
+bool resolveFinalPath(HANDLE handle, wstring& path);
+
 class Server;
 class WatchPoint;
 
@@ -112,36 +122,56 @@ private:
     OVERLAPPED overlapped;
 
     /**
-     * Event buffer used with ReadDirectoryChangesExW.
+     * Event buffer used with the currently pending ReadDirectoryChangesExW.
      */
     vector<BYTE> eventBuffer;
 
+    /**
+     * Buffer holding the events of the last completed read while they are being processed.
+     *
+     * The buffers are swapped on each completion, so that we can listen again
+     * before processing the events, and not miss changes that happen in the meantime.
+     */
+    vector<BYTE> spareEventBuffer;
+
     /**
      * Whether the watch point is watching, has been cancelled or fully closed.
      */
     WatchPointStatus status;
 
+    /**
+     * Key the directory handle is associated with the server's completion port with, or 0 when using APCs.
+     *
+     * Keys are never reused, so that the completion of a read cancelled by a removed watch point
+     * will not be mistaken for an event of a watch point allocated at the same address.
+     */
+    ULONG_PTR completionKey = 0;
+
     void handleEventsInBuffer(DWORD errorCode, DWORD bytesTransferred);
     friend static void CALLBACK handleEventCallback(DWORD errorCode, DWORD bytesTransferred, LPOVERLAPPED overlapped);
 };
 
 class Server : public AbstractServer {
 public:
-    Server(JNIEnv* env, size_t eventBufferSize, long commandTimeoutInMillis, jobject watcherCallback);
+    Server(JNIEnv* env, size_t eventBufferSize, long commandTimeoutInMillis, bool useCompletionPort, jobject watcherCallback);
 
     // List<String> droppedPaths
     void stopWatchingMovedPaths(jobject droppedPaths);
 
-    void handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<BYTE>& eventBuffer, DWORD bytesTransferred);
+    void handleEvents(WatchPoint* watchPoint, DWORD errorCode, DWORD bytesTransferred);
     bool executeOnRunLoop(function<bool()> command);
 
     virtual void registerPaths(const vector<u16string>& paths) override;
+    virtual vector<string> tryRegisterPaths(const vector<u16string>& paths) override;
     virtual bool unregisterPaths(const vector<u16string>& paths) override;
+    virtual void setWatchedPaths(const vector<u16string>& paths) override;
 
 protected:
     void initializeRunLoop() override;
     void runLoop() override;
     void shutdownRunLoop() override;
+    vector<u16string> getWatchedPaths() override;
+    size_t getWatchedPathCount() override;
 
 private:
     void handleEvent(JNIEnv* env, const wstring& watchedPath, FILE_NOTIFY_EXTENDED_INFORMATION* info);
@@ -151,13 +181,33 @@ private:
 
     void reportWatchPointDeleted(WatchPoint* watchPoint);
 
+    bool processCompletions(DWORD timeoutInMillis);
+    void handleCompletion(const OVERLAPPED_ENTRY& entry);
+
     HANDLE threadHandle;
     const size_t eventBufferSize;
     const long commandTimeoutInMillis;
+
+    /**
+     * When set, reads and commands complete via a completion port dequeued in batches
+     * instead of via APCs delivered to the alertable run loop thread.
+     */
+    const bool useCompletionPort;
+    HANDLE completionPort = NULL;
+    ULONG_PTR nextCompletionKey = COMMAND_COMPLETION_KEY + 1;
+
+    /**
+     * Watch points by completion key, declared before watchPoints so that it outlives them.
+     */
+    unordered_map<ULONG_PTR, WatchPoint*> watchPointsByCompletionKey;
     unordered_map<wstring, WatchPoint> watchPoints;
+
+    /**
+     * Size of watchPoints, as the map itself must only be accessed from the run loop thread.
+     */
+    atomic<size_t> watchPointCount { 0 };
     bool shouldTerminate = false;
     friend void CALLBACK executeOnRunLoopCallback(_In_ ULONG_PTR info);
-    jmethodID listAddMethod;
 };
 
 #endif
@@ -0,0 +1,124 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <windows.h>
+#include <winioctl.h>
+
+// Needs to stay below <windows.h> otherwise byte symbol gets confused with std::byte
+#include "win_fsnotifier.h"
+
+using namespace std;
+
+/**
+ * Where a directory has been before it was renamed or deleted, as recorded by the change journal.
+ */
+struct PreviousDirectoryLocation {
+    DWORDLONG parentFileReference;
+    wstring name;
+};
+
+enum class DirectoryResolution {
+    /**
+     * The path of the directory has been found.
+     */
+    RESOLVED,
+    /**
+     * The directory exists, but we are not allowed to open it, like the system directories of the volume.
+     */
+    INACCESSIBLE,
+    /**
+     * The directory doesn't exist anymore, and the records don't tell where it has been.
+     */
+    UNKNOWN
+};
+
+// Size of the buffer change journal records are read into
+#define CHANGE_JOURNAL_BUFFER_SIZE (64 * 1024)
+
+/**
+ * Reads the NTFS change journal (USN journal) of a volume.
+ *
+ * Unlike ReadDirectoryChangesExW, the journal persists changes across restarts of the process, so
+ * a client that remembers the position it has read up to can find out what has been changed
+ * since then without having to scan the whole hierarchy.
+ *
+ * @note Opening the volume requires administrator privileges.
+ */
+class ChangeJournal {
+public:
+    ChangeJournal(const wstring& path);
+    ~ChangeJournal();
+
+    /**
+     * The root of the volume, e.g. `C:\`.
+     */
+    const wstring& getVolumePath() const {
+        return volumePath;
+    }
+
+    USN_JOURNAL_DATA_V0 query();
+
+    /**
+     * Collects the paths below the given roots that have been changed since the given position.
+     *
+     * Returns false when the changes since the given position cannot be determined anymore,
+     * e.g. because the journal has been recreated or truncated since.
+     */
+    bool readChangesSince(DWORDLONG journalId, USN startUsn, const vector<wstring>& roots, vector<wstring>& changedPaths, USN& nextUsn);
+
+private:
+    /**
+     * Passes the records between the given positions to the handler, stopping when it returns false.
+     *
+     * Returns false when the records aren't available anymore, or when the handler returned false.
+     */
+    bool readRecords(DWORDLONG journalId, USN startUsn, USN endUsn, const function<bool(const USN_RECORD_V2*)>& handler, USN& nextUsn);
+    void recordPreviousLocation(const USN_RECORD_V2* record);
+    bool handleRecord(const USN_RECORD_V2* record, const vector<wstring>& roots, const vector<wstring>& finalRoots,
+        vector<wstring>& changedPaths, unordered_set<wstring>& reportedPaths);
+    DirectoryResolution resolveDirectory(DWORDLONG fileReference, wstring& path);
+    DirectoryResolution openDirectory(DWORDLONG fileReference, wstring& path);
+    void moveCachedDescendants(const wstring& oldPath, const wstring& newPath);
+    bool resolveRoot(const wstring& root, wstring& finalRoot);
+
+    wstring volumePath;
+    HANDLE volumeHandle;
+
+    /**
+     * Final paths of the directories referenced by the records, keyed by file reference number.
+     * Seeded with the roots, and updated from the records of created and renamed directories
+     * so that records referencing directories that don't exist anymore can still be placed.
+     */
+    unordered_map<DWORDLONG, wstring> directories;
+
+    /**
+     * The paths of directories a rename has been recorded for, until the record with their new name is handled.
+     */
+    unordered_map<DWORDLONG, wstring> renamedDirectories;
+
+    /**
+     * The earliest location of directories that have been renamed or deleted since the position we read from,
+     * keyed by file reference number. Collected in a first pass over the records, so that changes that happened
+     * inside the directories before they were moved or deleted can be placed by following the chain of parents.
+     */
+    unordered_map<DWORDLONG, PreviousDirectoryLocation> previousLocations;
+};
+
+class WindowsJniConstants : public JniSupport {
+public:
+    WindowsJniConstants(JavaVM* jvm);
+
+    const JClass changeJournalPositionClass;
+
+    const jmethodID changeJournalPositionConstructor;
+};
+
+extern WindowsJniConstants* windowsJniConstants;
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.annotations.Warmup;
+
+import java.io.File;
+import java.io.IOException;
+import java.util.Collections;
+import java.util.List;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
+
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.CREATED;
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.REMOVED;
+
+/**
+ * Measures the time from creating a file in a watched directory until the change can be taken from the event queue.
+ * JMH reports the percentiles of the sampled latencies.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.SampleTime)
+@OutputTimeUnit(TimeUnit.MICROSECONDS)
+@Warmup(iterations = 3, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(1)
+public class FileEventsLatencyBenchmark {
+    @Param({FileWatcherBenchmarkSupport.DEFAULT_BACKEND, FileWatcherBenchmarkSupport.ALTERNATIVE_BACKEND})
+    public String backend;
+
+    private final BlockingQueue<FileWatchEvent> eventQueue = new LinkedBlockingQueue<FileWatchEvent>();
+    private File watchedDir;
+    private File file;
+    private List<String> expectedPaths;
+    private FileWatcher watcher;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException, InterruptedException {
+        watchedDir = FileWatcherBenchmarkSupport.newBenchmarkDirectory("latency");
+        file = new File(watchedDir, "file.txt");
+        expectedPaths = Collections.singletonList(file.getAbsolutePath());
+        watcher = FileWatcherBenchmarkSupport.startWatcher(backend, eventQueue, 64 * 1024);
+        watcher.startWatching(Collections.singletonList(watchedDir));
+    }
+
+    @Setup(Level.Invocation)
+    public void removeFile() throws InterruptedException {
+        if (file.delete()) {
+            FileWatcherBenchmarkSupport.awaitChanges(eventQueue, REMOVED, expectedPaths);
+        }
+        eventQueue.clear();
+    }
+
+    @TearDown(Level.Trial)
+    public void tearDown() throws InterruptedException {
+        watcher.shutdown();
+        watcher.awaitTermination(5, TimeUnit.SECONDS);
+        FileWatcherBenchmarkSupport.deleteRecursively(watchedDir);
+    }
+
+    @Benchmark
+    public int createFile() throws IOException, InterruptedException {
+        if (!file.createNewFile()) {
+            throw new IOException("Could not create " + file);
+        }
+        return FileWatcherBenchmarkSupport.awaitChanges(eventQueue, CREATED, expectedPaths);
+    }
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import org.openjdk.jmh.annotations.AuxCounters;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.annotations.Warmup;
+
+import javax.annotation.Nullable;
+import java.io.File;
+import java.io.IOException;
+import java.util.Collections;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Finds the burst sizes at which the native side starts to lose events.
+ *
+ * Each iteration creates a burst of files in a freshly watched directory as fast as possible,
+ * then consumes the events until all creations arrived or an overflow has been reported.
+ * The {@code overflows} counter is the fraction of bursts that overflowed,
+ * and {@code creations} the number of creations that made it to the queue per burst.
+ *
+ * The buffer size is only used on Windows, where it is the size of the {@code ReadDirectoryChangesExW()} buffer.
+ * On Linux the limit is the kernel's inotify queue ({@code /proc/sys/fs/inotify/max_queued_events})
+ * together with how fast the watcher thread drains it into its read buffer.
+ * On macOS FSEvents does not lose events, but may coalesce them to the watched directory.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.SingleShotTime)
+@OutputTimeUnit(TimeUnit.MILLISECONDS)
+@Warmup(iterations = 2)
+@Measurement(iterations = 10)
+@Fork(1)
+public class FileEventsOverflowBenchmark {
+    private static final long QUIET_PERIOD_IN_MILLIS = 1000;
+
+    @Param({FileWatcherBenchmarkSupport.DEFAULT_BACKEND, FileWatcherBenchmarkSupport.ALTERNATIVE_BACKEND})
+    public String backend;
+
+    @Param({"1000", "10000", "50000"})
+    public int burstSize;
+
+    @Param({"16384", "65536", "1048576"})
+    public int bufferSize;
+
+    @State(Scope.Thread)
+    @AuxCounters(AuxCounters.Type.EVENTS)
+    public static class Counters {
+        public double overflows;
+        public long creations;
+
+        @Setup(Level.Iteration)
+        public void reset() {
+            overflows = 0;
+            creations = 0;
+        }
+    }
+
+    private final BlockingQueue<FileWatchEvent> eventQueue = new LinkedBlockingQueue<FileWatchEvent>();
+    private File rootDir;
+    private File watchedDir;
+    private FileWatcher watcher;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException {
+        rootDir = FileWatcherBenchmarkSupport.newBenchmarkDirectory("overflow");
+    }
+
+    @Setup(Level.Iteration)
+    public void startWatcher() throws IOException, InterruptedException {
+        watchedDir = File.createTempFile("burst", "", rootDir);
+        if (!watchedDir.delete() || !watchedDir.mkdir()) {
+            throw new IOException("Could not create " + watchedDir);
+        }
+        eventQueue.clear();
+        watcher = FileWatcherBenchmarkSupport.startWatcher(backend, eventQueue, bufferSize);
+        watcher.startWatching(Collections.singletonList(watchedDir));
+    }
+
+    @TearDown(Level.Iteration)
+    public void stopWatcher() throws InterruptedException {
+        watcher.shutdown();
+        watcher.awaitTermination(5, TimeUnit.SECONDS);
+        FileWatcherBenchmarkSupport.deleteRecursively(watchedDir);
+    }
+
+    @TearDown(Level.Trial)
+    public void tearDown() {
+        FileWatcherBenchmarkSupport.deleteRecursively(rootDir);
+    }
+
+    @Benchmark
+    public void createBurst(final Counters counters) throws IOException, InterruptedException {
+        for (int i = 0; i < burstSize; i++) {
+            File file = new File(watchedDir, "file-" + i);
+            if (!file.createNewFile()) {
+                throw new IOException("Could not create " + file);
+            }
+        }
+
+        final boolean[] overflown = new boolean[1];
+        while (!overflown[0] && counters.creations < burstSize) {
+            // Coalesced or lost events never arrive, so stop once the watcher has been quiet for a while
+            FileWatchEvent event = eventQueue.poll(QUIET_PERIOD_IN_MILLIS, TimeUnit.MILLISECONDS);
+            if (event == null) {
+                break;
+            }
+            event.handleEvent(new FileWatcherBenchmarkSupport.FailingHandler() {
+                @Override
+                public void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
+                    if (type == FileWatchEvent.ChangeType.CREATED) {
+                        counters.creations++;
+                    }
+                }
+
+                @Override
+                public void handleOverflow(FileWatchEvent.OverflowType type, @Nullable String absolutePath) {
+                    overflown[0] = true;
+                }
+            });
+        }
+        if (overflown[0]) {
+            counters.overflows++;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OperationsPerInvocation;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.annotations.Warmup;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Measures how many changes per second are delivered from the file system to the event queue.
+ * Each operation is a modification of a file in a watched directory, the operation completes
+ * once the change has been taken from the queue.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.Throughput)
+@OutputTimeUnit(TimeUnit.SECONDS)
+@Warmup(iterations = 3, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(1)
+public class FileEventsThroughputBenchmark {
+    private static final int CHANGES_PER_INVOCATION = 1000;
+
+    @Param({FileWatcherBenchmarkSupport.DEFAULT_BACKEND, FileWatcherBenchmarkSupport.ALTERNATIVE_BACKEND})
+    public String backend;
+
+    private final BlockingQueue<FileWatchEvent> eventQueue = new LinkedBlockingQueue<FileWatchEvent>();
+    private final List<File> files = new ArrayList<File>();
+    private final List<String> paths = new ArrayList<String>();
+    private File watchedDir;
+    private FileWatcher watcher;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException, InterruptedException {
+        watchedDir = FileWatcherBenchmarkSupport.newBenchmarkDirectory("throughput");
+        FileWatcherBenchmarkSupport.createFiles(watchedDir, CHANGES_PER_INVOCATION, files);
+        for (File file : files) {
+            paths.add(file.getAbsolutePath());
+        }
+        watcher = FileWatcherBenchmarkSupport.startWatcher(backend, eventQueue, 1024 * 1024);
+        watcher.startWatching(Collections.singletonList(watchedDir));
+    }
+
+    @Setup(Level.Invocation)
+    public void discardLateEvents() {
+        // Some backends report more than one event per change, don't count them for the next invocation
+        eventQueue.clear();
+    }
+
+    @TearDown(Level.Trial)
+    public void tearDown() throws InterruptedException {
+        watcher.shutdown();
+        watcher.awaitTermination(5, TimeUnit.SECONDS);
+        FileWatcherBenchmarkSupport.deleteRecursively(watchedDir);
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(CHANGES_PER_INVOCATION)
+    public int modifyFiles() throws IOException, InterruptedException {
+        for (File file : files) {
+            FileOutputStream outputStream = new FileOutputStream(file, true);
+            try {
+                outputStream.write('x');
+            } finally {
+                outputStream.close();
+            }
+        }
+        return FileWatcherBenchmarkSupport.awaitChanges(eventQueue, null, paths);
+    }
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.internal.Platform;
+import net.rubygrapefruit.platform.internal.jni.LinuxFileEventFunctions;
+import net.rubygrapefruit.platform.internal.jni.OsxFileEventFunctions;
+import net.rubygrapefruit.platform.internal.jni.WindowsFileEventFunctions;
+
+import javax.annotation.Nullable;
+import java.io.File;
+import java.io.IOException;
+import java.util.Collection;
+import java.util.HashSet;
+import java.util.Set;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Starts watchers and waits for their events in the file events benchmarks.
+ *
+ * Each platform has a {@code default} and an {@code alternative} backend, so that the same benchmark
+ * parameters can be used on all platforms:
+ *
+ * <ul>
+ *     <li>Linux: inotify, and fanotify (falls back to inotify when fanotify is not usable).</li>
+ *     <li>macOS: a run loop on the watcher thread, and a dispatch queue.</li>
+ *     <li>Windows: asynchronous procedure calls, and an I/O completion port.</li>
+ * </ul>
+ */
+class FileWatcherBenchmarkSupport {
+    static final String DEFAULT_BACKEND = "default";
+    static final String ALTERNATIVE_BACKEND = "alternative";
+    static final long EVENT_TIMEOUT_IN_SECONDS = 30;
+
+    private static final String BENCHMARK_DIRECTORY_SYSTEM_PROPERTY = "benchmark.directory";
+
+    static FileWatcher startWatcher(String backend, BlockingQueue<FileWatchEvent> eventQueue, int windowsBufferSize) throws InterruptedException {
+        boolean alternative = parseBackend(backend);
+        Platform platform = Platform.current();
+        if (platform.isLinux()) {
+            return FileEvents.get(LinuxFileEventFunctions.class).newWatcher(eventQueue)
+                .withFanotify(alternative)
+                .start();
+        } else if (platform.isMacOs()) {
+            return FileEvents.get(OsxFileEventFunctions.class).newWatcher(eventQueue)
+                .withLatency(0, TimeUnit.MILLISECONDS)
+                .withDispatchQueue(alternative)
+                .start();
+        } else if (platform.isWindows()) {
+            return FileEvents.get(WindowsFileEventFunctions.class).newWatcher(eventQueue)
+                .withBufferSize(windowsBufferSize)
+                .withCompletionPort(alternative)
+                .start();
+        }
+        throw new UnsupportedOperationException("File events are not supported on " + platform);
+    }
+
+    private static boolean parseBackend(String backend) {
+        if (DEFAULT_BACKEND.equals(backend)) {
+            return false;
+        } else if (ALTERNATIVE_BACKEND.equals(backend)) {
+            return true;
+        }
+        throw new IllegalArgumentException("Unknown backend: " + backend);
+    }
+
+    static File newBenchmarkDirectory(String name) throws IOException {
+        String rootPath = System.getProperty(BENCHMARK_DIRECTORY_SYSTEM_PROPERTY, System.getProperty("java.io.tmpdir"));
+        File root = new File(rootPath);
+        if (!root.isDirectory() && !root.mkdirs()) {
+            throw new IOException("Could not create benchmark directory " + root);
+        }
+        File dir = File.createTempFile(name, "", root);
+        if (!dir.delete() || !dir.mkdir()) {
+            throw new IOException("Could not create benchmark directory " + dir);
+        }
+        return dir.getCanonicalFile();
+    }
+
+    static void createFiles(File dir, int count, Collection<File> files) throws IOException {
+        for (int i = 0; i < count; i++) {
+            File file = new File(dir, "file-" + i + ".txt");
+            if (!file.createNewFile()) {
+                throw new IOException("Could not create " + file);
+            }
+            files.add(file);
+        }
+    }
+
+    static void deleteRecursively(@Nullable File file) {
+        if (file == null) {
+            return;
+        }
+        File[] children = file.listFiles();
+        if (children != null) {
+            for (File child : children) {
+                deleteRecursively(child);
+            }
+        }
+        file.delete();
+    }
+
+    /**
+     * Consumes events until each of the given paths has been reported at least once.
+     *
+     * @param expectedType only count changes of this type, or any change when {@code null}.
+     * @return the number of events consumed.
+     * @throws IllegalStateException when events have been lost, so the measurement is not valid.
+     */
+    static int awaitChanges(BlockingQueue<FileWatchEvent> eventQueue, @Nullable final FileWatchEvent.ChangeType expectedType, Collection<String> expectedPaths) throws InterruptedException {
+        final Set<String> pending = new HashSet<String>(expectedPaths);
+        int consumed = 0;
+        long deadline = System.nanoTime() + TimeUnit.SECONDS.toNanos(EVENT_TIMEOUT_IN_SECONDS);
+        while (!pending.isEmpty()) {
+            FileWatchEvent event = eventQueue.poll(deadline - System.nanoTime(), TimeUnit.NANOSECONDS);
+            if (event == null) {
+                throw new IllegalStateException("Timed out waiting for " + pending.size() + " changes");
+            }
+            consumed++;
+            event.handleEvent(new FailingHandler() {
+                @Override
+                public void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
+                    if (expectedType == null || expectedType == type) {
+                        pending.remove(absolutePath);
+                    }
+                }
+
+                @Override
+                public void handleUnknownEvent(String absolutePath) {
+                    if (expectedType == null) {
+                        pending.remove(absolutePath);
+                    }
+                }
+            });
+        }
+        return consumed;
+    }
+
+    /**
+     * Fails the benchmark for events that invalidate the measurement, ignores other changes.
+     */
+    static class FailingHandler implements FileWatchEvent.Handler {
+        @Override
+        public void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
+        }
+
+        @Override
+        public void handleUnknownEvent(String absolutePath) {
+        }
+
+        @Override
+        public void handleOverflow(FileWatchEvent.OverflowType type, @Nullable String absolutePath) {
+            throw new IllegalStateException("Events have been lost, reduce the load: " + type + " overflow at " + absolutePath);
+        }
+
+        @Override
+        public void handleFailure(Throwable failure) {
+            throw new IllegalStateException("Watcher failed", failure);
+        }
+
+        @Override
+        public void handleTerminated() {
+            throw new IllegalStateException("Watcher terminated unexpectedly");
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.annotations.Warmup;
+
+import java.io.File;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Measures the time it takes to register the given number of directories with a running watcher.
+ * The directories are unregistered again after each invocation, which is not measured.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.MILLISECONDS)
+@Warmup(iterations = 3, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(1)
+public class FileWatcherRegistrationBenchmark {
+    @Param({FileWatcherBenchmarkSupport.DEFAULT_BACKEND, FileWatcherBenchmarkSupport.ALTERNATIVE_BACKEND})
+    public String backend;
+
+    // Stays below the default inotify watch limit of older kernels
+    @Param({"100", "1000", "4000"})
+    public int directoryCount;
+
+    private final BlockingQueue<FileWatchEvent> eventQueue = new LinkedBlockingQueue<FileWatchEvent>();
+    private final List<File> directories = new ArrayList<File>();
+    private File rootDir;
+    private FileWatcher watcher;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException, InterruptedException {
+        rootDir = FileWatcherBenchmarkSupport.newBenchmarkDirectory("registration");
+        // Spread the directories over a two level hierarchy, like the source directories of a large build
+        for (int i = 0; i < directoryCount; i++) {
+            File dir = new File(rootDir, "project-" + (i / 100) + "/dir-" + i);
+            if (!dir.mkdirs()) {
+                throw new IOException("Could not create " + dir);
+            }
+            directories.add(dir);
+        }
+        watcher = FileWatcherBenchmarkSupport.startWatcher(backend, eventQueue, 16 * 1024);
+    }
+
+    @TearDown(Level.Invocation)
+    public void unregister() {
+        watcher.stopWatching(directories);
+        eventQueue.clear();
+    }
+
+    @TearDown(Level.Trial)
+    public void tearDown() throws InterruptedException {
+        watcher.shutdown();
+        watcher.awaitTermination(5, TimeUnit.SECONDS);
+        FileWatcherBenchmarkSupport.deleteRecursively(rootDir);
+    }
+
+    @Benchmark
+    public void register() {
+        watcher.startWatching(directories);
+    }
+}
@@ -1,9 +1,11 @@
 package net.rubygrapefruit.platform.file;
 
+import net.rubygrapefruit.platform.Native;
 import net.rubygrapefruit.platform.NativeException;
 import net.rubygrapefruit.platform.NativeIntegration;
 import net.rubygrapefruit.platform.NativeIntegrationUnavailableException;
 import net.rubygrapefruit.platform.ThreadSafe;
+import net.rubygrapefruit.platform.internal.NativeLibraryLoadListener;
 import net.rubygrapefruit.platform.internal.NativeLibraryLoader;
 import net.rubygrapefruit.platform.internal.NativeLibraryLocator;
 import net.rubygrapefruit.platform.internal.Platform;
@@ -16,6 +18,7 @@ import net.rubygrapefruit.platform.internal.jni.WindowsFileEventFunctions;
 import java.io.File;
 import java.util.HashMap;
 import java.util.Map;
+import java.util.concurrent.atomic.AtomicReference;
 
 @ThreadSafe
 public class FileEvents {
@@ -50,6 +53,54 @@ public class FileEvents {
         }
     }
 
+    /**
+     * Initialises the file events integration like {@link #init(File)} together with the other native integrations
+     * like {@link Native#init(File)}. The native libraries of both are extracted and loaded concurrently instead of
+     * one after the other, though depending on the JVM loading them may be serialized.
+     *
+     * @param extractDir The directory to extract native resources into. May be null, in which case a default is
+     * selected.
+     */
+    @ThreadSafe
+    static public void initWithNative(final File extractDir) throws NativeIntegrationUnavailableException, NativeException {
+        final AtomicReference<Throwable> nativeFailure = new AtomicReference<Throwable>();
+        Thread nativeInitThread = new Thread("Native integration initialisation") {
+            @Override
+            public void run() {
+                try {
+                    Native.init(extractDir);
+                } catch (Throwable t) {
+                    nativeFailure.set(t);
+                }
+            }
+        };
+        nativeInitThread.setDaemon(true);
+        nativeInitThread.start();
+        try {
+            init(extractDir);
+        } finally {
+            boolean interrupted = false;
+            while (true) {
+                try {
+                    nativeInitThread.join();
+                    break;
+                } catch (InterruptedException e) {
+                    interrupted = true;
+                }
+            }
+            if (interrupted) {
+                Thread.currentThread().interrupt();
+            }
+        }
+        Throwable failure = nativeFailure.get();
+        if (failure instanceof NativeException) {
+            throw (NativeException) failure;
+        }
+        if (failure != null) {
+            throw new NativeException("Failed to initialise native integration.", failure);
+        }
+    }
+
     /**
      * Locates a native integration of the given type.
      *
@@ -67,6 +118,10 @@ public class FileEvents {
             Object instance = integrations.get(type);
             if (instance == null) {
                 try {
+                    long initializationStart = System.nanoTime();
+                    if (AbstractFileEventFunctions.initialize()) {
+                        NativeLibraryLoader.stepCompleted(determineLibraryName(platform), NativeLibraryLoadListener.Step.INITIALIZATION, initializationStart);
+                    }
                     instance = getEventFunctions(type, platform);
                 } catch (NativeException e) {
                     throw e;
@@ -11,6 +11,9 @@ public interface FileWatchEvent {
 
         void handleUnknownEvent(String absolutePath);
 
+        /**
+         * Called when events have been lost. The path is {@code null} when all watched paths are affected.
+         */
         void handleOverflow(OverflowType type, @Nullable String absolutePath);
 
         void handleFailure(Throwable failure);
@@ -8,7 +8,11 @@ import net.rubygrapefruit.platform.file.FileWatcher;
 
 import javax.annotation.Nullable;
 import java.io.File;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.Collection;
+import java.util.LinkedHashMap;
+import java.util.Map;
 import java.util.concurrent.BlockingQueue;
 import java.util.concurrent.CountDownLatch;
 import java.util.concurrent.TimeUnit;
@@ -22,6 +26,32 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
 
     private static native String getVersion0();
 
+    private static boolean initialized;
+
+    protected AbstractFileEventFunctions() {
+        initialize();
+    }
+
+    /**
+     * Sets up the native state shared by all watchers, unless it has been set up already.
+     * This is done when the first integration is created rather than when the library is loaded,
+     * so that loading the library stays cheap.
+     *
+     * @return whether the native state has been set up by this call.
+     */
+    public static boolean initialize() {
+        synchronized (AbstractFileEventFunctions.class) {
+            if (initialized) {
+                return false;
+            }
+            initialize0();
+            initialized = true;
+            return true;
+        }
+    }
+
+    private static native void initialize0();
+
     /**
      * Forces the native backend to drop the cached JUL log level and thus
      * re-query it the next time it tries to log something to the Java side.
@@ -32,15 +62,109 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
 
     private native void invalidateLogLevelCache0();
 
-    public abstract static class AbstractWatcherBuilder<T extends FileWatcher> {
+    private static final long LOG_DRAIN_INTERVAL_IN_MILLIS = 50;
+    private static Thread logDrainThread;
+
+    /**
+     * Sends log messages from the native side to Java from a background thread, instead of from
+     * the thread producing them. This way logging never stalls the thread receiving file events.
+     * Messages are dropped when more accumulate between two drains than the native queue can hold.
+     *
+     * In asynchronous mode the native backend picks up changes to the JUL log level with the next drain.
+     * Logging is synchronous by default.
+     */
+    public void setAsynchronousLogging(boolean asynchronous) {
+        synchronized (AbstractFileEventFunctions.class) {
+            if (asynchronous == (logDrainThread != null)) {
+                return;
+            }
+            if (asynchronous) {
+                setAsynchronousLogging0(true);
+                logDrainThread = new Thread("File watcher log drain") {
+                    @Override
+                    public void run() {
+                        while (!isInterrupted()) {
+                            drainLogMessages0();
+                            try {
+                                Thread.sleep(LOG_DRAIN_INTERVAL_IN_MILLIS);
+                            } catch (InterruptedException e) {
+                                break;
+                            }
+                        }
+                    }
+                };
+                logDrainThread.setDaemon(true);
+                logDrainThread.start();
+            } else {
+                logDrainThread.interrupt();
+                // The native queue only supports a single consumer, so wait for the drain thread to finish
+                // even when interrupted, before draining the remaining messages from this thread
+                boolean interrupted = false;
+                while (true) {
+                    try {
+                        logDrainThread.join();
+                        break;
+                    } catch (InterruptedException e) {
+                        interrupted = true;
+                    }
+                }
+                if (interrupted) {
+                    Thread.currentThread().interrupt();
+                }
+                logDrainThread = null;
+                // Drains the remaining messages
+                setAsynchronousLogging0(false);
+            }
+        }
+    }
+
+    private static native void setAsynchronousLogging0(boolean asynchronous);
+
+    private static native void drainLogMessages0();
+
+    public abstract static class AbstractWatcherBuilder<T extends FileWatcher, B extends AbstractWatcherBuilder<T, B>> {
         public static final long DEFAULT_START_TIMEOUT_IN_SECONDS = 5;
+        public static final int MINIMUM_SHARED_EVENT_BUFFER_SIZE = 128 * 1024;
 
         private final BlockingQueue<FileWatchEvent> eventQueue;
+        private int sharedEventBufferSize;
+        private boolean coalesceChangeEvents;
 
         public AbstractWatcherBuilder(BlockingQueue<FileWatchEvent> eventQueue) {
             this.eventQueue = eventQueue;
         }
 
+        /**
+         * Deliver change events from the native side through a direct buffer of the given size
+         * shared with the watcher, instead of creating a Java string via JNI for each event.
+         * Each batch of events is copied out of the buffer at once, and the path of an event is
+         * only turned into a string when the event is first handled. Until then, a queued event keeps
+         * its whole batch in memory.
+         * The size must be at least {@value MINIMUM_SHARED_EVENT_BUFFER_SIZE} bytes.
+         *
+         * By default no shared buffer is used.
+         */
+        public B withSharedEventBuffer(int sizeInBytes) {
+            if (sizeInBytes < MINIMUM_SHARED_EVENT_BUFFER_SIZE) {
+                throw new IllegalArgumentException("Shared event buffer must be at least " + MINIMUM_SHARED_EVENT_BUFFER_SIZE + " bytes");
+            }
+            this.sharedEventBufferSize = sizeInBytes;
+            return self();
+        }
+
+        /**
+         * Coalesce change events for the same path that are reported by the operating system
+         * together, before passing them to Java. Repeated events of the same type are reported once,
+         * modifications right after the creation of a path are dropped, and a removal supersedes
+         * any earlier creation or modification of the same path.
+         *
+         * Coalescing is disabled by default.
+         */
+        public B withCoalescedChangeEvents(boolean coalesceChangeEvents) {
+            this.coalesceChangeEvents = coalesceChangeEvents;
+            return self();
+        }
+
         /**
          * Start the file watcher.
          *
@@ -64,11 +188,45 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
          * @see FileWatcher#startWatching(Collection)
          */
         public T start(long startTimeout, TimeUnit startTimeoutUnit) throws InterruptedException, InsufficientResourcesForWatchingException {
-            NativeFileWatcherCallback callback = new NativeFileWatcherCallback(eventQueue);
+            ByteBuffer sharedEventBuffer = sharedEventBufferSize == 0
+                ? null
+                : ByteBuffer.allocateDirect(sharedEventBufferSize).order(ByteOrder.nativeOrder());
+            NativeFileWatcherCallback callback = new NativeFileWatcherCallback(eventQueue, sharedEventBuffer, coalesceChangeEvents);
             Object server = startWatcher(callback);
             return createWatcher(server, startTimeout, startTimeoutUnit, callback);
         }
 
+        /**
+         * Start a watcher that can be shared by any number of logical watchers, see {@link SharedFileWatcher}.
+         * The event queue of this builder receives the failures and the termination of the shared watcher.
+         *
+         * @throws FileWatcherTimeoutException if the watcher did not start up
+         * in {@value DEFAULT_START_TIMEOUT_IN_SECONDS} seconds.
+         * @throws InterruptedException if the current thread has been interrupted.
+         */
+        public SharedFileWatcher<T> startShared() throws InterruptedException {
+            return startShared(DEFAULT_START_TIMEOUT_IN_SECONDS, SECONDS);
+        }
+
+        /**
+         * Start a watcher that can be shared by any number of logical watchers with the given timeout,
+         * see {@link #startShared()}.
+         */
+        public SharedFileWatcher<T> startShared(long startTimeout, TimeUnit startTimeoutUnit) throws InterruptedException, InsufficientResourcesForWatchingException {
+            ByteBuffer sharedEventBuffer = sharedEventBufferSize == 0
+                ? null
+                : ByteBuffer.allocateDirect(sharedEventBufferSize).order(ByteOrder.nativeOrder());
+            SharedFileWatcher.DispatchingCallback callback = new SharedFileWatcher.DispatchingCallback(eventQueue, sharedEventBuffer, coalesceChangeEvents);
+            Object server = startWatcher(callback);
+            T watcher = createWatcher(server, startTimeout, startTimeoutUnit, callback);
+            return new SharedFileWatcher<T>(watcher, callback);
+        }
+
+        /**
+         * Returns this builder as the platform specific builder, so that its options can be chained with the common ones.
+         */
+        protected abstract B self();
+
         protected abstract Object startWatcher(NativeFileWatcherCallback callback);
 
         protected abstract T createWatcher(final Object server, long startTimeout, TimeUnit startTimeoutUnit, final NativeFileWatcherCallback callback) throws InterruptedException;
@@ -81,20 +239,81 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
      * The queue must have a total capacity of at least 2 elements.
      * The caller should only consume events from the queue, and never add any of their own.
      */
-    public abstract AbstractWatcherBuilder<W> newWatcher(BlockingQueue<FileWatchEvent> queue);
+    public abstract AbstractWatcherBuilder<W, ?> newWatcher(BlockingQueue<FileWatchEvent> queue);
 
     protected static class NativeFileWatcherCallback {
 
         private final BlockingQueue<FileWatchEvent> eventQueue;
+        private final ByteBuffer sharedEventBuffer;
+        private final boolean coalescingChangeEvents;
 
         public NativeFileWatcherCallback(BlockingQueue<FileWatchEvent> eventQueue) {
+            this(eventQueue, null, false);
+        }
+
+        public NativeFileWatcherCallback(BlockingQueue<FileWatchEvent> eventQueue, @Nullable ByteBuffer sharedEventBuffer, boolean coalescingChangeEvents) {
             this.eventQueue = eventQueue;
+            this.sharedEventBuffer = sharedEventBuffer;
+            this.coalescingChangeEvents = coalescingChangeEvents;
+        }
+
+        public int getQueuedEventCount() {
+            return eventQueue.size();
+        }
+
+        // Called from the native side
+        @SuppressWarnings("unused")
+        public boolean isCoalescingChangeEvents() {
+            return coalescingChangeEvents;
+        }
+
+        // Called from the native side
+        @SuppressWarnings("unused")
+        @Nullable
+        public ByteBuffer getSharedEventBuffer() {
+            return sharedEventBuffer;
+        }
+
+        // Called from the native side
+        @SuppressWarnings("unused")
+        public void reportChangeEvents(int[] typeIndices, String[] paths) {
+            FileWatchEvent.ChangeType[] types = FileWatchEvent.ChangeType.values();
+            for (int i = 0; i < paths.length; i++) {
+                reportChangeEvent(types[typeIndices[i]], paths[i]);
+            }
         }
 
+        /**
+         * Decodes change events the native side has written to the shared event buffer.
+         * Each record consists of the change type and the path length as {@code int}s,
+         * followed by the UTF-16 characters of the path, all in native byte order.
+         */
         // Called from the native side
         @SuppressWarnings("unused")
-        public void reportChangeEvent(int typeIndex, String path) {
-            FileWatchEvent.ChangeType type = FileWatchEvent.ChangeType.values()[typeIndex];
+        public void reportEncodedChangeEvents(int length) {
+            FileWatchEvent.ChangeType[] types = FileWatchEvent.ChangeType.values();
+            // The native side reuses the buffer once this returns, so copy the whole batch out in one go.
+            // Only absolute reads are used on the buffer, so its position is always 0
+            char[] batch = new char[length / 2];
+            sharedEventBuffer.asCharBuffer().get(batch);
+            int position = 0;
+            while (position < length) {
+                int typeIndex = sharedEventBuffer.getInt(position);
+                int pathLength = sharedEventBuffer.getInt(position + 4);
+                reportEncodedChangeEvent(types[typeIndex], batch, (position + 8) / 2, pathLength);
+                position += 8 + 2 * pathLength;
+            }
+        }
+
+        /**
+         * Reports a change event whose path is made up of the given characters of a batch
+         * copied from the shared event buffer.
+         */
+        protected void reportEncodedChangeEvent(FileWatchEvent.ChangeType type, char[] batch, int pathOffset, int pathLength) {
+            queueEvent(new EncodedChangeEvent(type, batch, pathOffset, pathLength), false);
+        }
+
+        protected void reportChangeEvent(FileWatchEvent.ChangeType type, String path) {
             queueEvent(new ChangeEvent(type, path), false);
         }
 
@@ -110,6 +329,23 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
             signalOverflow(OverflowType.OPERATING_SYSTEM, path);
         }
 
+        /**
+         * Reports a single overflow affecting the given paths. Reports an overflow for all paths
+         * when no paths are given, or when the event queue cannot hold an overflow event for each of them.
+         */
+        // Called from the native side
+        @SuppressWarnings("unused")
+        public void reportOverflows(String[] paths) {
+            eventQueue.clear();
+            if (paths.length == 0 || paths.length > eventQueue.remainingCapacity()) {
+                forceQueueEvent(new OverflowEvent(OverflowType.OPERATING_SYSTEM, null));
+                return;
+            }
+            for (String path : paths) {
+                forceQueueEvent(new OverflowEvent(OverflowType.OPERATING_SYSTEM, path));
+            }
+        }
+
         // Called from the native side
         @SuppressWarnings("unused")
         public void reportFailure(Throwable ex) {
@@ -158,11 +394,13 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
 
     protected static abstract class NativeFileWatcher implements FileWatcher {
         protected final Object server;
+        private final NativeFileWatcherCallback callback;
         private final Thread processorThread;
         private boolean shutdown;
 
         public NativeFileWatcher(final Object server, long startTimeout, TimeUnit startTimeoutUnit, final NativeFileWatcherCallback callback) throws InterruptedException {
             this.server = server;
+            this.callback = callback;
             final CountDownLatch runLoopInitialized = new CountDownLatch(1);
             this.processorThread = new Thread("File watcher server") {
                 @Override
@@ -200,6 +438,27 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
 
         private native void startWatching0(Object server, String[] absolutePaths);
 
+        /**
+         * Starts watching the given paths like {@link #startWatching(Collection)}, but carries on
+         * with the remaining paths when some of them cannot be watched.
+         *
+         * @return the paths that could not be watched, mapped to the reason of the failure.
+         */
+        public Map<File, String> tryStartWatching(Collection<File> paths) {
+            ensureOpen();
+            String[] absolutePaths = toAbsolutePaths(paths);
+            String[] failures = tryStartWatching0(server, absolutePaths);
+            Map<File, String> failedPaths = new LinkedHashMap<File, String>();
+            for (int i = 0; i < absolutePaths.length; i++) {
+                if (failures[i] != null) {
+                    failedPaths.put(new File(absolutePaths[i]), failures[i]);
+                }
+            }
+            return failedPaths;
+        }
+
+        private native String[] tryStartWatching0(Object server, String[] absolutePaths);
+
         @Override
         public boolean stopWatching(Collection<File> paths) {
             ensureOpen();
@@ -208,6 +467,42 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
 
         private native boolean stopWatching0(Object server, String[] absolutePaths);
 
+        /**
+         * Updates the watcher to watch exactly the given paths. Only the paths that are not yet watched
+         * get registered, and only the watched paths missing from the given ones get unregistered.
+         */
+        public void setWatchedPaths(Collection<File> paths) {
+            ensureOpen();
+            setWatchedPaths0(server, toAbsolutePaths(paths));
+        }
+
+        private native void setWatchedPaths0(Object server, String[] absolutePaths);
+
+        /**
+         * Returns the counters collected by the watcher since it has been started.
+         */
+        public FileWatcherStatistics getStatistics() {
+            ensureOpen();
+            return new FileWatcherStatistics(getStatistics0(server), callback.getQueuedEventCount());
+        }
+
+        private native long[] getStatistics0(Object server);
+
+        /**
+         * Whether changes to all descendants of the watched paths are reported,
+         * or only changes to the watched paths and their immediate children.
+         */
+        protected boolean isReportingChangesToDescendants() {
+            return true;
+        }
+
+        /**
+         * Whether the reported paths have the same case as the watched paths.
+         */
+        protected boolean isReportingPathsInWatchedCase() {
+            return true;
+        }
+
         protected static String[] toAbsolutePaths(Collection<File> files) {
             String[] paths = new String[files.size()];
             int index = 0;
@@ -245,7 +540,7 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
 
         private native boolean awaitTermination0(Object server, long timeoutInMillis);
 
-        private void ensureOpen() {
+        protected void ensureOpen() {
             if (shutdown) {
                 throw new IllegalStateException("Watcher already closed");
             }
@@ -272,6 +567,59 @@ public abstract class AbstractFileEventFunctions<W extends FileWatcher> implemen
         }
     }
 
+    /**
+     * A change event delivered through the shared event buffer, which only creates its path
+     * when first handled. All events of a batch share the characters copied from the buffer.
+     *
+     * Until its path has been created, an event keeps the whole batch reachable, i.e. at most
+     * the size of the shared event buffer. Once created, the path is kept instead of the batch.
+     */
+    private static class EncodedChangeEvent implements FileWatchEvent {
+        private final ChangeType type;
+        private final int pathOffset;
+        private final int pathLength;
+
+        /**
+         * The characters of the batch, cleared once the path has been created.
+         * The path is set before the batch is cleared.
+         */
+        private volatile char[] batch;
+        private volatile String path;
+
+        public EncodedChangeEvent(ChangeType type, char[] batch, int pathOffset, int pathLength) {
+            this.type = type;
+            this.batch = batch;
+            this.pathOffset = pathOffset;
+            this.pathLength = pathLength;
+        }
+
+        private String getPath() {
+            String path = this.path;
+            if (path != null) {
+                return path;
+            }
+            char[] batch = this.batch;
+            if (batch == null) {
+                // Created concurrently
+                return this.path;
+            }
+            path = new String(batch, pathOffset, pathLength);
+            this.path = path;
+            this.batch = null;
+            return path;
+        }
+
+        @Override
+        public void handleEvent(Handler handler) {
+            handler.handleChangeEvent(type, getPath());
+        }
+
+        @Override
+        public String toString() {
+            return type + " " + getPath();
+        }
+    }
+
     private static class OverflowEvent implements FileWatchEvent {
         private final OverflowType type;
         private final String path;
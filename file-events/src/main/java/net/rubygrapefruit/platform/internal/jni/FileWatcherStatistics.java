@@ -0,0 +1,129 @@
+package net.rubygrapefruit.platform.internal.jni;
+
+import net.rubygrapefruit.platform.file.FileWatchEvent;
+
+/**
+ * A snapshot of the counters collected by a native file watcher since it has been started.
+ *
+ * @see AbstractFileEventFunctions.NativeFileWatcher#getStatistics()
+ */
+public class FileWatcherStatistics {
+    // Corresponds to values of Statistic in generic_fsnotifier.h
+    private static final int EVENTS_RECEIVED = 0;
+    private static final int BYTES_RECEIVED = 1;
+    private static final int EVENT_BATCHES_RECEIVED = 2;
+    private static final int CREATED_EVENTS_REPORTED = 3;
+    private static final int UNKNOWN_EVENTS_REPORTED = 7;
+    private static final int OVERFLOWS_REPORTED = 8;
+    private static final int FAILURES_REPORTED = 9;
+    private static final int CALLBACKS = 10;
+    private static final int CALLBACK_NANOS = 11;
+    private static final int CALLBACK_HISTOGRAM = 12;
+    private static final int CALLBACK_HISTOGRAM_BUCKETS = 6;
+    private static final int COMMANDS = 18;
+    private static final int COMMAND_NANOS = 19;
+    private static final int COMMAND_MAX_NANOS = 20;
+    private static final int WATCHED_PATHS = 21;
+
+    private final long[] values;
+    private final int queuedEventCount;
+
+    FileWatcherStatistics(long[] values, int queuedEventCount) {
+        this.values = values;
+        this.queuedEventCount = queuedEventCount;
+    }
+
+    /**
+     * Number of events received from the operating system, before any filtering or coalescing.
+     */
+    public long getEventsReceived() {
+        return values[EVENTS_RECEIVED];
+    }
+
+    /**
+     * Number of bytes of event data read from the operating system. Not available on macOS.
+     */
+    public long getBytesReceived() {
+        return values[BYTES_RECEIVED];
+    }
+
+    /**
+     * Number of reads, completions or callbacks the events have been received in.
+     */
+    public long getEventBatchesReceived() {
+        return values[EVENT_BATCHES_RECEIVED];
+    }
+
+    /**
+     * Number of change events of the given type reported to the event queue.
+     */
+    public long getChangeEventsReported(FileWatchEvent.ChangeType type) {
+        return values[CREATED_EVENTS_REPORTED + type.ordinal()];
+    }
+
+    public long getUnknownEventsReported() {
+        return values[UNKNOWN_EVENTS_REPORTED];
+    }
+
+    public long getOverflowsReported() {
+        return values[OVERFLOWS_REPORTED];
+    }
+
+    public long getFailuresReported() {
+        return values[FAILURES_REPORTED];
+    }
+
+    /**
+     * Number of calls from the native side into the Java callback.
+     */
+    public long getCallbacks() {
+        return values[CALLBACKS];
+    }
+
+    /**
+     * Total time spent in calls from the native side into the Java callback.
+     */
+    public long getCallbackNanos() {
+        return values[CALLBACK_NANOS];
+    }
+
+    /**
+     * Histogram of the time spent in calls into the Java callback.
+     * Bucket {@code i} counts the calls that took less than {@code 10^(i + 1)} microseconds,
+     * except for the last bucket that counts the calls that took 100 milliseconds or more.
+     */
+    public long[] getCallbackHistogram() {
+        long[] histogram = new long[CALLBACK_HISTOGRAM_BUCKETS];
+        System.arraycopy(values, CALLBACK_HISTOGRAM, histogram, 0, CALLBACK_HISTOGRAM_BUCKETS);
+        return histogram;
+    }
+
+    /**
+     * Number of commands executed, i.e. calls to register or unregister paths.
+     */
+    public long getCommands() {
+        return values[COMMANDS];
+    }
+
+    public long getCommandNanos() {
+        return values[COMMAND_NANOS];
+    }
+
+    public long getCommandMaxNanos() {
+        return values[COMMAND_MAX_NANOS];
+    }
+
+    /**
+     * Number of paths currently registered with the watcher.
+     */
+    public long getWatchedPaths() {
+        return values[WATCHED_PATHS];
+    }
+
+    /**
+     * Number of events waiting in the event queue to be consumed.
+     */
+    public int getQueuedEventCount() {
+        return queuedEventCount;
+    }
+}
@@ -31,6 +31,9 @@ import java.util.concurrent.TimeUnit;
  * File watcher for Linux. Reports changes to the watched paths and their immediate children.
  * Changes to deeper descendants are not reported.
  *
+ * When {@link WatcherBuilder#withFanotify(boolean)} is enabled and fanotify is usable on this system,
+ * the whole hierarchy below each watched path is watched instead, see {@link LinuxFileWatcher#isWatchingRecursively()}.
+ *
  * <h3>Remarks:</h3>
  *
  * <ul>
@@ -78,16 +81,75 @@ public class LinuxFileEventFunctions extends AbstractFileEventFunctions<LinuxFil
         }
 
         private native void stopWatchingMovedPaths0(Object server, String[] absolutePathsToCheck, List<String> droppedPaths);
+
+        /**
+         * Whether the watcher uses fanotify, and thus reports changes to all descendants of the watched paths.
+         * A watcher started with fanotify enabled determines whether it can use fanotify by registering the first path,
+         * so before that this might return {@code true} even though the watcher ends up falling back to inotify.
+         */
+        public boolean isWatchingRecursively() {
+            ensureOpen();
+            return isWatchingRecursively0(server);
+        }
+
+        private native boolean isWatchingRecursively0(Object server);
+
+        @Override
+        protected boolean isReportingChangesToDescendants() {
+            return isWatchingRecursively();
+        }
     }
 
-    public static class WatcherBuilder extends AbstractWatcherBuilder<LinuxFileWatcher> {
+    public static class WatcherBuilder extends AbstractWatcherBuilder<LinuxFileWatcher, WatcherBuilder> {
+        private boolean fanotify;
+        private boolean overflowReconciliation;
+
         WatcherBuilder(BlockingQueue<FileWatchEvent> eventQueue) {
             super(eventQueue);
         }
 
+        /**
+         * Watch each registered hierarchy with a single fanotify filesystem mark instead of
+         * one inotify watch per directory. This requires Linux 5.9 or later and a process
+         * privileged to place filesystem marks on a filesystem that can report file handles (e.g. not overlayfs).
+         * If fanotify is not usable, or no mark can be placed on the filesystem of the first registered path,
+         * the watcher falls back to inotify.
+         *
+         * By default inotify is used.
+         */
+        public WatcherBuilder withFanotify(boolean fanotify) {
+            this.fanotify = fanotify;
+            return this;
+        }
+
+        /**
+         * Keep a snapshot of the entries of each watched directory, so that when the kernel's event queue
+         * overflows, the watched directories are rescanned natively and only the differences are reported
+         * as change events. Overflow events are then only reported for directories that could not be rescanned.
+         * This makes registration slower and uses memory for each watched entry. Only used with inotify,
+         * including when falling back from fanotify.
+         *
+         * By default overflows are reported for the watched hierarchies.
+         */
+        public WatcherBuilder withOverflowReconciliation(boolean overflowReconciliation) {
+            this.overflowReconciliation = overflowReconciliation;
+            return this;
+        }
+
+        @Override
+        protected WatcherBuilder self() {
+            return this;
+        }
+
         @Override
         protected Object startWatcher(NativeFileWatcherCallback callback) throws InotifyInstanceLimitTooLowException {
-            return startWatcher0(callback);
+            if (fanotify) {
+                Object server = startFanotifyWatcher0(callback, overflowReconciliation);
+                if (server != null) {
+                    return server;
+                }
+            }
+            return startWatcher0(callback, overflowReconciliation);
         }
 
         @Override
@@ -96,5 +158,10 @@ public class LinuxFileEventFunctions extends AbstractFileEventFunctions<LinuxFil
         }
     }
 
-    private static native Object startWatcher0(NativeFileWatcherCallback callback);
+    private static native Object startWatcher0(NativeFileWatcherCallback callback, boolean reconcileOverflows);
+
+    /**
+     * Returns {@code null} if fanotify is not usable on this system.
+     */
+    private static native Object startFanotifyWatcher0(NativeFileWatcherCallback callback, boolean reconcileOverflows);
 }
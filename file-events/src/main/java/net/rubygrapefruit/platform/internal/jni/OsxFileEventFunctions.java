@@ -19,6 +19,8 @@ package net.rubygrapefruit.platform.internal.jni;
 import net.rubygrapefruit.platform.file.FileWatchEvent;
 import net.rubygrapefruit.platform.file.FileWatcher;
 
+import javax.annotation.Nullable;
+import java.io.File;
 import java.util.concurrent.BlockingQueue;
 import java.util.concurrent.TimeUnit;
 
@@ -36,7 +38,11 @@ import java.util.concurrent.TimeUnit;
  *     </ul>
  *     </li>
  *
- *     <li>Events arrive from a single background thread unique to the {@link FileWatcher}.
+ *     <li>A watcher can replay the changes since an {@link EventStreamCheckpoint} taken earlier,
+ *     e.g. before the process has been restarted; see {@link WatcherBuilder#withHistorySince(EventStreamCheckpoint)}.</li>
+ *
+ *     <li>Events arrive from a single background thread unique to the {@link FileWatcher},
+ *     or from the threads of a dispatch queue, see {@link WatcherBuilder#withDispatchQueue(boolean)}.
  *     Calling methods from the {@link FileWatcher} inside the callback method is undefined
  *     behavior and can lead to a deadlock.</li>
  * </ul>
@@ -49,14 +55,61 @@ public class OsxFileEventFunctions extends AbstractFileEventFunctions<OsxFileEve
         return new WatcherBuilder(eventQueue);
     }
 
+    /**
+     * A position in the FSEvents history of a device.
+     */
+    public static class EventStreamCheckpoint {
+        private final String deviceUuid;
+        private final long eventId;
+
+        public EventStreamCheckpoint(String deviceUuid, long eventId) {
+            this.deviceUuid = deviceUuid;
+            this.eventId = eventId;
+        }
+
+        /**
+         * The UUID of the FSEvents database of the device, it changes when the history is discarded.
+         */
+        public String getDeviceUuid() {
+            return deviceUuid;
+        }
+
+        public long getEventId() {
+            return eventId;
+        }
+
+        @Override
+        public String toString() {
+            return deviceUuid + ":" + eventId;
+        }
+    }
+
     public static class OsxFileWatcher extends AbstractFileEventFunctions.NativeFileWatcher {
         public OsxFileWatcher(Object server, long startTimeout, TimeUnit startTimeoutUnit, NativeFileWatcherCallback callback) throws InterruptedException {
             super(server, startTimeout, startTimeoutUnit, callback);
         }
+
+        /**
+         * Returns a checkpoint covering the events received so far for paths on the same device as the given path,
+         * or {@code null} if FSEvents doesn't keep history for the device.
+         */
+        @Nullable
+        public EventStreamCheckpoint getCheckpoint(File path) {
+            ensureOpen();
+            String deviceUuid = getDeviceUuid0(path.getAbsolutePath());
+            if (deviceUuid == null) {
+                return null;
+            }
+            return new EventStreamCheckpoint(deviceUuid, getLastEventId0(server));
+        }
+
+        private native long getLastEventId0(Object server);
     }
 
-    public static class WatcherBuilder extends AbstractWatcherBuilder<OsxFileWatcher> {
+    public static class WatcherBuilder extends AbstractWatcherBuilder<OsxFileWatcher, WatcherBuilder> {
         private long latencyInMillis = DEFAULT_LATENCY_IN_MS;
+        private EventStreamCheckpoint historyCheckpoint;
+        private boolean useDispatchQueue;
 
         WatcherBuilder(BlockingQueue<FileWatchEvent> eventQueue) {
             super(eventQueue);
@@ -74,9 +127,45 @@ public class OsxFileEventFunctions extends AbstractFileEventFunctions<OsxFileEve
             return this;
         }
 
+        /**
+         * Replay the changes since the given checkpoint for the paths passed to the first
+         * {@link FileWatcher#startWatching(java.util.Collection)} call.
+         *
+         * Paths on a device whose history is not available for the checkpoint are reported as overflown
+         * once the history has been replayed.
+         */
+        public WatcherBuilder withHistorySince(EventStreamCheckpoint checkpoint) {
+            this.historyCheckpoint = checkpoint;
+            return this;
+        }
+
+        /**
+         * Handle events on a serial dispatch queue of the watcher, instead of on a run loop
+         * of the watcher's own background thread. The queues of all watchers share the threads of the global dispatch queue.
+         * Each watcher has its own queue instead of one queue shared by all watchers, so that a watcher
+         * blocked in its callback does not hold up the events of other watchers.
+         *
+         * With a dispatch queue events arrive from the queue's threads, and changes to the watched paths are executed
+         * on the queue as well. The watched paths of other watchers can be changed from the callback.
+         *
+         * Defaults to {@code false}.
+         */
+        public WatcherBuilder withDispatchQueue(boolean useDispatchQueue) {
+            this.useDispatchQueue = useDispatchQueue;
+            return this;
+        }
+
+        @Override
+        protected WatcherBuilder self() {
+            return this;
+        }
+
         @Override
         protected Object startWatcher(NativeFileWatcherCallback callback) {
-            return startWatcher0(latencyInMillis, callback);
+            if (historyCheckpoint == null) {
+                return startWatcher0(latencyInMillis, 0, null, useDispatchQueue, callback);
+            }
+            return startWatcher0(latencyInMillis, historyCheckpoint.getEventId(), historyCheckpoint.getDeviceUuid(), useDispatchQueue, callback);
         }
 
         @Override
@@ -85,5 +174,8 @@ public class OsxFileEventFunctions extends AbstractFileEventFunctions<OsxFileEve
         }
     }
 
-    private static native Object startWatcher0(long latencyInMillis, NativeFileWatcherCallback callback);
+    private static native Object startWatcher0(long latencyInMillis, long historyEventId, @Nullable String historyDeviceUuid, boolean useDispatchQueue, NativeFileWatcherCallback callback);
+
+    @Nullable
+    private static native String getDeviceUuid0(String path);
 }
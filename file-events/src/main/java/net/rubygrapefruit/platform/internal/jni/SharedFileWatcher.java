@@ -0,0 +1,750 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+package net.rubygrapefruit.platform.internal.jni;
+
+import net.rubygrapefruit.platform.ThreadSafe;
+import net.rubygrapefruit.platform.file.FileWatchEvent;
+import net.rubygrapefruit.platform.file.FileWatcher;
+
+import javax.annotation.Nullable;
+import java.io.File;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.HashSet;
+import java.util.IdentityHashMap;
+import java.util.List;
+import java.util.Locale;
+import java.util.Map;
+import java.util.Set;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.CopyOnWriteArrayList;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Hosts any number of logical {@link FileWatcher}s on a single native watcher. The logical watchers share
+ * its background thread and its notification object of the operating system, like the inotify instance on Linux,
+ * instead of each starting their own. Start a shared watcher with {@link AbstractFileEventFunctions.AbstractWatcherBuilder#startShared()}.
+ *
+ * Each logical watcher has its own event queue and its own set of watched paths.
+ * The watched paths are reference counted: a path is registered with the native watcher when the first logical watcher
+ * starts watching it, and unregistered when the last one stops watching it.
+ * When the native watcher reports changes to all descendants of the watched paths, a path below another watched path
+ * is not registered itself as long as the ancestor is watched, since the operating system would report each change
+ * below it once for every registered ancestor.
+ * Changes and unknown events are delivered to the logical watchers watching the affected path,
+ * overflows also to the ones watching paths below it,
+ * failures and the termination of the native watcher to all of them.
+ *
+ * Contrary to a single {@link FileWatcher}, the shared watcher and its logical watchers can be used from any thread.
+ */
+@ThreadSafe
+public class SharedFileWatcher<W extends FileWatcher> {
+    private final W watcher;
+    private final AbstractFileEventFunctions.NativeFileWatcher nativeWatcher;
+    private final DispatchingCallback callback;
+    private final boolean reportingChangesToDescendants;
+    private final boolean caseSensitive;
+
+    /**
+     * Guards changes to the watched paths, and serializes registering them with the native watcher.
+     */
+    private final Object lock = new Object();
+
+    /**
+     * The logical watchers watching each path, keyed by {@link #key(String)}. Read without locking when dispatching events.
+     */
+    private final Map<String, Route> routes = new ConcurrentHashMap<String, Route>();
+    private final List<LogicalFileWatcher> watchers = new CopyOnWriteArrayList<LogicalFileWatcher>();
+    private volatile boolean shutdown;
+
+    SharedFileWatcher(W watcher, DispatchingCallback callback) {
+        this.watcher = watcher;
+        this.nativeWatcher = (AbstractFileEventFunctions.NativeFileWatcher) watcher;
+        this.callback = callback;
+        this.reportingChangesToDescendants = nativeWatcher.isReportingChangesToDescendants();
+        this.caseSensitive = nativeWatcher.isReportingPathsInWatchedCase();
+        callback.owner = this;
+    }
+
+    /**
+     * Returns the native watcher shared by the logical watchers.
+     * Paths should only be watched via the logical watchers.
+     */
+    public W getWatcher() {
+        return watcher;
+    }
+
+    /**
+     * Creates a new logical watcher reporting events to the given queue.
+     * The queue has the same requirements as the one passed to {@link AbstractFileEventFunctions#newWatcher(BlockingQueue)}.
+     */
+    public FileWatcher newWatcher(BlockingQueue<FileWatchEvent> eventQueue) {
+        LogicalFileWatcher logicalWatcher = new LogicalFileWatcher(this, new AbstractFileEventFunctions.NativeFileWatcherCallback(eventQueue));
+        watchers.add(logicalWatcher);
+        if (callback.terminated) {
+            watchers.remove(logicalWatcher);
+            throw new IllegalStateException("Watcher already closed");
+        }
+        return logicalWatcher;
+    }
+
+    /**
+     * Returns the number of logical watchers that have not been shut down.
+     */
+    public int getWatcherCount() {
+        return watchers.size();
+    }
+
+    /**
+     * Returns the number of distinct paths watched by the logical watchers.
+     */
+    public int getWatchedPathCount() {
+        return routes.size();
+    }
+
+    /**
+     * Returns the counters collected by the native watcher since it has been started.
+     */
+    public FileWatcherStatistics getStatistics() {
+        return nativeWatcher.getStatistics();
+    }
+
+    /**
+     * Shuts down the native watcher, and thus all logical watchers.
+     */
+    public void shutdown() {
+        shutdown = true;
+        nativeWatcher.shutdown();
+    }
+
+    public boolean awaitTermination(long timeout, TimeUnit unit) throws InterruptedException {
+        return nativeWatcher.awaitTermination(timeout, unit);
+    }
+
+    private String key(String absolutePath) {
+        return caseSensitive ? absolutePath : absolutePath.toLowerCase(Locale.ROOT);
+    }
+
+    /**
+     * Returns the parent of the given absolute path, or {@code null} for a file system root.
+     */
+    @Nullable
+    static String parentOf(String path) {
+        int index = path.lastIndexOf(File.separatorChar);
+        if (index < 0 || index == path.length() - 1) {
+            return null;
+        }
+        if (index == 0 || path.charAt(index - 1) == ':') {
+            // Keep the separator of the root, i.e. / or C:\
+            return path.substring(0, index + 1);
+        }
+        return path.substring(0, index);
+    }
+
+    /**
+     * Returns the logical watchers that are watching the given path or, depending on the native watcher,
+     * its parent or any of its ancestors.
+     */
+    private List<LogicalFileWatcher> findWatchers(String absolutePath) {
+        List<LogicalFileWatcher> targets = new ArrayList<LogicalFileWatcher>(2);
+        if (routes.isEmpty()) {
+            return targets;
+        }
+        String key = key(absolutePath);
+        addWatchers(routes.get(key), targets);
+        String ancestor = parentOf(key);
+        while (ancestor != null) {
+            addWatchers(routes.get(ancestor), targets);
+            if (!reportingChangesToDescendants) {
+                break;
+            }
+            ancestor = parentOf(ancestor);
+        }
+        return targets;
+    }
+
+    /**
+     * Returns the logical watchers affected by an overflow for the given path: the ones that would receive changes
+     * to the path, and the ones watching paths below it. The native watcher reports overflows for the registered
+     * paths only, and the paths below a watched path are not necessarily registered.
+     */
+    private List<LogicalFileWatcher> findOverflowWatchers(String absolutePath) {
+        List<LogicalFileWatcher> targets = findWatchers(absolutePath);
+        String key = key(absolutePath);
+        for (Map.Entry<String, Route> entry : routes.entrySet()) {
+            if (isBelow(entry.getKey(), key)) {
+                addWatchers(entry.getValue(), targets);
+            }
+        }
+        return targets;
+    }
+
+    private static boolean isBelow(String key, String ancestorKey) {
+        String ancestor = parentOf(key);
+        while (ancestor != null) {
+            if (ancestor.equals(ancestorKey)) {
+                return true;
+            }
+            ancestor = parentOf(ancestor);
+        }
+        return false;
+    }
+
+    private static void addWatchers(@Nullable Route route, List<LogicalFileWatcher> targets) {
+        if (route == null) {
+            return;
+        }
+        for (LogicalFileWatcher watcher : route.watchers) {
+            // A logical watcher can watch more than one ancestor of the path
+            if (!targets.contains(watcher)) {
+                targets.add(watcher);
+            }
+        }
+    }
+
+    /**
+     * Adds the watcher to the route of the given path.
+     *
+     * @return whether the path wasn't watched by any logical watcher before.
+     */
+    private boolean addRoute(String key, File path, LogicalFileWatcher watcher) {
+        Route route = routes.get(key);
+        if (route == null) {
+            routes.put(key, new Route(path, new LogicalFileWatcher[]{watcher}, false));
+            return true;
+        }
+        LogicalFileWatcher[] watchers = new LogicalFileWatcher[route.watchers.length + 1];
+        System.arraycopy(route.watchers, 0, watchers, 0, route.watchers.length);
+        watchers[route.watchers.length] = watcher;
+        routes.put(key, new Route(route.path, watchers, route.registered));
+        return false;
+    }
+
+    /**
+     * Removes the watcher from the route of the given path.
+     *
+     * @return the path to unregister from the native watcher if no other logical watcher is watching it
+     * and it is registered, otherwise {@code null}.
+     */
+    @Nullable
+    private File removeRoute(String key, LogicalFileWatcher watcher) {
+        Route route = routes.get(key);
+        if (route == null) {
+            return null;
+        }
+        if (route.watchers.length == 1) {
+            routes.remove(key);
+            return route.registered ? route.path : null;
+        }
+        LogicalFileWatcher[] watchers = new LogicalFileWatcher[route.watchers.length - 1];
+        int index = 0;
+        for (LogicalFileWatcher existing : route.watchers) {
+            if (existing != watcher) {
+                watchers[index++] = existing;
+            }
+        }
+        routes.put(key, new Route(route.path, watchers, route.registered));
+        return null;
+    }
+
+    private void setRegistered(String key, boolean registered) {
+        Route route = routes.get(key);
+        routes.put(key, new Route(route.path, route.watchers, registered));
+    }
+
+    /**
+     * Whether the changes below the given path are already reported for a watched ancestor.
+     */
+    private boolean isCoveredByAncestor(String key, File path) {
+        if (!reportingChangesToDescendants) {
+            return false;
+        }
+        String ancestor = parentOf(key);
+        while (ancestor != null) {
+            Route route = routes.get(ancestor);
+            if (route != null && isResolvedBelow(path, route.path)) {
+                return true;
+            }
+            ancestor = parentOf(ancestor);
+        }
+        return false;
+    }
+
+    /**
+     * Whether the path resolves to the same location below the ancestor, i.e. there are no symlinks
+     * between them that would lead the operating system to report changes under a different path.
+     */
+    private boolean isResolvedBelow(File path, File ancestor) {
+        String absolutePath = path.getPath();
+        String ancestorPath = ancestor.getPath();
+        if (absolutePath.length() <= ancestorPath.length()) {
+            return false;
+        }
+        try {
+            String expectedPath = ancestor.getCanonicalPath() + absolutePath.substring(ancestorPath.length());
+            return key(path.getCanonicalPath()).equals(key(expectedPath));
+        } catch (IOException e) {
+            return false;
+        }
+    }
+
+    /**
+     * Collects the changes to the native registrations needed after the routes of the given keys have been added or removed,
+     * so that exactly the watched paths that are not covered by a watched ancestor are registered.
+     * Only the routes of the keys themselves and their descendants can be affected.
+     */
+    private void collectRegistrationChanges(Set<String> changedKeys, List<String> keysToRegister, List<String> keysToUnregister) {
+        if (!reportingChangesToDescendants) {
+            for (String key : changedKeys) {
+                Route route = routes.get(key);
+                if (route != null && !route.registered) {
+                    keysToRegister.add(key);
+                }
+            }
+            return;
+        }
+        for (Map.Entry<String, Route> entry : routes.entrySet()) {
+            String key = entry.getKey();
+            if (!isSelfOrDescendant(key, changedKeys)) {
+                continue;
+            }
+            Route route = entry.getValue();
+            boolean needsRegistration = !isCoveredByAncestor(key, route.path);
+            if (needsRegistration && !route.registered) {
+                keysToRegister.add(key);
+            } else if (!needsRegistration && route.registered) {
+                keysToUnregister.add(key);
+            }
+        }
+    }
+
+    private static boolean isSelfOrDescendant(String key, Set<String> ancestorKeys) {
+        String current = key;
+        while (current != null) {
+            if (ancestorKeys.contains(current)) {
+                return true;
+            }
+            current = parentOf(current);
+        }
+        return false;
+    }
+
+    private List<File> pathsOf(List<String> keys) {
+        List<File> paths = new ArrayList<File>(keys.size());
+        for (String key : keys) {
+            paths.add(routes.get(key).path);
+        }
+        return paths;
+    }
+
+    private void startWatching(LogicalFileWatcher watcher, Collection<File> paths) {
+        synchronized (lock) {
+            watcher.ensureOpen();
+            List<File> absolutePaths = new ArrayList<File>(paths.size());
+            List<String> keys = new ArrayList<String>(paths.size());
+            Set<String> newKeys = new HashSet<String>();
+            for (File path : paths) {
+                File absolutePath = path.getAbsoluteFile();
+                String key = key(absolutePath.getPath());
+                if (watcher.watchedKeys.contains(key) || !newKeys.add(key)) {
+                    throw new AbstractFileEventFunctions.FileWatcherException("Already watching path: " + absolutePath.getPath());
+                }
+                absolutePaths.add(absolutePath);
+                keys.add(key);
+            }
+
+            Set<String> addedKeys = new HashSet<String>();
+            for (int i = 0; i < keys.size(); i++) {
+                if (addRoute(keys.get(i), absolutePaths.get(i), watcher)) {
+                    addedKeys.add(keys.get(i));
+                }
+            }
+            watcher.watchedKeys.addAll(newKeys);
+            if (addedKeys.isEmpty()) {
+                return;
+            }
+            List<String> keysToRegister = new ArrayList<String>();
+            List<String> keysToUnregister = new ArrayList<String>();
+            collectRegistrationChanges(addedKeys, keysToRegister, keysToUnregister);
+            if (!keysToRegister.isEmpty()) {
+                List<File> pathsToRegister = pathsOf(keysToRegister);
+                try {
+                    nativeWatcher.startWatching(pathsToRegister);
+                } catch (RuntimeException e) {
+                    // The native watcher keeps watching the paths registered before the failure
+                    unregisterQuietly(pathsToRegister);
+                    for (String key : keys) {
+                        removeRoute(key, watcher);
+                    }
+                    watcher.watchedKeys.removeAll(newKeys);
+                    throw e;
+                }
+                for (String key : keysToRegister) {
+                    setRegistered(key, true);
+                }
+            }
+            // Watched paths below the newly registered ones are now covered by them
+            if (!keysToUnregister.isEmpty()) {
+                List<File> pathsToUnregister = pathsOf(keysToUnregister);
+                for (String key : keysToUnregister) {
+                    setRegistered(key, false);
+                }
+                unregisterQuietly(pathsToUnregister);
+            }
+        }
+    }
+
+    private boolean stopWatching(LogicalFileWatcher watcher, Collection<File> paths) {
+        synchronized (lock) {
+            watcher.ensureOpen();
+            boolean success = true;
+            Set<String> removedKeys = new HashSet<String>();
+            List<File> pathsToUnregister = new ArrayList<File>();
+            for (File path : paths) {
+                String key = key(path.getAbsolutePath());
+                if (!watcher.watchedKeys.remove(key)) {
+                    success = false;
+                    continue;
+                }
+                removeRoute(key, watcher, removedKeys, pathsToUnregister);
+            }
+            registerUncoveredDescendants(removedKeys);
+            if (!pathsToUnregister.isEmpty()) {
+                success &= nativeWatcher.stopWatching(pathsToUnregister);
+            }
+            return success;
+        }
+    }
+
+    private void shutdown(LogicalFileWatcher watcher) {
+        synchronized (lock) {
+            watcher.ensureOpen();
+            watcher.shutdown = true;
+            Set<String> removedKeys = new HashSet<String>();
+            List<File> pathsToUnregister = new ArrayList<File>();
+            for (String key : watcher.watchedKeys) {
+                removeRoute(key, watcher, removedKeys, pathsToUnregister);
+            }
+            watcher.watchedKeys.clear();
+            watchers.remove(watcher);
+            registerUncoveredDescendants(removedKeys);
+            unregisterQuietly(pathsToUnregister);
+        }
+    }
+
+    private void removeRoute(String key, LogicalFileWatcher watcher, Set<String> removedKeys, List<File> pathsToUnregister) {
+        File registeredPath = removeRoute(key, watcher);
+        if (registeredPath != null) {
+            pathsToUnregister.add(registeredPath);
+        }
+        if (!routes.containsKey(key)) {
+            removedKeys.add(key);
+        }
+    }
+
+    /**
+     * Registers the watched paths below the removed ones that are no longer covered by a watched ancestor.
+     * This happens before the removed paths are unregistered, so that no changes below them are missed.
+     */
+    private void registerUncoveredDescendants(Set<String> removedKeys) {
+        if (!reportingChangesToDescendants || removedKeys.isEmpty() || shutdown || callback.terminated) {
+            return;
+        }
+        List<String> keysToRegister = new ArrayList<String>();
+        collectRegistrationChanges(removedKeys, keysToRegister, new ArrayList<String>());
+        if (keysToRegister.isEmpty()) {
+            return;
+        }
+        List<File> pathsToRegister = pathsOf(keysToRegister);
+        Map<File, String> failures = nativeWatcher.tryStartWatching(pathsToRegister);
+        for (int i = 0; i < keysToRegister.size(); i++) {
+            String key = keysToRegister.get(i);
+            String failure = failures.get(pathsToRegister.get(i));
+            if (failure == null) {
+                setRegistered(key, true);
+                continue;
+            }
+            AbstractFileEventFunctions.FileWatcherException exception = new AbstractFileEventFunctions.FileWatcherException(
+                "Couldn't keep watching " + pathsToRegister.get(i) + " after its ancestor has been unwatched: " + failure);
+            for (LogicalFileWatcher routeWatcher : routes.get(key).watchers) {
+                routeWatcher.reportFailure(exception);
+            }
+        }
+    }
+
+    private void unregisterQuietly(List<File> paths) {
+        if (paths.isEmpty() || shutdown || callback.terminated) {
+            return;
+        }
+        try {
+            if (!nativeWatcher.stopWatching(paths)) {
+                NativeLogger.LOGGER.fine("Some of the paths have not been watched: " + paths);
+            }
+        } catch (RuntimeException e) {
+            NativeLogger.LOGGER.info("Couldn't stop watching paths " + paths + ": " + e.getMessage());
+        }
+    }
+
+    private void dispatchChangeEvent(FileWatchEvent.ChangeType type, String path) {
+        for (LogicalFileWatcher watcher : findWatchers(path)) {
+            watcher.reportChangeEvent(type, path);
+        }
+    }
+
+    private void dispatchUnknownEvent(String path) {
+        for (LogicalFileWatcher watcher : findWatchers(path)) {
+            watcher.reportUnknownEvent(path);
+        }
+    }
+
+    private void dispatchOverflow(@Nullable String path) {
+        List<LogicalFileWatcher> targets = path == null ? watchers : findOverflowWatchers(path);
+        for (LogicalFileWatcher watcher : targets) {
+            watcher.reportOverflow(path);
+        }
+    }
+
+    private void dispatchOverflows(String[] paths) {
+        if (paths.length == 0) {
+            for (LogicalFileWatcher watcher : watchers) {
+                watcher.reportOverflows(paths);
+            }
+            return;
+        }
+        // Report a single overflow to each logical watcher for the affected paths it is watching
+        Map<LogicalFileWatcher, List<String>> pathsByWatcher = new IdentityHashMap<LogicalFileWatcher, List<String>>();
+        for (String path : paths) {
+            for (LogicalFileWatcher watcher : findOverflowWatchers(path)) {
+                List<String> watcherPaths = pathsByWatcher.get(watcher);
+                if (watcherPaths == null) {
+                    watcherPaths = new ArrayList<String>();
+                    pathsByWatcher.put(watcher, watcherPaths);
+                }
+                watcherPaths.add(path);
+            }
+        }
+        for (Map.Entry<LogicalFileWatcher, List<String>> entry : pathsByWatcher.entrySet()) {
+            List<String> watcherPaths = entry.getValue();
+            entry.getKey().reportOverflows(watcherPaths.toArray(new String[0]));
+        }
+    }
+
+    private void dispatchFailure(Throwable failure) {
+        for (LogicalFileWatcher watcher : watchers) {
+            watcher.reportFailure(failure);
+        }
+    }
+
+    private void dispatchTermination() {
+        for (LogicalFileWatcher watcher : watchers) {
+            watcher.terminate();
+        }
+        watchers.clear();
+    }
+
+    private static class Route {
+        /**
+         * The path as registered with the native watcher.
+         */
+        final File path;
+        final LogicalFileWatcher[] watchers;
+
+        /**
+         * Whether the path is registered with the native watcher, or covered by a watched ancestor instead.
+         */
+        final boolean registered;
+
+        Route(File path, LogicalFileWatcher[] watchers, boolean registered) {
+            this.path = path;
+            this.watchers = watchers;
+            this.registered = registered;
+        }
+    }
+
+    /**
+     * A watcher with its own event queue and watched paths, multiplexed over the shared native watcher.
+     */
+    private static class LogicalFileWatcher implements FileWatcher {
+        private final SharedFileWatcher<?> owner;
+        private final AbstractFileEventFunctions.NativeFileWatcherCallback callback;
+        private final CountDownLatch termination = new CountDownLatch(1);
+
+        /**
+         * Keys of the paths watched by this watcher. Guarded by the lock of the owner.
+         */
+        private final Set<String> watchedKeys = new HashSet<String>();
+        private boolean shutdown;
+
+        /**
+         * Guarded by this watcher, so that no events are delivered after the termination.
+         */
+        private boolean terminated;
+
+        LogicalFileWatcher(SharedFileWatcher<?> owner, AbstractFileEventFunctions.NativeFileWatcherCallback callback) {
+            this.owner = owner;
+            this.callback = callback;
+        }
+
+        /**
+         * Starts watching the given paths. When registering them fails, none of the given paths are watched.
+         */
+        @Override
+        public void startWatching(Collection<File> paths) {
+            owner.startWatching(this, paths);
+        }
+
+        @Override
+        public boolean stopWatching(Collection<File> paths) {
+            return owner.stopWatching(this, paths);
+        }
+
+        /**
+         * Stops watching all paths of this watcher, and reports its termination.
+         * The shared native watcher keeps running.
+         */
+        @Override
+        public void shutdown() {
+            owner.shutdown(this);
+            terminate();
+        }
+
+        @Override
+        public boolean awaitTermination(long timeout, TimeUnit unit) throws InterruptedException {
+            return termination.await(timeout, unit);
+        }
+
+        private void ensureOpen() {
+            if (shutdown) {
+                throw new IllegalStateException("Watcher already closed");
+            }
+        }
+
+        private synchronized void reportChangeEvent(FileWatchEvent.ChangeType type, String path) {
+            if (!terminated) {
+                callback.reportChangeEvent(type, path);
+            }
+        }
+
+        private synchronized void reportUnknownEvent(String path) {
+            if (!terminated) {
+                callback.reportUnknownEvent(path);
+            }
+        }
+
+        private synchronized void reportOverflow(@Nullable String path) {
+            if (!terminated) {
+                callback.reportOverflow(path);
+            }
+        }
+
+        private synchronized void reportOverflows(String[] paths) {
+            if (!terminated) {
+                callback.reportOverflows(paths);
+            }
+        }
+
+        private synchronized void reportFailure(Throwable failure) {
+            if (!terminated) {
+                callback.reportFailure(failure);
+            }
+        }
+
+        private void terminate() {
+            synchronized (this) {
+                if (terminated) {
+                    return;
+                }
+                terminated = true;
+                callback.reportTermination();
+            }
+            termination.countDown();
+        }
+    }
+
+    /**
+     * Receives the events of the native watcher, and dispatches them to the logical watchers.
+     */
+    static class DispatchingCallback extends AbstractFileEventFunctions.NativeFileWatcherCallback {
+        volatile SharedFileWatcher<?> owner;
+        volatile boolean terminated;
+
+        DispatchingCallback(BlockingQueue<FileWatchEvent> eventQueue, @Nullable ByteBuffer sharedEventBuffer, boolean coalescingChangeEvents) {
+            super(eventQueue, sharedEventBuffer, coalescingChangeEvents);
+        }
+
+        @Override
+        protected void reportChangeEvent(FileWatchEvent.ChangeType type, String path) {
+            SharedFileWatcher<?> owner = this.owner;
+            if (owner != null) {
+                owner.dispatchChangeEvent(type, path);
+            }
+        }
+
+        @Override
+        protected void reportEncodedChangeEvent(FileWatchEvent.ChangeType type, char[] batch, int pathOffset, int pathLength) {
+            // Routing needs the path anyway
+            reportChangeEvent(type, new String(batch, pathOffset, pathLength));
+        }
+
+        @Override
+        public void reportUnknownEvent(String path) {
+            SharedFileWatcher<?> owner = this.owner;
+            if (owner != null) {
+                owner.dispatchUnknownEvent(path);
+            }
+        }
+
+        @Override
+        public void reportOverflow(@Nullable String path) {
+            SharedFileWatcher<?> owner = this.owner;
+            if (owner != null) {
+                owner.dispatchOverflow(path);
+            }
+        }
+
+        @Override
+        public void reportOverflows(String[] paths) {
+            SharedFileWatcher<?> owner = this.owner;
+            if (owner != null) {
+                owner.dispatchOverflows(paths);
+            }
+        }
+
+        @Override
+        public void reportFailure(Throwable ex) {
+            super.reportFailure(ex);
+            SharedFileWatcher<?> owner = this.owner;
+            if (owner != null) {
+                owner.dispatchFailure(ex);
+            }
+        }
+
+        @Override
+        public void reportTermination() {
+            terminated = true;
+            super.reportTermination();
+            SharedFileWatcher<?> owner = this.owner;
+            if (owner != null) {
+                owner.dispatchTermination();
+            }
+        }
+    }
+}
@@ -16,12 +16,14 @@
 
 package net.rubygrapefruit.platform.internal.jni;
 
+import net.rubygrapefruit.platform.NativeException;
 import net.rubygrapefruit.platform.file.FileWatchEvent;
 import net.rubygrapefruit.platform.file.FileWatcher;
 
 import java.io.File;
 import java.util.ArrayList;
 import java.util.Collection;
+import java.util.Collections;
 import java.util.List;
 import java.util.concurrent.BlockingQueue;
 import java.util.concurrent.TimeUnit;
@@ -56,11 +58,131 @@ public class WindowsFileEventFunctions extends AbstractFileEventFunctions<Window
         return new WatcherBuilder(eventQueue);
     }
 
+    /**
+     * Returns the current position of the NTFS change journal of the volume containing the given path.
+     *
+     * The position can be persisted, and passed to {@link #readChangeJournal(ChangeJournalPosition, Collection)}
+     * after a restart to find the paths that have been changed in the meantime.
+     *
+     * Reading the change journal requires administrator privileges.
+     *
+     * @throws NativeException when the journal is not available, e.g. the volume isn't NTFS or the process isn't privileged enough.
+     */
+    public ChangeJournalPosition getChangeJournalPosition(File path) {
+        return getChangeJournalPosition0(path.getAbsolutePath());
+    }
+
+    /**
+     * Returns the paths below the given roots that have been changed since the given position of the change journal,
+     * together with the position to continue from next time.
+     *
+     * The changed paths include files and directories that have been created, modified, removed or renamed.
+     * Changes inside directories the process is not allowed to open are not reported.
+     * When the changes cannot be determined anymore, e.g. because the journal has been truncated or recreated
+     * since the given position, the returned changes are {@linkplain ChangeJournalChanges#isComplete() incomplete},
+     * and the roots need to be scanned instead.
+     */
+    public ChangeJournalChanges readChangeJournal(ChangeJournalPosition since, Collection<File> roots) {
+        String[] rootPaths = new String[roots.size()];
+        int index = 0;
+        for (File root : roots) {
+            rootPaths[index++] = root.getAbsolutePath();
+        }
+        List<String> changedPathStrings = new ArrayList<String>();
+        long nextUsn = readChangeJournal0(since.getVolume(), since.getJournalId(), since.getUsn(), rootPaths, changedPathStrings);
+        if (nextUsn < 0) {
+            return new ChangeJournalChanges(getChangeJournalPosition0(since.getVolume()), Collections.<File>emptyList(), false);
+        }
+        List<File> changedPaths = new ArrayList<File>(changedPathStrings.size());
+        for (String changedPath : changedPathStrings) {
+            changedPaths.add(new File(changedPath));
+        }
+        return new ChangeJournalChanges(new ChangeJournalPosition(since.getVolume(), since.getJournalId(), nextUsn), changedPaths, true);
+    }
+
+    /**
+     * A position in the change journal of a volume.
+     */
+    public static class ChangeJournalPosition {
+        private final String volume;
+        private final long journalId;
+        private final long usn;
+
+        public ChangeJournalPosition(String volume, long journalId, long usn) {
+            this.volume = volume;
+            this.journalId = journalId;
+            this.usn = usn;
+        }
+
+        /**
+         * The root of the volume, e.g. {@code C:\}.
+         */
+        public String getVolume() {
+            return volume;
+        }
+
+        /**
+         * Identifies the instance of the journal, it changes when the journal is recreated.
+         */
+        public long getJournalId() {
+            return journalId;
+        }
+
+        /**
+         * The update sequence number of the next change to be recorded in the journal.
+         */
+        public long getUsn() {
+            return usn;
+        }
+
+        @Override
+        public String toString() {
+            return volume + "@" + Long.toHexString(journalId) + ":" + usn;
+        }
+    }
+
+    public static class ChangeJournalChanges {
+        private final ChangeJournalPosition position;
+        private final List<File> changedPaths;
+        private final boolean complete;
+
+        private ChangeJournalChanges(ChangeJournalPosition position, List<File> changedPaths, boolean complete) {
+            this.position = position;
+            this.changedPaths = changedPaths;
+            this.complete = complete;
+        }
+
+        /**
+         * The position to read the next changes from.
+         */
+        public ChangeJournalPosition getPosition() {
+            return position;
+        }
+
+        public List<File> getChangedPaths() {
+            return changedPaths;
+        }
+
+        /**
+         * Whether all changes could be determined, if not the roots need to be scanned for changes.
+         */
+        public boolean isComplete() {
+            return complete;
+        }
+    }
+
     public static class WindowsFileWatcher extends AbstractFileEventFunctions.NativeFileWatcher {
         public WindowsFileWatcher(Object server, long startTimeout, TimeUnit startTimeoutUnit, NativeFileWatcherCallback callback) throws InterruptedException {
             super(server, startTimeout, startTimeoutUnit, callback);
         }
 
+        @Override
+        protected boolean isReportingPathsInWatchedCase() {
+            // Changes are reported as the registered path joined with the child names returned by the OS,
+            // which may differ in case from the path the change was watched for
+            return false;
+        }
+
         /**
          * Stops watching any directory hierarchies that have been moved to a different path since registration,
          * and returns the list of the registered paths that have been dropped.
@@ -78,9 +200,10 @@ public class WindowsFileEventFunctions extends AbstractFileEventFunctions<Window
         private native void stopWatchingMovedPaths0(Object server, List<String> droppedPaths);
     }
 
-    public static class WatcherBuilder extends AbstractWatcherBuilder<WindowsFileWatcher> {
+    public static class WatcherBuilder extends AbstractWatcherBuilder<WindowsFileWatcher, WatcherBuilder> {
         private int bufferSize = DEFAULT_BUFFER_SIZE;
         private long commandTimeoutInMillis = TimeUnit.SECONDS.toMillis(DEFAULT_COMMAND_TIMEOUT_IN_SECONDS);
+        private boolean useCompletionPort;
 
         private WatcherBuilder(BlockingQueue<FileWatchEvent> eventQueue) {
             super(eventQueue);
@@ -88,6 +211,8 @@ public class WindowsFileEventFunctions extends AbstractFileEventFunctions<Window
 
         /**
          * Set the buffer size used to collect events.
+         * Each watched hierarchy uses two buffers of this size, so that it can receive
+         * new events while the previously received ones are being reported.
          * Default value is {@value DEFAULT_BUFFER_SIZE} bytes.
          */
         public WatcherBuilder withBufferSize(int bufferSize) {
@@ -110,9 +235,29 @@ public class WindowsFileEventFunctions extends AbstractFileEventFunctions<Window
             return this;
         }
 
+        /**
+         * Sets whether to receive events and commands via an I/O completion port instead of
+         * asynchronous procedure calls.
+         *
+         * With a completion port the background thread dequeues the completions of many
+         * watched hierarchies in a single batch, which scales better with thousands of watched paths.
+         * Events still arrive from the single background thread.
+         *
+         * Defaults to {@code false}.
+         */
+        public WatcherBuilder withCompletionPort(boolean useCompletionPort) {
+            this.useCompletionPort = useCompletionPort;
+            return this;
+        }
+
+        @Override
+        protected WatcherBuilder self() {
+            return this;
+        }
+
         @Override
         protected Object startWatcher(NativeFileWatcherCallback callback) {
-            return startWatcher0(bufferSize, commandTimeoutInMillis, callback);
+            return startWatcher0(bufferSize, commandTimeoutInMillis, useCompletionPort, callback);
         }
 
         @Override
@@ -121,5 +266,9 @@ public class WindowsFileEventFunctions extends AbstractFileEventFunctions<Window
         }
     }
 
-    private static native Object startWatcher0(int bufferSize, long commandTimeoutInMillis, NativeFileWatcherCallback callback);
+    private static native ChangeJournalPosition getChangeJournalPosition0(String path);
+
+    private static native long readChangeJournal0(String volume, long journalId, long usn, String[] roots, List<String> changedPaths);
+
+    private static native Object startWatcher0(int bufferSize, long commandTimeoutInMillis, boolean useCompletionPort, NativeFileWatcherCallback callback);
 }
@@ -38,6 +38,7 @@ import spock.lang.Specification
 import spock.lang.Timeout
 
 import java.util.concurrent.BlockingQueue
+import java.util.concurrent.CountDownLatch
 import java.util.concurrent.LinkedBlockingQueue
 import java.util.concurrent.TimeUnit
 import java.util.function.BooleanSupplier
@@ -317,6 +318,36 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
         }
     }
 
+    private class ExpectedOverflow implements ExpectedEvent {
+        private final File file
+
+        ExpectedOverflow(File file) {
+            this.file = file
+        }
+
+        @Override
+        boolean matches(FileWatchEvent event) {
+            def matcher = new MatcherHandler() {
+                @Override
+                void handleOverflow(OverflowType type, @Nullable String absolutePath) {
+                    matched = ExpectedOverflow.this.file?.absolutePath == absolutePath
+                }
+            }
+            event.handleEvent(matcher)
+            return matcher.matched
+        }
+
+        @Override
+        boolean isOptional() {
+            false
+        }
+
+        @Override
+        String toString() {
+            return "OVERFLOW ${file == null ? null : shorten(file)}"
+        }
+    }
+
     private class ExpectedFailure implements ExpectedEvent {
         private final Pattern message
         private final Class<? extends Throwable> type
@@ -562,6 +593,10 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
         return new ExpectedChange(type, file, true)
     }
 
+    protected ExpectedEvent overflow(@Nullable File file) {
+        return new ExpectedOverflow(file)
+    }
+
     protected ExpectedEvent failure(Class<? extends Throwable> type = Exception, String message) {
         failure(type, Pattern.quote(message))
     }
@@ -574,6 +609,36 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
         return new ExpectedTermination()
     }
 
+    /**
+     * Creates a file and waits for the watcher thread to block while reporting its event,
+     * so that the events that follow pile up in the queue of the operating system, and are read as a single batch.
+     */
+    protected void pauseWatcher(PausingEventQueue pausingQueue, File file) {
+        createNewFile(file)
+        assert pausingQueue.paused.await(5, SECONDS)
+    }
+
+    /**
+     * Blocks the watcher thread when it reports its first event, until resumed.
+     */
+    protected static class PausingEventQueue extends LinkedBlockingQueue<FileWatchEvent> {
+        final CountDownLatch paused = new CountDownLatch(1)
+        private final CountDownLatch resumed = new CountDownLatch(1)
+
+        @Override
+        boolean offer(FileWatchEvent event) {
+            if (paused.count > 0 && Thread.currentThread().name == "File watcher server") {
+                paused.countDown()
+                resumed.await()
+            }
+            return super.offer(event)
+        }
+
+        void resume() {
+            resumed.countDown()
+        }
+    }
+
     protected void createNewFile(File file) {
         LOGGER.info("> Creating ${shorten(file)}")
         file.createNewFile()
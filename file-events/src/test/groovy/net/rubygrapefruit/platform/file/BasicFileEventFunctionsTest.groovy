@@ -458,6 +458,73 @@ class BasicFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         expectLogMessage(SEVERE, "Caught exception: Already watching path: ${rootDir.absolutePath}")
     }
 
+    def "can carry on watching other paths when some of them fail"() {
+        given:
+        def watchedDir = new File(rootDir, "watched")
+        assert watchedDir.mkdirs()
+        def otherDir = new File(rootDir, "other")
+        assert otherDir.mkdirs()
+        def createdFile = new File(otherDir, "created.txt")
+        startWatcher(watchedDir)
+
+        when:
+        def failures = (watcher as AbstractFileEventFunctions.NativeFileWatcher).tryStartWatching([watchedDir, otherDir])
+
+        then:
+        failures == [(watchedDir): "Already watching path: ${watchedDir.absolutePath}".toString()]
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents change(CREATED, createdFile)
+    }
+
+    def "can update the set of watched paths"() {
+        given:
+        def removedDir = new File(rootDir, "removed")
+        def keptDir = new File(rootDir, "kept")
+        def addedDir = new File(rootDir, "added")
+        [removedDir, keptDir, addedDir]*.mkdirs()
+        startWatcher(removedDir, keptDir)
+        def nativeWatcher = watcher as AbstractFileEventFunctions.NativeFileWatcher
+
+        when:
+        nativeWatcher.setWatchedPaths([keptDir, addedDir])
+        createNewFile(new File(removedDir, "created.txt"))
+        createNewFile(new File(keptDir, "created.txt"))
+        createNewFile(new File(addedDir, "created.txt"))
+
+        then:
+        expectEvents change(CREATED, new File(keptDir, "created.txt")), change(CREATED, new File(addedDir, "created.txt"))
+    }
+
+    def "collects statistics"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        startWatcher(rootDir)
+        def nativeWatcher = watcher as AbstractFileEventFunctions.NativeFileWatcher
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        when:
+        def statistics = nativeWatcher.statistics
+
+        then:
+        statistics.watchedPaths == 1
+        statistics.commands == 1
+        statistics.eventsReceived >= 1
+        statistics.getChangeEventsReported(CREATED) == 1
+        statistics.callbacks >= 1
+        statistics.callbackHistogram.sum() == statistics.callbacks
+        statistics.overflowsReported == 0
+        statistics.queuedEventCount == 0
+    }
+
     def "can un-watch path that was not watched"() {
         given:
         startWatcher()
@@ -517,6 +584,32 @@ class BasicFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         expectEvents change(CREATED, secondFileInSecondWatchedDir)
     }
 
+    def "keeps receiving events from watched directories when adding more"() {
+        given:
+        def firstWatchedDir = new File(testDir, "first")
+        assert firstWatchedDir.mkdirs()
+        def firstFile = new File(firstWatchedDir, "first.txt")
+        def secondWatchedDir = new File(testDir, "second")
+        assert secondWatchedDir.mkdirs()
+        def fileCreatedBeforeWatching = new File(secondWatchedDir, "before.txt")
+        def secondFile = new File(secondWatchedDir, "second.txt")
+        startWatcher(firstWatchedDir)
+
+        when:
+        createNewFile(fileCreatedBeforeWatching)
+        createNewFile(firstFile)
+        watcher.startWatching([secondWatchedDir])
+
+        then:
+        expectEvents change(CREATED, firstFile)
+
+        when:
+        createNewFile(secondFile)
+
+        then:
+        expectEvents change(CREATED, secondFile)
+    }
+
     @Requires({ !Platform.current().linux })
     def "can receive events from directory with different casing"() {
         given:
@@ -732,6 +825,28 @@ class BasicFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         "waiting for log level cache to time out" | { Thread.sleep(1500) }
     }
 
+    def "can log asynchronously"() {
+        given:
+        def unwatchedDirs = (1..3).collect { new File(rootDir, "unwatched-$it") }
+        startWatcher()
+
+        when:
+        logging.clear()
+        service.setAsynchronousLogging(true)
+        watcher.stopWatching(unwatchedDirs)
+        service.setAsynchronousLogging(false)
+
+        then:
+        logging.messages.findAll { message, level -> level == INFO }.keySet().toList() == unwatchedDirs.collect { "Path is not watched: ${it.absolutePath}".toString() }
+
+        unwatchedDirs.each {
+            expectLogMessage(INFO, "Path is not watched: ${it.absolutePath}")
+        }
+
+        cleanup:
+        service.setAsynchronousLogging(false)
+    }
+
     def "handles queue not able to take any events"() {
         given:
         def notAcceptingQueue = Stub(BlockingQueue) {
@@ -758,6 +873,109 @@ class BasicFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         expectLogMessage(SEVERE, "Couldn't queue event: TERMINATE")
     }
 
+    def "can receive events via shared event buffer"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        def modifiedFile = new File(rootDir, "modified.txt")
+        modifiedFile.createNewFile()
+        waitForChangeEventLatency()
+        watcher = service.newWatcher(eventQueue)
+            .withSharedEventBuffer(AbstractFileEventFunctions.AbstractWatcherBuilder.MINIMUM_SHARED_EVENT_BUFFER_SIZE)
+            .start()
+        watcher.startWatching([rootDir])
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        when:
+        waitForChangeEventLatency()
+        modifiedFile << "changed"
+
+        then:
+        expectEvents change(MODIFIED, modifiedFile)
+    }
+
+    def "fails when shared event buffer is too small"() {
+        when:
+        service.newWatcher(eventQueue).withSharedEventBuffer(1024)
+
+        then:
+        def ex = thrown IllegalArgumentException
+        ex.message == "Shared event buffer must be at least ${AbstractFileEventFunctions.AbstractWatcherBuilder.MINIMUM_SHARED_EVENT_BUFFER_SIZE} bytes"
+    }
+
+    def "coalesces repeated modifications of a path within a batch"() {
+        given:
+        def modifiedFile = new File(rootDir, "modified.txt")
+        def pauseFile = new File(rootDir, "pause.txt")
+        createNewFile(modifiedFile)
+        waitForChangeEventLatency()
+        def pausingQueue = new PausingEventQueue()
+        watcher = service.newWatcher(pausingQueue)
+            .withCoalescedChangeEvents(true)
+            .start()
+        watcher.startWatching([rootDir])
+
+        when:
+        pauseWatcher(pausingQueue, pauseFile)
+        5.times { modifiedFile << "change $it\n" }
+        waitForChangeEventLatency()
+        pausingQueue.resume()
+
+        then:
+        expectEvents pausingQueue, change(CREATED, pauseFile), change(MODIFIED, modifiedFile)
+    }
+
+    def "reports a single removal for a path created and removed within a batch"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        def pauseFile = new File(rootDir, "pause.txt")
+        def pausingQueue = new PausingEventQueue()
+        watcher = service.newWatcher(pausingQueue)
+            .withCoalescedChangeEvents(true)
+            .start()
+        watcher.startWatching([rootDir])
+
+        when:
+        pauseWatcher(pausingQueue, pauseFile)
+        createNewFile(createdFile)
+        createdFile << "changed"
+        assert createdFile.delete()
+        waitForChangeEventLatency()
+        pausingQueue.resume()
+
+        then:
+        expectEvents pausingQueue, change(CREATED, pauseFile), change(REMOVED, createdFile)
+    }
+
+    def "reports a single removal for a path modified, removed, created and removed again within a batch"() {
+        given:
+        def changedFile = new File(rootDir, "changed.txt")
+        def pauseFile = new File(rootDir, "pause.txt")
+        createNewFile(changedFile)
+        waitForChangeEventLatency()
+        def pausingQueue = new PausingEventQueue()
+        watcher = service.newWatcher(pausingQueue)
+            .withCoalescedChangeEvents(true)
+            .start()
+        watcher.startWatching([rootDir])
+
+        when:
+        pauseWatcher(pausingQueue, pauseFile)
+        changedFile << "changed"
+        assert changedFile.delete()
+        createNewFile(changedFile)
+        assert changedFile.delete()
+        waitForChangeEventLatency()
+        pausingQueue.resume()
+
+        then:
+        expectEvents pausingQueue, change(CREATED, pauseFile), change(REMOVED, changedFile)
+    }
+
     def "can handle watcher start timing out"() {
         when:
         service.newWatcher(eventQueue).start(0, SECONDS)
@@ -17,6 +17,8 @@
 package net.rubygrapefruit.platform.file
 
 import net.rubygrapefruit.platform.internal.Platform
+import net.rubygrapefruit.platform.internal.jni.LinuxFileEventFunctions
+import org.junit.Assume
 import org.spockframework.util.Nullable
 import spock.lang.Ignore
 import spock.lang.Requires
@@ -30,6 +32,7 @@ import java.util.concurrent.TimeUnit
 import static java.util.concurrent.TimeUnit.SECONDS
 import static java.util.logging.Level.INFO
 import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.CREATED
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.REMOVED
 
 @Requires({ Platform.current().macOs || Platform.current().linux || Platform.current().windows })
 class FileEventFunctionsOverflowTest extends AbstractFileEventFunctionsTest {
@@ -120,6 +123,106 @@ class FileEventFunctionsOverflowTest extends AbstractFileEventFunctionsTest {
         expectLogMessage(INFO, "Event queue overflow, dropping all events")
     }
 
+    @Requires({ Platform.current().linux })
+    def "reports a single overflow for each watched hierarchy when the inotify queue overflows"() {
+        given:
+        def firstRoot = new File(rootDir, "first")
+        def nestedRoot = new File(firstRoot, "nested")
+        def secondRoot = new File(rootDir, "second")
+        assert nestedRoot.mkdirs()
+        assert secondRoot.mkdirs()
+        def pausingQueue = new PausingEventQueue()
+        startWatcher(pausingQueue, firstRoot, nestedRoot, secondRoot)
+
+        when:
+        pauseWatcher(pausingQueue, new File(secondRoot, "pause.txt"))
+        floodInotifyQueue(secondRoot)
+        pausingQueue.resume()
+
+        then:
+        def overflows = collectEvents(pausingQueue) { observed -> observed.overflows.size() >= 2 }.overflows
+        overflows.sort() == [firstRoot.absolutePath, secondRoot.absolutePath].sort()
+
+        when:
+        waitForChangeEventLatency()
+
+        then:
+        collectEvents(pausingQueue) { observed -> pausingQueue.empty }.overflows.empty
+
+        expectLogMessage(INFO, "Detected overflow for 2 paths")
+    }
+
+    @Requires({ Platform.current().linux })
+    def "reports changes lost to an inotify queue overflow when reconciling overflows"() {
+        given:
+        def removedFile = new File(rootDir, "removed.txt")
+        createNewFile(removedFile)
+        def pausingQueue = new PausingEventQueue()
+        watcher = (service as LinuxFileEventFunctions).newWatcher(pausingQueue)
+            .withOverflowReconciliation(true)
+            .start()
+        watcher.startWatching([rootDir])
+
+        when:
+        pauseWatcher(pausingQueue, new File(rootDir, "pause.txt"))
+        def createdFiles = floodInotifyQueue(rootDir)
+        // The queue is full already, so this event is lost
+        removedFile.delete()
+        pausingQueue.resume()
+
+        then:
+        def expectedCreated = createdFiles*.absolutePath as Set
+        def events = collectEvents(pausingQueue) { observed ->
+            observed.created.containsAll(expectedCreated) && observed.removed.contains(removedFile.absolutePath)
+        }
+        events.created.containsAll(expectedCreated)
+        events.removed == [removedFile.absolutePath]
+        events.overflows.empty
+
+        expectLogMessage(INFO, "Reconciling 1 watched directories after overflow")
+    }
+
+    /**
+     * Creates more files than the inotify queue can hold while the watcher is paused.
+     */
+    private static List<File> floodInotifyQueue(File dir) {
+        int maxQueuedEvents = new File("/proc/sys/fs/inotify/max_queued_events").text.trim() as int
+        Assume.assumeTrue("Inotify queue is too large to overflow in a test", maxQueuedEvents <= 65536)
+        def files = (1..(maxQueuedEvents + 10)).collect { new File(dir, "flood-$it") }
+        files.each { assert it.createNewFile() }
+        return files
+    }
+
+    private static ObservedEvents collectEvents(BlockingQueue<FileWatchEvent> eventQueue, Closure<Boolean> complete) {
+        def events = new ObservedEvents()
+        long deadline = System.nanoTime() + SECONDS.toNanos(5)
+        while (!complete(events) && System.nanoTime() < deadline) {
+            def event = eventQueue.poll(100, TimeUnit.MILLISECONDS)
+            event?.handleEvent(new AbstractFileEventFunctionsTest.TestHandler() {
+                @Override
+                void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
+                    if (type == CREATED) {
+                        events.created << absolutePath
+                    } else if (type == REMOVED) {
+                        events.removed << absolutePath
+                    }
+                }
+
+                @Override
+                void handleOverflow(FileWatchEvent.OverflowType type, @Nullable String absolutePath) {
+                    events.overflows << absolutePath
+                }
+            })
+        }
+        return events
+    }
+
+    private static class ObservedEvents {
+        final Set<String> created = [] as Set
+        final List<String> removed = []
+        final List<String> overflows = []
+    }
+
     private boolean expectOverflow(BlockingQueue<FileWatchEvent> eventQueue = this.eventQueue, int timeoutValue, TimeUnit timeoutUnit) {
         boolean overflow = false
         expectEvents(eventQueue, timeoutValue, timeoutUnit, { -> true }, { event ->
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+package net.rubygrapefruit.platform.file
+
+import net.rubygrapefruit.platform.Native
+import net.rubygrapefruit.platform.SystemInfo
+import net.rubygrapefruit.platform.internal.NativeLibraryLoadListener
+import net.rubygrapefruit.platform.internal.NativeLibraryLoader
+import net.rubygrapefruit.platform.internal.Platform
+import net.rubygrapefruit.platform.internal.jni.AbstractFileEventFunctions
+import net.rubygrapefruit.platform.internal.jni.LinuxFileEventFunctions
+import net.rubygrapefruit.platform.internal.jni.OsxFileEventFunctions
+import net.rubygrapefruit.platform.internal.jni.WindowsFileEventFunctions
+import org.junit.Rule
+import org.junit.rules.TemporaryFolder
+import spock.lang.Specification
+import spock.lang.Timeout
+
+import java.util.concurrent.ConcurrentLinkedQueue
+import java.util.concurrent.LinkedBlockingQueue
+
+import static java.util.concurrent.TimeUnit.SECONDS
+
+/**
+ * The native libraries are loaded and initialised only once per JVM, so each scenario runs in a fresh JVM.
+ */
+@Timeout(value = 60, unit = SECONDS)
+class FileEventsInitializationTest extends Specification {
+    @Rule
+    TemporaryFolder tmpDir
+
+    def "reports each step of loading the file events library once"() {
+        when:
+        def output = runInFreshJvm("listener")
+
+        then:
+        output == [
+            "${fileEventsLibraryName()} EXTRACTION",
+            "${fileEventsLibraryName()} LOADING",
+            "${fileEventsLibraryName()} INITIALIZATION"
+        ].collect { it.toString() }
+    }
+
+    def "leaves both native and file events integrations usable after initialising them together"() {
+        when:
+        def output = runInFreshJvm("initWithNative")
+
+        then:
+        output == ["native usable", "file events usable"]
+    }
+
+    def "sets up the native state only on the first call"() {
+        when:
+        def output = runInFreshJvm("initialize")
+
+        then:
+        output == ["true", "false", "false"]
+    }
+
+    private List<String> runInFreshJvm(String scenario) {
+        def exe = "${System.getProperty("java.home")}/bin/java"
+        def builder = new ProcessBuilder(
+            exe,
+            "-cp", System.getProperty("java.class.path"),
+            Scenarios.name,
+            scenario,
+            tmpDir.newFolder("extract").absolutePath
+        )
+        def process = builder.start()
+        def stderr = new StringBuilder()
+        def stderrThread = process.consumeProcessErrorStream(stderr)
+        def output = process.inputStream.readLines()
+        def result = process.waitFor()
+        stderrThread.join()
+        assert result == 0: stderr.toString()
+        return output
+    }
+
+    static String fileEventsLibraryName() {
+        def platform = Platform.current()
+        if (platform.linux) {
+            return "libnative-platform-file-events.so"
+        }
+        if (platform.macOs) {
+            return "libnative-platform-file-events.dylib"
+        }
+        return "native-platform-file-events.dll"
+    }
+
+    static class Scenarios {
+        static void main(String[] args) {
+            def scenario = args[0]
+            def extractDir = new File(args[1])
+            switch (scenario) {
+                case "listener":
+                    def steps = new ConcurrentLinkedQueue<String>()
+                    NativeLibraryLoader.listener = { String libraryFileName, NativeLibraryLoadListener.Step step, long durationInNanos ->
+                        if (libraryFileName == fileEventsLibraryName()) {
+                            steps.add("$libraryFileName $step".toString())
+                        }
+                    } as NativeLibraryLoadListener
+                    FileEvents.initWithNative(extractDir)
+                    FileEvents.get(fileEventFunctionsType())
+                    FileEvents.get(fileEventFunctionsType())
+                    steps.each { println it }
+                    break
+                case "initWithNative":
+                    FileEvents.initWithNative(extractDir)
+                    assert Native.get(SystemInfo).kernelName != null
+                    println "native usable"
+                    def watcher = FileEvents.get(fileEventFunctionsType()).newWatcher(new LinkedBlockingQueue<FileWatchEvent>()).start()
+                    watcher.startWatching([extractDir])
+                    watcher.shutdown()
+                    assert watcher.awaitTermination(5, SECONDS)
+                    println "file events usable"
+                    break
+                case "initialize":
+                    FileEvents.init(extractDir)
+                    println AbstractFileEventFunctions.initialize()
+                    println AbstractFileEventFunctions.initialize()
+                    FileEvents.get(fileEventFunctionsType())
+                    println AbstractFileEventFunctions.initialize()
+                    break
+                default:
+                    throw new IllegalArgumentException(scenario)
+            }
+        }
+
+        private static Class<? extends AbstractFileEventFunctions> fileEventFunctionsType() {
+            def platform = Platform.current()
+            if (platform.linux) {
+                return LinuxFileEventFunctions
+            }
+            if (platform.macOs) {
+                return OsxFileEventFunctions
+            }
+            return WindowsFileEventFunctions
+        }
+    }
+}
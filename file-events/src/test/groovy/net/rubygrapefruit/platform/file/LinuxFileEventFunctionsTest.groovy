@@ -0,0 +1,176 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+package net.rubygrapefruit.platform.file
+
+import net.rubygrapefruit.platform.internal.Platform
+import net.rubygrapefruit.platform.internal.jni.AbstractFileEventFunctions
+import net.rubygrapefruit.platform.internal.jni.LinuxFileEventFunctions
+import spock.lang.Requires
+import spock.lang.Unroll
+
+import static java.nio.file.Files.createSymbolicLink
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.CREATED
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.MODIFIED
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.REMOVED
+
+@Unroll
+@Requires({ Platform.current().linux })
+class LinuxFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
+
+    def "can start watcher preferring fanotify"() {
+        given:
+        def watchedDir = new File(rootDir, "watched")
+        def childDir = new File(watchedDir, "child")
+        assert childDir.mkdirs()
+        def createdFile = new File(watchedDir, "created.txt")
+        def nestedFile = new File(childDir, "nested.txt")
+        def linuxWatcher = (service as LinuxFileEventFunctions).newWatcher(eventQueue)
+            .withFanotify(true)
+            .start()
+        watcher = linuxWatcher
+        watcher.startWatching([watchedDir])
+
+        when:
+        createNewFile(createdFile)
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        when:
+        createNewFile(nestedFile)
+        then:
+        // Only fanotify reports changes to deeper descendants
+        if (linuxWatcher.watchingRecursively) {
+            expectEvents change(CREATED, nestedFile)
+        } else {
+            expectNoEvents()
+        }
+    }
+
+    def "can combine common and Linux specific watcher options"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        watcher = (service as LinuxFileEventFunctions).newWatcher(eventQueue)
+            .withSharedEventBuffer(AbstractFileEventFunctions.AbstractWatcherBuilder.MINIMUM_SHARED_EVENT_BUFFER_SIZE)
+            .withCoalescedChangeEvents(true)
+            .withFanotify(true)
+            .start()
+        watcher.startWatching([rootDir])
+
+        when:
+        createNewFile(createdFile)
+        then:
+        expectEvents change(CREATED, createdFile)
+    }
+
+    def "fails to check whether watching recursively when closed"() {
+        given:
+        def linuxWatcher = (service as LinuxFileEventFunctions).newWatcher(eventQueue)
+            .withFanotify(true)
+            .start()
+        shutdownWatcher(linuxWatcher)
+
+        when:
+        linuxWatcher.watchingRecursively
+
+        then:
+        def ex = thrown IllegalStateException
+        ex.message == "Watcher already closed"
+    }
+
+    def "reports changes relative to a symlinked watched directory preferring fanotify"() {
+        given:
+        def canonicalDir = new File(rootDir, "canonical")
+        assert new File(canonicalDir, "child").mkdirs()
+        def watchedDir = new File(rootDir, "linked")
+        createSymbolicLink(watchedDir.toPath(), canonicalDir.toPath())
+        def createdFile = new File(watchedDir, "created.txt")
+        def nestedFile = new File(watchedDir, "child/nested.txt")
+        def linuxWatcher = (service as LinuxFileEventFunctions).newWatcher(eventQueue)
+            .withFanotify(true)
+            .start()
+        watcher = linuxWatcher
+        watcher.startWatching([watchedDir])
+
+        when:
+        createNewFile(createdFile)
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        when:
+        createNewFile(nestedFile)
+        then:
+        if (linuxWatcher.watchingRecursively) {
+            expectEvents change(CREATED, nestedFile)
+        } else {
+            expectNoEvents()
+        }
+    }
+
+    def "can start watcher with overflow reconciliation"() {
+        given:
+        def existingFile = new File(rootDir, "existing.txt")
+        createNewFile(existingFile)
+        def createdFile = new File(rootDir, "created.txt")
+        watcher = (service as LinuxFileEventFunctions).newWatcher(eventQueue)
+            .withOverflowReconciliation(true)
+            .start()
+        watcher.startWatching([rootDir])
+
+        when:
+        createNewFile(createdFile)
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        when:
+        existingFile << "changed"
+        then:
+        expectEvents change(MODIFIED, existingFile)
+
+        when:
+        existingFile.delete()
+        then:
+        expectEvents change(REMOVED, existingFile)
+    }
+
+    def "can carry on watching other paths when registering #pathCount paths fails for a malformed path name"() {
+        given:
+        def watchedDirs = (1..pathCount).collect { index ->
+            def dir = new File(rootDir, "dir-$index")
+            assert dir.mkdirs()
+            dir
+        }
+        // Unpaired surrogates are legal in Java strings, but can't be converted to a native path
+        def malformedDir = new File(rootDir, "malformed-\uD800")
+        def createdFile = new File(watchedDirs.last(), "created.txt")
+        startWatcher()
+
+        when:
+        def failures = (watcher as AbstractFileEventFunctions.NativeFileWatcher).tryStartWatching(watchedDirs + malformedDir)
+
+        then:
+        failures.keySet() == [malformedDir] as Set
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        where:
+        // Registration runs in parallel from 1024 paths
+        pathCount << [10, 2000]
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+package net.rubygrapefruit.platform.file
+
+import net.rubygrapefruit.platform.internal.Platform
+import net.rubygrapefruit.platform.internal.jni.OsxFileEventFunctions
+import spock.lang.Requires
+import spock.lang.Unroll
+
+import java.util.concurrent.LinkedBlockingQueue
+import java.util.concurrent.atomic.AtomicReference
+
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.CREATED
+
+@Unroll
+@Requires({ Platform.current().macOs })
+class OsxFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
+
+    def "can replay changes since checkpoint after restarting watcher"() {
+        given:
+        def watchedDir = new File(rootDir, "watched")
+        assert watchedDir.mkdirs()
+        def createdFile = new File(watchedDir, "created.txt")
+        def createdWhileNotWatching = new File(watchedDir, "created-while-not-watching.txt")
+        def osxWatcher = (service as OsxFileEventFunctions).newWatcher(eventQueue).start()
+        watcher = osxWatcher
+        watcher.startWatching([watchedDir])
+
+        when:
+        createNewFile(createdFile)
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        when:
+        def checkpoint = osxWatcher.getCheckpoint(watchedDir)
+        shutdownWatcher()
+        createNewFile(createdWhileNotWatching)
+        watcher = (service as OsxFileEventFunctions).newWatcher(eventQueue)
+            .withHistorySince(checkpoint)
+            .start()
+        watcher.startWatching([watchedDir])
+        then:
+        checkpoint != null
+        expectEvents change(CREATED, createdWhileNotWatching)
+    }
+
+    def "fails to get checkpoint when closed"() {
+        given:
+        def osxWatcher = (service as OsxFileEventFunctions).newWatcher(eventQueue).start()
+        shutdownWatcher(osxWatcher)
+
+        when:
+        osxWatcher.getCheckpoint(rootDir)
+
+        then:
+        def ex = thrown IllegalStateException
+        ex.message == "Watcher already closed"
+    }
+
+    def "can watch using dispatch queues with multiple watchers"() {
+        given:
+        def watchedDir = new File(rootDir, "watched")
+        def otherWatchedDir = new File(rootDir, "other")
+        assert watchedDir.mkdirs()
+        assert otherWatchedDir.mkdirs()
+        def createdFile = new File(watchedDir, "created.txt")
+        def otherCreatedFile = new File(otherWatchedDir, "created.txt")
+        def otherEventQueue = newEventQueue()
+        watcher = (service as OsxFileEventFunctions).newWatcher(eventQueue)
+            .withDispatchQueue(true)
+            .start()
+        def otherWatcher = (service as OsxFileEventFunctions).newWatcher(otherEventQueue)
+            .withDispatchQueue(true)
+            .start()
+        watcher.startWatching([watchedDir])
+        otherWatcher.startWatching([otherWatchedDir])
+
+        when:
+        createNewFile(createdFile)
+        createNewFile(otherCreatedFile)
+        then:
+        expectEvents change(CREATED, createdFile)
+        expectEvents otherEventQueue, change(CREATED, otherCreatedFile)
+
+        when:
+        otherWatcher.stopWatching([otherWatchedDir])
+        otherCreatedFile.delete()
+        then:
+        expectNoEvents otherEventQueue
+
+        cleanup:
+        shutdownWatcher(otherWatcher)
+    }
+
+    def "can change the paths of another watcher from the callback of a watcher using a dispatch queue"() {
+        given:
+        def watchedDir = new File(rootDir, "watched")
+        def otherWatchedDir = new File(rootDir, "other")
+        assert watchedDir.mkdirs()
+        assert otherWatchedDir.mkdirs()
+        def createdFile = new File(watchedDir, "created.txt")
+        def otherCreatedFile = new File(otherWatchedDir, "created.txt")
+        def otherEventQueue = newEventQueue()
+        def otherWatcher = (service as OsxFileEventFunctions).newWatcher(otherEventQueue)
+            .withDispatchQueue(true)
+            .start()
+        def callbackFailure = new AtomicReference<Throwable>()
+        def mutatingEventQueue = new LinkedBlockingQueue<FileWatchEvent>() {
+            @Override
+            boolean offer(FileWatchEvent event) {
+                try {
+                    otherWatcher.startWatching([otherWatchedDir])
+                } catch (Throwable ex) {
+                    callbackFailure.set(ex)
+                }
+                return super.offer(event)
+            }
+        }
+        watcher = (service as OsxFileEventFunctions).newWatcher(mutatingEventQueue)
+            .withDispatchQueue(true)
+            .start()
+        watcher.startWatching([watchedDir])
+
+        when:
+        createNewFile(createdFile)
+        then:
+        expectEvents mutatingEventQueue, change(CREATED, createdFile)
+        callbackFailure.get() == null
+
+        when:
+        createNewFile(otherCreatedFile)
+        then:
+        expectEvents otherEventQueue, change(CREATED, otherCreatedFile)
+
+        cleanup:
+        shutdownWatcher(otherWatcher)
+    }
+}
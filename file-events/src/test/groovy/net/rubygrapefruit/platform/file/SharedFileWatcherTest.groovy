@@ -0,0 +1,258 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+package net.rubygrapefruit.platform.file
+
+import net.rubygrapefruit.platform.internal.Platform
+import net.rubygrapefruit.platform.internal.jni.AbstractFileEventFunctions
+import net.rubygrapefruit.platform.internal.jni.SharedFileWatcher
+import spock.lang.Requires
+
+import static java.util.concurrent.TimeUnit.SECONDS
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.CREATED
+
+@Requires({ Platform.current().macOs || Platform.current().linux || Platform.current().windows })
+class SharedFileWatcherTest extends AbstractFileEventFunctionsTest {
+    SharedFileWatcher sharedWatcher
+
+    def setup() {
+        waitForChangeEventLatency()
+        sharedWatcher = service.newWatcher(eventQueue).startShared()
+    }
+
+    def cleanup() {
+        if (sharedWatcher != null) {
+            sharedWatcher.shutdown()
+            assert sharedWatcher.awaitTermination(5, SECONDS)
+        }
+    }
+
+    def "delivers events to each logical watcher watching the same directory"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        def firstQueue = newEventQueue()
+        def secondQueue = newEventQueue()
+        def firstWatcher = sharedWatcher.newWatcher(firstQueue)
+        def secondWatcher = sharedWatcher.newWatcher(secondQueue)
+        firstWatcher.startWatching([rootDir])
+        secondWatcher.startWatching([rootDir])
+
+        expect:
+        sharedWatcher.watcherCount == 2
+        sharedWatcher.watchedPathCount == 1
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents firstQueue, change(CREATED, createdFile)
+        expectEvents secondQueue, change(CREATED, createdFile)
+        expectNoEvents(eventQueue)
+    }
+
+    def "delivers events only to the logical watchers watching the changed path"() {
+        given:
+        def firstRoot = new File(rootDir, "first")
+        firstRoot.mkdirs()
+        def secondRoot = new File(rootDir, "second")
+        secondRoot.mkdirs()
+        def firstFile = new File(firstRoot, "file.txt")
+        def firstQueue = newEventQueue()
+        def secondQueue = newEventQueue()
+        sharedWatcher.newWatcher(firstQueue).startWatching([firstRoot])
+        sharedWatcher.newWatcher(secondQueue).startWatching([secondRoot])
+
+        when:
+        createNewFile(firstFile)
+
+        then:
+        expectEvents firstQueue, change(CREATED, firstFile)
+        expectNoEvents(secondQueue)
+    }
+
+    def "delivers events once to logical watchers watching nested directories"() {
+        given:
+        def outerRoot = new File(rootDir, "outer")
+        def innerRoot = new File(outerRoot, "inner")
+        assert innerRoot.mkdirs()
+        def innerFile = new File(innerRoot, "inner.txt")
+        def otherInnerFile = new File(innerRoot, "other-inner.txt")
+        def outerQueue = newEventQueue()
+        def innerQueue = newEventQueue()
+        def outerWatcher = sharedWatcher.newWatcher(outerQueue)
+        def innerWatcher = sharedWatcher.newWatcher(innerQueue)
+        outerWatcher.startWatching([outerRoot])
+        innerWatcher.startWatching([innerRoot])
+        // Only inotify doesn't report changes to deeper descendants, so there the inner directory has to be registered as well
+        def reportingDescendants = !Platform.current().linux
+
+        expect:
+        sharedWatcher.watchedPathCount == 2
+        sharedWatcher.statistics.watchedPaths == (reportingDescendants ? 1 : 2)
+
+        when:
+        createNewFile(innerFile)
+
+        then:
+        expectEvents innerQueue, change(CREATED, innerFile)
+        if (reportingDescendants) {
+            expectEvents outerQueue, change(CREATED, innerFile)
+        } else {
+            expectNoEvents(outerQueue)
+        }
+
+        when:
+        outerWatcher.stopWatching([outerRoot])
+        createNewFile(otherInnerFile)
+
+        then:
+        sharedWatcher.statistics.watchedPaths == 1
+        expectEvents innerQueue, change(CREATED, otherInnerFile)
+        expectNoEvents(outerQueue)
+    }
+
+    def "delivers overflows to the logical watchers watching the overflown path or paths below it"() {
+        given:
+        def outerRoot = new File(rootDir, "outer")
+        def innerRoot = new File(outerRoot, "inner")
+        def otherRoot = new File(rootDir, "other")
+        assert innerRoot.mkdirs()
+        assert otherRoot.mkdirs()
+        def outerQueue = newEventQueue()
+        def innerQueue = newEventQueue()
+        def otherQueue = newEventQueue()
+        sharedWatcher.newWatcher(outerQueue).startWatching([outerRoot])
+        sharedWatcher.newWatcher(innerQueue).startWatching([innerRoot])
+        sharedWatcher.newWatcher(otherQueue).startWatching([otherRoot])
+        // Simulate the native watcher reporting overflows for the registered roots only
+        def nativeCallback = sharedWatcher.@callback
+
+        when:
+        nativeCallback.reportOverflows([outerRoot.absolutePath] as String[])
+
+        then:
+        expectEvents outerQueue, overflow(outerRoot)
+        expectEvents innerQueue, overflow(outerRoot)
+        expectNoEvents(otherQueue)
+
+        when:
+        nativeCallback.reportOverflow(outerRoot.absolutePath)
+
+        then:
+        expectEvents outerQueue, overflow(outerRoot)
+        expectEvents innerQueue, overflow(outerRoot)
+        expectNoEvents(otherQueue)
+
+        when:
+        nativeCallback.reportOverflows([innerRoot.absolutePath] as String[])
+
+        then:
+        expectEvents outerQueue, overflow(innerRoot)
+        expectEvents innerQueue, overflow(innerRoot)
+        expectNoEvents(otherQueue)
+    }
+
+    def "keeps watching a directory until the last logical watcher stops watching it"() {
+        given:
+        def firstFile = new File(rootDir, "first.txt")
+        def secondFile = new File(rootDir, "second.txt")
+        def firstQueue = newEventQueue()
+        def secondQueue = newEventQueue()
+        def firstWatcher = sharedWatcher.newWatcher(firstQueue)
+        def secondWatcher = sharedWatcher.newWatcher(secondQueue)
+        firstWatcher.startWatching([rootDir])
+        secondWatcher.startWatching([rootDir])
+
+        when:
+        def stopped = firstWatcher.stopWatching([rootDir])
+        createNewFile(firstFile)
+
+        then:
+        stopped
+        sharedWatcher.watchedPathCount == 1
+        expectEvents secondQueue, change(CREATED, firstFile)
+        expectNoEvents(firstQueue)
+
+        when:
+        stopped = secondWatcher.stopWatching([rootDir])
+        createNewFile(secondFile)
+
+        then:
+        stopped
+        sharedWatcher.watchedPathCount == 0
+        expectNoEvents(firstQueue)
+        expectNoEvents(secondQueue)
+    }
+
+    def "cannot watch the same directory twice with a logical watcher"() {
+        given:
+        def logicalWatcher = sharedWatcher.newWatcher(newEventQueue())
+        logicalWatcher.startWatching([rootDir])
+
+        when:
+        logicalWatcher.startWatching([rootDir])
+
+        then:
+        def ex = thrown AbstractFileEventFunctions.FileWatcherException
+        ex.message == "Already watching path: ${rootDir.absolutePath}"
+    }
+
+    def "shutting down a logical watcher keeps the other ones running"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        def firstQueue = newEventQueue()
+        def secondQueue = newEventQueue()
+        def firstWatcher = sharedWatcher.newWatcher(firstQueue)
+        def secondWatcher = sharedWatcher.newWatcher(secondQueue)
+        firstWatcher.startWatching([rootDir])
+        secondWatcher.startWatching([rootDir])
+
+        when:
+        shutdownWatcher(firstWatcher)
+
+        then:
+        expectEvents firstQueue, termination()
+        sharedWatcher.watcherCount == 1
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents secondQueue, change(CREATED, createdFile)
+        expectNoEvents(firstQueue)
+    }
+
+    def "shutting down the shared watcher terminates the logical watchers"() {
+        given:
+        def firstQueue = newEventQueue()
+        def secondQueue = newEventQueue()
+        def firstWatcher = sharedWatcher.newWatcher(firstQueue)
+        def secondWatcher = sharedWatcher.newWatcher(secondQueue)
+        firstWatcher.startWatching([rootDir])
+
+        when:
+        def copyWatcher = sharedWatcher
+        sharedWatcher = null
+        copyWatcher.shutdown()
+
+        then:
+        copyWatcher.awaitTermination(5, SECONDS)
+        expectEvents eventQueue, termination()
+        expectEvents firstQueue, termination()
+        expectEvents secondQueue, termination()
+        firstWatcher.awaitTermination(5, SECONDS)
+        secondWatcher.awaitTermination(5, SECONDS)
+    }
+}
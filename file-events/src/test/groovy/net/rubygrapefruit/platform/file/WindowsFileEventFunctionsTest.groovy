@@ -15,7 +15,10 @@
  */
 package net.rubygrapefruit.platform.file
 
+import net.rubygrapefruit.platform.NativeException
 import net.rubygrapefruit.platform.internal.Platform
+import net.rubygrapefruit.platform.internal.jni.WindowsFileEventFunctions
+import org.junit.Assume
 import spock.lang.Requires
 import spock.lang.Unroll
 
@@ -50,6 +53,69 @@ class WindowsFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         expectNoEvents()
     }
 
+    def "can watch via completion port"() {
+        given:
+        def watchedDir = new File(rootDir, "watched")
+        def otherWatchedDir = new File(rootDir, "other")
+        assert watchedDir.mkdirs()
+        assert otherWatchedDir.mkdirs()
+        def createdFile = new File(watchedDir, "created.txt")
+        def otherCreatedFile = new File(otherWatchedDir, "created.txt")
+        def secondCreatedFile = new File(watchedDir, "second.txt")
+        def otherSecondCreatedFile = new File(otherWatchedDir, "second.txt")
+        watcher = (service as WindowsFileEventFunctions).newWatcher(eventQueue)
+            .withCompletionPort(true)
+            .start()
+        watcher.startWatching([watchedDir, otherWatchedDir])
+
+        when:
+        createNewFile(createdFile)
+        createNewFile(otherCreatedFile)
+        then:
+        expectEvents change(CREATED, createdFile), change(CREATED, otherCreatedFile)
+
+        when:
+        watcher.stopWatching([otherWatchedDir])
+        createNewFile(secondCreatedFile)
+        createNewFile(otherSecondCreatedFile)
+        then:
+        expectEvents change(CREATED, secondCreatedFile)
+    }
+
+    def "can read changes since last position from change journal"() {
+        given:
+        def service = service as WindowsFileEventFunctions
+        def watchedDir = new File(rootDir, "watched")
+        def unwatchedDir = new File(rootDir, "unwatched")
+        assert watchedDir.mkdirs()
+        assert unwatchedDir.mkdirs()
+        def createdFile = new File(watchedDir, "created.txt")
+        def unwatchedFile = new File(unwatchedDir, "created.txt")
+        WindowsFileEventFunctions.ChangeJournalPosition position = null
+        try {
+            position = service.getChangeJournalPosition(watchedDir)
+        } catch (NativeException ex) {
+            // Reading the journal requires administrator privileges
+            Assume.assumeNoException(ex)
+        }
+
+        when:
+        createNewFile(createdFile)
+        createNewFile(unwatchedFile)
+        def changes = service.readChangeJournal(position, [watchedDir])
+        then:
+        changes.complete
+        changes.changedPaths.contains(createdFile)
+        !changes.changedPaths.contains(unwatchedFile)
+        changes.position.usn > position.usn
+
+        when:
+        def laterChanges = service.readChangeJournal(changes.position, [watchedDir])
+        then:
+        laterChanges.complete
+        laterChanges.changedPaths.empty
+    }
+
     def "reports changes on subst drive"() {
         given:
         subst("G:", rootDir)
@@ -180,4 +180,17 @@ Java_net_rubygrapefruit_platform_internal_jni_TerminfoFunctions_showCursor(JNIEn
     return read_capability(env, getcap("ve"), result);
 }
 
+JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM* jvm, void*) {
+    JNIEnv* env;
+    jint ret = jvm->GetEnv((void**) &env, JNI_VERSION_1_6);
+    if (ret != JNI_OK) {
+        return -1;
+    }
+    if (!init_generic(env)) {
+        return -1;
+    }
+    return JNI_VERSION_1_6;
+}
+
 #endif
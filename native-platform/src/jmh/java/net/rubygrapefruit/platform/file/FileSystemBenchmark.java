@@ -0,0 +1,198 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.Native;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OperationsPerInvocation;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.annotations.Warmup;
+import org.openjdk.jmh.infra.Blackhole;
+
+import java.io.File;
+import java.io.IOException;
+import java.nio.file.DirectoryStream;
+import java.nio.file.FileVisitResult;
+import java.nio.file.LinkOption;
+import java.nio.file.Path;
+import java.nio.file.SimpleFileVisitor;
+import java.nio.file.attribute.BasicFileAttributes;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Measures how many file system entries per second can be listed and queried, comparing
+ * the native integrations with the equivalent {@code java.nio.file} calls as a baseline.
+ *
+ * Each operation is one entry: {@value #FILES_PER_DIRECTORY} files are listed or queried per invocation,
+ * except for the tree walks, which visit {@value #DIRECTORIES} directories with all their files.
+ */
+@State(Scope.Benchmark)
+@BenchmarkMode(Mode.Throughput)
+@OutputTimeUnit(TimeUnit.SECONDS)
+@Warmup(iterations = 3, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(1)
+public class FileSystemBenchmark {
+    private static final String BENCHMARK_DIRECTORY_SYSTEM_PROPERTY = "benchmark.directory";
+    private static final int DIRECTORIES = 10;
+    private static final int FILES_PER_DIRECTORY = 1000;
+    private static final int TREE_ENTRIES = DIRECTORIES * (FILES_PER_DIRECTORY + 1);
+
+    private final Files files = Native.get(Files.class);
+    private final List<File> filesInDirectory = new ArrayList<File>();
+    private File rootDir;
+    private File directory;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException {
+        File parentDir = new File(System.getProperty(BENCHMARK_DIRECTORY_SYSTEM_PROPERTY, System.getProperty("java.io.tmpdir")));
+        if (!parentDir.isDirectory() && !parentDir.mkdirs()) {
+            throw new IOException("Could not create " + parentDir);
+        }
+        rootDir = File.createTempFile("file-system", "", parentDir);
+        if (!rootDir.delete() || !rootDir.mkdir()) {
+            throw new IOException("Could not create " + rootDir);
+        }
+        for (int dirIndex = 0; dirIndex < DIRECTORIES; dirIndex++) {
+            File dir = new File(rootDir, "dir-" + dirIndex);
+            if (!dir.mkdir()) {
+                throw new IOException("Could not create " + dir);
+            }
+            for (int fileIndex = 0; fileIndex < FILES_PER_DIRECTORY; fileIndex++) {
+                File file = new File(dir, "file-" + fileIndex + ".txt");
+                if (!file.createNewFile()) {
+                    throw new IOException("Could not create " + file);
+                }
+                if (dirIndex == 0) {
+                    filesInDirectory.add(file);
+                }
+            }
+        }
+        directory = new File(rootDir, "dir-0");
+    }
+
+    @TearDown(Level.Trial)
+    public void tearDown() throws IOException {
+        java.nio.file.Files.walkFileTree(rootDir.toPath(), new SimpleFileVisitor<Path>() {
+            @Override
+            public FileVisitResult visitFile(Path file, BasicFileAttributes attrs) throws IOException {
+                java.nio.file.Files.delete(file);
+                return FileVisitResult.CONTINUE;
+            }
+
+            @Override
+            public FileVisitResult postVisitDirectory(Path dir, IOException exc) throws IOException {
+                java.nio.file.Files.delete(dir);
+                return FileVisitResult.CONTINUE;
+            }
+        });
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(FILES_PER_DIRECTORY)
+    public List<? extends DirEntry> listDir() {
+        return files.listDir(directory);
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(FILES_PER_DIRECTORY)
+    public void listDirJava(Blackhole blackhole) throws IOException {
+        DirectoryStream<Path> stream = java.nio.file.Files.newDirectoryStream(directory.toPath());
+        try {
+            for (Path path : stream) {
+                blackhole.consume(java.nio.file.Files.readAttributes(path, BasicFileAttributes.class, LinkOption.NOFOLLOW_LINKS));
+            }
+        } finally {
+            stream.close();
+        }
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(FILES_PER_DIRECTORY)
+    public void stat(Blackhole blackhole) {
+        for (File file : filesInDirectory) {
+            blackhole.consume(files.stat(file));
+        }
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(FILES_PER_DIRECTORY)
+    public List<? extends FileInfo> statAll() {
+        return files.statAll(filesInDirectory, false, 1);
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(FILES_PER_DIRECTORY)
+    public void statJava(Blackhole blackhole) throws IOException {
+        for (File file : filesInDirectory) {
+            blackhole.consume(java.nio.file.Files.readAttributes(file.toPath(), BasicFileAttributes.class, LinkOption.NOFOLLOW_LINKS));
+        }
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(TREE_ENTRIES)
+    public void walkTree(final Blackhole blackhole) {
+        files.walkTree(rootDir, false, 1, Collections.<String>emptyList(), new FileTreeVisitor() {
+            @Override
+            public void visitEntry(String path, DirEntry entry) {
+                blackhole.consume(entry);
+            }
+        });
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(TREE_ENTRIES)
+    public void walkTreeParallel(final Blackhole blackhole) {
+        files.walkTree(rootDir, false, 4, Collections.<String>emptyList(), new FileTreeVisitor() {
+            @Override
+            public void visitEntry(String path, DirEntry entry) {
+                blackhole.consume(entry);
+            }
+        });
+    }
+
+    @Benchmark
+    @OperationsPerInvocation(TREE_ENTRIES)
+    public void walkTreeJava(final Blackhole blackhole) throws IOException {
+        java.nio.file.Files.walkFileTree(rootDir.toPath(), new SimpleFileVisitor<Path>() {
+            @Override
+            public FileVisitResult preVisitDirectory(Path dir, BasicFileAttributes attrs) {
+                blackhole.consume(attrs);
+                return FileVisitResult.CONTINUE;
+            }
+
+            @Override
+            public FileVisitResult visitFile(Path file, BasicFileAttributes attrs) {
+                blackhole.consume(attrs);
+                return FileVisitResult.CONTINUE;
+            }
+        });
+    }
+}
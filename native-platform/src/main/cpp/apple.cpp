@@ -23,10 +23,13 @@
 #include "net_rubygrapefruit_platform_internal_jni_MemoryFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_OsxMemoryFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions.h"
+#include <dispatch/dispatch.h>
 #include <mach/mach.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/attr.h>
+#include <sys/event.h>
 #include <sys/mount.h>
 #include <sys/param.h>
 #include <sys/sysctl.h>
@@ -39,9 +42,36 @@ typedef struct vol_caps_buf {
     vol_capabilities_attr_t caps;
 } vol_caps_buf_t;
 
+// Looked up in JNI_OnLoad, in posix.cpp
+extern jmethodID osxMemoryInfoDetailsMethodId;
+
 /*
  * File system functions
  */
+// Queue receiving file system events, polled for changes. Only used by the caller of fileSystemsChanged(), which is synchronized on the Java side.
+static int mountEventQueue = -1;
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_fileSystemsChanged(JNIEnv* env, jclass target) {
+    if (mountEventQueue < 0) {
+        mountEventQueue = kqueue();
+        if (mountEventQueue >= 0) {
+            struct kevent event;
+            EV_SET(&event, 0, EVFILT_FS, EV_ADD | EV_CLEAR, 0, 0, NULL);
+            if (kevent(mountEventQueue, &event, 1, NULL, 0, NULL) != 0) {
+                close(mountEventQueue);
+                mountEventQueue = -1;
+            }
+        }
+        return JNI_TRUE;
+    }
+    // Drain all pending events, any of mount, unmount or update means the file systems need to be listed again
+    struct kevent events[16];
+    struct timespec timeout = { 0, 0 };
+    int count = kevent(mountEventQueue, NULL, 0, events, 16, &timeout);
+    return count != 0 ? JNI_TRUE : JNI_FALSE;
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileSystems(JNIEnv* env, jclass target, jobject info, jobject result) {
     int fs_count = getfsstat(NULL, 0, MNT_NOWAIT);
@@ -58,10 +88,6 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
         return;
     }
 
-    jclass info_class = env->GetObjectClass(info);
-    jmethodID method = env->GetMethodID(info_class, "add", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZZZ)V");
-    jmethodID unknownFsMethod = env->GetMethodID(info_class, "addForUnknownCaseSensitivity", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Z)V");
-
     for (int i = 0; i < fs_count; i++) {
         struct attrlist alist;
         memset(&alist, 0, sizeof(alist));
@@ -77,7 +103,7 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
         // getattrlist requires the path to the actual mount point.
         int err = getattrlist(buf[i].f_mntonname, &alist, &buffer, sizeof(buffer), 0);
         if (err != 0) {
-            env->CallVoidMethod(info, unknownFsMethod, mount_point, file_system_type, device_name, remote);
+            env->CallVoidMethod(info, fileSystemListAddForUnknownCaseSensitivityMethodId, mount_point, file_system_type, device_name, remote);
         } else {
             jboolean caseSensitive = JNI_TRUE;
             jboolean casePreserving = JNI_TRUE;
@@ -91,8 +117,11 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
                 }
             }
 
-            env->CallVoidMethod(info, method, mount_point, file_system_type, device_name, remote, caseSensitive, casePreserving);
+            env->CallVoidMethod(info, fileSystemListAddMethodId, mount_point, file_system_type, device_name, remote, caseSensitive, casePreserving);
         }
+        env->DeleteLocalRef(mount_point);
+        env->DeleteLocalRef(file_system_type);
+        env->DeleteLocalRef(device_name);
     }
     free(buf);
 }
@@ -102,12 +131,6 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
  */
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_getMemoryInfo(JNIEnv* env, jclass type, jobject dest, jobject result) {
-    jclass destClass = env->GetObjectClass(dest);
-    jmethodID mid = env->GetMethodID(destClass, "details", "(JJ)V");
-    if (mid == NULL) {
-        mark_failed_with_message(env, "could not find method", result);
-        return;
-    }
 
     // Get total physical memory
     int mib[2];
@@ -143,18 +166,93 @@ Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_getMemoryInfo(JNIE
                                      - (int64_t) vm_stats.speculative_count)
         * (int64_t) page_size;
     // Feed Java with details
-    env->CallVoidMethod(dest, mid, (jlong) total_memory, (jlong) available_memory);
+    env->CallVoidMethod(dest, memoryInfoDetailsMethodId, (jlong) total_memory, (jlong) available_memory);
 }
 
-JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_OsxMemoryFunctions_getOsxMemoryInfo(JNIEnv* env, jclass type, jobject dest, jobject result) {
-    jclass destClass = env->GetObjectClass(dest);
-    jmethodID mid = env->GetMethodID(destClass, "details", "(JJJJJJJJJ)V");
-    if (mid == NULL) {
-        mark_failed_with_message(env, "could not find method", result);
-        return;
+typedef struct memory_monitor {
+    dispatch_source_t source;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int level;
+    bool stopped;
+} memory_monitor_t;
+
+static void memory_pressure_event(void* context) {
+    memory_monitor_t* monitor = (memory_monitor_t*) context;
+    unsigned long flags = dispatch_source_get_data(monitor->source);
+    int level = (flags & DISPATCH_MEMORYPRESSURE_CRITICAL) ? MEMORY_PRESSURE_CRITICAL : (flags & DISPATCH_MEMORYPRESSURE_WARN) ? MEMORY_PRESSURE_WARNING : MEMORY_PRESSURE_NORMAL;
+    pthread_mutex_lock(&monitor->lock);
+    monitor->level = level;
+    pthread_cond_broadcast(&monitor->changed);
+    pthread_mutex_unlock(&monitor->lock);
+}
+
+// Runs once the source has been cancelled and no more events will be delivered
+static void memory_pressure_cancelled(void* context) {
+    memory_monitor_t* monitor = (memory_monitor_t*) context;
+    dispatch_release(monitor->source);
+    pthread_cond_destroy(&monitor->changed);
+    pthread_mutex_destroy(&monitor->lock);
+    free(monitor);
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_openMemoryPressureMonitor(JNIEnv* env, jclass type, jobject result) {
+    memory_monitor_t* monitor = (memory_monitor_t*) malloc(sizeof(memory_monitor_t));
+    if (monitor == NULL) {
+        mark_failed_with_message(env, "could not allocate memory monitor", result);
+        return 0;
+    }
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    monitor->source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+        DISPATCH_MEMORYPRESSURE_NORMAL | DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, queue);
+    if (monitor->source == NULL) {
+        mark_failed_with_message(env, "could not create memory pressure source", result);
+        free(monitor);
+        return 0;
+    }
+    pthread_mutex_init(&monitor->lock, NULL);
+    pthread_cond_init(&monitor->changed, NULL);
+    // The source only reports changes, so assume there is no pressure until told otherwise
+    monitor->level = MEMORY_PRESSURE_NORMAL;
+    monitor->stopped = false;
+    dispatch_set_context(monitor->source, monitor);
+    dispatch_source_set_event_handler_f(monitor->source, memory_pressure_event);
+    dispatch_source_set_cancel_handler_f(monitor->source, memory_pressure_cancelled);
+    dispatch_resume(monitor->source);
+    return (jlong) monitor;
+}
+
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_waitForMemoryPressure(JNIEnv* env, jclass type, jlong handle, jint currentLevel, jobject result) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    pthread_mutex_lock(&monitor->lock);
+    while (!monitor->stopped && monitor->level == currentLevel) {
+        pthread_cond_wait(&monitor->changed, &monitor->lock);
     }
+    int level = monitor->stopped ? MEMORY_PRESSURE_STOPPED : monitor->level;
+    pthread_mutex_unlock(&monitor->lock);
+    return level;
+}
 
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_stopMemoryPressureMonitor(JNIEnv* env, jclass type, jlong handle) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    pthread_mutex_lock(&monitor->lock);
+    monitor->stopped = true;
+    pthread_cond_broadcast(&monitor->changed);
+    pthread_mutex_unlock(&monitor->lock);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_closeMemoryPressureMonitor(JNIEnv* env, jclass type, jlong handle) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    // The monitor is freed by the cancel handler, as an event handler may still be running
+    dispatch_source_cancel(monitor->source);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_OsxMemoryFunctions_getOsxMemoryInfo(JNIEnv* env, jclass type, jobject dest, jobject result) {
     // Get total physical memory
     int mib[2];
     mib[0] = CTL_HW;
@@ -190,7 +288,7 @@ Java_net_rubygrapefruit_platform_internal_jni_OsxMemoryFunctions_getOsxMemoryInf
         * (int64_t) page_size;
 
     // Feed Java with details
-    env->CallVoidMethod(dest, mid,
+    env->CallVoidMethod(dest, osxMemoryInfoDetailsMethodId,
         (jlong) page_size,
         (jlong) vm_stats.free_count,
         (jlong) vm_stats.inactive_count,
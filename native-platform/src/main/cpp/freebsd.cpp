@@ -24,14 +24,41 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/event.h>
 #include <sys/mount.h>
 #include <sys/param.h>
+#include <sys/time.h>
+#include <sys/types.h>
 #include <sys/ucred.h>
 #include <unistd.h>
 
 /*
  * File system functions
  */
+// Queue receiving file system events, polled for changes. Only used by the caller of fileSystemsChanged(), which is synchronized on the Java side.
+static int mountEventQueue = -1;
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_fileSystemsChanged(JNIEnv* env, jclass target) {
+    if (mountEventQueue < 0) {
+        mountEventQueue = kqueue();
+        if (mountEventQueue >= 0) {
+            struct kevent event;
+            EV_SET(&event, 0, EVFILT_FS, EV_ADD | EV_CLEAR, 0, 0, NULL);
+            if (kevent(mountEventQueue, &event, 1, NULL, 0, NULL) != 0) {
+                close(mountEventQueue);
+                mountEventQueue = -1;
+            }
+        }
+        return JNI_TRUE;
+    }
+    // Drain all pending events, any of mount, unmount or update means the file systems need to be listed again
+    struct kevent events[16];
+    struct timespec timeout = { 0, 0 };
+    int count = kevent(mountEventQueue, NULL, 0, events, 16, &timeout);
+    return count != 0 ? JNI_TRUE : JNI_FALSE;
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileSystems(JNIEnv* env, jclass target, jobject info, jobject result) {
     int fs_count = getfsstat(NULL, 0, MNT_NOWAIT);
@@ -48,9 +75,6 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
         return;
     }
 
-    jclass info_class = env->GetObjectClass(info);
-    jmethodID method = env->GetMethodID(info_class, "add", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZZZ)V");
-
     for (int i = 0; i < fs_count; i++) {
         jboolean caseSensitive = JNI_TRUE;
         jboolean casePreserving = JNI_TRUE;
@@ -59,7 +83,10 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
         jstring file_system_type = char_to_java(env, buf[i].f_fstypename, result);
         jstring device_name = char_to_java(env, buf[i].f_mntfromname, result);
         jboolean remote = (buf[i].f_flags & MNT_LOCAL) == 0;
-        env->CallVoidMethod(info, method, mount_point, file_system_type, device_name, remote, caseSensitive, casePreserving);
+        env->CallVoidMethod(info, fileSystemListAddMethodId, mount_point, file_system_type, device_name, remote, caseSensitive, casePreserving);
+        env->DeleteLocalRef(mount_point);
+        env->DeleteLocalRef(file_system_type);
+        env->DeleteLocalRef(device_name);
     }
     free(buf);
 }
@@ -20,17 +20,45 @@
 #ifdef __linux__
 
 #include "generic.h"
+#include "net_rubygrapefruit_platform_internal_jni_MemoryFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions.h"
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <mntent.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/inotify.h>
+#include <time.h>
 #include <unistd.h>
 
 /*
  * File system functions
  */
+
+// Descriptor of the mount table, polled for changes. Only used by the caller of fileSystemsChanged(), which is synchronized on the Java side.
+static int mountTableFd = -1;
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_fileSystemsChanged(JNIEnv* env, jclass target) {
+    if (mountTableFd < 0) {
+        // The kernel reports POLLPRI for changes made after the file has been opened
+        mountTableFd = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+        return JNI_TRUE;
+    }
+    struct pollfd fd;
+    fd.fd = mountTableFd;
+    fd.events = POLLPRI;
+    fd.revents = 0;
+    if (poll(&fd, 1, 0) != 0) {
+        // Changed, or an error that we can't tell apart from a change
+        return JNI_TRUE;
+    }
+    return JNI_FALSE;
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileSystems(JNIEnv* env, jclass target, jobject info, jobject result) {
     FILE* fp = setmntent(MOUNTED, "r");
@@ -41,17 +69,251 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
     char buf[1024];
     struct mntent mount_info;
 
-    jclass info_class = env->GetObjectClass(info);
-    jmethodID method = env->GetMethodID(info_class, "add", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZZZ)V");
-
     while (getmntent_r(fp, &mount_info, buf, sizeof(buf)) != NULL) {
         jstring mount_point = char_to_java(env, mount_info.mnt_dir, result);
         jstring file_system_type = char_to_java(env, mount_info.mnt_type, result);
         jstring device_name = char_to_java(env, mount_info.mnt_fsname, result);
-        env->CallVoidMethod(info, method, mount_point, file_system_type, device_name, JNI_FALSE, JNI_TRUE, JNI_TRUE);
+        env->CallVoidMethod(info, fileSystemListAddMethodId, mount_point, file_system_type, device_name, JNI_FALSE, JNI_TRUE, JNI_TRUE);
+        env->DeleteLocalRef(mount_point);
+        env->DeleteLocalRef(file_system_type);
+        env->DeleteLocalRef(device_name);
     }
 
     endmntent(fp);
 }
 
+/*
+ * Memory functions
+ */
+
+// Available memory, as a percentage of the total memory, below which memory pressure is reported
+#define MEMORY_WARNING_PERCENT 10
+#define MEMORY_CRITICAL_PERCENT 5
+
+// Pressure stall triggers, see https://docs.kernel.org/accounting/psi.html
+// Unprivileged processes can only use windows that are a multiple of 2 seconds
+#define PSI_WINDOW_MILLIS 2000
+#define PSI_SOME_TRIGGER "some 150000 2000000"
+#define PSI_FULL_TRIGGER "full 50000 2000000"
+
+// How often available memory is sampled while waiting for the memory pressure to change
+#define MEMORY_SAMPLE_INTERVAL_MILLIS 1000
+
+// /proc/meminfo opened once and read with pread(), so that sampling takes a single system call
+static int meminfoFd = -1;
+
+static int get_meminfo_fd() {
+    int fd = __sync_fetch_and_add(&meminfoFd, 0);
+    if (fd >= 0) {
+        return fd;
+    }
+    fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int existing = __sync_val_compare_and_swap(&meminfoFd, -1, fd);
+    if (existing >= 0) {
+        // Another thread got there first
+        close(fd);
+        return existing;
+    }
+    return fd;
+}
+
+static jlong parse_meminfo_value(const char* buffer, const char* key) {
+    const char* line = strstr(buffer, key);
+    if (line == NULL) {
+        return -1;
+    }
+    // Values are reported in kB
+    return strtoll(line + strlen(key), NULL, 10) * 1024;
+}
+
+/*
+ * Reads total and available memory from /proc/meminfo. Returns false and sets errno on failure.
+ */
+static bool read_meminfo(jlong* totalMemory, jlong* availableMemory) {
+    int fd = get_meminfo_fd();
+    if (fd < 0) {
+        return false;
+    }
+    char buffer[8192];
+    ssize_t count = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (count < 0) {
+        return false;
+    }
+    buffer[count] = 0;
+
+    *totalMemory = parse_meminfo_value(buffer, "MemTotal:");
+    *availableMemory = parse_meminfo_value(buffer, "MemAvailable:");
+    if (*availableMemory < 0) {
+        // Kernels before 3.14 don't report an estimate
+        jlong freeMemory = parse_meminfo_value(buffer, "MemFree:");
+        jlong buffers = parse_meminfo_value(buffer, "Buffers:");
+        // Not to be confused with SwapCached
+        jlong cached = parse_meminfo_value(buffer, "\nCached:");
+        *availableMemory = (freeMemory > 0 ? freeMemory : 0) + (buffers > 0 ? buffers : 0) + (cached > 0 ? cached : 0);
+    }
+    if (*totalMemory <= 0) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_getMemoryInfo(JNIEnv* env, jclass type, jobject dest, jobject result) {
+    jlong totalMemory;
+    jlong availableMemory;
+    if (!read_meminfo(&totalMemory, &availableMemory)) {
+        mark_failed_with_errno(env, "could not read /proc/meminfo", result);
+        return;
+    }
+    env->CallVoidMethod(dest, memoryInfoDetailsMethodId, totalMemory, availableMemory);
+}
+
+typedef struct memory_monitor {
+    // Pressure stall triggers, or -1 when not supported by the kernel or not permitted
+    int someTriggerFd;
+    int fullTriggerFd;
+    // Written to by stopMemoryPressureMonitor() to wake up the waiting thread
+    int wakeFds[2];
+    int stallLevel;
+    jlong stallMillis;
+} memory_monitor_t;
+
+static jlong monotonic_millis() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (jlong) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int open_psi_trigger(const char* trigger) {
+    int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (write(fd, trigger, strlen(trigger) + 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int memory_pressure_from_meminfo() {
+    jlong totalMemory;
+    jlong availableMemory;
+    if (!read_meminfo(&totalMemory, &availableMemory)) {
+        return MEMORY_PRESSURE_NORMAL;
+    }
+    if (availableMemory * 100 < totalMemory * MEMORY_CRITICAL_PERCENT) {
+        return MEMORY_PRESSURE_CRITICAL;
+    }
+    if (availableMemory * 100 < totalMemory * MEMORY_WARNING_PERCENT) {
+        return MEMORY_PRESSURE_WARNING;
+    }
+    return MEMORY_PRESSURE_NORMAL;
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_openMemoryPressureMonitor(JNIEnv* env, jclass type, jobject result) {
+    if (get_meminfo_fd() < 0) {
+        mark_failed_with_errno(env, "could not open /proc/meminfo", result);
+        return 0;
+    }
+    memory_monitor_t* monitor = (memory_monitor_t*) malloc(sizeof(memory_monitor_t));
+    if (monitor == NULL) {
+        mark_failed_with_message(env, "could not allocate memory monitor", result);
+        return 0;
+    }
+    if (pipe2(monitor->wakeFds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        mark_failed_with_errno(env, "could not create pipe", result);
+        free(monitor);
+        return 0;
+    }
+    monitor->someTriggerFd = open_psi_trigger(PSI_SOME_TRIGGER);
+    monitor->fullTriggerFd = open_psi_trigger(PSI_FULL_TRIGGER);
+    monitor->stallLevel = MEMORY_PRESSURE_NORMAL;
+    monitor->stallMillis = 0;
+    return (jlong) monitor;
+}
+
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_waitForMemoryPressure(JNIEnv* env, jclass type, jlong handle, jint currentLevel, jobject result) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    while (true) {
+        struct pollfd fds[3];
+        fds[0].fd = monitor->wakeFds[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = monitor->someTriggerFd;
+        fds[1].events = POLLPRI;
+        fds[2].fd = monitor->fullTriggerFd;
+        fds[2].events = POLLPRI;
+        for (int i = 0; i < 3; i++) {
+            fds[i].revents = 0;
+        }
+        // Negative descriptors are ignored by poll()
+        int ready = poll(fds, 3, MEMORY_SAMPLE_INTERVAL_MILLIS);
+        if (ready < 0 && errno != EINTR) {
+            mark_failed_with_errno(env, "could not wait for memory pressure", result);
+            return MEMORY_PRESSURE_STOPPED;
+        }
+        if (fds[0].revents != 0) {
+            return MEMORY_PRESSURE_STOPPED;
+        }
+
+        jlong now = monotonic_millis();
+        int stallLevel = (fds[2].revents & POLLPRI) ? MEMORY_PRESSURE_CRITICAL : (fds[1].revents & POLLPRI) ? MEMORY_PRESSURE_WARNING : MEMORY_PRESSURE_NORMAL;
+        for (int i = 1; i < 3; i++) {
+            if (fds[i].revents & POLLERR) {
+                // The trigger is gone, e.g. because the cgroup has been removed, so rely on sampling instead
+                close(fds[i].fd);
+                if (i == 1) {
+                    monitor->someTriggerFd = -1;
+                } else {
+                    monitor->fullTriggerFd = -1;
+                }
+            }
+        }
+        if (stallLevel != MEMORY_PRESSURE_NORMAL) {
+            if (stallLevel >= monitor->stallLevel || now - monitor->stallMillis >= PSI_WINDOW_MILLIS) {
+                monitor->stallLevel = stallLevel;
+            }
+            monitor->stallMillis = now;
+        } else if (now - monitor->stallMillis >= PSI_WINDOW_MILLIS) {
+            // Stalls are only reported once per window, so keep the level until a window has passed without one
+            monitor->stallLevel = MEMORY_PRESSURE_NORMAL;
+        }
+
+        int level = memory_pressure_from_meminfo();
+        if (monitor->stallLevel > level) {
+            level = monitor->stallLevel;
+        }
+        if (level != currentLevel) {
+            return level;
+        }
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_stopMemoryPressureMonitor(JNIEnv* env, jclass type, jlong handle) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    char wake = 0;
+    write(monitor->wakeFds[1], &wake, 1);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_closeMemoryPressureMonitor(JNIEnv* env, jclass type, jlong handle) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    if (monitor->someTriggerFd >= 0) {
+        close(monitor->someTriggerFd);
+    }
+    if (monitor->fullTriggerFd >= 0) {
+        close(monitor->fullTriggerFd);
+    }
+    close(monitor->wakeFds[0]);
+    close(monitor->wakeFds[1]);
+    free(monitor);
+}
+
 #endif
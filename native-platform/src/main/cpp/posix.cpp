@@ -20,6 +20,8 @@
 #ifndef _WIN32
 
 #include "generic.h"
+#include "stat_batch.h"
+#include "tree_walk.h"
 #include "net_rubygrapefruit_platform_internal_jni_NativeLibraryFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixFileFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixProcessFunctions.h"
@@ -27,6 +29,8 @@
 #include "net_rubygrapefruit_platform_internal_jni_PosixTypeFunctions.h"
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -37,6 +41,13 @@
 #include <unistd.h>
 
 jmethodID fileStatDetailsMethodId;
+jmethodID dirListAddFileMethodId;
+jmethodID fileSystemListAddMethodId;
+jmethodID fileSystemListAddForUnknownCaseSensitivityMethodId;
+jmethodID memoryInfoDetailsMethodId;
+#ifdef __APPLE__
+jmethodID osxMemoryInfoDetailsMethodId;
+#endif
 
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_NativeLibraryFunctions_getSystemInfo(JNIEnv* env, jclass target, jobject info, jobject result) {
@@ -151,15 +162,73 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_stat(JNIEnv* en
     }
 }
 
-JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readdir(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject contents, jobject result) {
-    jclass contentsClass = env->GetObjectClass(contents);
-    jmethodID mid = env->GetMethodID(contentsClass, "addFile", "(Ljava/lang/String;IJJ)V");
-    if (mid == NULL) {
-        mark_failed_with_message(env, "could not find method", result);
-        return;
+// Number of jlongs per path written by statAll(), see FileStat.details(long[], int)
+#define STAT_RECORD_SIZE 7
+
+int stat_batch_entry(stat_batch_t* batch, const char* path, jlong* record, const char** message) {
+    struct stat fileInfo;
+    int retval = batch->followLink ? stat(path, &fileInfo) : lstat(path, &fileInfo);
+    if (retval != 0) {
+        if (errno != ENOENT && errno != ENOTDIR) {
+            *message = "could not stat file";
+            return errno;
+        }
+        record[0] = FILE_TYPE_MISSING;
+        for (int i = 1; i < STAT_RECORD_SIZE; i++) {
+            record[i] = 0;
+        }
+        return 0;
     }
 
+    file_stat_t fileResult;
+    unpackStat(&fileInfo, &fileResult);
+    record[0] = fileResult.fileType;
+    record[1] = 0777 & fileInfo.st_mode;
+    record[2] = fileInfo.st_uid;
+    record[3] = fileInfo.st_gid;
+    record[4] = fileResult.size;
+    record[5] = fileResult.lastModified;
+    record[6] = fileInfo.st_blksize;
+    return 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_statAll(JNIEnv* env, jclass target, jobjectArray paths, jboolean followLink, jint parallelism, jlongArray stats, jobject result) {
+    stat_batch_t batch;
+    batch.followLink = followLink;
+    batch.parallelism = parallelism;
+    batch.count = env->GetArrayLength(paths);
+    batch.recordSize = STAT_RECORD_SIZE;
+    batch.paths = (char**) calloc(batch.count + 1, sizeof(char*));
+    if (batch.paths == NULL) {
+        mark_failed_with_message(env, "could not allocate stat buffer", result);
+        return -1;
+    }
+
+    jint failedIndex = -1;
+    for (jsize i = 0; i < batch.count; i++) {
+        jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+        batch.paths[i] = java_to_char(env, path, result);
+        env->DeleteLocalRef(path);
+        if (batch.paths[i] == NULL) {
+            failedIndex = i;
+            break;
+        }
+    }
+
+    if (failedIndex < 0) {
+        failedIndex = stat_batch_run(env, &batch, stats, result);
+    }
+
+    for (jsize i = 0; i < batch.count; i++) {
+        free(batch.paths[i]);
+    }
+    free(batch.paths);
+    return failedIndex;
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readdir(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject contents, jobject result) {
     char* pathStr = java_to_char(env, path, result);
     if (pathStr == NULL) {
         return;
@@ -213,13 +282,125 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readdir(JNIEnv*
         }
 
         jstring childName = char_to_java(env, entry.d_name, result);
-        env->CallVoidMethod(contents, mid, childName, fileResult.fileType, fileResult.size, fileResult.lastModified);
+        env->CallVoidMethod(contents, dirListAddFileMethodId, childName, fileResult.fileType, fileResult.size, fileResult.lastModified);
     }
 
     closedir(dir);
     free(pathStr);
 }
 
+bool tree_walk_is_excluded(tree_walk_t* walk, const char* name) {
+    for (int i = 0; i < walk->excludeCount; i++) {
+        if (fnmatch(walk->excludes[i], name, 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void tree_scan_directory(tree_scan_t* scan, const char* path) {
+    tree_walk_t* walk = scan->walk;
+    bool isRoot = path[0] == 0;
+    // Never descend into symlinks to directories, so that cycles are not a problem
+    int dirFd = openat(walk->rootFd, isRoot ? "." : path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dirFd < 0) {
+        if (!isRoot && (errno == ENOENT || errno == ENOTDIR || errno == ELOOP)) {
+            // The directory has been removed or replaced since it was listed
+            return;
+        }
+        tree_scan_fail(scan, errno, "could not open directory");
+        return;
+    }
+    DIR* dir = fdopendir(dirFd);
+    if (dir == NULL) {
+        tree_scan_fail(scan, errno, "could not open directory");
+        close(dirFd);
+        return;
+    }
+    while (true) {
+        errno = 0;
+        struct dirent* entry = readdir(dir);
+        if (entry == NULL) {
+            if (errno != 0) {
+                tree_scan_fail(scan, errno, "could not read directory entry");
+            }
+            break;
+        }
+        if (strcmp(".", entry->d_name) == 0 || strcmp("..", entry->d_name) == 0) {
+            continue;
+        }
+        if (tree_walk_is_excluded(walk, entry->d_name)) {
+            continue;
+        }
+
+        struct stat fileInfo;
+        file_stat_t fileResult;
+        if (fstatat(dirFd, entry->d_name, &fileInfo, walk->followLink ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+            if (errno != ENOENT) {
+                tree_scan_fail(scan, errno, "could not stat file");
+                break;
+            }
+            if (!walk->followLink) {
+                // The entry has been removed since it was listed
+                continue;
+            }
+            fileResult.fileType = FILE_TYPE_MISSING;
+            fileResult.size = 0;
+            fileResult.lastModified = 0;
+        } else {
+            unpackStat(&fileInfo, &fileResult);
+        }
+
+        if (!tree_scan_add_entry(scan, path, entry->d_name, &fileResult, fileResult.fileType == FILE_TYPE_DIRECTORY)) {
+            break;
+        }
+    }
+    closedir(dir);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_walkTree(JNIEnv* env, jclass target, jstring path, jboolean followLink, jint parallelism, jobjectArray excludes, jobject buffer, jobject callback, jobject result) {
+    char* pathStr = java_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return;
+    }
+    int rootFd = open(pathStr, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(pathStr);
+    if (rootFd < 0) {
+        mark_failed_with_errno(env, "could not open directory", result);
+        return;
+    }
+
+    tree_walk_t walk;
+    walk.followLink = followLink;
+    walk.parallelism = parallelism;
+    walk.rootFd = rootFd;
+    walk.excludeCount = 0;
+    jsize excludeCount = env->GetArrayLength(excludes);
+    walk.excludes = (char**) malloc(sizeof(char*) * (excludeCount + 1));
+    bool converted = true;
+    for (jsize i = 0; i < excludeCount && converted; i++) {
+        jstring exclude = (jstring) env->GetObjectArrayElement(excludes, i);
+        char* excludeStr = java_to_char(env, exclude, result);
+        env->DeleteLocalRef(exclude);
+        if (excludeStr == NULL) {
+            converted = false;
+        } else {
+            walk.excludes[walk.excludeCount++] = excludeStr;
+        }
+    }
+
+    if (converted) {
+        tree_walk_run(env, &walk, buffer, callback, result);
+    }
+
+    for (int i = 0; i < walk.excludeCount; i++) {
+        free(walk.excludes[i]);
+    }
+    free(walk.excludes);
+    close(rootFd);
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_symlink(JNIEnv* env, jclass target, jstring path, jstring contents, jobject result) {
     char* pathStr = java_to_char(env, path, result);
@@ -413,8 +594,29 @@ JNI_OnLoad(JavaVM* jvm, void*) {
     if (ret != JNI_OK) {
         return -1;
     }
-    jclass destClass = env->FindClass("net/rubygrapefruit/platform/internal/FileStat");
-    fileStatDetailsMethodId = env->GetMethodID(destClass, "details", "(IIIIJJI)V");
+    if (!init_generic(env)) {
+        return -1;
+    }
+    fileStatDetailsMethodId = find_method(env, "net/rubygrapefruit/platform/internal/FileStat", "details", "(IIIIJJI)V");
+    dirListAddFileMethodId = find_method(env, "net/rubygrapefruit/platform/internal/DirList", "addFile", "(Ljava/lang/String;IJJ)V");
+    dirTreeBufferAddEntriesMethodId = find_method(env, "net/rubygrapefruit/platform/internal/DirTreeBuffer", "addEntries", "(I)V");
+    fileSystemListAddMethodId = find_method(env, "net/rubygrapefruit/platform/internal/FileSystemList", "add", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZZZ)V");
+    fileSystemListAddForUnknownCaseSensitivityMethodId = find_method(env, "net/rubygrapefruit/platform/internal/FileSystemList", "addForUnknownCaseSensitivity", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Z)V");
+    memoryInfoDetailsMethodId = find_method(env, "net/rubygrapefruit/platform/internal/DefaultMemoryInfo", "details", "(JJ)V");
+    if (fileStatDetailsMethodId == NULL
+        || dirListAddFileMethodId == NULL
+        || dirTreeBufferAddEntriesMethodId == NULL
+        || fileSystemListAddMethodId == NULL
+        || fileSystemListAddForUnknownCaseSensitivityMethodId == NULL
+        || memoryInfoDetailsMethodId == NULL) {
+        return -1;
+    }
+#ifdef __APPLE__
+    osxMemoryInfoDetailsMethodId = find_method(env, "net/rubygrapefruit/platform/internal/DefaultOsxMemoryInfo", "details", "(JJJJJJJJJ)V");
+    if (osxMemoryInfoDetailsMethodId == NULL) {
+        return -1;
+    }
+#endif
     return JNI_VERSION_1_6;
 }
 
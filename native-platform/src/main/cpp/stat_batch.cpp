@@ -0,0 +1,148 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * Batched stat engine, see stat_batch.h.
+ */
+#include "stat_batch.h"
+#include <errno.h>
+#include <stdlib.h>
+
+static void lock_batch(stat_batch_t* batch) {
+#ifdef _WIN32
+    EnterCriticalSection(&batch->lock);
+#else
+    pthread_mutex_lock(&batch->lock);
+#endif
+}
+
+static void unlock_batch(stat_batch_t* batch) {
+#ifdef _WIN32
+    LeaveCriticalSection(&batch->lock);
+#else
+    pthread_mutex_unlock(&batch->lock);
+#endif
+}
+
+static void run_worker(stat_batch_t* batch) {
+    lock_batch(batch);
+    while (batch->failedIndex < 0 && batch->nextIndex < batch->count) {
+        int index = batch->nextIndex++;
+        unlock_batch(batch);
+        const char* message = NULL;
+        int errorCode = stat_batch_entry(batch, batch->paths[index], batch->records + (size_t) index * batch->recordSize, &message);
+        lock_batch(batch);
+        if (errorCode != 0 && (batch->failedIndex < 0 || index < batch->failedIndex)) {
+            batch->failedIndex = index;
+            batch->failureCode = errorCode;
+            batch->failureMessage = message;
+        }
+    }
+    unlock_batch(batch);
+}
+
+#ifdef _WIN32
+typedef HANDLE stat_thread_t;
+
+static DWORD WINAPI stat_worker_main(LPVOID arg) {
+    run_worker((stat_batch_t*) arg);
+    return 0;
+}
+
+static bool start_worker(stat_batch_t* batch, stat_thread_t* thread) {
+    *thread = CreateThread(NULL, 0, stat_worker_main, batch, 0, NULL);
+    return *thread != NULL;
+}
+
+static void join_worker(stat_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+typedef pthread_t stat_thread_t;
+
+static void* stat_worker_main(void* arg) {
+    run_worker((stat_batch_t*) arg);
+    return NULL;
+}
+
+static bool start_worker(stat_batch_t* batch, stat_thread_t* thread) {
+    return pthread_create(thread, NULL, stat_worker_main, batch) == 0;
+}
+
+static void join_worker(stat_thread_t thread) {
+    pthread_join(thread, NULL);
+}
+#endif
+
+jint stat_batch_run(JNIEnv* env, stat_batch_t* batch, jlongArray stats, jobject result) {
+    if (env->GetArrayLength(stats) < (jsize) batch->count * batch->recordSize) {
+        mark_failed_with_message(env, "stat array is too small", result);
+        return -1;
+    }
+    batch->records = (jlong*) malloc(sizeof(jlong) * ((size_t) batch->count * batch->recordSize + 1));
+    if (batch->records == NULL) {
+        mark_failed_with_message(env, "could not allocate stat buffer", result);
+        return -1;
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(&batch->lock);
+#else
+    pthread_mutex_init(&batch->lock, NULL);
+#endif
+    batch->nextIndex = 0;
+    batch->failedIndex = -1;
+    batch->failureCode = 0;
+    batch->failureMessage = NULL;
+
+    // Starting threads only pays off when there are enough paths to share out
+    int parallelism = batch->parallelism > STAT_BATCH_MAX_PARALLELISM ? STAT_BATCH_MAX_PARALLELISM : batch->parallelism;
+    if (parallelism > batch->count) {
+        parallelism = batch->count;
+    }
+    stat_thread_t threads[STAT_BATCH_MAX_PARALLELISM];
+    int threadCount = 0;
+    while (parallelism > 1 && threadCount < parallelism - 1 && start_worker(batch, &threads[threadCount])) {
+        threadCount++;
+    }
+
+    // The calling thread takes part as well, so the batch completes even when no threads could be started
+    run_worker(batch);
+    for (int i = 0; i < threadCount; i++) {
+        join_worker(threads[i]);
+    }
+#ifdef _WIN32
+    DeleteCriticalSection(&batch->lock);
+#else
+    pthread_mutex_destroy(&batch->lock);
+#endif
+
+    jint failedIndex = batch->failedIndex;
+    if (failedIndex >= 0) {
+#ifdef _WIN32
+        SetLastError((DWORD) batch->failureCode);
+#else
+        errno = batch->failureCode;
+#endif
+        mark_failed_with_errno(env, batch->failureMessage, result);
+    } else {
+        env->SetLongArrayRegion(stats, 0, (jsize) batch->count * batch->recordSize, batch->records);
+    }
+    free(batch->records);
+    batch->records = NULL;
+    return failedIndex;
+}
@@ -0,0 +1,484 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * Directory tree walk engine, see tree_walk.h.
+ */
+#include "tree_walk.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#define tree_strlen wcslen
+#define TREE_OUT_OF_MEMORY ERROR_NOT_ENOUGH_MEMORY
+#else
+#define tree_strlen strlen
+#define TREE_OUT_OF_MEMORY ENOMEM
+#endif
+
+jmethodID dirTreeBufferAddEntriesMethodId;
+
+static void lock_walk(tree_walk_t* walk) {
+#ifdef _WIN32
+    EnterCriticalSection(&walk->lock);
+#else
+    pthread_mutex_lock(&walk->lock);
+#endif
+}
+
+static void unlock_walk(tree_walk_t* walk) {
+#ifdef _WIN32
+    LeaveCriticalSection(&walk->lock);
+#else
+    pthread_mutex_unlock(&walk->lock);
+#endif
+}
+
+#ifdef TREE_WALK_THREADS
+#ifdef _WIN32
+typedef CONDITION_VARIABLE tree_condition_t;
+#else
+typedef pthread_cond_t tree_condition_t;
+#endif
+
+static void wait_walk(tree_walk_t* walk, tree_condition_t* condition) {
+#ifdef _WIN32
+    SleepConditionVariableCS(condition, &walk->lock, INFINITE);
+#else
+    pthread_cond_wait(condition, &walk->lock);
+#endif
+}
+
+static void wake_all(tree_condition_t* condition) {
+#ifdef _WIN32
+    WakeAllConditionVariable(condition);
+#else
+    pthread_cond_broadcast(condition);
+#endif
+}
+
+static void wake_workers_and_caller(tree_walk_t* walk) {
+    wake_all(&walk->workAvailable);
+    wake_all(&walk->outputAvailable);
+    wake_all(&walk->outputConsumed);
+}
+#else
+static void wake_workers_and_caller(tree_walk_t* walk) {
+}
+#endif
+
+static jint next_directory_id(tree_walk_t* walk) {
+#ifdef _WIN32
+    return (jint) InterlockedIncrement((volatile LONG*) &walk->nextId);
+#else
+    return __sync_add_and_fetch(&walk->nextId, 1);
+#endif
+}
+
+/*
+ * Creates a work item for the directory with the given name in the given parent directory.
+ * The path is allocated along with the work item, so a single free() releases both.
+ */
+static tree_work_t* new_work(jint id, const tree_char_t* parentPath, const tree_char_t* name) {
+    size_t parentLength = tree_strlen(parentPath);
+    size_t nameLength = tree_strlen(name);
+    size_t pathLength = parentLength == 0 ? nameLength : parentLength + 1 + nameLength;
+    tree_work_t* work = (tree_work_t*) malloc(sizeof(tree_work_t) + (pathLength + 1) * sizeof(tree_char_t));
+    if (work == NULL) {
+        return NULL;
+    }
+    work->next = NULL;
+    work->id = id;
+    work->path = (tree_char_t*) (work + 1);
+    tree_char_t* target = work->path;
+    if (parentLength > 0) {
+        memcpy(target, parentPath, parentLength * sizeof(tree_char_t));
+        target += parentLength;
+        *target++ = TREE_PATH_SEPARATOR;
+    }
+    memcpy(target, name, nameLength * sizeof(tree_char_t));
+    target[nameLength] = 0;
+    return work;
+}
+
+static void free_work_list(tree_work_t* work) {
+    while (work != NULL) {
+        tree_work_t* next = work->next;
+        free(work);
+        work = next;
+    }
+}
+
+static void free_chunk_list(tree_chunk_t* chunk) {
+    while (chunk != NULL) {
+        tree_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+/*
+ * Appends the given chunk to the output. Must be called while holding the lock.
+ */
+static void append_output(tree_walk_t* walk, tree_chunk_t* chunk) {
+    chunk->next = NULL;
+    if (walk->outputTail == NULL) {
+        walk->outputHead = chunk;
+    } else {
+        walk->outputTail->next = chunk;
+    }
+    walk->outputTail = chunk;
+    walk->outputCount++;
+}
+
+static void fail_walk(tree_walk_t* walk, int errorCode, const char* message) {
+    lock_walk(walk);
+    if (!walk->stopped) {
+        walk->stopped = true;
+        walk->failureCode = errorCode;
+        walk->failureMessage = message;
+    }
+    wake_workers_and_caller(walk);
+    unlock_walk(walk);
+}
+
+static bool publish_chunk(tree_scan_t* scan) {
+    tree_walk_t* walk = scan->walk;
+    lock_walk(walk);
+#ifdef TREE_WALK_THREADS
+    while (walk->maxOutputCount > 0 && walk->outputCount >= walk->maxOutputCount && !walk->stopped) {
+        wait_walk(walk, &walk->outputConsumed);
+    }
+#endif
+    if (walk->stopped) {
+        unlock_walk(walk);
+        return false;
+    }
+    append_output(walk, scan->chunk);
+#ifdef TREE_WALK_THREADS
+    wake_all(&walk->outputAvailable);
+#endif
+    unlock_walk(walk);
+    scan->chunk = NULL;
+    return true;
+}
+
+bool tree_scan_add_entry(tree_scan_t* scan, const tree_char_t* path, const tree_char_t* name, file_stat_t* fileStat, bool descend) {
+    jint nameLength = (jint) (tree_strlen(name) * sizeof(tree_char_t));
+    size_t recordSize = TREE_RECORD_HEADER_SIZE + nameLength;
+    if (scan->chunk != NULL && scan->chunk->used + recordSize > TREE_CHUNK_SIZE) {
+        if (!publish_chunk(scan)) {
+            return false;
+        }
+    }
+    if (scan->chunk == NULL) {
+        scan->chunk = (tree_chunk_t*) malloc(sizeof(tree_chunk_t));
+        if (scan->chunk == NULL) {
+            tree_scan_fail(scan, TREE_OUT_OF_MEMORY, "could not allocate tree walk buffer");
+            return false;
+        }
+        scan->chunk->next = NULL;
+        scan->chunk->used = 0;
+    }
+
+    jint id = -1;
+    if (descend) {
+        id = next_directory_id(scan->walk);
+        tree_work_t* child = new_work(id, path, name);
+        if (child == NULL) {
+            tree_scan_fail(scan, TREE_OUT_OF_MEMORY, "could not allocate tree walk buffer");
+            return false;
+        }
+        if (scan->childrenTail == NULL) {
+            scan->childrenHead = child;
+        } else {
+            scan->childrenTail->next = child;
+        }
+        scan->childrenTail = child;
+        scan->childCount++;
+    }
+
+    char* record = scan->chunk->data + scan->chunk->used;
+    memcpy(record, &scan->id, sizeof(jint));
+    record += sizeof(jint);
+    memcpy(record, &id, sizeof(jint));
+    record += sizeof(jint);
+    memcpy(record, &fileStat->fileType, sizeof(jint));
+    record += sizeof(jint);
+    memcpy(record, &fileStat->size, sizeof(jlong));
+    record += sizeof(jlong);
+    memcpy(record, &fileStat->lastModified, sizeof(jlong));
+    record += sizeof(jlong);
+    memcpy(record, &nameLength, sizeof(jint));
+    record += sizeof(jint);
+    memcpy(record, name, nameLength);
+    scan->chunk->used += recordSize;
+    return true;
+}
+
+void tree_scan_fail(tree_scan_t* scan, int errorCode, const char* message) {
+    fail_walk(scan->walk, errorCode, message);
+}
+
+/*
+ * Scans the directory of the given work item, then publishes its remaining entries and queues its subdirectories.
+ * Subdirectories are only queued once all entries of the directory have been published, so that Java always
+ * receives the entry of a directory before the entries in it.
+ */
+static void scan_work(tree_walk_t* walk, tree_work_t* work) {
+    tree_scan_t scan;
+    scan.walk = walk;
+    scan.id = work->id;
+    scan.chunk = NULL;
+    scan.childrenHead = NULL;
+    scan.childrenTail = NULL;
+    scan.childCount = 0;
+    tree_scan_directory(&scan, work->path);
+    free(work);
+
+    lock_walk(walk);
+    if (!walk->stopped) {
+        if (scan.chunk != NULL) {
+            append_output(walk, scan.chunk);
+            scan.chunk = NULL;
+        }
+        if (scan.childrenHead != NULL) {
+            if (walk->workTail == NULL) {
+                walk->workHead = scan.childrenHead;
+            } else {
+                walk->workTail->next = scan.childrenHead;
+            }
+            walk->workTail = scan.childrenTail;
+            walk->pendingDirectories += scan.childCount;
+            scan.childrenHead = NULL;
+        }
+    }
+    walk->pendingDirectories--;
+    wake_workers_and_caller(walk);
+    unlock_walk(walk);
+
+    free(scan.chunk);
+    free_work_list(scan.childrenHead);
+}
+
+/*
+ * Takes the next directory to scan from the queue. Must be called while holding the lock.
+ */
+static tree_work_t* take_work(tree_walk_t* walk) {
+    tree_work_t* work = walk->workHead;
+    walk->workHead = work->next;
+    if (walk->workHead == NULL) {
+        walk->workTail = NULL;
+    }
+    return work;
+}
+
+#ifdef TREE_WALK_THREADS
+static void run_worker(tree_walk_t* walk) {
+    lock_walk(walk);
+    while (true) {
+        while (walk->workHead == NULL && walk->pendingDirectories > 0 && !walk->stopped) {
+            wait_walk(walk, &walk->workAvailable);
+        }
+        if (walk->stopped || walk->workHead == NULL) {
+            break;
+        }
+        tree_work_t* work = take_work(walk);
+        unlock_walk(walk);
+        scan_work(walk, work);
+        lock_walk(walk);
+    }
+    unlock_walk(walk);
+}
+
+#ifdef _WIN32
+typedef HANDLE tree_thread_t;
+
+static DWORD WINAPI tree_worker_main(LPVOID arg) {
+    run_worker((tree_walk_t*) arg);
+    return 0;
+}
+
+static bool start_worker(tree_walk_t* walk, tree_thread_t* thread) {
+    *thread = CreateThread(NULL, 0, tree_worker_main, walk, 0, NULL);
+    return *thread != NULL;
+}
+
+static void join_worker(tree_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+typedef pthread_t tree_thread_t;
+
+static void* tree_worker_main(void* arg) {
+    run_worker((tree_walk_t*) arg);
+    return NULL;
+}
+
+static bool start_worker(tree_walk_t* walk, tree_thread_t* thread) {
+    return pthread_create(thread, NULL, tree_worker_main, walk) == 0;
+}
+
+static void join_worker(tree_thread_t thread) {
+    pthread_join(thread, NULL);
+}
+#endif
+#endif
+
+static bool flush_entries(JNIEnv* env, jobject callback, size_t used) {
+    if (used == 0) {
+        return true;
+    }
+    env->CallVoidMethod(callback, dirTreeBufferAddEntriesMethodId, (jint) used);
+    return !env->ExceptionCheck();
+}
+
+void tree_walk_run(JNIEnv* env, tree_walk_t* walk, jobject buffer, jobject callback, jobject result) {
+    char* bufferAddress = (char*) env->GetDirectBufferAddress(buffer);
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (bufferAddress == NULL || capacity < TREE_CHUNK_SIZE) {
+        mark_failed_with_message(env, "could not access tree walk buffer", result);
+        return;
+    }
+
+    static const tree_char_t emptyPath[] = { 0 };
+    tree_work_t* root = new_work(0, emptyPath, emptyPath);
+    if (root == NULL) {
+        mark_failed_with_message(env, "could not allocate tree walk buffer", result);
+        return;
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(&walk->lock);
+#ifdef TREE_WALK_THREADS
+    InitializeConditionVariable(&walk->workAvailable);
+    InitializeConditionVariable(&walk->outputAvailable);
+    InitializeConditionVariable(&walk->outputConsumed);
+#endif
+#else
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_cond_init(&walk->workAvailable, NULL);
+    pthread_cond_init(&walk->outputAvailable, NULL);
+    pthread_cond_init(&walk->outputConsumed, NULL);
+#endif
+    walk->workHead = root;
+    walk->workTail = root;
+    walk->outputHead = NULL;
+    walk->outputTail = NULL;
+    walk->outputCount = 0;
+    walk->maxOutputCount = 0;
+    walk->pendingDirectories = 1;
+    walk->nextId = 0;
+    walk->stopped = false;
+    walk->failureCode = 0;
+    walk->failureMessage = NULL;
+
+    // With a parallelism of 1, or when no threads can be started, the calling thread scans the directories itself
+    int threadCount = 0;
+#ifdef TREE_WALK_THREADS
+    tree_thread_t threads[TREE_MAX_PARALLELISM];
+    int parallelism = walk->parallelism > TREE_MAX_PARALLELISM ? TREE_MAX_PARALLELISM : walk->parallelism;
+    while (parallelism > 1 && threadCount < parallelism && start_worker(walk, &threads[threadCount])) {
+        threadCount++;
+    }
+    // When scanning on the calling thread there is nobody else to consume the chunks, so only workers wait
+    lock_walk(walk);
+    walk->maxOutputCount = threadCount * TREE_OUTPUT_CHUNKS_PER_WORKER;
+    unlock_walk(walk);
+#endif
+
+    size_t used = 0;
+    bool completed = false;
+    lock_walk(walk);
+    while (true) {
+        while (walk->outputHead != NULL && !walk->stopped) {
+            tree_chunk_t* chunk = walk->outputHead;
+            walk->outputHead = chunk->next;
+            if (walk->outputHead == NULL) {
+                walk->outputTail = NULL;
+            }
+            walk->outputCount--;
+            unlock_walk(walk);
+            bool succeeded = true;
+            if (used + chunk->used > (size_t) capacity) {
+                succeeded = flush_entries(env, callback, used);
+                used = 0;
+            }
+            if (succeeded) {
+                memcpy(bufferAddress + used, chunk->data, chunk->used);
+                used += chunk->used;
+            }
+            free(chunk);
+            lock_walk(walk);
+#ifdef TREE_WALK_THREADS
+            wake_all(&walk->outputConsumed);
+#endif
+            if (!succeeded) {
+                // The callback has thrown an exception, which is rethrown once we return to Java
+                walk->stopped = true;
+                wake_workers_and_caller(walk);
+            }
+        }
+        if (walk->stopped) {
+            break;
+        }
+        if (walk->pendingDirectories == 0) {
+            completed = true;
+            break;
+        }
+        if (threadCount == 0) {
+            tree_work_t* work = take_work(walk);
+            unlock_walk(walk);
+            scan_work(walk, work);
+            lock_walk(walk);
+        } else {
+#ifdef TREE_WALK_THREADS
+            wait_walk(walk, &walk->outputAvailable);
+#endif
+        }
+    }
+    unlock_walk(walk);
+
+#ifdef TREE_WALK_THREADS
+    for (int i = 0; i < threadCount; i++) {
+        join_worker(threads[i]);
+    }
+#endif
+    free_work_list(walk->workHead);
+    free_chunk_list(walk->outputHead);
+#ifdef _WIN32
+    DeleteCriticalSection(&walk->lock);
+#else
+    pthread_cond_destroy(&walk->outputConsumed);
+    pthread_cond_destroy(&walk->outputAvailable);
+    pthread_cond_destroy(&walk->workAvailable);
+    pthread_mutex_destroy(&walk->lock);
+#endif
+
+    if (walk->failureMessage != NULL) {
+#ifdef _WIN32
+        SetLastError((DWORD) walk->failureCode);
+#else
+        errno = walk->failureCode;
+#endif
+        mark_failed_with_errno(env, walk->failureMessage, result);
+    } else if (completed) {
+        flush_entries(env, callback, used);
+    }
+}
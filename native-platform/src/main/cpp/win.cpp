@@ -18,6 +18,9 @@
 
 #include "win.h"
 #include "generic.h"
+#include "stat_batch.h"
+#include "tree_walk.h"
+#include "net_rubygrapefruit_platform_internal_jni_MemoryFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_NativeLibraryFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixProcessFunctions.h"
@@ -36,7 +39,7 @@ void mark_failed_with_errno(JNIEnv* env, const char* message, jobject result) {
 }
 
 int map_error_code(int error_code) {
-    if (error_code == ERROR_PATH_NOT_FOUND) {
+    if (error_code == ERROR_PATH_NOT_FOUND || error_code == ERROR_FILE_NOT_FOUND) {
         return FAILURE_NO_SUCH_FILE;
     }
     if (error_code == ERROR_DIRECTORY) {
@@ -327,16 +330,152 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixProcessFunctions_setEnvironme
     }
 }
 
+/*
+ * Memory functions
+ */
+
+// Available memory, as a percentage of the total memory, below which memory pressure is reported
+#define MEMORY_WARNING_PERCENT 10
+#define MEMORY_CRITICAL_PERCENT 5
+
+// How often available memory is sampled while waiting for the memory pressure to change
+#define MEMORY_SAMPLE_INTERVAL_MILLIS 1000
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_getMemoryInfo(JNIEnv* env, jclass type, jobject dest, jobject result) {
+
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) {
+        mark_failed_with_errno(env, "could not query memory status", result);
+        return;
+    }
+    env->CallVoidMethod(dest, memoryInfoDetailsMethodId, (jlong) status.ullTotalPhys, (jlong) status.ullAvailPhys);
+}
+
+typedef struct memory_monitor {
+    // Signalled by the system while available memory is low
+    HANDLE lowMemory;
+    // Signalled by stopMemoryPressureMonitor()
+    HANDLE stopped;
+} memory_monitor_t;
+
+static int memory_pressure_from_status() {
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status) || status.ullTotalPhys == 0) {
+        return MEMORY_PRESSURE_NORMAL;
+    }
+    if (status.ullAvailPhys * 100 < status.ullTotalPhys * MEMORY_CRITICAL_PERCENT) {
+        return MEMORY_PRESSURE_CRITICAL;
+    }
+    if (status.ullAvailPhys * 100 < status.ullTotalPhys * MEMORY_WARNING_PERCENT) {
+        return MEMORY_PRESSURE_WARNING;
+    }
+    return MEMORY_PRESSURE_NORMAL;
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_openMemoryPressureMonitor(JNIEnv* env, jclass type, jobject result) {
+    HANDLE lowMemory = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+    if (lowMemory == NULL) {
+        mark_failed_with_errno(env, "could not create memory resource notification", result);
+        return 0;
+    }
+    HANDLE stopped = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (stopped == NULL) {
+        mark_failed_with_errno(env, "could not create event", result);
+        CloseHandle(lowMemory);
+        return 0;
+    }
+    memory_monitor_t* monitor = (memory_monitor_t*) malloc(sizeof(memory_monitor_t));
+    if (monitor == NULL) {
+        mark_failed_with_message(env, "could not allocate memory monitor", result);
+        CloseHandle(stopped);
+        CloseHandle(lowMemory);
+        return 0;
+    }
+    monitor->lowMemory = lowMemory;
+    monitor->stopped = stopped;
+    return (jlong) monitor;
+}
+
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_waitForMemoryPressure(JNIEnv* env, jclass type, jlong handle, jint currentLevel, jobject result) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    while (true) {
+        BOOL low = FALSE;
+        if (!QueryMemoryResourceNotification(monitor->lowMemory, &low)) {
+            mark_failed_with_errno(env, "could not query memory resource notification", result);
+            return MEMORY_PRESSURE_STOPPED;
+        }
+        int level = memory_pressure_from_status();
+        if (low && level == MEMORY_PRESSURE_NORMAL) {
+            level = MEMORY_PRESSURE_WARNING;
+        }
+        if (level != currentLevel) {
+            return level;
+        }
+
+        // The notification stays signalled while memory is low, so only wait for it while it isn't
+        HANDLE handles[2] = { monitor->stopped, monitor->lowMemory };
+        DWORD ret = WaitForMultipleObjects(low ? 1 : 2, handles, FALSE, MEMORY_SAMPLE_INTERVAL_MILLIS);
+        if (ret == WAIT_OBJECT_0) {
+            return MEMORY_PRESSURE_STOPPED;
+        }
+        if (ret == WAIT_FAILED) {
+            mark_failed_with_errno(env, "could not wait for memory pressure", result);
+            return MEMORY_PRESSURE_STOPPED;
+        }
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_stopMemoryPressureMonitor(JNIEnv* env, jclass type, jlong handle) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    SetEvent(monitor->stopped);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_MemoryFunctions_closeMemoryPressureMonitor(JNIEnv* env, jclass type, jlong handle) {
+    memory_monitor_t* monitor = (memory_monitor_t*) handle;
+    CloseHandle(monitor->lowMemory);
+    CloseHandle(monitor->stopped);
+    free(monitor);
+}
+
 /*
  * File system functions
  */
 
+// Drives present when fileSystemsChanged() was last called. Only used by the caller of fileSystemsChanged(), which is synchronized on the Java side.
+static DWORD knownLogicalDrives = 0;
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_fileSystemsChanged(JNIEnv* env, jclass target) {
+    DWORD drives = GetLogicalDrives();
+    bool changed = drives == 0 || drives != knownLogicalDrives;
+    knownLogicalDrives = drives;
+    if (changed) {
+        return JNI_TRUE;
+    }
+    // Media can be swapped and network drives remapped without the drive letters changing, so those are always listed again
+    wchar_t root[] = L"A:\\";
+    for (int i = 0; i < 26; i++) {
+        if ((drives & (1 << i)) == 0) {
+            continue;
+        }
+        root[0] = (wchar_t) (L'A' + i);
+        UINT type = GetDriveTypeW(root);
+        if (type == DRIVE_REMOVABLE || type == DRIVE_CDROM || type == DRIVE_REMOTE) {
+            return JNI_TRUE;
+        }
+    }
+    return JNI_FALSE;
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileSystems(JNIEnv* env, jclass target, jobject info, jobject result) {
-    jclass info_class = env->GetObjectClass(info);
-    jmethodID method = env->GetMethodID(info_class, "add", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZZZ)V");
-    jmethodID unknownFsMethod = env->GetMethodID(info_class, "addForUnknownCaseSensitivity", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Z)V");
-
     DWORD required = GetLogicalDriveStringsW(0, NULL);
     if (required == 0) {
         mark_failed_with_errno(env, "could not determine logical drive buffer size", result);
@@ -397,7 +536,7 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
             if (available) {
                 DWORD flags;
                 if (GetVolumeInformationW(cur, NULL, 0, NULL, NULL, &flags, fileSystemName, MAX_PATH + 1) == 0) {
-                    env->CallVoidMethod(info, unknownFsMethod,
+                    env->CallVoidMethod(info, fileSystemListAddForUnknownCaseSensitivityMethodId,
                         mount_point,
                         NULL,
                         device_name,
@@ -414,7 +553,7 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
             }
 
             jstring file_system_type = wchar_to_java(env, fileSystemName, wcslen(fileSystemName), result);
-            env->CallVoidMethod(info, method,
+            env->CallVoidMethod(info, fileSystemListAddMethodId,
                 mount_point,
                 file_system_type,
                 device_name,
@@ -427,15 +566,17 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
     free(fileSystemName);
 }
 
+jmethodID fileStatDetailsMethodId;
+jmethodID windowsDirListAddFileMethodId;
+jmethodID windowsDirListAddFileWithIdMethodId;
+jmethodID fileSystemListAddMethodId;
+jmethodID fileSystemListAddForUnknownCaseSensitivityMethodId;
+jmethodID memoryInfoDetailsMethodId;
+jmethodID charInputBufferKeyMethodId;
+jmethodID charInputBufferCharacterMethodId;
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_stat(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject dest, jobject result) {
-    jclass destClass = env->GetObjectClass(dest);
-    jmethodID mid = env->GetMethodID(destClass, "details", "(IJJ)V");
-    if (mid == NULL) {
-        mark_failed_with_message(env, "could not find method", result);
-        return;
-    }
-
     wchar_t* pathStr = java_to_wchar_path(env, path);
     file_stat_t fileStat;
     DWORD errorCode = get_file_stat(pathStr, followLink, &fileStat);
@@ -444,18 +585,102 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_stat(JNIEnv*
         mark_failed_with_code(env, "could not file attributes", errorCode, NULL, result);
         return;
     }
-    env->CallVoidMethod(dest, mid, fileStat.fileType, fileStat.size, fileStat.lastModified);
+    env->CallVoidMethod(dest, fileStatDetailsMethodId, fileStat.fileType, fileStat.size, fileStat.lastModified);
 }
 
-JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_readdir(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject contents, jobject result) {
-    jclass contentsClass = env->GetObjectClass(contents);
-    jmethodID mid = env->GetMethodID(contentsClass, "addFile", "(Ljava/lang/String;IJJ)V");
-    if (mid == NULL) {
-        mark_failed_with_message(env, "could not find method", result);
-        return;
+// Number of jlongs per path written by statAll(), see WindowsFileStat.details(long[], int)
+#define STAT_RECORD_SIZE 3
+
+int stat_batch_entry(stat_batch_t* batch, const wchar_t* path, jlong* record, const char** message) {
+    file_stat_t fileStat;
+    DWORD errorCode = get_file_stat((wchar_t*) path, batch->followLink, &fileStat);
+    if (errorCode != ERROR_SUCCESS) {
+        *message = "could not file attributes";
+        return (int) errorCode;
     }
+    record[0] = fileStat.fileType;
+    record[1] = fileStat.size;
+    record[2] = fileStat.lastModified;
+    return 0;
+}
 
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_statAll(JNIEnv* env, jclass target, jobjectArray paths, jboolean followLink, jint parallelism, jlongArray stats, jobject result) {
+    stat_batch_t batch;
+    batch.followLink = followLink;
+    batch.parallelism = parallelism;
+    batch.count = env->GetArrayLength(paths);
+    batch.recordSize = STAT_RECORD_SIZE;
+    batch.paths = (wchar_t**) calloc(batch.count + 1, sizeof(wchar_t*));
+    if (batch.paths == NULL) {
+        mark_failed_with_message(env, "could not allocate stat buffer", result);
+        return -1;
+    }
+
+    for (jsize i = 0; i < batch.count; i++) {
+        jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+        batch.paths[i] = java_to_wchar_path(env, path);
+        env->DeleteLocalRef(path);
+    }
+
+    jint failedIndex = stat_batch_run(env, &batch, stats, result);
+
+    for (jsize i = 0; i < batch.count; i++) {
+        free(batch.paths[i]);
+    }
+    free(batch.paths);
+    return failedIndex;
+}
+
+#ifndef WINDOWS_MIN
+// Size of the buffer directory entries are read into with GetFileInformationByHandleEx()
+#define DIRECTORY_INFO_BUFFER_SIZE (64 * 1024)
+
+typedef struct dir_entry_info {
+    const wchar_t* name;
+    DWORD nameLength;
+    DWORD attributes;
+    DWORD reparseTag;
+    LARGE_INTEGER lastWriteTime;
+    LARGE_INTEGER size;
+    jlong fileIdHigh;
+    jlong fileIdLow;
+} dir_entry_info_t;
+
+//
+// Decodes the entry at the given position of a buffer filled by GetFileInformationByHandleEx(),
+// returns the offset of the next entry or 0 if this was the last one.
+//
+DWORD decode_dir_entry(FILE_INFO_BY_HANDLE_CLASS infoClass, BYTE* entry, dir_entry_info_t* info) {
+    if (infoClass == FileIdExtdDirectoryInfo) {
+        FILE_ID_EXTD_DIR_INFO* extdInfo = (FILE_ID_EXTD_DIR_INFO*) entry;
+        info->name = extdInfo->FileName;
+        info->nameLength = extdInfo->FileNameLength / sizeof(wchar_t);
+        info->attributes = extdInfo->FileAttributes;
+        info->reparseTag = extdInfo->ReparsePointTag;
+        info->lastWriteTime = extdInfo->LastWriteTime;
+        info->size = extdInfo->EndOfFile;
+        memcpy(&info->fileIdLow, extdInfo->FileId.Identifier, sizeof(jlong));
+        memcpy(&info->fileIdHigh, extdInfo->FileId.Identifier + sizeof(jlong), sizeof(jlong));
+        return extdInfo->NextEntryOffset;
+    }
+    FILE_ID_BOTH_DIR_INFO* bothInfo = (FILE_ID_BOTH_DIR_INFO*) entry;
+    info->name = bothInfo->FileName;
+    info->nameLength = bothInfo->FileNameLength / sizeof(wchar_t);
+    info->attributes = bothInfo->FileAttributes;
+    // For reparse points the EA size holds the reparse tag, like dwReserved0 of WIN32_FIND_DATA
+    info->reparseTag = bothInfo->EaSize;
+    info->lastWriteTime = bothInfo->LastWriteTime;
+    info->size = bothInfo->EndOfFile;
+    info->fileIdHigh = 0;
+    info->fileIdLow = (jlong) bothInfo->FileId.QuadPart;
+    return bothInfo->NextEntryOffset;
+}
+#endif
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_readdir(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject contents, jobject result) {
+#ifdef WINDOWS_MIN
     WIN32_FIND_DATAW entry;
     wchar_t* pathStr = java_to_wchar_path(env, path);
     wchar_t* patternStr = add_suffix(pathStr, wcslen(pathStr), L"\\*");
@@ -496,7 +721,7 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_readdir(JNIEn
 
         // Add entry
         jstring childName = wchar_to_java(env, entry.cFileName, wcslen(entry.cFileName), result);
-        env->CallVoidMethod(contents, mid, childName, fileInfo.fileType, fileInfo.size, fileInfo.lastModified);
+        env->CallVoidMethod(contents, windowsDirListAddFileMethodId, childName, fileInfo.fileType, fileInfo.size, fileInfo.lastModified);
     } while (FindNextFileW(dirHandle, &entry) != 0);
 
     DWORD error = GetLastError();
@@ -504,10 +729,247 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_readdir(JNIEn
         mark_failed_with_errno(env, "could not read next directory entry", result);
     }
 
+    free(patternStr);
+    FindClose(dirHandle);
+#else
+    wchar_t* pathStr = java_to_wchar_path(env, path);
+    HANDLE dirHandle = CreateFileW(
+        pathStr,
+        FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS,
+        NULL);
+    if (dirHandle == INVALID_HANDLE_VALUE) {
+        mark_failed_with_errno(env, "could not open directory", result);
+        free(pathStr);
+        return;
+    }
+    BY_HANDLE_FILE_INFORMATION dirInfo;
+    if (!GetFileInformationByHandle(dirHandle, &dirInfo)) {
+        mark_failed_with_errno(env, "could not open directory", result);
+        CloseHandle(dirHandle);
+        free(pathStr);
+        return;
+    }
+    if ((dirInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        mark_failed_with_code(env, "could not open directory", ERROR_DIRECTORY, NULL, result);
+        CloseHandle(dirHandle);
+        free(pathStr);
+        return;
+    }
+
+    // Read entries in large batches, falling back to 64 bit file ids where 128 bit ones are not supported (before Windows 8 and on FAT)
+    BYTE* buffer = (BYTE*) malloc(DIRECTORY_INFO_BUFFER_SIZE);
+    FILE_INFO_BY_HANDLE_CLASS infoClass = FileIdExtdDirectoryInfo;
+    BOOL ok = GetFileInformationByHandleEx(dirHandle, infoClass, buffer, DIRECTORY_INFO_BUFFER_SIZE);
+    if (!ok && GetLastError() == ERROR_INVALID_PARAMETER) {
+        infoClass = FileIdBothDirectoryInfo;
+        ok = GetFileInformationByHandleEx(dirHandle, infoClass, buffer, DIRECTORY_INFO_BUFFER_SIZE);
+    }
+    if (!ok && GetLastError() != ERROR_NO_MORE_FILES) {
+        mark_failed_with_errno(env, "could not read directory", result);
+    }
+    size_t pathLen = wcslen(pathStr);
+    while (ok) {
+        DWORD offset = 0;
+        while (true) {
+            dir_entry_info_t entry;
+            DWORD nextOffset = decode_dir_entry(infoClass, buffer + offset, &entry);
+            bool isDotEntry = (entry.nameLength == 1 && entry.name[0] == L'.')
+                || (entry.nameLength == 2 && entry.name[0] == L'.' && entry.name[1] == L'.');
+            if (!isDotEntry) {
+                // If entry is a symbolic link, we may have to get the attributes of the link target
+                bool isSymLink = is_file_symlink(entry.attributes, entry.reparseTag);
+                file_stat_t fileInfo;
+                if (isSymLink && followLink) {
+                    wchar_t* childPathStr = (wchar_t*) malloc(sizeof(wchar_t) * (pathLen + entry.nameLength + 2));
+                    wcscpy(childPathStr, pathStr);
+                    size_t childPathLen = pathLen;
+                    if (childPathLen == 0 || childPathStr[childPathLen - 1] != L'\\') {
+                        childPathStr[childPathLen++] = L'\\';
+                    }
+                    wcsncpy(childPathStr + childPathLen, entry.name, entry.nameLength);
+                    childPathStr[childPathLen + entry.nameLength] = 0;
+                    DWORD errorCode = get_file_stat(childPathStr, true, &fileInfo);
+                    free(childPathStr);
+                    if (errorCode != ERROR_SUCCESS) {
+                        mark_failed_with_code(env, "could not stat directory entry", errorCode, NULL, result);
+                        ok = FALSE;
+                        break;
+                    }
+                } else {
+                    fileInfo.fileType = isSymLink
+                        ? FILE_TYPE_SYMLINK
+                        : (entry.attributes & FILE_ATTRIBUTE_DIRECTORY)
+                            ? FILE_TYPE_DIRECTORY
+                            : FILE_TYPE_FILE;
+                    fileInfo.lastModified = (jlong) entry.lastWriteTime.QuadPart;
+                    fileInfo.size = fileInfo.fileType == FILE_TYPE_FILE ? (jlong) entry.size.QuadPart : 0;
+                }
+
+                jstring childName = wchar_to_java(env, entry.name, entry.nameLength, result);
+                env->CallVoidMethod(contents, windowsDirListAddFileWithIdMethodId, childName, fileInfo.fileType, fileInfo.size, fileInfo.lastModified, entry.fileIdHigh, entry.fileIdLow);
+                env->DeleteLocalRef(childName);
+            }
+            if (nextOffset == 0) {
+                break;
+            }
+            offset += nextOffset;
+        }
+        if (!ok) {
+            break;
+        }
+        ok = GetFileInformationByHandleEx(dirHandle, infoClass, buffer, DIRECTORY_INFO_BUFFER_SIZE);
+        if (!ok && GetLastError() != ERROR_NO_MORE_FILES) {
+            mark_failed_with_errno(env, "could not read next directory entry", result);
+        }
+    }
+    free(buffer);
+    CloseHandle(dirHandle);
+    free(pathStr);
+#endif
+}
+
+bool tree_walk_is_excluded(tree_walk_t* walk, const wchar_t* name) {
+    for (int i = 0; i < walk->excludeCount; i++) {
+        if (PathMatchSpecW(name, walk->excludes[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void tree_scan_directory(tree_scan_t* scan, const wchar_t* path) {
+    tree_walk_t* walk = scan->walk;
+    bool isRoot = path[0] == 0;
+    size_t rootLength = wcslen(walk->rootPath);
+    size_t pathLength = wcslen(path);
+    wchar_t* patternStr = (wchar_t*) malloc(sizeof(wchar_t) * (rootLength + pathLength + 4));
+    if (patternStr == NULL) {
+        tree_scan_fail(scan, ERROR_NOT_ENOUGH_MEMORY, "could not open directory");
+        return;
+    }
+    size_t patternLength = rootLength;
+    wcscpy(patternStr, walk->rootPath);
+    if (patternLength > 0 && patternStr[patternLength - 1] != L'\\') {
+        patternStr[patternLength++] = L'\\';
+    }
+    if (!isRoot) {
+        wcscpy(patternStr + patternLength, path);
+        patternLength += pathLength;
+        patternStr[patternLength++] = L'\\';
+    }
+    patternStr[patternLength++] = L'*';
+    patternStr[patternLength] = 0;
+
+    WIN32_FIND_DATAW entry;
+#ifdef WINDOWS_MIN
+    HANDLE dirHandle = FindFirstFileW(patternStr, &entry);
+#else
+    // Skip looking up short names, and fetch entries from the file system in larger batches
+    HANDLE dirHandle = FindFirstFileExW(patternStr, FindExInfoBasic, &entry, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (dirHandle == INVALID_HANDLE_VALUE && GetLastError() == ERROR_INVALID_PARAMETER) {
+        // Basic info and large fetches are not supported before Windows 7
+        dirHandle = FindFirstFileExW(patternStr, FindExInfoStandard, &entry, FindExSearchNameMatch, NULL, 0);
+    }
+#endif
+    if (dirHandle == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        if (!isRoot && (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND || error == ERROR_DIRECTORY)) {
+            // The directory has been removed or replaced since it was listed
+            free(patternStr);
+            return;
+        }
+        tree_scan_fail(scan, error, "could not open directory");
+        free(patternStr);
+        return;
+    }
+
+    bool succeeded = true;
+    do {
+        if (wcscmp(L".", entry.cFileName) == 0 || wcscmp(L"..", entry.cFileName) == 0) {
+            continue;
+        }
+        if (tree_walk_is_excluded(walk, entry.cFileName)) {
+            continue;
+        }
+
+        bool isSymLink = is_file_symlink(entry.dwFileAttributes, entry.dwReserved0);
+        file_stat_t fileInfo;
+        if (isSymLink && walk->followLink) {
+            // We use patternStr minus the last character ("*") to create the absolute path of the child entry
+            wchar_t* childPathStr = add_suffix(patternStr, wcslen(patternStr) - 1, entry.cFileName);
+            DWORD errorCode = get_file_stat(childPathStr, true, &fileInfo);
+            free(childPathStr);
+            if (errorCode != ERROR_SUCCESS) {
+                tree_scan_fail(scan, errorCode, "could not stat directory entry");
+                succeeded = false;
+                break;
+            }
+        } else {
+            fileInfo.fileType = isSymLink
+                ? FILE_TYPE_SYMLINK
+                : (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                    ? FILE_TYPE_DIRECTORY
+                    : FILE_TYPE_FILE;
+            fileInfo.lastModified = lastModifiedNanos(&entry.ftLastWriteTime);
+            fileInfo.size = ((jlong) entry.nFileSizeHigh << 32) | entry.nFileSizeLow;
+        }
+
+        // Never descend into symlinks or junctions, so that cycles are not a problem
+        bool descend = fileInfo.fileType == FILE_TYPE_DIRECTORY
+            && (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0;
+        if (!tree_scan_add_entry(scan, path, entry.cFileName, &fileInfo, descend)) {
+            succeeded = false;
+            break;
+        }
+    } while (FindNextFileW(dirHandle, &entry) != 0);
+
+    if (succeeded) {
+        DWORD error = GetLastError();
+        if (error != ERROR_NO_MORE_FILES) {
+            tree_scan_fail(scan, error, "could not read next directory entry");
+        }
+    }
+
     free(patternStr);
     FindClose(dirHandle);
 }
 
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_WindowsFileFunctions_walkTree(JNIEnv* env, jclass target, jstring path, jboolean followLink, jint parallelism, jobjectArray excludes, jobject buffer, jobject callback, jobject result) {
+    tree_walk_t walk;
+    walk.followLink = followLink;
+    walk.parallelism = parallelism;
+    walk.rootPath = java_to_wchar_path(env, path);
+    walk.excludeCount = 0;
+    jsize excludeCount = env->GetArrayLength(excludes);
+    walk.excludes = (wchar_t**) malloc(sizeof(wchar_t*) * (excludeCount + 1));
+    bool converted = true;
+    for (jsize i = 0; i < excludeCount && converted; i++) {
+        jstring exclude = (jstring) env->GetObjectArrayElement(excludes, i);
+        wchar_t* excludeStr = java_to_wchar(env, exclude, result);
+        env->DeleteLocalRef(exclude);
+        if (excludeStr == NULL) {
+            converted = false;
+        } else {
+            walk.excludes[walk.excludeCount++] = excludeStr;
+        }
+    }
+
+    if (converted) {
+        tree_walk_run(env, &walk, buffer, callback, result);
+    }
+
+    for (int i = 0; i < walk.excludeCount; i++) {
+        free(walk.excludes[i]);
+    }
+    free(walk.excludes);
+    free(walk.rootPath);
+}
+
 /*
  * Console functions
  */
@@ -653,15 +1115,11 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsConsoleFunctions_resetInput
 }
 
 void control_key(JNIEnv* env, jint key, jobject char_buffer, jobject result) {
-    jclass bufferClass = env->GetObjectClass(char_buffer);
-    jmethodID method = env->GetMethodID(bufferClass, "key", "(I)V");
-    env->CallVoidMethod(char_buffer, method, key);
+    env->CallVoidMethod(char_buffer, charInputBufferKeyMethodId, key);
 }
 
 void character(JNIEnv* env, jchar char_value, jobject char_buffer, jobject result) {
-    jclass bufferClass = env->GetObjectClass(char_buffer);
-    jmethodID method = env->GetMethodID(bufferClass, "character", "(C)V");
-    env->CallVoidMethod(char_buffer, method, char_value);
+    env->CallVoidMethod(char_buffer, charInputBufferCharacterMethodId, char_value);
 }
 
 JNIEXPORT void JNICALL
@@ -797,8 +1255,7 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsConsoleFunctions_reset(JNIE
     }
 }
 
-JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_WindowsConsoleFunctions_foreground(JNIEnv* env, jclass target, jint color, jobject result) {
+void set_foreground(jint color) {
     current_attributes &= ~ALL_COLORS;
     switch (color) {
         case 0:
@@ -825,7 +1282,11 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsConsoleFunctions_foreground
             current_attributes |= FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
             break;
     }
+}
 
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_WindowsConsoleFunctions_foreground(JNIEnv* env, jclass target, jint color, jobject result) {
+    set_foreground(color);
     if (!SetConsoleTextAttribute(current_console, current_attributes)) {
         mark_failed_with_errno(env, "could not set text attributes", result);
     }
@@ -937,6 +1398,192 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsConsoleFunctions_clearToEnd
     }
 }
 
+// Corresponds to values of WindowsConsoleFrame
+#define CONSOLE_OP_TEXT 0
+#define CONSOLE_OP_BOLD_ON 1
+#define CONSOLE_OP_BOLD_OFF 2
+#define CONSOLE_OP_RESET 3
+#define CONSOLE_OP_SHOW_CURSOR 4
+#define CONSOLE_OP_HIDE_CURSOR 5
+#define CONSOLE_OP_FOREGROUND 6
+#define CONSOLE_OP_DEFAULT_FOREGROUND 7
+#define CONSOLE_OP_LEFT 8
+#define CONSOLE_OP_RIGHT 9
+#define CONSOLE_OP_UP 10
+#define CONSOLE_OP_DOWN 11
+#define CONSOLE_OP_START_LINE 12
+#define CONSOLE_OP_CLEAR_TO_END_OF_LINE 13
+
+/*
+ * Console state while a frame is applied. The cursor position is only queried when needed after text has been
+ * written, and cursor motion and text attributes are only applied before they take effect, so that a series of
+ * operations turns into a single console call.
+ */
+typedef struct console_frame {
+    COORD cursor;
+    SHORT width;
+    bool cursorKnown;
+    bool cursorMoved;
+    WORD appliedAttributes;
+} console_frame_t;
+
+bool frame_query_cursor(JNIEnv* env, console_frame_t* frame, jobject result) {
+    if (frame->cursorKnown) {
+        return true;
+    }
+    CONSOLE_SCREEN_BUFFER_INFO console_info;
+    if (!GetConsoleScreenBufferInfo(current_console, &console_info)) {
+        mark_failed_with_errno(env, "could not get console buffer", result);
+        return false;
+    }
+    frame->cursor = console_info.dwCursorPosition;
+    frame->width = console_info.dwSize.X;
+    frame->cursorKnown = true;
+    return true;
+}
+
+bool frame_apply_state(JNIEnv* env, console_frame_t* frame, jobject result) {
+    if (frame->cursorMoved) {
+        if (!SetConsoleCursorPosition(current_console, frame->cursor)) {
+            mark_failed_with_errno(env, "could not set cursor position", result);
+            return false;
+        }
+        frame->cursorMoved = false;
+    }
+    if (frame->appliedAttributes != current_attributes) {
+        if (!SetConsoleTextAttribute(current_console, current_attributes)) {
+            mark_failed_with_errno(env, "could not set text attributes", result);
+            return false;
+        }
+        frame->appliedAttributes = current_attributes;
+    }
+    return true;
+}
+
+bool frame_write_text(JNIEnv* env, console_frame_t* frame, const jbyte* text, jint length, jobject result) {
+    while (length > 0) {
+        DWORD written;
+        if (!WriteFile(current_console, text, length, &written, NULL)) {
+            mark_failed_with_errno(env, "could not write to console", result);
+            return false;
+        }
+        text += written;
+        length -= written;
+    }
+    // Text may wrap or scroll, so let the console tell where the cursor ended up
+    frame->cursorKnown = false;
+    return true;
+}
+
+bool frame_apply_op(JNIEnv* env, console_frame_t* frame, jint op, jint arg, const jbyte* text, jint* textOffset, jint textLength, jobject result) {
+    CONSOLE_CURSOR_INFO cursor;
+    switch (op) {
+        case CONSOLE_OP_TEXT:
+            if (arg < 0 || arg > textLength - *textOffset) {
+                mark_failed_with_message(env, "invalid frame text", result);
+                return false;
+            }
+            if (!frame_apply_state(env, frame, result) || !frame_write_text(env, frame, text + *textOffset, arg, result)) {
+                return false;
+            }
+            *textOffset += arg;
+            return true;
+        case CONSOLE_OP_BOLD_ON:
+            current_attributes |= FOREGROUND_INTENSITY;
+            return true;
+        case CONSOLE_OP_BOLD_OFF:
+            current_attributes &= ~FOREGROUND_INTENSITY;
+            return true;
+        case CONSOLE_OP_RESET:
+            current_attributes = original_attributes;
+            if (!SetConsoleCursorInfo(current_console, &original_cursor)) {
+                mark_failed_with_errno(env, "could not set console cursor", result);
+                return false;
+            }
+            return true;
+        case CONSOLE_OP_SHOW_CURSOR:
+        case CONSOLE_OP_HIDE_CURSOR:
+            cursor = original_cursor;
+            cursor.bVisible = op == CONSOLE_OP_SHOW_CURSOR;
+            if (!SetConsoleCursorInfo(current_console, &cursor)) {
+                mark_failed_with_errno(env, "could not set console cursor", result);
+                return false;
+            }
+            return true;
+        case CONSOLE_OP_FOREGROUND:
+            set_foreground(arg);
+            return true;
+        case CONSOLE_OP_DEFAULT_FOREGROUND:
+            current_attributes = (current_attributes & ~ALL_COLORS) | (original_attributes & ALL_COLORS);
+            return true;
+        case CONSOLE_OP_LEFT:
+        case CONSOLE_OP_RIGHT:
+        case CONSOLE_OP_UP:
+        case CONSOLE_OP_DOWN:
+        case CONSOLE_OP_START_LINE:
+            if (!frame_query_cursor(env, frame, result)) {
+                return false;
+            }
+            if (op == CONSOLE_OP_LEFT) {
+                frame->cursor.X -= arg;
+            } else if (op == CONSOLE_OP_RIGHT) {
+                frame->cursor.X += arg;
+            } else if (op == CONSOLE_OP_UP) {
+                frame->cursor.Y -= arg;
+            } else if (op == CONSOLE_OP_DOWN) {
+                frame->cursor.Y += arg;
+            } else {
+                frame->cursor.X = 0;
+            }
+            frame->cursorMoved = true;
+            return true;
+        case CONSOLE_OP_CLEAR_TO_END_OF_LINE: {
+            if (!frame_apply_state(env, frame, result) || !frame_query_cursor(env, frame, result)) {
+                return false;
+            }
+            DWORD count;
+            if (!FillConsoleOutputCharacterW(current_console, L' ', frame->width - frame->cursor.X, frame->cursor, &count)) {
+                mark_failed_with_errno(env, "could not clear console", result);
+                return false;
+            }
+            return true;
+        }
+        default:
+            mark_failed_with_message(env, "unknown frame operation", result);
+            return false;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_WindowsConsoleFunctions_writeFrame(JNIEnv* env, jclass target, jintArray ops, jint opsLength, jbyteArray text, jint textLength, jobject result) {
+    // Copy the frame, as writing to the console can block and we don't want to hold on to the Java arrays meanwhile
+    jint* opValues = (jint*) malloc(sizeof(jint) * (opsLength > 0 ? opsLength : 1));
+    jbyte* textValues = (jbyte*) malloc(textLength > 0 ? textLength : 1);
+    if (opValues == NULL || textValues == NULL) {
+        free(opValues);
+        free(textValues);
+        mark_failed_with_message(env, "could not allocate frame", result);
+        return;
+    }
+    env->GetIntArrayRegion(ops, 0, opsLength, opValues);
+    env->GetByteArrayRegion(text, 0, textLength, textValues);
+
+    console_frame_t frame;
+    frame.cursorKnown = false;
+    frame.cursorMoved = false;
+    frame.appliedAttributes = current_attributes;
+    jint textOffset = 0;
+    bool ok = true;
+    for (jint i = 0; ok && i + 1 < opsLength; i += 2) {
+        ok = frame_apply_op(env, &frame, opValues[i], opValues[i + 1], textValues, &textOffset, textLength, result);
+    }
+    if (ok) {
+        frame_apply_state(env, &frame, result);
+    }
+    free(opValues);
+    free(textValues);
+}
+
 void uninheritStream(JNIEnv* env, DWORD stdInputHandle, jobject result) {
     HANDLE streamHandle = GetStdHandle(stdInputHandle);
     if (streamHandle == NULL) {
@@ -1083,4 +1730,37 @@ Java_net_rubygrapefruit_platform_internal_jni_WindowsRegistryFunctions_getValueN
     return true;
 }
 
+JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM* jvm, void*) {
+    JNIEnv* env;
+    jint ret = jvm->GetEnv((void**) &env, JNI_VERSION_1_6);
+    if (ret != JNI_OK) {
+        return -1;
+    }
+    if (!init_generic(env)) {
+        return -1;
+    }
+    fileStatDetailsMethodId = find_method(env, "net/rubygrapefruit/platform/internal/WindowsFileStat", "details", "(IJJ)V");
+    windowsDirListAddFileMethodId = find_method(env, "net/rubygrapefruit/platform/internal/WindowsDirList", "addFile", "(Ljava/lang/String;IJJ)V");
+    windowsDirListAddFileWithIdMethodId = find_method(env, "net/rubygrapefruit/platform/internal/WindowsDirList", "addFile", "(Ljava/lang/String;IJJJJ)V");
+    dirTreeBufferAddEntriesMethodId = find_method(env, "net/rubygrapefruit/platform/internal/DirTreeBuffer", "addEntries", "(I)V");
+    fileSystemListAddMethodId = find_method(env, "net/rubygrapefruit/platform/internal/FileSystemList", "add", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZZZ)V");
+    fileSystemListAddForUnknownCaseSensitivityMethodId = find_method(env, "net/rubygrapefruit/platform/internal/FileSystemList", "addForUnknownCaseSensitivity", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Z)V");
+    memoryInfoDetailsMethodId = find_method(env, "net/rubygrapefruit/platform/internal/DefaultMemoryInfo", "details", "(JJ)V");
+    charInputBufferKeyMethodId = find_method(env, "net/rubygrapefruit/platform/internal/CharInputBuffer", "key", "(I)V");
+    charInputBufferCharacterMethodId = find_method(env, "net/rubygrapefruit/platform/internal/CharInputBuffer", "character", "(C)V");
+    if (fileStatDetailsMethodId == NULL
+        || windowsDirListAddFileMethodId == NULL
+        || windowsDirListAddFileWithIdMethodId == NULL
+        || dirTreeBufferAddEntriesMethodId == NULL
+        || fileSystemListAddMethodId == NULL
+        || fileSystemListAddForUnknownCaseSensitivityMethodId == NULL
+        || memoryInfoDetailsMethodId == NULL
+        || charInputBufferKeyMethodId == NULL
+        || charInputBufferCharacterMethodId == NULL) {
+        return -1;
+    }
+    return JNI_VERSION_1_6;
+}
+
 #endif
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+package net.rubygrapefruit.platform.file;
+
+/**
+ * Receives the entries of a directory tree walked by {@link Files#walkTree(java.io.File, boolean, FileTreeVisitor)}.
+ */
+public interface FileTreeVisitor {
+    /**
+     * Called for each entry in the tree. The entry for a directory is visited before the entries it contains.
+     *
+     * @param path The path of the entry relative to the root of the tree, using {@code /} as the separator.
+     * @param entry Details of the entry.
+     */
+    void visitEntry(String path, DirEntry entry);
+}
@@ -21,11 +21,16 @@ import net.rubygrapefruit.platform.NativeIntegration;
 import net.rubygrapefruit.platform.ThreadSafe;
 
 import java.io.File;
+import java.util.Collection;
 import java.util.List;
 
 /**
  * Functions to query and modify files. There are several sub-types of this interface that allow access to
  * platform specific file features.
+ *
+ * <p>This interface is only meant to be implemented by native-platform itself, and methods may be added to it.
+ * Version 0.22 added {@link #statAll(List, boolean, int)} and the {@code walkTree} methods, so implementations outside
+ * of native-platform need to implement these as well.</p>
  */
 public interface Files extends NativeIntegration {
     /**
@@ -57,6 +62,21 @@ public interface Files extends NativeIntegration {
     @ThreadSafe
     FileInfo stat(File file, boolean linkTarget) throws NativeException;
 
+    /**
+     * Returns basic information about each of the given files, as {@link #stat(File, boolean)} does for a single file.
+     * All files are queried with a single native call, which avoids most of the per-file overhead when querying many files.
+     *
+     * @param files The paths of the files to get details of.
+     * @param linkTarget When true and a file is a symlink, return details of the target of the symlink instead of details of the symlink itself.
+     * @param parallelism The maximum number of files to query concurrently. This helps on file systems with high latency,
+     * such as network file systems. When 1, the files are queried on the calling thread.
+     * @return Details of the files, in the same order as the given files.
+     * @throws NativeException On failure to query the file information of any of the files.
+     * @throws FilePermissionException When the user has insufficient permissions to query the file information of any of the files.
+     */
+    @ThreadSafe
+    List<? extends FileInfo> statAll(List<File> files, boolean linkTarget, int parallelism) throws NativeException;
+
     /**
      * Lists the entries of the given directory.
      *
@@ -83,4 +103,42 @@ public interface Files extends NativeIntegration {
      */
     @ThreadSafe
     List<? extends DirEntry> listDir(File dir, boolean linkTarget) throws NativeException;
+
+    /**
+     * Walks the directory tree below the given directory, reporting each entry to the given visitor.
+     * Entries are read in batches, so this is considerably cheaper than listing each directory of the tree separately.
+     *
+     * <p>The entry for a directory is reported before the entries it contains. Symlinks and junctions to directories
+     * are never descended into. Entries removed while the tree is walked are skipped.</p>
+     *
+     * @param root The directory to walk. Follows symlinks to this directory. The directory itself is not reported.
+     * @param linkTarget When true and an entry is a symlink, report details of the target of the symlink instead of details of the symlink itself.
+     * A symlink to a directory is then reported as a {@link FileInfo.Type#Directory} without any entries below it.
+     * @throws NativeException On failure.
+     * @throws NoSuchFileException When the specified directory does not exist.
+     * @throws NotADirectoryException When the specified file is not a directory.
+     * @throws FilePermissionException When the user has insufficient permissions to list the entries of a directory in the tree
+     */
+    @ThreadSafe
+    void walkTree(File root, boolean linkTarget, FileTreeVisitor visitor) throws NativeException;
+
+    /**
+     * Walks the directory tree below the given directory, scanning up to the given number of directories concurrently.
+     * This helps on file systems with high latency, such as network file systems, or when caches are cold.
+     *
+     * <p>The entries are reported to the visitor on the calling thread. The entry for a directory is still reported before
+     * the entries it contains, but otherwise entries are reported in no particular order.</p>
+     *
+     * @param root The directory to walk. Follows symlinks to this directory. The directory itself is not reported.
+     * @param linkTarget When true and an entry is a symlink, report details of the target of the symlink instead of details of the symlink itself.
+     * A symlink to a directory is then reported as a {@link FileInfo.Type#Directory} without any entries below it.
+     * @param parallelism The maximum number of directories to scan concurrently. When 1, the tree is walked on the calling thread.
+     * @param excludes Patterns of entry names to skip, along with their contents, e.g. {@code .git} or {@code *.tmp}.
+     * @throws NativeException On failure.
+     * @throws NoSuchFileException When the specified directory does not exist.
+     * @throws NotADirectoryException When the specified file is not a directory.
+     * @throws FilePermissionException When the user has insufficient permissions to list the entries of a directory in the tree
+     */
+    @ThreadSafe
+    void walkTree(File root, boolean linkTarget, int parallelism, Collection<String> excludes, FileTreeVisitor visitor) throws NativeException;
 }
@@ -21,6 +21,7 @@ import net.rubygrapefruit.platform.NativeIntegration;
 import net.rubygrapefruit.platform.ThreadSafe;
 
 import java.io.File;
+import java.util.List;
 
 /**
  * Functions to query and modify files on a Posix file system.
@@ -70,4 +71,16 @@ public interface PosixFiles extends Files, NativeIntegration {
      */
     @ThreadSafe
     PosixFileInfo stat(File file, boolean linkTarget) throws NativeException;
+
+    /**
+     * {@inheritDoc}
+     */
+    @ThreadSafe
+    List<? extends PosixFileInfo> statAll(List<File> files, boolean linkTarget, int parallelism) throws NativeException;
+
+    /**
+     * {@inheritDoc}
+     */
+    @ThreadSafe
+    void walkTree(File root, boolean linkTarget, FileTreeVisitor visitor) throws NativeException;
 }
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.ThreadSafe;
+
+import javax.annotation.Nullable;
+
+/**
+ * Details about a file in a directory on a Windows file system. This is a snapshot and does not change.
+ *
+ * <p>Entries can be listed using {@link WindowsFiles#listDir(java.io.File)}</p>
+ */
+@ThreadSafe
+public interface WindowsDirEntry extends DirEntry {
+    /**
+     * Returns an object that uniquely identifies the file on its volume, like the file key of
+     * {@link java.nio.file.attribute.BasicFileAttributes#fileKey()}. Entries for hard links to the same file
+     * have equal keys, and the key of a file does not change when it is renamed.
+     *
+     * @return The key, or {@code null} when the file system does not provide file ids.
+     */
+    @Nullable
+    Object getFileKey();
+}
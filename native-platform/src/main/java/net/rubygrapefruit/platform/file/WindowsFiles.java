@@ -20,6 +20,7 @@ import net.rubygrapefruit.platform.NativeException;
 import net.rubygrapefruit.platform.NativeIntegration;
 
 import java.io.File;
+import java.util.List;
 
 /**
  * Functions to query files on a Windows file system.
@@ -34,4 +35,19 @@ public interface WindowsFiles extends Files, NativeIntegration {
      * {@inheritDoc}
      */
     WindowsFileInfo stat(File file, boolean linkTarget) throws NativeException;
+
+    /**
+     * {@inheritDoc}
+     */
+    List<? extends WindowsFileInfo> statAll(List<File> files, boolean linkTarget, int parallelism) throws NativeException;
+
+    /**
+     * {@inheritDoc}
+     */
+    List<? extends WindowsDirEntry> listDir(File dir) throws NativeException;
+
+    /**
+     * {@inheritDoc}
+     */
+    List<? extends WindowsDirEntry> listDir(File dir, boolean linkTarget) throws NativeException;
 }
@@ -18,13 +18,28 @@ package net.rubygrapefruit.platform.internal;
 
 import net.rubygrapefruit.platform.*;
 import net.rubygrapefruit.platform.file.FilePermissionException;
+import net.rubygrapefruit.platform.file.FileTreeVisitor;
 import net.rubygrapefruit.platform.file.Files;
 import net.rubygrapefruit.platform.file.NoSuchFileException;
 import net.rubygrapefruit.platform.file.NotADirectoryException;
 
 import java.io.File;
+import java.util.Collections;
+import java.util.List;
 
 public abstract class AbstractFiles implements Files {
+    public void walkTree(File root, boolean linkTarget, FileTreeVisitor visitor) throws NativeException {
+        walkTree(root, linkTarget, 1, Collections.<String>emptyList(), visitor);
+    }
+
+    protected static String[] toPaths(List<File> files) {
+        String[] paths = new String[files.size()];
+        for (int i = 0; i < paths.length; i++) {
+            paths[i] = files.get(i).getPath();
+        }
+        return paths;
+    }
+
     protected NativeException listDirFailure(File dir, FunctionResult result) {
         if (result.getFailure() == FunctionResult.Failure.NoSuchFile) {
             throw new NoSuchFileException(String.format("Could not list directory %s as this directory does not exist.", dir));
@@ -39,7 +39,7 @@ public class AnsiTerminal extends AbstractTerminal {
     private Color foreground;
     private boolean bright;
     private final Terminals.Output output;
-    private final OutputStream outputStream;
+    private final FramedOutputStream outputStream;
 
     static {
         for (Color color : Color.values()) {
@@ -49,7 +49,7 @@ public class AnsiTerminal extends AbstractTerminal {
     }
 
     public AnsiTerminal(OutputStream outputStream, Terminals.Output output) {
-        this.outputStream = outputStream;
+        this.outputStream = new FramedOutputStream(outputStream);
         this.output = output;
     }
 
@@ -256,4 +256,20 @@ public class AnsiTerminal extends AbstractTerminal {
         }
         return this;
     }
+
+    @Override
+    public TerminalOutput beginFrame() {
+        outputStream.beginFrame();
+        return this;
+    }
+
+    @Override
+    public TerminalOutput endFrame() throws NativeException {
+        try {
+            outputStream.endFrame();
+        } catch (IOException e) {
+            throw new NativeException(String.format("Could not write frame to %s.", getOutputDisplay()), e);
+        }
+        return this;
+    }
 }
@@ -21,7 +21,7 @@ import net.rubygrapefruit.platform.internal.jni.MemoryFunctions;
 import net.rubygrapefruit.platform.memory.Memory;
 import net.rubygrapefruit.platform.memory.MemoryInfo;
 
-public class DefaultMemory implements Memory {
+public class DefaultMemory extends AbstractMemory implements Memory {
     public MemoryInfo getMemoryInfo() {
         FunctionResult result = new FunctionResult();
         DefaultMemoryInfo memoryInfo = new DefaultMemoryInfo();
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.NativeException;
+import net.rubygrapefruit.platform.internal.jni.MemoryFunctions;
+import net.rubygrapefruit.platform.memory.MemoryPressure;
+import net.rubygrapefruit.platform.memory.MemoryPressureListener;
+import net.rubygrapefruit.platform.memory.MemoryPressureMonitor;
+
+/**
+ * Blocks a daemon thread in native code until the memory pressure changes, so that nothing runs while the pressure stays the same.
+ */
+public class DefaultMemoryPressureMonitor implements MemoryPressureMonitor {
+    private final Object lock = new Object();
+    private final Source source;
+    private final MemoryPressureListener listener;
+    private final Thread thread;
+    private volatile MemoryPressure currentLevel = MemoryPressure.NORMAL;
+    private boolean stopped;
+    private boolean closed;
+
+    /**
+     * Where the memory pressure levels come from. The native monitor applies the thresholds for the
+     * current platform, and reports the levels as the ordinals of {@link MemoryPressure}.
+     */
+    interface Source {
+        /**
+         * Blocks until the memory pressure differs from the given level, see {@link MemoryFunctions#waitForMemoryPressure(long, int, FunctionResult)}.
+         */
+        int waitForMemoryPressure(int currentLevel, FunctionResult result);
+
+        /**
+         * Wakes up a thread waiting for the memory pressure to change.
+         */
+        void stop();
+
+        void close();
+    }
+
+    private static class NativeSource implements Source {
+        private final long handle;
+
+        NativeSource(long handle) {
+            this.handle = handle;
+        }
+
+        public int waitForMemoryPressure(int currentLevel, FunctionResult result) {
+            return MemoryFunctions.waitForMemoryPressure(handle, currentLevel, result);
+        }
+
+        public void stop() {
+            source.stop();
+        }
+
+        public void close() {
+            source.close();
+        }
+    }
+
+    private DefaultMemoryPressureMonitor(Source source, MemoryPressureListener listener) {
+        this.source = source;
+        this.listener = listener;
+        this.thread = new Thread(new Runnable() {
+            public void run() {
+                monitor();
+            }
+        }, "memory pressure monitor");
+        thread.setDaemon(true);
+    }
+
+    public static MemoryPressureMonitor start(MemoryPressureListener listener) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        long handle = MemoryFunctions.openMemoryPressureMonitor(result);
+        if (result.isFailed()) {
+            throw new NativeException(String.format("Could not start memory pressure monitor: %s", result.getMessage()));
+        }
+        return start(new NativeSource(handle), listener);
+    }
+
+    static DefaultMemoryPressureMonitor start(Source source, MemoryPressureListener listener) {
+        DefaultMemoryPressureMonitor monitor = new DefaultMemoryPressureMonitor(source, listener);
+        monitor.thread.start();
+        return monitor;
+    }
+
+    public MemoryPressure getCurrentLevel() {
+        return currentLevel;
+    }
+
+    public void stop() {
+        synchronized (lock) {
+            if (stopped) {
+                return;
+            }
+            stopped = true;
+            if (!closed) {
+                source.stop();
+            }
+        }
+        if (Thread.currentThread() == thread) {
+            return;
+        }
+        try {
+            thread.join();
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+        }
+    }
+
+    private void monitor() {
+        try {
+            MemoryPressure[] levels = MemoryPressure.values();
+            int level = currentLevel.ordinal();
+            while (true) {
+                FunctionResult result = new FunctionResult();
+                level = source.waitForMemoryPressure(level, result);
+                if (result.isFailed() || level < 0) {
+                    // Nobody to report a failure to, so just stop notifying the listener
+                    return;
+                }
+                currentLevel = levels[level];
+                synchronized (lock) {
+                    if (stopped) {
+                        return;
+                    }
+                }
+                listener.onMemoryPressureChanged(currentLevel);
+            }
+        } finally {
+            synchronized (lock) {
+                closed = true;
+                source.close();
+            }
+        }
+    }
+}
@@ -21,7 +21,7 @@ import net.rubygrapefruit.platform.internal.jni.OsxMemoryFunctions;
 import net.rubygrapefruit.platform.memory.OsxMemory;
 import net.rubygrapefruit.platform.memory.OsxMemoryInfo;
 
-public class DefaultOsxMemory implements OsxMemory {
+public class DefaultOsxMemory extends AbstractMemory implements OsxMemory {
     public OsxMemoryInfo getMemoryInfo() throws NativeException {
         FunctionResult result = new FunctionResult();
         DefaultOsxMemoryInfo memoryInfo = new DefaultOsxMemoryInfo();
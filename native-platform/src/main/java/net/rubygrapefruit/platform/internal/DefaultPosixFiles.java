@@ -19,11 +19,14 @@ package net.rubygrapefruit.platform.internal;
 import net.rubygrapefruit.platform.*;
 import net.rubygrapefruit.platform.file.DirEntry;
 import net.rubygrapefruit.platform.file.FilePermissionException;
+import net.rubygrapefruit.platform.file.FileTreeVisitor;
 import net.rubygrapefruit.platform.file.PosixFileInfo;
 import net.rubygrapefruit.platform.file.PosixFiles;
 import net.rubygrapefruit.platform.internal.jni.PosixFileFunctions;
 
 import java.io.File;
+import java.util.ArrayList;
+import java.util.Collection;
 import java.util.List;
 
 public class DefaultPosixFiles extends AbstractFiles implements PosixFiles {
@@ -36,14 +39,38 @@ public class DefaultPosixFiles extends AbstractFiles implements PosixFiles {
         FileStat stat = new FileStat(file.getPath());
         PosixFileFunctions.stat(file.getPath(), linkTarget, stat, result);
         if (result.isFailed()) {
-            if (result.getFailure() == FunctionResult.Failure.Permissions) {
-                throw new FilePermissionException(String.format("Could not get file details of %s: permission denied", file));
-            }
-            throw new NativeException(String.format("Could not get file details of %s: %s", file, result.getMessage()));
+            throw statFailure(file, result);
         }
         return stat;
     }
 
+    public List<FileStat> statAll(List<File> files, boolean linkTarget, int parallelism) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        String[] paths = toPaths(files);
+        long[] stats = new long[paths.length * FileStat.RECORD_SIZE];
+        int failed = PosixFileFunctions.statAll(paths, linkTarget, parallelism, stats, result);
+        if (result.isFailed()) {
+            if (failed >= 0) {
+                throw statFailure(files.get(failed), result);
+            }
+            throw new NativeException(String.format("Could not get file details: %s", result.getMessage()));
+        }
+        List<FileStat> fileStats = new ArrayList<FileStat>(paths.length);
+        for (int i = 0; i < paths.length; i++) {
+            FileStat stat = new FileStat(paths[i]);
+            stat.details(stats, i * FileStat.RECORD_SIZE);
+            fileStats.add(stat);
+        }
+        return fileStats;
+    }
+
+    private NativeException statFailure(File file, FunctionResult result) {
+        if (result.getFailure() == FunctionResult.Failure.Permissions) {
+            throw new FilePermissionException(String.format("Could not get file details of %s: permission denied", file));
+        }
+        throw new NativeException(String.format("Could not get file details of %s: %s", file, result.getMessage()));
+    }
+
     public List<DirEntry> listDir(File dir) throws NativeException {
         return listDir(dir, false);
     }
@@ -58,6 +85,15 @@ public class DefaultPosixFiles extends AbstractFiles implements PosixFiles {
         return dirList.files;
     }
 
+    public void walkTree(File root, boolean linkTarget, int parallelism, Collection<String> excludes, FileTreeVisitor visitor) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        DirTreeBuffer treeBuffer = new DirTreeBuffer(visitor);
+        PosixFileFunctions.walkTree(root.getPath(), linkTarget, parallelism, excludes.toArray(new String[0]), treeBuffer.buffer, treeBuffer, result);
+        if (result.isFailed()) {
+            throw listDirFailure(root, result);
+        }
+    }
+
     public void setMode(File file, int perms) {
         FunctionResult result = new FunctionResult();
         PosixFileFunctions.chmod(file.getPath(), perms, result);
@@ -17,12 +17,15 @@
 package net.rubygrapefruit.platform.internal;
 
 import net.rubygrapefruit.platform.*;
-import net.rubygrapefruit.platform.file.DirEntry;
+import net.rubygrapefruit.platform.file.FileTreeVisitor;
+import net.rubygrapefruit.platform.file.WindowsDirEntry;
 import net.rubygrapefruit.platform.file.WindowsFileInfo;
 import net.rubygrapefruit.platform.file.WindowsFiles;
 import net.rubygrapefruit.platform.internal.jni.WindowsFileFunctions;
 
 import java.io.File;
+import java.util.ArrayList;
+import java.util.Collection;
 import java.util.List;
 
 public class DefaultWindowsFiles extends AbstractFiles implements WindowsFiles {
@@ -40,7 +43,27 @@ public class DefaultWindowsFiles extends AbstractFiles implements WindowsFiles {
         return stat;
     }
 
-    public List<? extends DirEntry> listDir(File dir, boolean linkTarget) throws NativeException {
+    public List<WindowsFileStat> statAll(List<File> files, boolean linkTarget, int parallelism) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        String[] paths = toPaths(files);
+        long[] stats = new long[paths.length * WindowsFileStat.RECORD_SIZE];
+        int failed = WindowsFileFunctions.statAll(paths, linkTarget, parallelism, stats, result);
+        if (result.isFailed()) {
+            if (failed >= 0) {
+                throw new NativeException(String.format("Could not get file details of %s: %s", files.get(failed), result.getMessage()));
+            }
+            throw new NativeException(String.format("Could not get file details: %s", result.getMessage()));
+        }
+        List<WindowsFileStat> fileStats = new ArrayList<WindowsFileStat>(paths.length);
+        for (int i = 0; i < paths.length; i++) {
+            WindowsFileStat stat = new WindowsFileStat(paths[i]);
+            stat.details(stats, i * WindowsFileStat.RECORD_SIZE);
+            fileStats.add(stat);
+        }
+        return fileStats;
+    }
+
+    public List<? extends WindowsDirEntry> listDir(File dir, boolean linkTarget) throws NativeException {
         FunctionResult result = new FunctionResult();
         WindowsDirList dirList = new WindowsDirList();
         WindowsFileFunctions.readdir(dir.getPath(), linkTarget, dirList, result);
@@ -50,7 +73,16 @@ public class DefaultWindowsFiles extends AbstractFiles implements WindowsFiles {
         return dirList.files;
     }
 
-    public List<? extends DirEntry> listDir(File dir) throws NativeException {
+    public List<? extends WindowsDirEntry> listDir(File dir) throws NativeException {
         return listDir(dir, false);
     }
+
+    public void walkTree(File root, boolean linkTarget, int parallelism, Collection<String> excludes, FileTreeVisitor visitor) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        DirTreeBuffer treeBuffer = new WindowsDirTreeBuffer(visitor);
+        WindowsFileFunctions.walkTree(root.getPath(), linkTarget, parallelism, excludes.toArray(new String[0]), treeBuffer.buffer, treeBuffer, result);
+        if (result.isFailed()) {
+            throw listDirFailure(root, result);
+        }
+    }
 }
@@ -32,7 +32,7 @@ public class DirList {
         files.add(fileStat);
     }
 
-    private static class DefaultDirEntry implements DirEntry {
+    static class DefaultDirEntry implements DirEntry {
         private final String name;
         private final Type type;
         private final long size;
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.file.FileInfo;
+import net.rubygrapefruit.platform.file.FileTreeVisitor;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+import java.util.HashMap;
+import java.util.Map;
+
+/**
+ * Receives the entries of a tree walk from native code in batches, and reports them to a visitor.
+ *
+ * <p>The records written to the buffer are laid out as described in {@code tree_walk.h}.</p>
+ */
+public class DirTreeBuffer {
+    private static final int BUFFER_SIZE = 64 * 1024;
+    private static final Charset FILE_NAME_CHARSET = fileNameCharset();
+
+    public final ByteBuffer buffer = ByteBuffer.allocateDirect(BUFFER_SIZE).order(ByteOrder.nativeOrder());
+    private final FileTreeVisitor visitor;
+    private final Charset nameCharset;
+    private final Map<Integer, String> directoryPaths = new HashMap<Integer, String>();
+    private byte[] nameBytes = new byte[512];
+
+    public DirTreeBuffer(FileTreeVisitor visitor) {
+        this(visitor, FILE_NAME_CHARSET);
+    }
+
+    protected DirTreeBuffer(FileTreeVisitor visitor, Charset nameCharset) {
+        this.visitor = visitor;
+        this.nameCharset = nameCharset;
+    }
+
+    // Called from native code
+    @SuppressWarnings("UnusedDeclaration")
+    public void addEntries(int length) {
+        buffer.clear();
+        while (buffer.position() < length) {
+            int parentId = buffer.getInt();
+            int id = buffer.getInt();
+            int type = buffer.getInt();
+            long size = buffer.getLong();
+            long lastModified = buffer.getLong();
+            int nameLength = buffer.getInt();
+            if (nameBytes.length < nameLength) {
+                nameBytes = new byte[nameLength];
+            }
+            buffer.get(nameBytes, 0, nameLength);
+            String name = new String(nameBytes, 0, nameLength, nameCharset);
+
+            // The entry of a directory is always received before the entries in it
+            String path = parentId == 0 ? name : directoryPaths.get(parentId) + "/" + name;
+            if (id > 0) {
+                directoryPaths.put(id, path);
+            }
+            visitor.visitEntry(path, new DirList.DefaultDirEntry(name, FileInfo.Type.values()[type], size, toJavaTime(lastModified)));
+        }
+    }
+
+    protected long toJavaTime(long lastModified) {
+        return lastModified;
+    }
+
+    private static Charset fileNameCharset() {
+        String encoding = System.getProperty("sun.jnu.encoding");
+        if (encoding != null && Charset.isSupported(encoding)) {
+            return Charset.forName(encoding);
+        }
+        return Charset.defaultCharset();
+    }
+}
@@ -19,6 +19,11 @@ package net.rubygrapefruit.platform.internal;
 import net.rubygrapefruit.platform.file.PosixFileInfo;
 
 public class FileStat implements PosixFileInfo {
+    /**
+     * The number of values per file written by a batched stat: type, mode, uid, gid, size, modification time and block size.
+     */
+    public static final int RECORD_SIZE = 7;
+
     private final String path;
     private int mode;
     private Type type;
@@ -42,6 +47,10 @@ public class FileStat implements PosixFileInfo {
         this.blockSize = blockSize;
     }
 
+    public void details(long[] stats, int offset) {
+        details((int) stats[offset], (int) stats[offset + 1], (int) stats[offset + 2], (int) stats[offset + 3], stats[offset + 4], stats[offset + 5], (int) stats[offset + 6]);
+    }
+
     @Override
     public String toString() {
         return path;
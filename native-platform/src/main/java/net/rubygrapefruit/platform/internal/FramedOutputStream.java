@@ -0,0 +1,79 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+
+/**
+ * Passes writes through to the target stream, except while a frame is open, when they are collected and then written with a single write.
+ */
+public class FramedOutputStream extends OutputStream {
+    private final OutputStream target;
+    private final ByteArrayOutputStream frame = new ByteArrayOutputStream();
+    private int depth;
+
+    public FramedOutputStream(OutputStream target) {
+        this.target = target;
+    }
+
+    public synchronized void beginFrame() {
+        depth++;
+    }
+
+    public synchronized void endFrame() throws IOException {
+        if (depth == 0) {
+            return;
+        }
+        depth--;
+        if (depth == 0 && frame.size() > 0) {
+            try {
+                frame.writeTo(target);
+                target.flush();
+            } finally {
+                frame.reset();
+            }
+        }
+    }
+
+    @Override
+    public synchronized void write(int b) throws IOException {
+        if (depth > 0) {
+            frame.write(b);
+        } else {
+            target.write(b);
+        }
+    }
+
+    @Override
+    public synchronized void write(byte[] b, int off, int len) throws IOException {
+        if (depth > 0) {
+            frame.write(b, off, len);
+        } else {
+            target.write(b, off, len);
+        }
+    }
+
+    @Override
+    public synchronized void flush() throws IOException {
+        if (depth == 0) {
+            target.flush();
+        }
+    }
+}
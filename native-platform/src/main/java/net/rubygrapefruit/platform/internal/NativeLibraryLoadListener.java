@@ -0,0 +1,43 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+package net.rubygrapefruit.platform.internal;
+
+/**
+ * Receives how long each step of loading a native library took, e.g. to track startup time.
+ * Register a listener with {@link NativeLibraryLoader#setListener(NativeLibraryLoadListener)}.
+ *
+ * Called from the thread loading the library, so implementations need to be thread safe.
+ */
+public interface NativeLibraryLoadListener {
+    enum Step {
+        /**
+         * Locating the library, and extracting it from the class path unless it has been extracted before.
+         * Only reported when a library file has been found.
+         */
+        EXTRACTION,
+        /**
+         * Loading the library with {@link System#load(String)}, including running its {@code JNI_OnLoad} function.
+         */
+        LOADING,
+        /**
+         * Setting up the native state of the library deferred to the first use of its integrations.
+         */
+        INITIALIZATION
+    }
+
+    void stepCompleted(String libraryFileName, Step step, long durationInNanos);
+}
@@ -20,12 +20,15 @@ import net.rubygrapefruit.platform.NativeException;
 import net.rubygrapefruit.platform.NativeIntegrationLinkageException;
 import net.rubygrapefruit.platform.NativeIntegrationUnavailableException;
 
+import javax.annotation.Nullable;
 import java.io.File;
 import java.util.HashSet;
 import java.util.List;
 import java.util.Set;
 
 public class NativeLibraryLoader {
+    private static volatile NativeLibraryLoadListener listener;
+
     private final Set<String> loaded = new HashSet<String>();
     private final Platform platform;
     private final NativeLibraryLocator nativeLibraryLocator;
@@ -35,6 +38,25 @@ public class NativeLibraryLoader {
         this.nativeLibraryLocator = nativeLibraryLocator;
     }
 
+    /**
+     * Sets the listener to notify about the time it takes to load each native library, or {@code null} to remove it.
+     */
+    public static void setListener(@Nullable NativeLibraryLoadListener listener) {
+        NativeLibraryLoader.listener = listener;
+    }
+
+    /**
+     * Notifies the listener, if any, that the given step of loading the library has completed.
+     *
+     * @param startNanos the value of {@link System#nanoTime()} when the step started.
+     */
+    public static void stepCompleted(String libraryFileName, NativeLibraryLoadListener.Step step, long startNanos) {
+        NativeLibraryLoadListener listener = NativeLibraryLoader.listener;
+        if (listener != null) {
+            listener.stepCompleted(libraryFileName, step, System.nanoTime() - startNanos);
+        }
+    }
+
     public void load(String libraryFileName, List<String> platforms) {
         if (loaded.contains(libraryFileName)) {
             return;
@@ -42,17 +64,21 @@ public class NativeLibraryLoader {
         try {
             UnsatisfiedLinkError loadFailure = null;
             for (String platformId : platforms) {
+                long extractionStart = System.nanoTime();
                 File libFile = nativeLibraryLocator.find(new LibraryDef(libraryFileName, platformId));
                 if (libFile == null) {
                     continue;
                 }
+                stepCompleted(libraryFileName, NativeLibraryLoadListener.Step.EXTRACTION, extractionStart);
 
+                long loadingStart = System.nanoTime();
                 try {
                     System.load(libFile.getCanonicalPath());
                 } catch (UnsatisfiedLinkError e) {
                     loadFailure = e;
                     continue;
                 }
+                stepCompleted(libraryFileName, NativeLibraryLoadListener.Step.LOADING, loadingStart);
 
                 loaded.add(libraryFileName);
                 return;
@@ -179,6 +179,9 @@ public abstract class Platform {
             if (type.equals(WindowsRegistry.class)) {
                 return type.cast(new DefaultWindowsRegistry());
             }
+            if (type.equals(Memory.class)) {
+                return type.cast(new DefaultMemory());
+            }
             return super.get(type, nativeLibraryLoader);
         }
     }
@@ -270,6 +273,14 @@ public abstract class Platform {
         public boolean isLinux() {
             return true;
         }
+
+        @Override
+        public <T extends NativeIntegration> T get(Class<T> type, NativeLibraryLoader nativeLibraryLoader) {
+            if (type.equals(Memory.class)) {
+                return type.cast(new DefaultMemory());
+            }
+            return super.get(type, nativeLibraryLoader);
+        }
     }
 
     private static class Linux32Bit extends Linux {
@@ -21,16 +21,28 @@ import net.rubygrapefruit.platform.file.FileSystems;
 import net.rubygrapefruit.platform.NativeException;
 import net.rubygrapefruit.platform.internal.jni.PosixFileSystemFunctions;
 
+import java.util.ArrayList;
 import java.util.List;
 
 public class PosixFileSystems implements FileSystems {
+    // The native change detection state is process wide, so the lock and the cached file systems are shared by all instances
+    private static final Object lock = new Object();
+    private static List<FileSystemInfo> fileSystems;
+
     public List<FileSystemInfo> getFileSystems() {
-        FunctionResult result = new FunctionResult();
-        FileSystemList fileSystems = new FileSystemList();
-        PosixFileSystemFunctions.listFileSystems(fileSystems, result);
-        if (result.isFailed()) {
-            throw new NativeException(String.format("Could not query file systems: %s", result.getMessage()));
+        synchronized (lock) {
+            // Listing the file systems is expensive on machines with many mounts, so only do it when something has changed
+            if (PosixFileSystemFunctions.fileSystemsChanged() || fileSystems == null) {
+                FunctionResult result = new FunctionResult();
+                FileSystemList fileSystemList = new FileSystemList();
+                PosixFileSystemFunctions.listFileSystems(fileSystemList, result);
+                if (result.isFailed()) {
+                    fileSystems = null;
+                    throw new NativeException(String.format("Could not query file systems: %s", result.getMessage()));
+                }
+                fileSystems = fileSystemList.fileSystems;
+            }
+            return new ArrayList<FileSystemInfo>(fileSystems);
         }
-        return fileSystems.fileSystems;
     }
 }
@@ -23,6 +23,7 @@ import net.rubygrapefruit.platform.terminal.TerminalOutput;
 import net.rubygrapefruit.platform.terminal.TerminalSize;
 import net.rubygrapefruit.platform.terminal.Terminals;
 
+import java.io.IOException;
 import java.io.OutputStream;
 import java.util.HashMap;
 import java.util.Map;
@@ -30,7 +31,7 @@ import java.util.Map;
 public class TerminfoTerminal extends AbstractTerminal {
     private final Terminals.Output output;
     private final TerminalCapabilities capabilities = new TerminalCapabilities();
-    private final OutputStream outputStream;
+    private final FramedOutputStream outputStream;
     private final Object lock = new Object();
     private Map<Color, byte[]> foregroundColors = new HashMap<Color, byte[]>();
     private byte[] boldOn;
@@ -51,7 +52,7 @@ public class TerminfoTerminal extends AbstractTerminal {
 
     public TerminfoTerminal(Terminals.Output output) {
         this.output = output;
-        this.outputStream = AbstractTerminal.streamForOutput(output);
+        this.outputStream = new FramedOutputStream(AbstractTerminal.streamForOutput(output));
     }
 
     @Override
@@ -372,4 +373,20 @@ public class TerminfoTerminal extends AbstractTerminal {
         }
         return this;
     }
+
+    @Override
+    public TerminalOutput beginFrame() {
+        outputStream.beginFrame();
+        return this;
+    }
+
+    @Override
+    public TerminalOutput endFrame() throws NativeException {
+        try {
+            outputStream.endFrame();
+        } catch (IOException e) {
+            throw new NativeException(String.format("Could not write frame to %s.", getOutputDisplay()), e);
+        }
+        return this;
+    }
 }
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.internal.jni.WindowsConsoleFunctions;
+
+/**
+ * Collects the console operations and text of a frame, so that they can be applied with a single native call.
+ * Each operation is encoded as a pair of op code and argument, text operations refer to the next bytes of the text buffer.
+ */
+public class WindowsConsoleFrame {
+    // Corresponds to values of CONSOLE_OP_* in win.cpp
+    static final int TEXT = 0;
+    static final int BOLD_ON = 1;
+    static final int BOLD_OFF = 2;
+    static final int RESET = 3;
+    static final int SHOW_CURSOR = 4;
+    static final int HIDE_CURSOR = 5;
+    static final int FOREGROUND = 6;
+    static final int DEFAULT_FOREGROUND = 7;
+    static final int LEFT = 8;
+    static final int RIGHT = 9;
+    static final int UP = 10;
+    static final int DOWN = 11;
+    static final int START_LINE = 12;
+    static final int CLEAR_TO_END_OF_LINE = 13;
+
+    private int[] ops = new int[64];
+    private int opsLength;
+    private byte[] text = new byte[1024];
+    private int textLength;
+    private int depth;
+
+    boolean isOpen() {
+        return depth > 0;
+    }
+
+    void begin() {
+        depth++;
+    }
+
+    /**
+     * Returns true when the outermost frame has been ended and the frame should be written.
+     */
+    boolean end() {
+        if (depth == 0) {
+            return false;
+        }
+        depth--;
+        return depth == 0;
+    }
+
+    void add(int op, int arg) {
+        if (opsLength + 2 > ops.length) {
+            int[] newOps = new int[ops.length * 2];
+            System.arraycopy(ops, 0, newOps, 0, opsLength);
+            ops = newOps;
+        }
+        ops[opsLength++] = op;
+        ops[opsLength++] = arg;
+    }
+
+    void addText(byte[] bytes, int offset, int length) {
+        if (length == 0) {
+            return;
+        }
+        if (textLength + length > text.length) {
+            byte[] newText = new byte[Math.max(text.length * 2, textLength + length)];
+            System.arraycopy(text, 0, newText, 0, textLength);
+            text = newText;
+        }
+        System.arraycopy(bytes, offset, text, textLength, length);
+        textLength += length;
+        if (opsLength > 0 && ops[opsLength - 2] == TEXT) {
+            // Extend the previous text operation
+            ops[opsLength - 1] += length;
+        } else {
+            add(TEXT, length);
+        }
+    }
+
+    void write(FunctionResult result) {
+        if (opsLength == 0) {
+            return;
+        }
+        try {
+            WindowsConsoleFunctions.writeFrame(ops, opsLength, text, textLength, result);
+        } finally {
+            opsLength = 0;
+            textLength = 0;
+        }
+    }
+}
@@ -16,11 +16,70 @@
 
 package net.rubygrapefruit.platform.internal;
 
-public class WindowsDirList extends DirList {
-    // Called from native code
+import net.rubygrapefruit.platform.file.FileInfo;
+import net.rubygrapefruit.platform.file.WindowsDirEntry;
+
+import java.util.ArrayList;
+import java.util.List;
+
+public class WindowsDirList {
+    public List<WindowsDirEntry> files = new ArrayList<WindowsDirEntry>();
+
+    // Called from native code when file ids are not available
     @SuppressWarnings("UnusedDeclaration")
-    @Override
     public void addFile(String name, int type, long size, long lastModified) {
-        super.addFile(name, type, size, WindowsFileTime.toJavaTime(lastModified));
+        files.add(new DefaultWindowsDirEntry(name, FileInfo.Type.values()[type], size, WindowsFileTime.toJavaTime(lastModified), null));
+    }
+
+    // Called from native code
+    @SuppressWarnings("UnusedDeclaration")
+    public void addFile(String name, int type, long size, long lastModified, long fileIdHigh, long fileIdLow) {
+        WindowsFileKey fileKey = new WindowsFileKey(fileIdHigh, fileIdLow);
+        files.add(new DefaultWindowsDirEntry(name, FileInfo.Type.values()[type], size, WindowsFileTime.toJavaTime(lastModified), fileKey));
+    }
+
+    private static class DefaultWindowsDirEntry extends DirList.DefaultDirEntry implements WindowsDirEntry {
+        private final WindowsFileKey fileKey;
+
+        DefaultWindowsDirEntry(String name, Type type, long size, long lastModified, WindowsFileKey fileKey) {
+            super(name, type, size, lastModified);
+            this.fileKey = fileKey;
+        }
+
+        public Object getFileKey() {
+            return fileKey;
+        }
+    }
+
+    private static class WindowsFileKey {
+        private final long high;
+        private final long low;
+
+        WindowsFileKey(long high, long low) {
+            this.high = high;
+            this.low = low;
+        }
+
+        @Override
+        public boolean equals(Object obj) {
+            if (obj == this) {
+                return true;
+            }
+            if (obj == null || obj.getClass() != getClass()) {
+                return false;
+            }
+            WindowsFileKey other = (WindowsFileKey) obj;
+            return high == other.high && low == other.low;
+        }
+
+        @Override
+        public int hashCode() {
+            return (int) (high ^ (high >>> 32) ^ low ^ (low >>> 32));
+        }
+
+        @Override
+        public String toString() {
+            return String.format("%016x%016x", high, low);
+        }
     }
 }
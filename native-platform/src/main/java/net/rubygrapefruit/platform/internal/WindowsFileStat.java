@@ -19,6 +19,11 @@ package net.rubygrapefruit.platform.internal;
 import net.rubygrapefruit.platform.file.WindowsFileInfo;
 
 public class WindowsFileStat implements WindowsFileInfo {
+    /**
+     * The number of values per file written by a batched stat: type, size and last modified time.
+     */
+    public static final int RECORD_SIZE = 3;
+
     private final String path;
     private Type type;
     private long size;
@@ -34,6 +39,10 @@ public class WindowsFileStat implements WindowsFileInfo {
         this.lastModified = WindowsFileTime.toJavaTime(lastModifiedWinTime);
     }
 
+    public void details(long[] stats, int offset) {
+        details((int) stats[offset], stats[offset + 1], stats[offset + 2]);
+    }
+
     @Override
     public String toString() {
         return path;
@@ -22,16 +22,18 @@ import net.rubygrapefruit.platform.terminal.TerminalOutput;
 import net.rubygrapefruit.platform.terminal.TerminalSize;
 import net.rubygrapefruit.platform.terminal.Terminals;
 
+import java.io.IOException;
 import java.io.OutputStream;
 
 public class WindowsTerminal extends AbstractTerminal {
     private final Object lock = new Object();
     private final Terminals.Output output;
     private final OutputStream outputStream;
+    private final WindowsConsoleFrame frame = new WindowsConsoleFrame();
 
     public WindowsTerminal(Terminals.Output output) {
         this.output = output;
-        this.outputStream = streamForOutput(output);
+        this.outputStream = new ConsoleOutputStream(streamForOutput(output));
     }
 
     @Override
@@ -95,6 +97,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput bold() {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.BOLD_ON, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.boldOn(result);
             if (result.isFailed()) {
@@ -107,6 +113,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput foreground(Color color) {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.FOREGROUND, color.ordinal());
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.foreground(color.ordinal(), result);
             if (result.isFailed()) {
@@ -129,6 +139,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput defaultForeground() throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.DEFAULT_FOREGROUND, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.defaultForeground(result);
             if (result.isFailed()) {
@@ -141,6 +155,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput normal() {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.BOLD_OFF, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.boldOff(result);
             if (result.isFailed()) {
@@ -153,6 +171,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput reset() {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.RESET, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.reset(result);
             if (result.isFailed()) {
@@ -165,6 +187,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput hideCursor() throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.HIDE_CURSOR, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.hideCursor(result);
             if (result.isFailed()) {
@@ -177,6 +203,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput showCursor() throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.SHOW_CURSOR, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.showCursor(result);
             if (result.isFailed()) {
@@ -189,6 +219,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput cursorDown(int count) throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.DOWN, count);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.down(count, result);
             if (result.isFailed()) {
@@ -201,6 +235,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput cursorUp(int count) throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.UP, count);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.up(count, result);
             if (result.isFailed()) {
@@ -213,6 +251,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput cursorLeft(int count) throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.LEFT, count);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.left(count, result);
             if (result.isFailed()) {
@@ -225,6 +267,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput cursorRight(int count) throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.RIGHT, count);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.right(count, result);
             if (result.isFailed()) {
@@ -237,6 +283,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput cursorStartOfLine() throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.START_LINE, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.startLine(result);
             if (result.isFailed()) {
@@ -249,6 +299,10 @@ public class WindowsTerminal extends AbstractTerminal {
     @Override
     public TerminalOutput clearToEndOfLine() throws NativeException {
         synchronized (lock) {
+            if (frame.isOpen()) {
+                frame.add(WindowsConsoleFrame.CLEAR_TO_END_OF_LINE, 0);
+                return this;
+            }
             FunctionResult result = new FunctionResult();
             WindowsConsoleFunctions.clearToEndOfLine(result);
             if (result.isFailed()) {
@@ -257,4 +311,59 @@ public class WindowsTerminal extends AbstractTerminal {
         }
         return this;
     }
+
+    @Override
+    public TerminalOutput beginFrame() {
+        synchronized (lock) {
+            frame.begin();
+        }
+        return this;
+    }
+
+    @Override
+    public TerminalOutput endFrame() throws NativeException {
+        synchronized (lock) {
+            if (!frame.end()) {
+                return this;
+            }
+            FunctionResult result = new FunctionResult();
+            frame.write(result);
+            if (result.isFailed()) {
+                throw new NativeException(String.format("Could not write frame to %s: %s", getOutputDisplay(), result.getMessage()));
+            }
+        }
+        return this;
+    }
+
+    /**
+     * Collects the text written while a frame is open, so that it is written in order with the other operations of the frame.
+     */
+    private class ConsoleOutputStream extends OutputStream {
+        private final OutputStream target;
+
+        ConsoleOutputStream(OutputStream target) {
+            this.target = target;
+        }
+
+        @Override
+        public void write(int b) throws IOException {
+            write(new byte[]{(byte) b}, 0, 1);
+        }
+
+        @Override
+        public void write(byte[] b, int off, int len) throws IOException {
+            synchronized (lock) {
+                if (frame.isOpen()) {
+                    frame.addText(b, off, len);
+                    return;
+                }
+            }
+            target.write(b, off, len);
+        }
+
+        @Override
+        public void flush() throws IOException {
+            target.flush();
+        }
+    }
 }
@@ -21,4 +21,15 @@ import net.rubygrapefruit.platform.internal.FunctionResult;
 
 public class MemoryFunctions {
     public static native void getMemoryInfo(DefaultMemoryInfo memoryInfo, FunctionResult result);
+
+    public static native long openMemoryPressureMonitor(FunctionResult result);
+
+    /**
+     * Blocks until the memory pressure differs from the given level, and returns the new level, or -1 once the monitor has been stopped.
+     */
+    public static native int waitForMemoryPressure(long monitor, int currentLevel, FunctionResult result);
+
+    public static native void stopMemoryPressureMonitor(long monitor);
+
+    public static native void closeMemoryPressureMonitor(long monitor);
 }
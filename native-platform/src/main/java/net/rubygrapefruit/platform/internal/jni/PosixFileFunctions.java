@@ -17,16 +17,26 @@
 package net.rubygrapefruit.platform.internal.jni;
 
 import net.rubygrapefruit.platform.internal.DirList;
+import net.rubygrapefruit.platform.internal.DirTreeBuffer;
 import net.rubygrapefruit.platform.internal.FileStat;
 import net.rubygrapefruit.platform.internal.FunctionResult;
 
+import java.nio.ByteBuffer;
+
 public class PosixFileFunctions {
     public static native void chmod(String file, int perms, FunctionResult result);
 
     public static native void stat(String file, boolean followLink, FileStat stat, FunctionResult result);
 
+    /**
+     * Writes {@link FileStat#RECORD_SIZE} values per file into the given array. Returns the index of the file that could not be queried, or -1.
+     */
+    public static native int statAll(String[] files, boolean followLink, int parallelism, long[] stats, FunctionResult result);
+
     public static native void readdir(String file, boolean followLink, DirList stat, FunctionResult result);
 
+    public static native void walkTree(String file, boolean followLink, int parallelism, String[] excludes, ByteBuffer buffer, DirTreeBuffer callback, FunctionResult result);
+
     public static native void symlink(String file, String content, FunctionResult result);
 
     public static native String readlink(String file, FunctionResult result);
@@ -21,4 +21,10 @@ import net.rubygrapefruit.platform.internal.FunctionResult;
 
 public class PosixFileSystemFunctions {
     public static native void listFileSystems(FileSystemList fileSystems, FunctionResult result);
+
+    /**
+     * Returns true when the file systems may have changed since the previous call, and always for the first call.
+     * Callers need to synchronize.
+     */
+    public static native boolean fileSystemsChanged();
 }
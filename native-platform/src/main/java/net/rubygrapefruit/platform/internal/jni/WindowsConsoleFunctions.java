@@ -65,4 +65,9 @@ public class WindowsConsoleFunctions {
     public static native void startLine(FunctionResult result);
 
     public static native void clearToEndOfLine(FunctionResult result);
+
+    /**
+     * Applies the operations collected by a {@link net.rubygrapefruit.platform.internal.WindowsConsoleFrame}.
+     */
+    public static native void writeFrame(int[] ops, int opsLength, byte[] text, int textLength, FunctionResult result);
 }
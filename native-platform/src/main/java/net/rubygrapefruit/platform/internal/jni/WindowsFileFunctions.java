@@ -16,12 +16,22 @@
 
 package net.rubygrapefruit.platform.internal.jni;
 
-import net.rubygrapefruit.platform.internal.DirList;
+import net.rubygrapefruit.platform.internal.DirTreeBuffer;
 import net.rubygrapefruit.platform.internal.FunctionResult;
+import net.rubygrapefruit.platform.internal.WindowsDirList;
 import net.rubygrapefruit.platform.internal.WindowsFileStat;
 
+import java.nio.ByteBuffer;
+
 public class WindowsFileFunctions {
     public static native void stat(String file, boolean followLink, WindowsFileStat stat, FunctionResult result);
 
-    public static native void readdir(String path, boolean followLink, DirList dirList, FunctionResult result);
+    /**
+     * Writes {@link WindowsFileStat#RECORD_SIZE} values per file into the given array. Returns the index of the file that could not be queried, or -1.
+     */
+    public static native int statAll(String[] files, boolean followLink, int parallelism, long[] stats, FunctionResult result);
+
+    public static native void readdir(String path, boolean followLink, WindowsDirList dirList, FunctionResult result);
+
+    public static native void walkTree(String path, boolean followLink, int parallelism, String[] excludes, ByteBuffer buffer, DirTreeBuffer callback, FunctionResult result);
 }
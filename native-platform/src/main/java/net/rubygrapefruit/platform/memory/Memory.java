@@ -33,4 +33,15 @@ public interface Memory extends NativeIntegration {
      */
     @ThreadSafe
     MemoryInfo getMemoryInfo() throws NativeException;
+
+    /**
+     * Starts monitoring the memory pressure of the system. The pressure is assumed to be {@link MemoryPressure#NORMAL}
+     * initially, and the listener is notified from a background thread each time it changes, so that caches can be
+     * released without having to poll {@link #getMemoryInfo()}.
+     *
+     * @return The running monitor, which should be stopped when no longer required.
+     * @throws NativeException On failure.
+     */
+    @ThreadSafe
+    MemoryPressureMonitor startMemoryPressureMonitor(MemoryPressureListener listener) throws NativeException;
 }
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.memory;
+
+/**
+ * The memory pressure of the system, as reported by the operating system.
+ */
+public enum MemoryPressure {
+    /**
+     * There is enough memory available.
+     */
+    NORMAL,
+    /**
+     * The system is running low on memory. Caches should be trimmed.
+     */
+    WARNING,
+    /**
+     * The system is about to run out of memory. As much memory as possible should be released.
+     */
+    CRITICAL
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.memory;
+
+/**
+ * Receives changes of the memory pressure of the system.
+ */
+public interface MemoryPressureListener {
+    /**
+     * Called when the memory pressure changes. Called from the thread of the monitor, so it should not block for long.
+     */
+    void onMemoryPressureChanged(MemoryPressure pressure);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.memory;
+
+import net.rubygrapefruit.platform.ThreadSafe;
+
+/**
+ * A running monitor of the memory pressure of the system.
+ */
+@ThreadSafe
+public interface MemoryPressureMonitor {
+    /**
+     * Returns the memory pressure last reported to the listener.
+     */
+    @ThreadSafe
+    MemoryPressure getCurrentLevel();
+
+    /**
+     * Stops the monitor. The listener is not notified any more once this method returns, unless it is called by the listener itself.
+     */
+    @ThreadSafe
+    void stop();
+}
@@ -52,10 +52,15 @@ class SelectView {
         }
         selected--;
         int rowsToMoveUp = options.size() - selected;
-        output.cursorUp(rowsToMoveUp);
-        renderItem(selected);
-        renderItem(selected + 1);
-        output.cursorDown(rowsToMoveUp - 2);
+        output.beginFrame();
+        try {
+            output.cursorUp(rowsToMoveUp);
+            renderItem(selected);
+            renderItem(selected + 1);
+            output.cursorDown(rowsToMoveUp - 2);
+        } finally {
+            output.endFrame();
+        }
     }
 
     void selectNext() {
@@ -64,10 +69,15 @@ class SelectView {
         }
         selected++;
         int rowsToModeUp = options.size() - selected + 1;
-        output.cursorUp(rowsToModeUp);
-        renderItem(selected - 1);
-        renderItem(selected);
-        output.cursorDown(rowsToModeUp - 2);
+        output.beginFrame();
+        try {
+            output.cursorUp(rowsToModeUp);
+            renderItem(selected - 1);
+            renderItem(selected);
+            output.cursorDown(rowsToModeUp - 2);
+        } finally {
+            output.endFrame();
+        }
     }
 
     void close(Integer selected) {
@@ -68,7 +68,7 @@ public interface TerminalOutput {
     TerminalSize getTerminalSize() throws NativeException;
 
     /**
-     * Returns an {@link OutputStream} that writes to this terminal. The output stream is not buffered.
+     * Returns an {@link OutputStream} that writes to this terminal. The output stream is not buffered, except while a frame is open.
      */
     OutputStream getOutputStream();
 
@@ -201,4 +201,21 @@ public interface TerminalOutput {
      * @throws NativeException On failure, or if this terminal does not support clearing.
      */
     TerminalOutput clearToEndOfLine() throws NativeException;
+
+    /**
+     * Starts a frame, such as a redraw of a progress display. Text, attribute changes and cursor motion are collected
+     * until the frame is ended, and then written to the terminal in a single operation. This includes anything written to
+     * {@link #getOutputStream()}, but not what is written to {@link System#out} or {@link System#err} directly.
+     *
+     * <p>Frames can be nested, in which case the output is written when the outermost frame is ended.</p>
+     */
+    TerminalOutput beginFrame();
+
+    /**
+     * Ends the current frame, writing the collected output to the terminal when this is the outermost frame. Does nothing
+     * when no frame has been started.
+     *
+     * @throws NativeException On failure.
+     */
+    TerminalOutput endFrame() throws NativeException;
 }
@@ -26,13 +26,28 @@ void mark_failed_with_message(JNIEnv* env, const char* message, jobject result)
     mark_failed_with_code(env, message, 0, NULL, result);
 }
 
+static jmethodID functionResultFailedMethodId;
+
+jmethodID find_method(JNIEnv* env, const char* class_name, const char* name, const char* signature) {
+    jclass cls = env->FindClass(class_name);
+    if (cls == NULL) {
+        return NULL;
+    }
+    jmethodID method = env->GetMethodID(cls, name, signature);
+    env->DeleteLocalRef(cls);
+    return method;
+}
+
+bool init_generic(JNIEnv* env) {
+    functionResultFailedMethodId = find_method(env, "net/rubygrapefruit/platform/internal/FunctionResult", "failed", "(Ljava/lang/String;IILjava/lang/String;)V");
+    return functionResultFailedMethodId != NULL;
+}
+
 void mark_failed_with_code(JNIEnv* env, const char* message, int error_code, const char* error_code_message, jobject result) {
-    jclass destClass = env->GetObjectClass(result);
-    jmethodID method = env->GetMethodID(destClass, "failed", "(Ljava/lang/String;IILjava/lang/String;)V");
     jstring message_str = env->NewStringUTF(message);
     jstring error_code_str = error_code_message == NULL ? NULL : env->NewStringUTF(error_code_message);
     jint failure_code = map_error_code(error_code);
-    env->CallVoidMethod(result, method, message_str, failure_code, error_code, error_code_str);
+    env->CallVoidMethod(result, functionResultFailedMethodId, message_str, failure_code, error_code, error_code_str);
     if (error_code_str != NULL) {
         env->DeleteLocalRef(error_code_str);
     }
@@ -20,12 +20,173 @@
 #if defined(__linux__) || defined(__FreeBSD__)
 
 #include "generic.h"
+#include <langinfo.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
 
+// Strings decoded from the current locale with up to this many characters are decoded into a stack buffer
+#define STACK_STRING_LENGTH 256
+
+/*
+ * Returns true when the current locale encodes strings as UTF-8, so that conversion can skip wcstombs() and mbstowcs().
+ */
+static bool is_utf8_locale() {
+    const char* codeset = nl_langinfo(CODESET);
+    return codeset != NULL && strcmp(codeset, "UTF-8") == 0;
+}
+
+/*
+ * Returns true when the given chars are all ASCII. Checks a word at a time where possible.
+ */
+static bool is_ascii(const char* chars, size_t bytes) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, chars + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) {
+            return false;
+        }
+    }
+    for (; i < bytes; i++) {
+        if (chars[i] & 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Returns the number of bytes needed to encode the given UTF-16 string as UTF-8, or (size_t) -1 when it contains unpaired surrogates.
+ */
+static size_t utf8_length(const jchar* chars, size_t len) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < len; i++) {
+        jchar ch = chars[i];
+        if (ch < 0x80) {
+            bytes += 1;
+        } else if (ch < 0x800) {
+            bytes += 2;
+        } else if (ch >= 0xD800 && ch < 0xE000) {
+            if (ch >= 0xDC00 || i + 1 >= len || chars[i + 1] < 0xDC00 || chars[i + 1] >= 0xE000) {
+                return (size_t) -1;
+            }
+            bytes += 4;
+            i++;
+        } else {
+            bytes += 3;
+        }
+    }
+    return bytes;
+}
+
+static void encode_utf8(const jchar* chars, size_t len, char* target) {
+    unsigned char* out = (unsigned char*) target;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t ch = chars[i];
+        if (ch < 0x80) {
+            *out++ = (unsigned char) ch;
+            continue;
+        }
+        if (ch < 0x800) {
+            *out++ = (unsigned char) (0xC0 | (ch >> 6));
+            *out++ = (unsigned char) (0x80 | (ch & 0x3F));
+            continue;
+        }
+        if (ch >= 0xD800 && ch < 0xE000) {
+            // Surrogate pairs have been validated by utf8_length()
+            ch = 0x10000 + ((ch - 0xD800) << 10) + (chars[++i] - 0xDC00);
+            *out++ = (unsigned char) (0xF0 | (ch >> 18));
+            *out++ = (unsigned char) (0x80 | ((ch >> 12) & 0x3F));
+            *out++ = (unsigned char) (0x80 | ((ch >> 6) & 0x3F));
+            *out++ = (unsigned char) (0x80 | (ch & 0x3F));
+            continue;
+        }
+        *out++ = (unsigned char) (0xE0 | (ch >> 12));
+        *out++ = (unsigned char) (0x80 | ((ch >> 6) & 0x3F));
+        *out++ = (unsigned char) (0x80 | (ch & 0x3F));
+    }
+}
+
+/*
+ * Decodes the given UTF-8 string into the given target, which must have room for as many UTF-16 chars as there are bytes.
+ * Returns the number of UTF-16 chars written, or (size_t) -1 when the string is not valid UTF-8.
+ */
+static size_t decode_utf8(const char* chars, size_t bytes, jchar* target) {
+    const unsigned char* in = (const unsigned char*) chars;
+    const unsigned char* end = in + bytes;
+    jchar* out = target;
+    while (in < end) {
+        uint32_t ch = *in++;
+        if (ch < 0x80) {
+            *out++ = (jchar) ch;
+            continue;
+        }
+        int continuations;
+        uint32_t min;
+        if ((ch & 0xE0) == 0xC0) {
+            continuations = 1;
+            min = 0x80;
+            ch &= 0x1F;
+        } else if ((ch & 0xF0) == 0xE0) {
+            continuations = 2;
+            min = 0x800;
+            ch &= 0x0F;
+        } else if ((ch & 0xF8) == 0xF0) {
+            continuations = 3;
+            min = 0x10000;
+            ch &= 0x07;
+        } else {
+            return (size_t) -1;
+        }
+        for (int i = 0; i < continuations; i++) {
+            if (in >= end || (*in & 0xC0) != 0x80) {
+                return (size_t) -1;
+            }
+            ch = (ch << 6) | (*in++ & 0x3F);
+        }
+        if (ch < min || ch > 0x10FFFF || (ch >= 0xD800 && ch < 0xE000)) {
+            return (size_t) -1;
+        }
+        if (ch >= 0x10000) {
+            ch -= 0x10000;
+            *out++ = (jchar) (0xD800 + (ch >> 10));
+            *out++ = (jchar) (0xDC00 + (ch & 0x3FF));
+        } else {
+            *out++ = (jchar) ch;
+        }
+    }
+    return out - target;
+}
+
 char* java_to_char(JNIEnv* env, jstring string, jobject result) {
     size_t stringLen = env->GetStringLength(string);
+    if (is_utf8_locale()) {
+        // Encode straight from the Java chars, without an intermediate wide string
+        const jchar* javaString = env->GetStringCritical(string, NULL);
+        if (javaString == NULL) {
+            mark_failed_with_message(env, "could not get string chars", result);
+            return NULL;
+        }
+        size_t bytes = utf8_length(javaString, stringLen);
+        if (bytes == (size_t) -1) {
+            env->ReleaseStringCritical(string, javaString);
+            mark_failed_with_message(env, "could not convert string to current locale", result);
+            return NULL;
+        }
+        char* chars = (char*) malloc(bytes + 1);
+        if (chars != NULL) {
+            encode_utf8(javaString, stringLen, chars);
+            chars[bytes] = 0;
+        }
+        env->ReleaseStringCritical(string, javaString);
+        if (chars == NULL) {
+            mark_failed_with_message(env, "could not allocate string", result);
+        }
+        return chars;
+    }
+
     wchar_t* wideString = (wchar_t*) malloc(sizeof(wchar_t) * (stringLen + 1));
     const jchar* javaString = env->GetStringChars(string, NULL);
     for (size_t i = 0; i < stringLen; i++) {
@@ -50,6 +211,30 @@ char* java_to_char(JNIEnv* env, jstring string, jobject result) {
 
 jstring char_to_java(JNIEnv* env, const char* chars, jobject result) {
     size_t bytes = strlen(chars);
+    if (is_ascii(chars, bytes)) {
+        // ASCII is the same in every locale we support, and in modified UTF-8
+        return env->NewStringUTF(chars);
+    }
+    if (is_utf8_locale()) {
+        jchar stackString[STACK_STRING_LENGTH];
+        jchar* javaString = bytes <= STACK_STRING_LENGTH ? stackString : (jchar*) malloc(sizeof(jchar) * bytes);
+        if (javaString == NULL) {
+            mark_failed_with_message(env, "could not allocate string", result);
+            return NULL;
+        }
+        size_t stringLen = decode_utf8(chars, bytes, javaString);
+        jstring string = NULL;
+        if (stringLen == (size_t) -1) {
+            mark_failed_with_message(env, "could not convert string from current locale", result);
+        } else {
+            string = env->NewString(javaString, stringLen);
+        }
+        if (javaString != stackString) {
+            free(javaString);
+        }
+        return string;
+    }
+
     wchar_t* wideString = (wchar_t*) malloc(sizeof(wchar_t) * (bytes + 1));
     if (mbstowcs(wideString, chars, bytes + 1) == (size_t) -1) {
         mark_failed_with_message(env, "could not convert string from current locale", result);
@@ -58,7 +243,7 @@ jstring char_to_java(JNIEnv* env, const char* chars, jobject result) {
     }
     size_t stringLen = wcslen(wideString);
     jchar* javaString = (jchar*) malloc(sizeof(jchar) * stringLen);
-    for (int i = 0; i < stringLen; i++) {
+    for (size_t i = 0; i < stringLen; i++) {
         javaString[i] = (jchar) wideString[i];
     }
     jstring string = env->NewString(javaString, stringLen);
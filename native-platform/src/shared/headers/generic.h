@@ -37,6 +37,12 @@ extern "C" {
 #define FILE_TYPE_OTHER 3
 #define FILE_TYPE_MISSING 4
 
+// Corresponds to values of MemoryPressure, -1 is returned once a monitor has been stopped
+#define MEMORY_PRESSURE_NORMAL 0
+#define MEMORY_PRESSURE_WARNING 1
+#define MEMORY_PRESSURE_CRITICAL 2
+#define MEMORY_PRESSURE_STOPPED -1
+
 // Corresponds to values of FunctionResult.Failure
 #define FAILURE_GENERIC 0
 #define FAILURE_NO_SUCH_FILE 1
@@ -63,6 +69,28 @@ extern void mark_failed_with_code(JNIEnv* env, const char* message, int error_co
  */
 extern int map_error_code(int error_code);
 
+/*
+ * Looks up the given method of the given class. Method IDs stay valid for as long as the library is loaded,
+ * so the entry points look them up once in JNI_OnLoad() instead of on every call.
+ *
+ * Returns NULL on failure, with a Java exception pending.
+ */
+extern jmethodID find_method(JNIEnv* env, const char* class_name, const char* name, const char* signature);
+
+/*
+ * Looks up the method IDs used by the functions above. Must be called from JNI_OnLoad().
+ *
+ * Returns false on failure, with a Java exception pending.
+ */
+extern bool init_generic(JNIEnv* env);
+
+/*
+ * Method IDs of callbacks used by more than one source file, looked up in JNI_OnLoad().
+ */
+extern jmethodID fileSystemListAddMethodId;
+extern jmethodID fileSystemListAddForUnknownCaseSensitivityMethodId;
+extern jmethodID memoryInfoDetailsMethodId;
+
 /*
  * Converts the given Java string to a NULL terminated wchar_str. Should call free() when finished.
  *
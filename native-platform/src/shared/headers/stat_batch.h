@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * Batched stat engine shared by the POSIX and Windows file functions.
+ *
+ * The paths are queried by a pool of worker threads, each taking the next path by index. The details of each path
+ * are written as a fixed size record of jlongs, whose layout is defined by each platform, and the records are copied
+ * into the Java array once all paths have been queried.
+ */
+#ifndef __INCLUDE_STAT_BATCH_H__
+#define __INCLUDE_STAT_BATCH_H__
+
+#include "generic.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef wchar_t stat_char_t;
+#else
+#include <pthread.h>
+typedef char stat_char_t;
+#endif
+
+#define STAT_BATCH_MAX_PARALLELISM 64
+
+typedef struct stat_batch {
+    // Configuration, set up before calling stat_batch_run()
+    jboolean followLink;
+    int parallelism;
+    int count;
+    int recordSize;
+    stat_char_t** paths;
+
+    // State shared between the workers and the calling thread, guarded by lock
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+    jlong* records;
+    int nextIndex;
+    // Lowest index of a path that could not be queried, or -1
+    int failedIndex;
+    int failureCode;
+    const char* failureMessage;
+} stat_batch_t;
+
+/*
+ * Queries the given path, writing its details to the given record. Implemented separately for each platform.
+ *
+ * Returns 0 on success, or a system error code and sets message on failure.
+ */
+extern int stat_batch_entry(stat_batch_t* batch, const stat_char_t* path, jlong* record, const char** message);
+
+/*
+ * Queries the paths configured in the given batch and copies the records into the given array.
+ *
+ * Returns the index of the path that could not be queried, or -1.
+ */
+extern jint stat_batch_run(JNIEnv* env, stat_batch_t* batch, jlongArray stats, jobject result);
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * Directory tree walk engine shared by the POSIX and Windows file functions.
+ *
+ * Directories are scanned by a pool of worker threads, each taking the next directory from a shared queue.
+ * The entries are written by the workers as packed records into chunks, which the calling thread copies into
+ * the direct buffer passed from Java and hands to Java whenever the buffer is full.
+ *
+ * Each record consists of the following fields, in native byte order: parent id (jint), id (jint), type (jint),
+ * size (jlong), last modified (jlong), name length in bytes (jint) followed by the bytes of the name.
+ * The root directory has id 0, each directory entry gets a unique positive id, and other entries have id -1.
+ * The chunks holding the entries of a directory are always handed to Java before the entries of its subdirectories.
+ * Workers wait for the calling thread to consume chunks when TREE_OUTPUT_CHUNKS_PER_WORKER chunks per worker are
+ * outstanding, so that a slow consumer doesn't let the queued entries grow with the size of the tree.
+ */
+#ifndef __INCLUDE_TREE_WALK_H__
+#define __INCLUDE_TREE_WALK_H__
+
+#include "generic.h"
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef WINDOWS_MIN
+// Condition variables are only available on Windows Vista and later, so the minimal variant walks on the calling thread
+#define TREE_WALK_THREADS
+#endif
+typedef wchar_t tree_char_t;
+#define TREE_PATH_SEPARATOR L'\\'
+#else
+#include <pthread.h>
+#define TREE_WALK_THREADS
+typedef char tree_char_t;
+#define TREE_PATH_SEPARATOR '/'
+#endif
+
+#define TREE_RECORD_HEADER_SIZE (4 * sizeof(jint) + 2 * sizeof(jlong))
+#define TREE_CHUNK_SIZE (16 * 1024)
+#define TREE_MAX_PARALLELISM 64
+#define TREE_OUTPUT_CHUNKS_PER_WORKER 2
+
+typedef struct tree_chunk {
+    struct tree_chunk* next;
+    size_t used;
+    char data[TREE_CHUNK_SIZE];
+} tree_chunk_t;
+
+typedef struct tree_work {
+    struct tree_work* next;
+    jint id;
+    // Path of the directory relative to the root of the walk, empty for the root itself
+    tree_char_t* path;
+} tree_work_t;
+
+typedef struct tree_walk {
+    // Configuration, set up before calling tree_walk_run()
+    jboolean followLink;
+    int parallelism;
+    tree_char_t** excludes;
+    int excludeCount;
+#ifdef _WIN32
+    // Root directory, including the long path prefix
+    wchar_t* rootPath;
+#else
+    int rootFd;
+#endif
+
+    // State shared between the workers and the calling thread, guarded by lock
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#ifdef TREE_WALK_THREADS
+    CONDITION_VARIABLE workAvailable;
+    CONDITION_VARIABLE outputAvailable;
+    CONDITION_VARIABLE outputConsumed;
+#endif
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t workAvailable;
+    pthread_cond_t outputAvailable;
+    pthread_cond_t outputConsumed;
+#endif
+    tree_work_t* workHead;
+    tree_work_t* workTail;
+    tree_chunk_t* outputHead;
+    tree_chunk_t* outputTail;
+    // Number of chunks in the output, and how many workers may queue before waiting, 0 for no limit
+    int outputCount;
+    int maxOutputCount;
+    // Number of directories queued or being scanned
+    int pendingDirectories;
+    jint nextId;
+    bool stopped;
+    int failureCode;
+    const char* failureMessage;
+} tree_walk_t;
+
+/*
+ * State of a single directory being scanned by a worker.
+ */
+typedef struct tree_scan {
+    tree_walk_t* walk;
+    jint id;
+    tree_chunk_t* chunk;
+    tree_work_t* childrenHead;
+    tree_work_t* childrenTail;
+    int childCount;
+} tree_scan_t;
+
+/*
+ * Scans the directory with the given path relative to the root, reporting its entries via tree_scan_add_entry().
+ * Implemented separately for each platform.
+ */
+extern void tree_scan_directory(tree_scan_t* scan, const tree_char_t* path);
+
+/*
+ * Returns true when the entry with the given name matches one of the exclusion patterns and should not be reported.
+ * Implemented separately for each platform.
+ */
+extern bool tree_walk_is_excluded(tree_walk_t* walk, const tree_char_t* name);
+
+/*
+ * Adds an entry of the directory being scanned. When descend is true, the entry is queued to be scanned as well.
+ *
+ * Returns false when the walk should stop.
+ */
+extern bool tree_scan_add_entry(tree_scan_t* scan, const tree_char_t* path, const tree_char_t* name, file_stat_t* fileStat, bool descend);
+
+/*
+ * Stops the walk, failing with the given system error code.
+ */
+extern void tree_scan_fail(tree_scan_t* scan, int errorCode, const char* message);
+
+/*
+ * Walks the tree configured in the given walk, reporting batches of entries to the callback via the given direct buffer.
+ * Cleans up the state shared with the workers, but not the configuration.
+ */
+extern void tree_walk_run(JNIEnv* env, tree_walk_t* walk, jobject buffer, jobject callback, jobject result);
+
+/*
+ * DirTreeBuffer.addEntries(), looked up in JNI_OnLoad.
+ */
+extern jmethodID dirTreeBufferAddEntriesMethodId;
+
+#endif
@@ -60,6 +60,19 @@ class FileSystemsTest extends Specification {
     }
 
 
+    def "returns the same file systems when nothing has been mounted"() {
+        when:
+        def first = fileSystems.fileSystems
+        first.clear()
+        def second = fileSystems.fileSystems
+        def third = fileSystems.fileSystems
+
+        then:
+        !second.empty
+        second*.mountPoint == third*.mountPoint
+        second*.fileSystemType == third*.fileSystemType
+    }
+
     @Requires({ Platform.current().linux })
     def "detects file systems of mount points correctly"() {
         def mountPoint = "/${fileSystemType}"
@@ -413,6 +413,36 @@ abstract class FilesTest extends AbstractFilesTest {
         stat.type == FileInfo.Type.Directory
     }
 
+    @Unroll
+    def "can stat multiple files using #parallelism threads"() {
+        def dir = tmpDir.newFolder()
+        def testFiles = names.collect { new File(dir, it) }
+        testFiles.each { it.parentFile.mkdirs(); it.text = 'hi' }
+        def testDir = new File(dir, "some-dir")
+        testDir.mkdirs()
+        def missing = new File(dir, "missing")
+
+        when:
+        def stats = files.statAll(testFiles + [testDir, missing], false, parallelism)
+
+        then:
+        stats.size() == testFiles.size() + 2
+        testFiles.eachWithIndex { file, i ->
+            assertIsFile(stats[i], file)
+            assert stats[i].size == 2
+        }
+        assertIsDirectory(stats[testFiles.size()], testDir)
+        assertIsMissing(stats[testFiles.size() + 1])
+
+        where:
+        parallelism << [1, 4]
+    }
+
+    def "can stat an empty list of files"() {
+        expect:
+        files.statAll([], false, 4).empty
+    }
+
     @Unroll
     def "can list contents of an empty directory"() {
         def dir = tmpDir.newFolder()
@@ -600,4 +630,115 @@ abstract class FilesTest extends AbstractFilesTest {
         fileName << names
     }
 
+    @Unroll
+    def "can walk a directory tree"() {
+        def dir = tmpDir.newFolder()
+        def testDir = new File(dir, fileName)
+        testDir.mkdirs()
+        def childDir = new File(testDir, "a")
+        new File(childDir, "b").mkdirs()
+        def childFile = new File(childDir, "b/c")
+        childFile.text = 'contents'
+        def otherFile = new File(testDir, "d")
+        otherFile.text = ''
+
+        when:
+        def entries = [:]
+        files.walkTree(testDir, false) { path, entry -> entries[path] = entry }
+
+        then:
+        entries.keySet().sort() == ["a", "a/b", "a/b/c", "d"]
+        assertIsDirectory(entries["a"], childDir)
+        assertIsFile(entries["a/b/c"], childFile)
+        assertIsFile(entries["d"], otherFile)
+
+        where:
+        fileName << names
+    }
+
+    @Unroll
+    def "can walk a directory tree using #parallelism threads"() {
+        def dir = tmpDir.newFolder()
+        def expected = []
+        10.times { i ->
+            10.times { j ->
+                def subDir = new File(dir, "dir-$i/sub-dir-$j")
+                subDir.mkdirs()
+                expected << "dir-$i".toString() << "dir-$i/sub-dir-$j".toString()
+                50.times { k ->
+                    new File(subDir, "file-with-a-longer-name-$k").text = ''
+                    expected << "dir-$i/sub-dir-$j/file-with-a-longer-name-$k".toString()
+                }
+            }
+        }
+        expected = expected.unique()
+
+        when:
+        def visited = [] as LinkedHashSet
+        files.walkTree(dir, false, parallelism, []) { path, entry ->
+            def parent = path.contains("/") ? path.substring(0, path.lastIndexOf("/")) : null
+            assert parent == null || visited.contains(parent)
+            visited << path
+        }
+
+        then:
+        visited.size() == expected.size()
+        visited.sort() == expected.sort()
+
+        where:
+        parallelism << [1, 4]
+    }
+
+    def "can walk a directory tree with more entries than fit into a single batch"() {
+        def dir = tmpDir.newFolder()
+        def names = (1..3000).collect { "some-longer-file-name-$it".toString() }
+        names.each { new File(dir, "sub/$it").with { parentFile.mkdirs(); text = '' } }
+
+        when:
+        def paths = []
+        files.walkTree(dir, false, 1, []) { path, entry -> paths << path }
+
+        then:
+        paths.size() == names.size() + 1
+        paths.first() == "sub"
+        paths.sort() == (["sub"] + names.collect { "sub/$it" }).sort()
+    }
+
+    def "tree walk skips excluded entries"() {
+        def dir = tmpDir.newFolder()
+        new File(dir, "a/.git/objects").mkdirs()
+        new File(dir, "a/.git/objects/1").text = ''
+        new File(dir, "a/b.tmp").text = ''
+        new File(dir, "a/c.txt").text = ''
+        new File(dir, "build/classes").mkdirs()
+
+        when:
+        def paths = []
+        files.walkTree(dir, false, 2, [".git", "*.tmp", "build"]) { path, entry -> paths << path }
+
+        then:
+        paths.sort() == ["a", "a/c.txt"]
+    }
+
+    def "cannot walk tree of file"() {
+        def testFile = tmpDir.newFile()
+
+        when:
+        files.walkTree(testFile, false) { path, entry -> }
+
+        then:
+        def e = thrown(NotADirectoryException)
+        e.message == "Could not list directory $testFile as it is not a directory."
+    }
+
+    def "cannot walk tree of missing directory"() {
+        def testFile = new File(tmpDir.newFolder(), "missing")
+
+        when:
+        files.walkTree(testFile, false) { path, entry -> }
+
+        then:
+        def e = thrown(NoSuchFileException)
+        e.message == "Could not list directory $testFile as this directory does not exist."
+    }
 }
@@ -98,6 +98,23 @@ class PosixFilesTest extends FilesTest {
         [OWNER_READ]  | _
     }
 
+    def "cannot stat multiple files when one has no execute permission on parent"() {
+        def okFile = tmpDir.newFile("ok.file")
+        def testDir = tmpDir.newFolder("test-dir")
+        def testFile = new File(testDir, "test.file")
+        chmod(testDir, [OWNER_READ])
+
+        when:
+        files.statAll([okFile, testFile, okFile], false, 2)
+
+        then:
+        def e = thrown(FilePermissionException)
+        e.message == "Could not get file details of $testFile: permission denied"
+
+        cleanup:
+        chmod(testDir, [OWNER_READ, OWNER_WRITE])
+    }
+
     def "can stat a symlink with no read permissions on symlink"() {
         def testDir = tmpDir.newFolder("test-dir")
         new File(testDir, "test.file").createNewFile()
@@ -181,6 +198,37 @@ class PosixFilesTest extends FilesTest {
         list*.name.sort() == ["a", "b"]
     }
 
+    def "tree walk reports symlinks"() {
+        def dir = tmpDir.newFolder()
+        new File(dir, "a/b").mkdirs()
+        new File(dir, "a/b/c").text = 'content'
+        files.symlink(new File(dir, "link"), "a")
+
+        when:
+        def entries = [:]
+        files.walkTree(dir, false) { path, entry -> entries[path] = entry }
+
+        then:
+        entries.keySet().sort() == ["a", "a/b", "a/b/c", "link"]
+        entries["link"].type == FileInfo.Type.Symlink
+    }
+
+    def "tree walk does not descend into symlinks to directories"() {
+        def dir = tmpDir.newFolder()
+        new File(dir, "a/b").mkdirs()
+        files.symlink(new File(dir, "a/loop"), dir.absolutePath)
+        files.symlink(new File(dir, "missing"), "does-not-exist")
+
+        when:
+        def entries = [:]
+        files.walkTree(dir, true) { path, entry -> entries[path] = entry }
+
+        then:
+        entries.keySet().sort() == ["a", "a/b", "a/loop", "missing"]
+        entries["a/loop"].type == FileInfo.Type.Directory
+        entries["missing"].type == FileInfo.Type.Missing
+    }
+
     def "cannot list directory without read and execute permissions"() {
         def dir = tmpDir.newFolder()
         new File(dir, "a").text = 'content'
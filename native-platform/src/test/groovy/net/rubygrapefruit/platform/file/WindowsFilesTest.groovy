@@ -42,4 +42,30 @@ class WindowsFilesTest extends FilesTest {
         then:
         stat.type == FileInfo.Type.File
     }
+
+    def "directory listing reports file keys"() {
+        def dir = tmpDir.newFolder()
+        def file = new File(dir, "a")
+        file.text = 'content'
+        def link = new File(dir, "b")
+        java.nio.file.Files.createLink(link.toPath(), file.toPath())
+        new File(dir, "c").text = 'other'
+
+        when:
+        def entries = files.listDir(dir).collectEntries { [it.name, it] }
+
+        then:
+        entries.size() == 3
+        entries.a.fileKey != null
+        entries.a.fileKey == entries.b.fileKey
+        entries.a.fileKey != entries.c.fileKey
+
+        when:
+        def key = entries.a.fileKey
+        file.renameTo(new File(dir, "d"))
+        entries = files.listDir(dir).collectEntries { [it.name, it] }
+
+        then:
+        entries.d.fileKey == key
+    }
 }
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal
+
+import net.rubygrapefruit.platform.terminal.TerminalOutput
+import net.rubygrapefruit.platform.terminal.Terminals
+import spock.lang.Specification
+
+class AnsiTerminalTest extends Specification {
+    def writes = []
+    def target = new OutputStream() {
+        @Override
+        void write(int b) {
+            write([(byte) b] as byte[], 0, 1)
+        }
+
+        @Override
+        void write(byte[] b, int off, int len) {
+            writes << new String(b, off, len)
+        }
+    }
+    def terminal = new AnsiTerminal(target, Terminals.Output.Stdout)
+
+    def "writes output immediately when no frame is open"() {
+        when:
+        terminal.cursorUp(2).write("text").clearToEndOfLine()
+
+        then:
+        writes == ["\u001b[2A", "text", "\u001b[0K"]
+    }
+
+    def "writes output of a frame with a single write"() {
+        when:
+        terminal.beginFrame()
+        terminal.cursorUp(2).foreground(TerminalOutput.Color.Red).write("text")
+        terminal.outputStream.write("more".bytes)
+
+        then:
+        writes.empty
+
+        when:
+        terminal.endFrame()
+
+        then:
+        writes == ["\u001b[2A\u001b[31mtextmore"]
+    }
+
+    def "writes output of nested frames when the outermost frame is ended"() {
+        when:
+        terminal.beginFrame()
+        terminal.write("a")
+        terminal.beginFrame()
+        terminal.write("b")
+        terminal.endFrame()
+
+        then:
+        writes.empty
+
+        when:
+        terminal.endFrame()
+        terminal.endFrame()
+        terminal.write("c")
+
+        then:
+        writes == ["ab", "c"]
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+package net.rubygrapefruit.platform.internal
+
+import net.rubygrapefruit.platform.memory.MemoryPressure
+import net.rubygrapefruit.platform.memory.MemoryPressureListener
+import spock.lang.Specification
+import spock.lang.Timeout
+import spock.lang.Unroll
+
+import java.util.concurrent.BlockingQueue
+import java.util.concurrent.CountDownLatch
+import java.util.concurrent.LinkedBlockingQueue
+
+import static java.util.concurrent.TimeUnit.SECONDS
+
+@Timeout(value = 10, unit = SECONDS)
+class DefaultMemoryPressureMonitorTest extends Specification {
+    def source = new FakeSource()
+    def reported = new LinkedBlockingQueue<MemoryPressure>()
+    def listener = { MemoryPressure pressure -> reported.put(pressure) } as MemoryPressureListener
+
+    @Unroll
+    def "reports level #level as #pressure"() {
+        def monitor = DefaultMemoryPressureMonitor.start(source, listener)
+
+        when:
+        source.levels.put(level)
+
+        then:
+        reported.poll(5, SECONDS) == pressure
+        monitor.currentLevel == pressure
+
+        cleanup:
+        monitor.stop()
+
+        where:
+        level | pressure
+        1     | MemoryPressure.WARNING
+        2     | MemoryPressure.CRITICAL
+    }
+
+    def "waits for a change from the last reported level"() {
+        def monitor = DefaultMemoryPressureMonitor.start(source, listener)
+
+        when:
+        source.levels.put(1)
+        source.levels.put(2)
+        source.levels.put(0)
+        def levels = (1..3).collect { reported.poll(5, SECONDS) }
+        monitor.stop()
+
+        then:
+        levels == [MemoryPressure.WARNING, MemoryPressure.CRITICAL, MemoryPressure.NORMAL]
+        source.waitedFor == [0, 1, 2, 0]
+        monitor.currentLevel == MemoryPressure.NORMAL
+    }
+
+    def "stops reporting and closes the source once stopped"() {
+        def monitor = DefaultMemoryPressureMonitor.start(source, listener)
+
+        when:
+        source.levels.put(1)
+        reported.poll(5, SECONDS)
+        monitor.stop()
+        monitor.stop()
+
+        then:
+        source.stopCount == 1
+        source.closed.count == 0
+        reported.empty
+        monitor.currentLevel == MemoryPressure.WARNING
+    }
+
+    static class FakeSource implements DefaultMemoryPressureMonitor.Source {
+        final BlockingQueue<Integer> levels = new LinkedBlockingQueue<Integer>()
+        final List<Integer> waitedFor = Collections.synchronizedList([])
+        final CountDownLatch closed = new CountDownLatch(1)
+        volatile int stopCount
+
+        @Override
+        int waitForMemoryPressure(int currentLevel, FunctionResult result) {
+            waitedFor << currentLevel
+            return levels.take()
+        }
+
+        @Override
+        void stop() {
+            stopCount++
+            levels.put(-1)
+        }
+
+        @Override
+        void close() {
+            closed.countDown()
+        }
+    }
+}
@@ -22,8 +22,9 @@ import spock.lang.IgnoreIf
 import spock.lang.Specification
 
 import java.lang.management.ManagementFactory
+import java.util.concurrent.LinkedBlockingQueue
 
-@IgnoreIf({ !Platform.current().macOs })
+@IgnoreIf({ Platform.current().freeBSD })
 class MemoryTest extends Specification {
     def "caches memory instance"() {
         expect:
@@ -42,6 +43,26 @@ class MemoryTest extends Specification {
         memoryInfo.availablePhysicalMemory <= memoryInfo.totalPhysicalMemory
     }
 
+    def "can start and stop a memory pressure monitor"() {
+        def memory = Native.get(Memory.class)
+        def levels = new LinkedBlockingQueue<MemoryPressure>()
+
+        when:
+        def monitor = memory.startMemoryPressureMonitor({ MemoryPressure pressure -> levels.put(pressure) } as MemoryPressureListener)
+
+        then:
+        monitor.currentLevel != null
+
+        when:
+        monitor.stop()
+        def reported = levels.size()
+        monitor.stop()
+
+        then:
+        levels.size() == reported
+        reported == 0 || levels.toList().last() == monitor.currentLevel
+    }
+
     long getJmxTotalPhysicalMemory() {
         ManagementFactory.operatingSystemMXBean.totalPhysicalMemorySize
     }